@@ -67,6 +67,7 @@
 #include "queue.h"
 #include "cjson.h"
 #include "iperf_time.h"
+#include "iperf_histogram.h"
 
 #if defined(HAVE_SSL)
 #include <openssl/bio.h>
@@ -77,6 +78,136 @@
 typedef uint64_t iperf_size_t;
 #endif // __IPERF_API_H
 
+/*
+ * What a --echo client has seen, as highest forward and reverse
+ * sequence numbers reflected back and reflections received; the
+ * difference between two of these gives the packets and losses
+ * in each direction in between.
+ */
+struct iperf_echo_counts
+{
+    uint64_t  fwd_packets;
+    uint64_t  rev_packets;
+    uint64_t  received;
+};
+
+/*
+ * Sequence bookkeeping of a UDP receiving stream; sequence numbers
+ * SEQ_WINDOW behind the highest seen are settled
+ */
+#define SEQ_WINDOW 4096			/* a multiple of 64 */
+
+struct iperf_seq {
+    uint64_t  bits[SEQ_WINDOW / 64];	/* which of (top - SEQ_WINDOW, top] have arrived */
+    uint32_t  passed[SEQ_WINDOW];	/* for a missing one, the arrival that first went past it */
+    uint64_t  top;			/* highest sequence number seen */
+    uint64_t  retired;			/* highest sequence number moved out of the window */
+    uint64_t  arrivals;			/* datagrams read, the arrival index */
+    int       losing;			/* the run being retired is of losses */
+    uint64_t  run;			/* and its length so far */
+    uint64_t  lost, bursts, reordered, late, duplicates;
+    struct iperf_histogram *extent;	/* --loss-stats: RFC 4737 reorder extents */
+    struct iperf_histogram *burst;	/* --loss-stats: loss burst lengths */
+    struct iperf_histogram *gap;	/* --loss-stats: received runs between bursts */
+    int       finished;
+};
+
+/* What --loss-stats reports of a stream, as the receiver saw it */
+struct iperf_seq_summary {
+    int       valid;
+    uint64_t  lost, bursts, reordered, late, duplicates;
+    double    burst_mean, burst_p90, burst_max;
+    double    gap_mean, gap_p90, gap_max;
+    double    extent_p50, extent_p90, extent_max;
+};
+
+/* One --tcp-sample reading of a sending stream's TCP_INFO */
+struct iperf_tcp_sample {
+    int64_t   usecs;			/* since the stream started */
+    uint32_t  snd_cwnd;			/* bytes */
+    uint32_t  rtt;			/* smoothed, usecs */
+    uint32_t  rttvar;
+    uint32_t  total_retrans;
+    uint64_t  delivery_rate;		/* bytes/sec; 0 where the system has none */
+    uint64_t  pacing_rate;
+};
+
+/* What --tcp-sample derives from the samples of an interval, or of the test */
+#define TCP_SAMPLE_CWND 0
+#define TCP_SAMPLE_RTT 1
+#define TCP_SAMPLE_DELIVERY 2
+#define TCP_SAMPLE_PACING 3
+#define TCP_SAMPLE_METRICS 4
+struct iperf_tcp_sample_stats {
+    int       samples;
+    double    min[TCP_SAMPLE_METRICS];
+    double    max[TCP_SAMPLE_METRICS];
+    double    sum[TCP_SAMPLE_METRICS];
+};
+
+/* Where a TCP sender's time went (--bottleneck), in usecs, from TCP_INFO */
+struct iperf_limited {
+    uint64_t  busy;			/* with data to send, including the two below */
+    uint64_t  rwnd;			/* held back by the receiver's window */
+    uint64_t  sndbuf;			/* held back by the send buffer */
+    uint64_t  elapsed;			/* all of it */
+};
+
+/* What the last inet_diag dump (--diag) had for a test socket */
+#define DIAG_TCP_INFO_MAX 512		/* room for a newer kernel's struct tcp_info */
+#define DIAG_CONG_MAX 16		/* TCP_CA_NAME_MAX */
+#define DIAG_SKMEM_VARS 9		/* SK_MEMINFO_VARS */
+struct iperf_diag_stream {
+    uint32_t  inode;			/* the socket's, to find it in the dump */
+    int       valid;			/* it was in the last dump */
+    unsigned char tcp_info[DIAG_TCP_INFO_MAX];	/* the kernel's struct tcp_info */
+    int       tcp_info_len;
+    char      cong[DIAG_CONG_MAX];	/* congestion control, "" if not given */
+    int       cc;			/* DIAG_CC_, which of the below is set */
+    uint64_t  bbr_bw;			/* bytes/sec, BBR's bandwidth estimate */
+    uint32_t  bbr_min_rtt;		/* usecs */
+    uint32_t  bbr_pacing_gain;		/* << 8 */
+    uint32_t  bbr_cwnd_gain;		/* << 8 */
+    uint32_t  dctcp_alpha;		/* of 1024, DCTCP's estimate of the CE fraction */
+    uint32_t  dctcp_ce_state;
+    uint32_t  dctcp_ab_ecn;		/* bytes acked with and without CE */
+    uint32_t  dctcp_ab_tot;
+    int       has_skmem;
+    uint32_t  skmem[DIAG_SKMEM_VARS];	/* in SK_MEMINFO_ order */
+};
+
+/* Socket queue occupancy (--queues), bytes summed over the samples */
+struct iperf_queue_stats {
+    int       samples;
+    int       inq_busy;			/* receiver: samples with data waiting to be read */
+    uint64_t  outq_sum, outq_max;	/* sender: in the send queue, unsent or unacknowledged */
+    uint64_t  notsent_sum, notsent_max;	/* sender, TCP: of that, not yet sent */
+    uint64_t  inq_sum, inq_max;		/* receiver: received but not yet read */
+    int       has_meminfo;
+    uint32_t  meminfo[DIAG_SKMEM_VARS];	/* SO_MEMINFO, at the end */
+    uint32_t  drops;			/* SK_MEMINFO_DROPS, since the start */
+};
+
+/* A receiver's reads (--rcv-drain, --rcvlowat) */
+struct iperf_read_counts {
+    uint64_t  wakeups;			/* times select() found the stream readable */
+    uint64_t  reads;			/* read()s and recvmsg()s */
+    uint64_t  bytes;
+};
+
+/* A UDP receiver's datagrams by how they were timestamped (--rx-timestamps) */
+struct iperf_rxstamp_counts {
+    uint64_t  datagrams;
+    uint64_t  kernel;			/* with a kernel software timestamp */
+    uint64_t  hw;			/* with a hardware one too */
+};
+
+/* A write waiting for its transmit timestamps (--tx-timestamps) */
+struct iperf_txstamp {
+    uint32_t  key;			/* the offset of its last byte, as SO_TIMESTAMPING counts */
+    int64_t   written;			/* nsecs, CLOCK_REALTIME, when write() was called */
+};
+
 struct iperf_interval_results
 {
     iperf_size_t bytes_transferred; /* bytes transferred in this interval */
@@ -92,6 +223,16 @@ struct iperf_interval_results
     double    jitter;
     int       outoforder_packets;
     int       cnt_error;
+    int       owd_count;	/* one-way delay this interval, ms */
+    double    owd_min, owd_avg, owd_max, owd_p99;
+    iperf_size_t transactions;	/* request/response mode, this interval */
+    struct iperf_echo_counts echo;	/* --echo, this interval */
+    struct iperf_tcp_sample_stats tcp_sample;	/* --tcp-sample, this interval */
+    struct iperf_limited limited;	/* --bottleneck, this interval */
+    struct iperf_queue_stats queues;	/* --queues, this interval */
+    struct iperf_read_counts reads;	/* --rcv-drain or --rcvlowat, this interval */
+    struct iperf_rxstamp_counts rxstamps;	/* --rx-timestamps, this interval */
+    double    jitter_user;		/* --rx-timestamps: jitter from user-space arrival times */
 
     int omitted;
 #if (defined(linux) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)) && \
@@ -111,6 +252,27 @@ struct iperf_interval_results
     long pmtu;
 };
 
+/*
+ * The rest of TCP_INFO, as one end of a stream saw it: the receiver's
+ * view and the sender's, exchanged with the results.  The counts are
+ * since omitting ended.
+ */
+struct iperf_tcp_extra {
+    int       valid;
+    /* receiver */
+    int64_t   rcv_rtt;			/* usecs, the receiver's estimate */
+    int64_t   rcv_space;		/* bytes, what it sizes its buffer to */
+    int64_t   rcv_ooopack;		/* segments that came out of order */
+    int64_t   reordering;		/* segments, the reordering degree estimate */
+    /* sender */
+    int64_t   lost;			/* segments thought lost at the end */
+    int64_t   dsack_dups;		/* retransmissions reported as duplicates */
+    int64_t   delivery_rate;		/* bytes/sec, at the end */
+    int64_t   bytes_retrans;
+    int64_t   segs_out;
+    int64_t   segs_in;
+};
+
 struct iperf_stream_result
 {
     iperf_size_t bytes_received;
@@ -126,6 +288,9 @@ struct iperf_stream_result
     int stream_count_rtt;
     long stream_max_snd_cwnd;
     long stream_max_snd_wnd;
+    struct iperf_tcp_extra tcp_extra;	/* this end's, at the last interval */
+    struct iperf_tcp_extra tcp_extra_base;	/* this end's, when omitting ended */
+    struct iperf_tcp_extra peer_tcp_extra;	/* the other end's, from its results */
     struct iperf_time start_time;
     struct iperf_time end_time;
     struct iperf_time start_time_fixed;
@@ -171,6 +336,50 @@ struct iperf_settings
 
 struct iperf_test;
 
+/* One connection of a --crr transaction */
+struct iperf_crr_conn {
+    int       fd;			/* -1 when the slot is free */
+    int       phase;			/* CRR_ */
+    int       in;			/* bytes of the message read so far */
+    int       out;			/* bytes still to write */
+    struct iperf_stream *sp;		/* server: the stream named in the request */
+    struct iperf_time start;		/* client: when connect() was called */
+};
+
+/* Send latency stages (--tx-timestamps), from write() to */
+#define TXSTAMP_SCHED 0			/* leaving the socket for the packet scheduler */
+#define TXSTAMP_SND 1			/* being handed to the driver */
+#define TXSTAMP_ACK 2			/* being acknowledged */
+#define TXSTAMP_STAGES 3
+#define TXSTAMP_RING 4096		/* writes in flight per stream; a power of 2 */
+
+/* Busy-poll receive (--busy-poll) */
+#define DEFAULT_BUSY_POLL 50		/* SO_BUSY_POLL usecs */
+
+/* CPU and NUMA placement (--place) */
+#define PLACE_LIST_LEN 128		/* a CPU list such as "0-15,32-47" */
+#define PLACE_TIMER_USECS 10000		/* main loop's look at the stream threads */
+#define PLACE_POLL_MSECS 10		/* longest a stream thread waits for its socket */
+
+/* Kernel receive timestamps (--rx-timestamps) */
+#define RXSTAMP_SW 1			/* software */
+#define RXSTAMP_HW 2			/* hardware where the NIC gives them, else software */
+
+/* Receive strategy (--rcv-drain) */
+#define DEFAULT_RCV_DRAIN (4 * 1024 * 1024)	/* bytes per wakeup */
+#define RCV_DRAIN_USECS 1000		/* and no longer than this */
+
+/* Latency histogram metrics (--histograms) */
+#define HIST_JITTER 0			/* UDP: inter-arrival transit difference */
+#define HIST_PDV 1			/* UDP: transit above the lowest seen */
+#define HIST_RTT 2			/* TCP: sampled smoothed RTT; UDP --echo: round trip */
+#define HIST_RR 3			/* TCP --rr: request (--rr-rate: its intended send time) to response */
+#define HIST_CONNECT 4			/* TCP --crr: handshake */
+#define HIST_FIRST_BYTE 5		/* TCP --crr: connect to first response byte */
+#define HIST_REFLECT 6			/* UDP --echo: time inside the reflector */
+#define HIST_METRICS 7
+#define HIST_RTT_SAMPLE_USECS 1000	/* read TCP_INFO at most once a ms */
+
 struct iperf_stream
 {
     struct iperf_test* test;
@@ -208,7 +417,116 @@ struct iperf_stream
     int       omitted_outoforder_packets;
     int       cnt_error;
     int       omitted_cnt_error;
-    uint64_t  target;
+    uint64_t  target;		/* current rate under rate control or search */
+
+    /* receiver counters at the last UDP_FEEDBACK message */
+    int       feedback_packet_count;
+    int       feedback_cnt_error;
+
+    /* closed-loop UDP rate control, sender side */
+    struct iperf_time target_start;	/* when target last changed */
+    iperf_size_t target_start_bytes;	/* bytes sent at that time */
+    uint64_t  rc_step;			/* additive increase, 0 while probing */
+    double    rc_integral;		/* PID state */
+    double    rc_prev_error;
+
+    /* one-way delay (--owd), receiver side, in microseconds */
+    struct iperf_histogram *owd_interval;
+    struct iperf_histogram *owd_total;
+    /* totals in ms; for a sending stream, as reported by the receiver */
+    iperf_size_t owd_count;
+    double    owd_min, owd_avg, owd_max, owd_p99;
+
+    /* latency histograms (--histograms), in microseconds, by HIST_ metric */
+    struct iperf_histogram *hist[HIST_METRICS];		/* filling */
+    struct iperf_histogram *hist_last[HIST_METRICS];	/* last finished interval */
+    struct iperf_histogram *hist_total[HIST_METRICS];	/* or the peer's, from the results */
+    double    min_transit;		/* for delay variation */
+    struct iperf_time rtt_sampled;	/* when TCP_INFO was last read for the RTT */
+
+    /* request/response mode (--rr) */
+    struct iperf_time *rr_sent;		/* client: when each request in flight went out */
+    uint64_t *rr_stamps;		/* server --rr-rate: stamps of the responses owed, as they came */
+    int       rr_head;			/* oldest request in flight (client), stamp owed (server) */
+    int       rr_pending;		/* requests in flight (client), responses owed (server) */
+    int       rr_in;			/* bytes of the message being read */
+    int       rr_out;			/* bytes of the message being written, still to go */
+    iperf_size_t rr_transactions;
+    iperf_size_t rr_transactions_interval;
+    uint64_t  rr_stamp_in;		/* --rr-rate: stamp of the message being read, big-endian */
+    uint64_t  rr_stamp_out;		/* --rr-rate: stamp of the message being written, big-endian */
+    double    rr_due;			/* client --rr-rate: when the next request is due, usecs */
+    iperf_size_t rr_offered;		/* client --rr-rate: requests that have come due */
+    struct iperf_crr_conn *crr;		/* client --crr: rr_depth connections */
+    iperf_size_t crr_failures;		/* client --crr: connections that did not complete */
+
+    /* UDP sequence bookkeeping (--loss-stats reports it) */
+    struct iperf_seq *seq;		/* receiver */
+    struct iperf_seq_summary seq_result;	/* the receiver's, or from its results */
+
+    uint64_t  trace_offset;		/* --trace, TCP: bytes of the stream so far */
+
+    /* TCP_INFO sampling (--tcp-sample), sender */
+    struct iperf_tcp_sample *tcp_samples;	/* the ring */
+    uint64_t  tcp_samples_mask;		/* its capacity - 1 */
+    uint64_t  tcp_samples_written;
+    uint64_t  tcp_samples_mark;		/* the first of this interval's */
+    uint64_t  tcp_samples_dumped;	/* the first not yet in --tcp-sample-file */
+    struct iperf_tcp_sample_stats tcp_sample_total;
+
+    /* sender attribution (--bottleneck) */
+    struct iperf_limited limited_prev;	/* the counters at the last interval */
+    struct iperf_limited limited_total;	/* the intervals not omitted */
+    double    max_rate;			/* bytes/sec, the highest interval rate */
+    long      min_rtt;			/* usecs, the kernel's or the lowest smoothed one */
+    long      max_snd_wnd;		/* the receiver's largest window */
+
+    struct iperf_diag_stream *diag;	/* --diag, the last dump's entry */
+
+    /* socket queue occupancy (--queues) */
+    struct iperf_queue_stats queue_acc;	/* the samples since the last interval */
+    struct iperf_queue_stats queue_total;	/* the intervals not omitted */
+    uint32_t  queue_prev_drops;		/* SK_MEMINFO_DROPS at the last interval */
+
+    /* send latency from transmit timestamps (--tx-timestamps), usecs, by TXSTAMP_ stage */
+    struct iperf_txstamp *txstamps;	/* ring of the writes not yet timestamped */
+    uint64_t  txstamps_written;
+    uint64_t  txstamps_next[TXSTAMP_STAGES];	/* the oldest write each stage can still report */
+    uint64_t  txstamp_count;		/* OPT_ID's count since timestamping began: bytes (TCP) or datagrams (UDP) */
+    struct iperf_histogram *txstamp_hist[TXSTAMP_STAGES];	/* filling */
+    struct iperf_histogram *txstamp_last[TXSTAMP_STAGES];	/* last finished interval */
+    struct iperf_histogram *txstamp_total[TXSTAMP_STAGES];
+
+    /* receive strategy (--rcv-drain, --rcvlowat) */
+    struct iperf_read_counts reads;	/* so far */
+    struct iperf_read_counts reads_prev;	/* at the last interval */
+    struct iperf_read_counts reads_start;	/* when omitting ended */
+    int       rcv_inq;			/* bytes left queued after the last read, from TCP_INQ; -1 if unknown */
+
+    /* kernel receive timestamps (--rx-timestamps) */
+    struct iperf_rxstamp_counts rxstamps;	/* so far */
+    struct iperf_rxstamp_counts rxstamps_prev;	/* at the last interval */
+    struct iperf_rxstamp_counts rxstamps_start;	/* when omitting ended */
+    double    jitter_user;		/* what jitter is from user-space arrival times */
+    double    prev_transit_user;
+    double    prev_transit_hw;
+    int       prev_hw;			/* the last datagram had a hardware timestamp */
+    struct iperf_histogram *rx_wait_hist;	/* kernel to user-space arrival, usecs: filling */
+    struct iperf_histogram *rx_wait_last;	/* last finished interval */
+    struct iperf_histogram *rx_wait_total;
+
+    /* CPU placement (--place) */
+    int       incoming_cpu;		/* SO_INCOMING_CPU at the last interval; -1 if unknown */
+    int       incoming_moves;		/* times it changed */
+    int       place_cpu;		/* CPU its thread is pinned to; -1 if none */
+    int       place_ran_on;		/* CPU its thread last ran on; -1 if no thread */
+    struct iperf_place_worker *place_worker;	/* its thread while it runs, else NULL */
+
+    /* UDP reflector mode (--echo) */
+    uint64_t  echo_reflected;		/* server: the reverse sequence */
+    struct iperf_echo_counts echo;	/* client: so far */
+    struct iperf_echo_counts echo_start;	/* at the end of omitting */
+    struct iperf_echo_counts echo_last;	/* at the last interval */
 
     struct sockaddr_storage local_addr;
     struct sockaddr_storage remote_addr;
@@ -243,6 +561,98 @@ struct iperf_textline {
     TAILQ_ENTRY(iperf_textline) textlineentries;
 };
 
+/* Per-size outcome of a throughput search (--search) */
+struct iperf_search_result {
+    int       size;			/* datagram size */
+    uint64_t  rate;			/* highest passing rate, bits/sec */
+    double    pps;			/* packets/sec sent at that rate */
+    double    loss;			/* loss at that rate, percent */
+    int       trials;
+    int       confirmed;		/* passed the confirmation run */
+};
+
+/* State of an RFC 2544-style UDP throughput search */
+struct iperf_search {
+    int       method;			/* SEARCH_BINARY or SEARCH_EXPONENTIAL */
+    int      *sizes;
+    int       nsizes;
+    int       cur;			/* index of the size being searched */
+    int       max_size;			/* blksize to restore afterwards */
+    int64_t   trial_usecs;
+    int64_t   confirm_usecs;
+    uint64_t  start_rate;		/* -b: upper bound, or first probe */
+
+    int       phase;			/* SEARCH_PROBE, SEARCH_BISECT, SEARCH_CONFIRM */
+    int       sending;			/* a trial is in progress */
+    uint64_t  rate, lo, hi;		/* bits/sec, summed over streams */
+    int       trials;			/* trials at this size */
+    Timer    *timer;
+    struct iperf_time trial_start;
+    iperf_size_t packets_start;
+    iperf_size_t bytes_start;
+    iperf_size_t packets_sent;		/* trial totals, sender side */
+    iperf_size_t bytes;
+    double    trial_secs;
+    iperf_size_t received;		/* from the receiver's feedback */
+
+    struct iperf_search_result *results;
+};
+
+/* Latency-under-load probing (--probe) */
+struct iperf_probe {
+    int       fd;			/* the probe connection */
+    int       pending;			/* client: a probe is awaiting its response */
+    struct iperf_time sent;		/* client: when it went */
+    Timer    *timer;			/* client: sends the next */
+    struct iperf_histogram *idle;	/* before the streams start */
+    struct iperf_histogram *loaded;	/* this interval */
+    struct iperf_histogram *loaded_total;
+    struct iperf_histogram *streams;	/* --probe-streams: the streams' own RTT, this interval */
+    struct iperf_histogram *streams_total;
+};
+
+/* Per-packet trace (--trace): the mapped ring file */
+struct iperf_trace {
+    int       fd;
+    size_t    len;			/* of the mapping */
+    struct iperf_trace_header *header;	/* the start of it */
+    struct iperf_trace_record *records;
+    uint64_t  mask;			/* capacity - 1 */
+    uint64_t  written;
+};
+
+/* One datagram of a packet train, as seen by the receiver */
+struct iperf_train_sample {
+    uint64_t  sent_us;			/* sender's clock, from the UDP header */
+    uint64_t  arrived_ns;		/* 0 if the datagram never arrived */
+};
+
+/* Packet-train capacity estimation (--trains) */
+struct iperf_train {
+    int       sent;			/* trains sent so far */
+    Timer    *timer;
+    struct iperf_train_sample *samples;	/* trains * train_length, by sequence */
+    int       kernel_timestamps;	/* arrival times came from the kernel */
+
+    /* computed by the receiver, passed to the client with the results */
+    int       analyzed;
+    int       size;			/* datagram size */
+    int       trains_received;		/* trains with at least two datagrams */
+    int       received;			/* datagrams that arrived, of trains * train_length */
+    int       pairs;			/* back-to-back pairs measured */
+    double    capacity;			/* bits/sec */
+    double    dispersion;
+    double    available;
+};
+
+/* One NTP-style clock comparison over the control connection (--owd) */
+struct iperf_clock_sync {
+    int       valid;
+    int64_t   at;			/* client clock when measured, us */
+    int64_t   offset;			/* server clock minus client clock, us */
+    int64_t   uncertainty;		/* half the best round trip, us */
+};
+
 struct xbind_entry {
     char *name;
     struct addrinfo *ai;
@@ -327,6 +737,74 @@ struct iperf_test
     int	      repeating_payload;                /* --repeating-payload */
     int       timestamps;			/* --timestamps */
     char     *timestamp_format;
+    int       rate_control;			/* --rate-control */
+    double    target_loss;			/* --target-loss, in percent */
+    struct iperf_search *search;		/* --search */
+    int       trains;				/* --trains */
+    int       train_length;
+    struct iperf_train *train;
+    int       histograms;			/* --histograms */
+    struct iperf_histogram *hist_sum;		/* scratch for [SUM] lines */
+    int       rr;				/* --rr */
+    int       rr_request, rr_response;	/* message sizes */
+    int       rr_depth;				/* requests in flight per stream */
+    int       rr_connect;			/* --crr: a connection per transaction */
+    double    rr_rate;				/* --rr-rate: open loop, requests/sec per stream */
+    int       rr_poisson;			/* --rr-arrivals poisson */
+    int       fastopen;				/* --fastopen */
+    int       linger;				/* --linger, seconds; -1 leaves it alone */
+    int       crr_listener;			/* server: where --crr connections arrive */
+    int       crr_port;
+    struct sockaddr_storage crr_addr;		/* client: where to connect */
+    socklen_t crr_addrlen;
+    struct sockaddr_storage crr_local;		/* client: what to bind, with -B */
+    socklen_t crr_locallen;
+    struct iperf_crr_conn *crr_conns;		/* server */
+    int       crr_slots;
+    int       owd;				/* --owd */
+    struct iperf_clock_sync owd_sync[2];	/* before and after the test */
+    int       echo;				/* --echo */
+    int       loss_stats;			/* --loss-stats */
+    char     *trace_file;			/* --trace */
+    uint64_t  trace_records;			/* --trace-records */
+    struct iperf_trace *trace;
+    int       probe_interval;			/* --probe, ms between probes; 0 for none */
+    int       probe_streams;			/* --probe-streams */
+    struct iperf_probe *probe;
+    int       tcp_sample_usecs;			/* --tcp-sample; 0 for none */
+    char     *tcp_sample_file;			/* --tcp-sample-file */
+    FILE     *tcp_sample_fp;
+    Timer    *tcp_sample_timer;
+    int       bottleneck;			/* --bottleneck */
+    int       diag;				/* --diag */
+    int       diag_fd;				/* the NETLINK_SOCK_DIAG socket */
+    int       diag_families;			/* DIAG_ bits, the families to dump */
+    struct iperf_diag_index *diag_index;	/* the streams by socket inode */
+    int       diag_streams;
+    char     *diag_buf;
+    uint64_t  diag_dumps;			/* dumps and their cost, for the summary */
+    uint64_t  diag_entries;			/* test sockets found, over all of them */
+    uint64_t  diag_usecs;
+    int       queue_interval;			/* --queues, ms between samples; 0 for none */
+    Timer    *queue_timer;
+    struct iperf_time queue_last;		/* the last sample */
+    int       notsent_lowat;			/* --notsent-lowat, bytes; 0 for none */
+    int       tx_timestamps;			/* --tx-timestamps */
+    int       rcv_drain;			/* --rcv-drain, bytes to read per wakeup; 0 for a block */
+    int       rcvlowat;				/* --rcvlowat, bytes; 0 for none */
+    int       discard;				/* --discard, receive with MSG_TRUNC */
+    int       rx_timestamps;			/* --rx-timestamps, RXSTAMP_ */
+    int       busy_poll;			/* --busy-poll, SO_BUSY_POLL usecs; 0 for none */
+    int       prefer_busy_poll;			/* --prefer-busy-poll */
+    int       busy_poll_budget;			/* its SO_BUSY_POLL_BUDGET; 0 for the default */
+    int       busy_poll_errno;			/* why setting them failed, or 0 */
+    uint64_t  busy_spins;			/* times round the main loop while spinning */
+    uint64_t  busy_idle;			/* of which found nothing to do */
+    iperf_size_t busy_progress;			/* bytes sent and received at the last spin */
+    int       place;				/* --place */
+    char     *place_cpus;			/* --place=: this end's CPU list or "rx"; NULL for no threads */
+    char     *place_peer_cpus;			/* the server's, sent to it */
+    struct iperf_place *place_threads;		/* the stream threads' shared state while they run */
 
     char     *json_output_string; /* rendered JSON output if json_output is set */
     /* Select related parameters */
@@ -340,6 +818,7 @@ struct iperf_test
     double    reporter_interval;
     void      (*stats_callback) (struct iperf_test *);
     void      (*reporter_callback) (struct iperf_test *);
+    TimerQueue *timers;                         /* pending timers of this test */
     Timer     *omit_timer;
     Timer     *timer;
     int        done;
@@ -428,6 +907,85 @@ struct iperf_test
 
 #define TIMESTAMP_FORMAT "%c "
 
+/* Closed-loop UDP rate control algorithms (--rate-control) */
+#define RATE_CONTROL_NONE 0
+#define RATE_CONTROL_AIMD 1
+#define RATE_CONTROL_PID 2
+#define DEFAULT_TARGET_LOSS 1.0	/* percent */
+
+/* UDP throughput search (--search) */
+#define SEARCH_BINARY 1
+#define SEARCH_EXPONENTIAL 2
+#define SEARCH_PROBE 0			/* exponential growth phase */
+#define SEARCH_BISECT 1
+#define SEARCH_CONFIRM 2
+#define DEFAULT_TRIAL_TIME 1.0		/* seconds */
+#define SEARCH_SETTLE_USECS 100000	/* quiet time before asking for counts */
+#define SEARCH_RESOLUTION 0.01		/* stop when hi and lo are within 1% */
+#define SEARCH_SHORTFALL 0.05		/* sender may fall 5% short of the rate */
+#define SEARCH_MAX_TRIALS 40		/* per size */
+
+/* Packet-train capacity estimation (--trains) */
+#define DEFAULT_TRAIN_LENGTH 16
+#define MAX_TRAINS 1000
+#define MAX_TRAIN_LENGTH 1000
+#define TRAIN_GAP_USECS 10000		/* between train starts */
+#define TRAIN_DRAIN_USECS 200000	/* wait for the last train to arrive */
+#define TRAIN_LOSS_WARN 10		/* percent lost within the trains worth a warning */
+
+/* Request/response mode (--rr) */
+#define DEFAULT_RR_SIZE 1
+#define DEFAULT_RR_DEPTH 1
+#define MAX_RR_DEPTH 1024
+#define MAX_CRR_CONNS 256		/* per client, all streams; keeps fds within select() */
+#define CRR_CONNECTING 1		/* client: waiting for the handshake */
+#define CRR_REQUEST 2			/* client: writing the request; server: reading it */
+#define CRR_RESPONSE 3			/* client: reading the response; server: writing it */
+#define CRR_CLOSING 4			/* server: waiting for the client to close */
+#define CRR_ACCEPT_BATCH 64		/* connections the server takes per wakeup */
+#define MAX_RR_RATE 1000000		/* --rr-rate, per stream */
+#define RR_STAMP_LEN 8			/* --rr-rate: intended send time leading each message */
+#define RR_OPEN_QUEUE 4096		/* --rr-rate: responses the server owes per stream */
+
+/* UDP reflector mode (--echo): reflector times and reverse sequence follow the UDP header */
+#define ECHO_HEADER_LEN (4 + 4 + 8 + 4 + 4 + 4 + 4 + 8)
+
+/* Per-packet trace (--trace) */
+#define DEFAULT_TRACE_RECORDS (1 << 20)
+#define MAX_TRACE_RECORDS (1 << 28)	/* 8 GB of records */
+
+/* Latency-under-load probing (--probe) */
+#define DEFAULT_PROBE_INTERVAL 100	/* ms */
+#define MAX_PROBE_INTERVAL 10000
+#define PROBE_IDLE_ROUNDS 10		/* before the streams start */
+#define PROBE_ACCEPT_SECS 10		/* server: wait for the probe connection */
+
+/* TCP_INFO sampling (--tcp-sample) */
+#define MIN_TCP_SAMPLE_USECS 100
+#define MAX_TCP_SAMPLE_USECS 1000000
+#define MIN_TCP_SAMPLES 256		/* ring slots per stream, at the least */
+#define MAX_TCP_SAMPLES (1 << 20)
+
+/* Sender attribution (--bottleneck) */
+#define LIMITED_HINT_PERCENT 10		/* of the time window-limited, to suggest a -w */
+
+/* Socket diagnostics over netlink (--diag) */
+#define DIAG_INET 1			/* diag_families */
+#define DIAG_INET6 2
+#define DIAG_CC_NONE 0			/* iperf_diag_stream.cc */
+#define DIAG_CC_BBR 1
+#define DIAG_CC_DCTCP 2
+#define DIAG_BUFSIZE (64 * 1024)	/* for a recv() of the dump */
+
+/* Socket queue occupancy (--queues) */
+#define DEFAULT_QUEUE_INTERVAL 10	/* ms */
+#define MAX_QUEUE_INTERVAL 1000
+
+/* One-way delay (--owd) */
+#define OWD_SYNC_BEFORE 0
+#define OWD_SYNC_AFTER 1
+#define OWD_SYNC_ROUNDS 8		/* keep the one with the shortest round trip */
+
 extern int gerror; /* error value from getaddrinfo(3), for use in internal error handling */
 
 /* UDP "connect" message and reply (textual value for Wireshark, etc. readability - legacy was numeric) */
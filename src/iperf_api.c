@@ -75,6 +75,24 @@
 #include "iperf.h"
 #include "iperf_api.h"
 #include "iperf_udp.h"
+#include "iperf_search.h"
+#include "iperf_train.h"
+#include "iperf_owd.h"
+#include "iperf_latency.h"
+#include "iperf_rr.h"
+#include "iperf_echo.h"
+#include "iperf_seq.h"
+#include "iperf_trace.h"
+#include "iperf_tcpsample.h"
+#include "iperf_bottleneck.h"
+#include "iperf_diag.h"
+#include "iperf_queues.h"
+#include "iperf_txstamp.h"
+#include "iperf_drain.h"
+#include "iperf_rxstamp.h"
+#include "iperf_busypoll.h"
+#include "iperf_place.h"
+#include "iperf_probe.h"
 #include "iperf_tcp.h"
 #if defined(HAVE_SCTP_H)
 #include "iperf_sctp.h"
@@ -101,6 +119,7 @@ static int diskfile_send(struct iperf_stream *sp);
 static int diskfile_recv(struct iperf_stream *sp);
 static int JSON_write(int fd, cJSON *json);
 static void print_interval_results(struct iperf_test *test, struct iperf_stream *sp, cJSON *json_interval_streams);
+static void print_cpu_per_gbit(struct iperf_test *test);
 static cJSON *JSON_read(int fd);
 
 
@@ -116,7 +135,7 @@ usage()
 void
 usage_long(FILE *f)
 {
-    fprintf(f, usage_longstr, DEFAULT_NO_MSG_RCVD_TIMEOUT, UDP_RATE / (1024*1024), DEFAULT_PACING_TIMER, DURATION, DEFAULT_TCP_BLKSIZE / 1024, DEFAULT_UDP_BLKSIZE);
+    fprintf(f, usage_longstr, DEFAULT_TRACE_RECORDS, DEFAULT_NO_MSG_RCVD_TIMEOUT, UDP_RATE / (1024*1024), DEFAULT_PACING_TIMER, DEFAULT_PROBE_INTERVAL, DURATION, DEFAULT_TCP_BLKSIZE / 1024, DEFAULT_UDP_BLKSIZE);
 }
 
 
@@ -952,6 +971,7 @@ iperf_on_connect(struct iperf_test *test)
 	// Duplicate to make sure it appears on all output
         cJSON_AddNumberToObject(test->json_start, "target_bitrate", test->settings->rate);
         cJSON_AddNumberToObject(test->json_start, "fq_rate", test->settings->fqrate);
+        cJSON_AddStringToObject(test->json_start, "clock_source", iperf_time_clock_name(iperf_time_get_clock()));
     } else if (test->verbose) {
         iperf_printf(test, report_cookie, test->cookie);
         if (test->protocol->id == SOCK_STREAM) {
@@ -963,6 +983,7 @@ iperf_on_connect(struct iperf_test *test)
         }
         if (test->settings->rate)
             iperf_printf(test, "      Target Bitrate: %"PRIu64"\n", test->settings->rate);
+        iperf_printf(test, "      Clock source: %s\n", iperf_time_clock_name(iperf_time_get_clock()));
     }
 }
 
@@ -1104,6 +1125,42 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
         {"idle-timeout", required_argument, NULL, OPT_IDLE_TIMEOUT},
         {"rcv-timeout", required_argument, NULL, OPT_RCV_TIMEOUT},
         {"snd-timeout", required_argument, NULL, OPT_SND_TIMEOUT},
+        {"clock", required_argument, NULL, OPT_CLOCK},
+        {"rate-control", required_argument, NULL, OPT_RATE_CONTROL},
+        {"target-loss", required_argument, NULL, OPT_TARGET_LOSS},
+        {"search", required_argument, NULL, OPT_SEARCH},
+        {"search-sizes", required_argument, NULL, OPT_SEARCH_SIZES},
+        {"trial-time", required_argument, NULL, OPT_TRIAL_TIME},
+        {"trains", required_argument, NULL, OPT_TRAINS},
+        {"owd", no_argument, NULL, OPT_OWD},
+        {"histograms", no_argument, NULL, OPT_HISTOGRAMS},
+        {"rr", required_argument, NULL, OPT_RR},
+        {"rr-depth", required_argument, NULL, OPT_RR_DEPTH},
+        {"rr-rate", required_argument, NULL, OPT_RR_RATE},
+        {"rr-arrivals", required_argument, NULL, OPT_RR_ARRIVALS},
+        {"loss-stats", no_argument, NULL, OPT_LOSS_STATS},
+        {"trace", required_argument, NULL, OPT_TRACE},
+        {"trace-records", required_argument, NULL, OPT_TRACE_RECORDS},
+        {"tcp-sample", required_argument, NULL, OPT_TCP_SAMPLE},
+        {"tcp-sample-file", required_argument, NULL, OPT_TCP_SAMPLE_FILE},
+        {"bottleneck", no_argument, NULL, OPT_BOTTLENECK},
+        {"diag", no_argument, NULL, OPT_DIAG},
+        {"queues", optional_argument, NULL, OPT_QUEUES},
+        {"notsent-lowat", required_argument, NULL, OPT_NOTSENT_LOWAT},
+        {"tx-timestamps", no_argument, NULL, OPT_TX_TIMESTAMPS},
+        {"rcv-drain", optional_argument, NULL, OPT_RCV_DRAIN},
+        {"rcvlowat", required_argument, NULL, OPT_RCVLOWAT},
+        {"discard", no_argument, NULL, OPT_DISCARD},
+        {"rx-timestamps", optional_argument, NULL, OPT_RX_TIMESTAMPS},
+        {"busy-poll", optional_argument, NULL, OPT_BUSY_POLL},
+        {"prefer-busy-poll", optional_argument, NULL, OPT_PREFER_BUSY_POLL},
+        {"place", optional_argument, NULL, OPT_PLACE},
+        {"crr", no_argument, NULL, OPT_CRR},
+        {"fastopen", no_argument, NULL, OPT_FASTOPEN},
+        {"linger", required_argument, NULL, OPT_LINGER},
+        {"echo", no_argument, NULL, OPT_ECHO},
+        {"probe", optional_argument, NULL, OPT_PROBE},
+        {"probe-streams", no_argument, NULL, OPT_PROBE_STREAMS},
         {"debug", optional_argument, NULL, 'd'},
         {"help", no_argument, NULL, 'h'},
         {NULL, 0, NULL, 0}
@@ -1480,6 +1537,151 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
                 snd_timeout_flag = 1;
 	        break;
 #endif /* HAVE_TCP_USER_TIMEOUT */
+            case OPT_CLOCK:
+                if (strcmp(optarg, "tsc") == 0) {
+                    if (iperf_time_set_clock(IPERF_CLOCK_TSC) < 0)
+                        warning("TSC clock not available, falling back to the monotonic clock");
+                } else if (strcmp(optarg, "monotonic") == 0)
+                    iperf_time_set_clock(IPERF_CLOCK_MONOTONIC);
+                else {
+                    i_errno = IECLOCK;
+                    return -1;
+                }
+                break;
+            case OPT_RATE_CONTROL:
+                if (strcmp(optarg, "aimd") == 0)
+                    test->rate_control = RATE_CONTROL_AIMD;
+                else if (strcmp(optarg, "pid") == 0)
+                    test->rate_control = RATE_CONTROL_PID;
+                else {
+                    i_errno = IERATECONTROL;
+                    return -1;
+                }
+                client_flag = 1;
+                break;
+            case OPT_TARGET_LOSS:
+                test->target_loss = atof(optarg);
+                if (test->target_loss < 0 || test->target_loss >= 100) {
+                    i_errno = IETARGETLOSS;
+                    return -1;
+                }
+                client_flag = 1;
+                break;
+            case OPT_SEARCH:
+            case OPT_SEARCH_SIZES:
+            case OPT_TRIAL_TIME:
+                if (test->search == NULL) {
+                    test->search = calloc(1, sizeof(struct iperf_search));
+                    if (test->search == NULL) {
+                        i_errno = IENEWTEST;
+                        return -1;
+                    }
+                    test->search->trial_usecs = DEFAULT_TRIAL_TIME * SEC_TO_US;
+                }
+                if (flag == OPT_SEARCH) {
+                    if (strcmp(optarg, "binary") == 0)
+                        test->search->method = SEARCH_BINARY;
+                    else if (strcmp(optarg, "exponential") == 0)
+                        test->search->method = SEARCH_EXPONENTIAL;
+                    else {
+                        i_errno = IESEARCH;
+                        return -1;
+                    }
+                } else if (flag == OPT_SEARCH_SIZES) {
+                    if (iperf_search_parse_sizes(test, optarg) < 0)
+                        return -1;
+                } else {
+                    double trial_time = atof(optarg);
+                    if (trial_time < MIN_INTERVAL || trial_time > MAX_TIME) {
+                        i_errno = IETRIALTIME;
+                        return -1;
+                    }
+                    test->search->trial_usecs = trial_time * SEC_TO_US;
+                }
+                client_flag = 1;
+                break;
+            case OPT_TRAINS:
+                if (iperf_train_parse(test, optarg) < 0)
+                    return -1;
+                client_flag = 1;
+                break;
+            case OPT_OWD:
+                test->owd = 1;
+                client_flag = 1;
+                break;
+            case OPT_HISTOGRAMS:
+                test->histograms = 1;
+                client_flag = 1;
+                break;
+            case OPT_RR:
+                if (iperf_rr_parse(test, optarg) < 0)
+                    return -1;
+                client_flag = 1;
+                break;
+            case OPT_RR_DEPTH:
+                test->rr_depth = atoi(optarg);
+                if (test->rr_depth < 1 || test->rr_depth > MAX_RR_DEPTH) {
+                    i_errno = IEREQRESP;
+                    return -1;
+                }
+                client_flag = 1;
+                break;
+            case OPT_RR_RATE:
+                test->rr_rate = atof(optarg);
+                if (test->rr_rate <= 0 || test->rr_rate > MAX_RR_RATE) {
+                    i_errno = IERRRATE;
+                    return -1;
+                }
+                client_flag = 1;
+                break;
+            case OPT_RR_ARRIVALS:
+                if (strcmp(optarg, "poisson") == 0)
+                    test->rr_poisson = 1;
+                else if (strcmp(optarg, "fixed") == 0)
+                    test->rr_poisson = 0;
+                else {
+                    i_errno = IERRRATE;
+                    return -1;
+                }
+                client_flag = 1;
+                break;
+            case OPT_CRR:
+                test->rr = 1;
+                test->rr_connect = 1;
+                client_flag = 1;
+                break;
+            case OPT_FASTOPEN:
+                test->fastopen = 1;
+                client_flag = 1;
+                break;
+            case OPT_PROBE:
+                test->probe_interval = optarg ? atoi(optarg) : DEFAULT_PROBE_INTERVAL;
+                if (test->probe_interval < 1 || test->probe_interval > MAX_PROBE_INTERVAL) {
+                    i_errno = IEPROBE;
+                    return -1;
+                }
+                client_flag = 1;
+                break;
+            case OPT_PROBE_STREAMS:
+                test->probe_streams = 1;
+                client_flag = 1;
+                break;
+            case OPT_ECHO:
+                test->echo = 1;
+                client_flag = 1;
+                break;
+            case OPT_LOSS_STATS:
+                test->loss_stats = 1;
+                client_flag = 1;
+                break;
+            case OPT_LINGER:
+                test->linger = atoi(optarg);
+                if (test->linger < 0) {
+                    i_errno = IECRR;
+                    return -1;
+                }
+                client_flag = 1;
+                break;
             case 'A':
 #if defined(HAVE_CPU_AFFINITY)
                 test->affinity = strtol(optarg, &endptr, 0);
@@ -1530,6 +1732,151 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
 	    case OPT_LOGFILE:
 		test->logfile = strdup(optarg);
 		break;
+	    case OPT_TRACE:
+		free(test->trace_file);
+		test->trace_file = strdup(optarg);
+		break;
+	    case OPT_TRACE_RECORDS:
+		test->trace_records = unit_atoi(optarg);
+		if (test->trace_records < 1 || test->trace_records > MAX_TRACE_RECORDS) {
+		    i_errno = IETRACERECORDS;
+		    return -1;
+		}
+		break;
+	    case OPT_TCP_SAMPLE:
+		test->tcp_sample_usecs = (int) (atof(optarg) * 1000.0 + 0.5);
+		if (test->tcp_sample_usecs < MIN_TCP_SAMPLE_USECS || test->tcp_sample_usecs > MAX_TCP_SAMPLE_USECS) {
+		    i_errno = IETCPSAMPLE;
+		    return -1;
+		}
+		client_flag = 1;
+		break;
+	    case OPT_BOTTLENECK:
+		test->bottleneck = 1;
+		client_flag = 1;
+		break;
+	    case OPT_DIAG:
+#if defined(HAVE_LINUX_INET_DIAG_H) && defined(HAVE_LINUX_SOCK_DIAG_H)
+		test->diag = 1;
+		client_flag = 1;
+#else /* HAVE_LINUX_INET_DIAG_H && HAVE_LINUX_SOCK_DIAG_H */
+		i_errno = IEUNIMP;
+		return -1;
+#endif
+		break;
+	    case OPT_QUEUES:
+		test->queue_interval = optarg ? atoi(optarg) : DEFAULT_QUEUE_INTERVAL;
+		if (test->queue_interval < 1 || test->queue_interval > MAX_QUEUE_INTERVAL) {
+		    i_errno = IEQUEUES;
+		    return -1;
+		}
+		client_flag = 1;
+		break;
+	    case OPT_NOTSENT_LOWAT:
+#if defined(TCP_NOTSENT_LOWAT)
+		test->notsent_lowat = unit_atoi(optarg);
+		if (test->notsent_lowat <= 0) {
+		    i_errno = IETXSTAMP;
+		    return -1;
+		}
+		client_flag = 1;
+#else /* TCP_NOTSENT_LOWAT */
+		i_errno = IEUNIMP;
+		return -1;
+#endif
+		break;
+	    case OPT_TX_TIMESTAMPS:
+#if defined(HAVE_LINUX_NET_TSTAMP_H) && defined(HAVE_LINUX_ERRQUEUE_H) && defined(SO_TIMESTAMPING)
+		test->tx_timestamps = 1;
+		client_flag = 1;
+#else
+		i_errno = IEUNIMP;
+		return -1;
+#endif
+		break;
+	    case OPT_RCV_DRAIN:
+		test->rcv_drain = optarg ? unit_atoi(optarg) : DEFAULT_RCV_DRAIN;
+		if (test->rcv_drain <= 0 || test->rcv_drain > MAX_TCP_BUFFER) {
+		    i_errno = IERCVDRAIN;
+		    return -1;
+		}
+		client_flag = 1;
+		break;
+	    case OPT_RCVLOWAT:
+		test->rcvlowat = unit_atoi(optarg);
+		if (test->rcvlowat <= 0 || test->rcvlowat > MAX_TCP_BUFFER) {
+		    i_errno = IERCVDRAIN;
+		    return -1;
+		}
+		client_flag = 1;
+		break;
+	    case OPT_DISCARD:
+#if defined(linux) && defined(MSG_TRUNC)
+		test->discard = 1;
+		client_flag = 1;
+#else /* linux && MSG_TRUNC */
+		i_errno = IEUNIMP;
+		return -1;
+#endif /* linux && MSG_TRUNC */
+		break;
+	    case OPT_RX_TIMESTAMPS:
+#if defined(HAVE_LINUX_NET_TSTAMP_H) && defined(SO_TIMESTAMPING) && defined(HAVE_SO_TIMESTAMPNS)
+		if (optarg == NULL)
+		    test->rx_timestamps = RXSTAMP_SW;
+		else if (strcmp(optarg, "hw") == 0)
+		    test->rx_timestamps = RXSTAMP_HW;
+		else {
+		    i_errno = IERXSTAMP;
+		    return -1;
+		}
+		client_flag = 1;
+#else
+		i_errno = IEUNIMP;
+		return -1;
+#endif
+		break;
+	    case OPT_BUSY_POLL:
+#if defined(SO_BUSY_POLL)
+		test->busy_poll = optarg ? atoi(optarg) : DEFAULT_BUSY_POLL;
+		if (test->busy_poll <= 0) {
+		    i_errno = IEBUSYPOLL;
+		    return -1;
+		}
+		client_flag = 1;
+#else /* SO_BUSY_POLL */
+		i_errno = IEUNIMP;
+		return -1;
+#endif /* SO_BUSY_POLL */
+		break;
+	    case OPT_PREFER_BUSY_POLL:
+#if defined(SO_PREFER_BUSY_POLL) && defined(SO_BUSY_POLL_BUDGET)
+		test->prefer_busy_poll = 1;
+		test->busy_poll_budget = optarg ? atoi(optarg) : 0;
+		if (test->busy_poll_budget < 0 || test->busy_poll_budget > USHRT_MAX) {
+		    i_errno = IEBUSYPOLL;
+		    return -1;
+		}
+		client_flag = 1;
+#else /* SO_PREFER_BUSY_POLL */
+		i_errno = IEUNIMP;
+		return -1;
+#endif /* SO_PREFER_BUSY_POLL */
+		break;
+	    case OPT_PLACE:
+#if defined(HAVE_SCHED_SETAFFINITY) && defined(SO_INCOMING_CPU)
+		if (optarg && iperf_place_parse(test, optarg) < 0)
+		    return -1;
+		test->place = 1;
+		client_flag = 1;
+#else /* HAVE_SCHED_SETAFFINITY && SO_INCOMING_CPU */
+		i_errno = IEUNIMP;
+		return -1;
+#endif /* HAVE_SCHED_SETAFFINITY && SO_INCOMING_CPU */
+		break;
+	    case OPT_TCP_SAMPLE_FILE:
+		free(test->tcp_sample_file);
+		test->tcp_sample_file = strdup(optarg);
+		break;
 	    case OPT_FORCEFLUSH:
 		test->forceflush = 1;
 		break;
@@ -1700,6 +2047,181 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
     if (!rate_flag)
 	test->settings->rate = test->protocol->id == Pudp ? UDP_RATE : 0;
 
+    if (test->rate_control) {
+        if (test->protocol->id != Pudp) {
+            i_errno = IERATECONTROL;
+            return -1;
+        }
+        /* -b is only the starting point; the controller needs a pacing timer */
+        if (test->settings->rate == 0)
+            test->settings->rate = UDP_RATE;
+    }
+
+    if (test->search) {
+        struct iperf_search *search = test->search;
+        int i;
+
+        if (search->method == 0 || test->protocol->id != Pudp ||
+            test->reverse || test->bidirectional || test->rate_control) {
+            i_errno = IESEARCH;
+            return -1;
+        }
+        if (search->method == SEARCH_BINARY && (!rate_flag || test->settings->rate == 0)) {
+            i_errno = IESEARCHBOUND;
+            return -1;
+        }
+        if (test->settings->rate == 0)
+            test->settings->rate = UDP_RATE;
+        /* the receiver's buffers must hold the largest size searched */
+        for (i = 0; i < search->nsizes; ++i)
+            if (search->sizes[i] > test->settings->blksize)
+                test->settings->blksize = search->sizes[i];
+        /* the search ends the test; -t is the confirmation run */
+        search->confirm_usecs = test->duration * SEC_TO_US;
+        test->duration = 0;
+    }
+
+    if (test->owd && test->protocol->id != Pudp) {
+        i_errno = IEOWD;
+        return -1;
+    }
+
+    if (test->histograms && test->protocol->id != Pudp && test->protocol->id != Ptcp) {
+        i_errno = IEHISTOGRAMS;
+        return -1;
+    }
+
+    if (test->rr) {
+        if (test->protocol->id != Ptcp || test->reverse || test->bidirectional ||
+            test->settings->bytes != 0 || test->settings->blocks != 0) {
+            i_errno = IEREQRESP;
+            return -1;
+        }
+        /* Every --crr connection is open at once on the server */
+        if (test->rr_connect && test->num_streams * test->rr_depth > MAX_CRR_CONNS) {
+            i_errno = IEREQRESP;
+            return -1;
+        }
+        /* Small messages would otherwise wait on Nagle; the latencies go in a histogram */
+        test->no_delay = 1;
+        test->histograms = 1;
+    }
+
+    if ((test->rr_rate > 0 || test->rr_poisson) &&
+        (!test->rr || test->rr_connect || test->rr_rate == 0 || test->settings->rate != 0 ||
+         test->rr_request < RR_STAMP_LEN || test->rr_response < RR_STAMP_LEN ||
+         (test->settings->blksize > 0 && test->settings->blksize < RR_STAMP_LEN))) {
+        i_errno = IERRRATE;
+        return -1;
+    }
+
+    if (test->echo) {
+        if (test->protocol->id != Pudp || test->reverse || test->bidirectional ||
+            test->trains || test->search ||
+            (test->settings->blksize > 0 && test->settings->blksize < ECHO_HEADER_LEN)) {
+            i_errno = IEECHO;
+            return -1;
+        }
+        /* The round trips go in a histogram */
+        test->histograms = 1;
+    }
+
+    if (test->trace_records != DEFAULT_TRACE_RECORDS && test->trace_file == NULL) {
+        i_errno = IETRACERECORDS;
+        return -1;
+    }
+
+    if (test->loss_stats && test->protocol->id != Pudp) {
+        i_errno = IELOSSSTATS;
+        return -1;
+    }
+
+    if (test->tcp_sample_usecs && test->protocol->id != Ptcp) {
+        i_errno = IETCPSAMPLE;
+        return -1;
+    }
+    if (test->bottleneck && test->protocol->id != Ptcp) {
+        i_errno = IEBOTTLENECK;
+        return -1;
+    }
+    if (test->diag && test->protocol->id != Ptcp) {
+        i_errno = IEDIAG;
+        return -1;
+    }
+    if (test->queue_interval && test->protocol->id != Ptcp && test->protocol->id != Pudp) {
+        i_errno = IEQUEUES;
+        return -1;
+    }
+    if ((test->notsent_lowat && test->protocol->id != Ptcp) ||
+        (test->tx_timestamps && test->protocol->id != Ptcp && test->protocol->id != Pudp)) {
+        i_errno = IETXSTAMP;
+        return -1;
+    }
+    if ((test->rcv_drain || test->rcvlowat) && test->protocol->id != Ptcp) {
+        i_errno = IERCVDRAIN;
+        return -1;
+    }
+    if (test->discard && test->protocol->id != Ptcp && test->protocol->id != Pudp) {
+        i_errno = IEDISCARD;
+        return -1;
+    }
+    if (test->rx_timestamps && test->protocol->id != Pudp) {
+        i_errno = IERXSTAMP;
+        return -1;
+    }
+    if ((test->busy_poll && test->protocol->id != Ptcp && test->protocol->id != Pudp) ||
+        (test->prefer_busy_poll && !test->busy_poll)) {
+        i_errno = IEBUSYPOLL;
+        return -1;
+    }
+
+    /* Stream threads run each stream on its own; these need the main loop's view of all of them */
+    if ((test->place_cpus != NULL || test->place_peer_cpus != NULL) &&
+        (test->rr || test->echo || test->trains || test->search != NULL || test->rate_control ||
+         test->busy_poll || test->trace_file != NULL || test->diskfile_name != NULL)) {
+        i_errno = IEPLACE;
+        return -1;
+    }
+
+    /*
+     * A server may be asked for samples by any client.  With -R only the
+     * server sends, so the client would write a file with no samples in
+     * it; the server's own --tcp-sample-file has them.
+     */
+    if (test->tcp_sample_file != NULL && test->role == 'c' && (test->tcp_sample_usecs == 0 || test->reverse)) {
+        i_errno = IETCPSAMPLE;
+        return -1;
+    }
+
+    /* With -R the client has no sending stream whose RTT it could read */
+    if (test->probe_streams && (test->probe_interval == 0 || test->protocol->id != Ptcp || test->reverse)) {
+        i_errno = IEPROBE;
+        return -1;
+    }
+
+    if ((test->fastopen || test->linger >= 0) && !test->rr_connect) {
+        i_errno = IECRR;
+        return -1;
+    }
+#if !defined(TCP_FASTOPEN_CONNECT)
+    if (test->fastopen) {
+        i_errno = IECRR;
+        return -1;
+    }
+#endif /* TCP_FASTOPEN_CONNECT */
+
+    if (test->trains) {
+        if (test->protocol->id != Pudp || test->num_streams != 1 ||
+            test->bidirectional || test->rate_control || test->search ||
+            test->settings->bytes != 0 || test->settings->blocks != 0) {
+            i_errno = IETRAIN;
+            return -1;
+        }
+        /* back to back: no pacing, and the trains end the test */
+        test->settings->rate = 0;
+        test->duration = 0;
+    }
+
     /* if no bytes or blocks specified, nor a duration_flag, and we have -F,
     ** get the file-size as the bytes count to be transferred
     */
@@ -1812,16 +2334,30 @@ iperf_check_throttle(struct iperf_stream *sp, struct iperf_time *nowP)
 
     if (sp->test->done || sp->test->settings->rate == 0)
         return;
-    iperf_time_diff(&sp->result->start_time_fixed, nowP, &temp_time);
-    seconds = iperf_time_in_secs(&temp_time);
-    bits_per_second = sp->result->bytes_sent * 8 / seconds;
-    if (bits_per_second < sp->test->settings->rate) {
-        sp->green_light = 1;
-        FD_SET(sp->socket, &sp->test->write_set);
-    } else {
+    if (sp->test->search && !sp->test->search->sending) {
+        /* between search trials */
         sp->green_light = 0;
         FD_CLR(sp->socket, &sp->test->write_set);
+        return;
+    }
+    if (sp->target != 0) {
+        /* rate control: average since the controller last moved the target */
+        iperf_time_diff(&sp->target_start, nowP, &temp_time);
+        seconds = iperf_time_in_secs(&temp_time);
+        bits_per_second = seconds > 0 ? (sp->result->bytes_sent - sp->target_start_bytes) * 8 / seconds : 0;
+    } else {
+        iperf_time_diff(&sp->result->start_time_fixed, nowP, &temp_time);
+        seconds = iperf_time_in_secs(&temp_time);
+        bits_per_second = sp->result->bytes_sent * 8 / seconds;
     }
+    sp->green_light = bits_per_second < (sp->target != 0 ? sp->target : sp->test->settings->rate);
+    /* A stream with a --place thread of its own is not in the main loop's select() */
+    if (sp->place_worker != NULL)
+        return;
+    if (sp->green_light)
+        FD_SET(sp->socket, &sp->test->write_set);
+    else
+        FD_CLR(sp->socket, &sp->test->write_set);
 }
 
 /* Verify that average traffic is not greater than the specified limit */
@@ -1888,7 +2424,7 @@ iperf_send(struct iperf_test *test, fd_set *write_setP)
 	    iperf_time_now(&now);
 	streams_active = 0;
 	SLIST_FOREACH(sp, &test->streams, streams) {
-	    if ((sp->green_light && sp->sender &&
+	    if ((sp->green_light && sp->sender && sp->place_worker == NULL &&
 		 (write_setP == NULL || FD_ISSET(sp->socket, write_setP)))) {
         if (multisend > 1 && test->settings->bytes != 0 && test->bytes_sent >= test->settings->bytes)
             break;
@@ -1914,7 +2450,7 @@ iperf_send(struct iperf_test *test, fd_set *write_setP)
     if (!no_throttle_check) {   /* Throttle check if was not checked for each send */
 	iperf_time_now(&now);
 	SLIST_FOREACH(sp, &test->streams, streams)
-	    if (sp->sender)
+	    if (sp->sender && sp->place_worker == NULL)
 	        iperf_check_throttle(sp, &now);
     }
     if (write_setP != NULL)
@@ -1932,7 +2468,7 @@ iperf_recv(struct iperf_test *test, fd_set *read_setP)
     struct iperf_stream *sp;
 
     SLIST_FOREACH(sp, &test->streams, streams) {
-	if (FD_ISSET(sp->socket, read_setP) && !sp->sender) {
+	if (FD_ISSET(sp->socket, read_setP) && !sp->sender && sp->place_worker == NULL) {
 	    if ((r = sp->rcv(sp)) < 0) {
 		i_errno = IESTREAMREAD;
 		return r;
@@ -1957,6 +2493,10 @@ iperf_init_test(struct iperf_test *test)
             return -1;
     }
 
+    /* Faulting in a large --trace file takes a while, so before the clock starts */
+    if (iperf_trace_open(test) < 0)
+	return -1;
+
     /* Init each stream. */
     if (iperf_time_now(&now) < 0) {
 	i_errno = IEINITTEST;
@@ -1966,6 +2506,13 @@ iperf_init_test(struct iperf_test *test)
 	sp->result->start_time = sp->result->start_time_fixed = now;
     }
 
+    if (iperf_train_init(test) < 0 || iperf_owd_init(test) < 0 || iperf_latency_init(test) < 0 ||
+	iperf_rr_init(test) < 0 || iperf_echo_init(test) < 0 || iperf_seq_init(test) < 0 ||
+	iperf_tcpsample_init(test) < 0 || iperf_diag_init(test) < 0 || iperf_queues_init(test) < 0 ||
+	iperf_txstamp_init(test) < 0 || iperf_drain_init(test) < 0 || iperf_rxstamp_init(test) < 0 ||
+	iperf_busypoll_init(test) < 0 || iperf_place_init(test) < 0)
+	return -1;
+
     if (test->on_test_start)
         test->on_test_start(test);
 
@@ -1998,14 +2545,23 @@ iperf_create_send_timers(struct iperf_test * test)
     SLIST_FOREACH(sp, &test->streams, streams) {
         sp->green_light = 1;
 	if (test->settings->rate != 0 && sp->sender) {
+	    if (test->rate_control) {
+		sp->target = test->settings->rate;
+		sp->target_start = now;
+		sp->target_start_bytes = sp->result->bytes_sent;
+		sp->rc_step = 0;
+		sp->rc_integral = sp->rc_prev_error = 0;
+	    }
 	    cd.p = sp;
-	    sp->send_timer = tmr_create(NULL, send_timer_proc, cd, test->settings->pacing_timer, 1);
+	    sp->send_timer = tmr_create(test->timers, NULL, send_timer_proc, cd, test->settings->pacing_timer, 1);
 	    if (sp->send_timer == NULL) {
 		i_errno = IEINITTEST;
 		return -1;
 	    }
 	}
     }
+    if (test->trains)
+	return iperf_train_start(test);
     return 0;
 }
 
@@ -2056,6 +2612,8 @@ iperf_exchange_parameters(struct iperf_test *test)
 
     if (test->role == 'c') {
 
+        if (iperf_place_check(test) < 0)
+            return -1;
         if (send_parameters(test) < 0)
             return -1;
 
@@ -2078,6 +2636,22 @@ iperf_exchange_parameters(struct iperf_test *test)
         }
 #endif //HAVE_SSL
 
+        if (iperf_place_check(test) < 0) {
+            if (iperf_set_send_state(test, SERVER_ERROR) != 0)
+                return -1;
+            err = htonl(i_errno);
+            if (Nwrite(test->ctrl_sck, (char*) &err, sizeof(err), Ptcp) < 0) {
+                i_errno = IECTRLWRITE;
+                return -1;
+            }
+            err = htonl(errno);
+            if (Nwrite(test->ctrl_sck, (char*) &err, sizeof(err), Ptcp) < 0) {
+                i_errno = IECTRLWRITE;
+                return -1;
+            }
+            return -1;
+        }
+
         if ((s = test->protocol->listen(test)) < 0) {
 	        if (iperf_set_send_state(test, SERVER_ERROR) != 0)
                 return -1;
@@ -2102,6 +2676,15 @@ iperf_exchange_parameters(struct iperf_test *test)
 	if (iperf_set_send_state(test, CREATE_STREAMS) != 0)
             return -1;
 
+        /* The client compares clocks before it connects the streams */
+        if (test->owd && iperf_owd_sync(test, OWD_SYNC_BEFORE) < 0)
+            return -1;
+
+        if ((test->rr_connect || test->probe_interval) && iperf_crr_setup(test) < 0)
+            return -1;
+        if (test->probe_interval && iperf_probe_setup(test) < 0)
+            return -1;
+
     }
 
     return 0;
@@ -2112,6 +2695,8 @@ iperf_exchange_parameters(struct iperf_test *test)
 int
 iperf_exchange_results(struct iperf_test *test)
 {
+    if (test->owd && iperf_owd_sync(test, OWD_SYNC_AFTER) < 0)
+        return -1;
     if (test->role == 'c') {
         /* Send results to server. */
 	if (send_results(test) < 0)
@@ -2172,6 +2757,67 @@ send_parameters(struct iperf_test *test)
 	    cJSON_AddNumberToObject(j, "bandwidth", test->settings->rate);
 	if (test->settings->fqrate)
 	    cJSON_AddNumberToObject(j, "fqrate", test->settings->fqrate);
+	if (test->rate_control) {
+	    cJSON_AddNumberToObject(j, "rate_control", test->rate_control);
+	    cJSON_AddNumberToObject(j, "target_loss", test->target_loss);
+	}
+	if (test->owd)
+	    cJSON_AddTrueToObject(j, "owd");
+	if (test->histograms)
+	    cJSON_AddTrueToObject(j, "histograms");
+	if (test->echo)
+	    cJSON_AddTrueToObject(j, "echo");
+	if (test->loss_stats)
+	    cJSON_AddTrueToObject(j, "loss_stats");
+	if (test->probe_interval)
+	    cJSON_AddNumberToObject(j, "probe", test->probe_interval);
+	if (test->tcp_sample_usecs)
+	    cJSON_AddNumberToObject(j, "tcp_sample_usecs", test->tcp_sample_usecs);
+	if (test->bottleneck)
+	    cJSON_AddTrueToObject(j, "bottleneck");
+	if (test->diag)
+	    cJSON_AddTrueToObject(j, "diag");
+	if (test->queue_interval)
+	    cJSON_AddNumberToObject(j, "queue_interval", test->queue_interval);
+	if (test->notsent_lowat)
+	    cJSON_AddNumberToObject(j, "notsent_lowat", test->notsent_lowat);
+	if (test->tx_timestamps)
+	    cJSON_AddTrueToObject(j, "tx_timestamps");
+	if (test->rcv_drain)
+	    cJSON_AddNumberToObject(j, "rcv_drain", test->rcv_drain);
+	if (test->rcvlowat)
+	    cJSON_AddNumberToObject(j, "rcvlowat", test->rcvlowat);
+	if (test->discard)
+	    cJSON_AddTrueToObject(j, "discard");
+	if (test->rx_timestamps)
+	    cJSON_AddNumberToObject(j, "rx_timestamps", test->rx_timestamps);
+	if (test->busy_poll)
+	    cJSON_AddNumberToObject(j, "busy_poll", test->busy_poll);
+	if (test->prefer_busy_poll)
+	    cJSON_AddNumberToObject(j, "busy_poll_budget", test->busy_poll_budget);
+	if (test->place)
+	    cJSON_AddTrueToObject(j, "place");
+	if (test->place_peer_cpus != NULL)
+	    cJSON_AddStringToObject(j, "place_cpus", test->place_peer_cpus);
+	if (test->rr) {
+	    cJSON_AddNumberToObject(j, "rr_request", test->rr_request);
+	    cJSON_AddNumberToObject(j, "rr_response", test->rr_response);
+	    cJSON_AddNumberToObject(j, "rr_depth", test->rr_depth);
+	    if (test->rr_connect)
+		cJSON_AddTrueToObject(j, "crr");
+	    if (test->rr_rate > 0)
+		cJSON_AddNumberToObject(j, "rr_rate", test->rr_rate);
+	    if (test->rr_poisson)
+		cJSON_AddTrueToObject(j, "rr_poisson");
+	    if (test->fastopen)
+		cJSON_AddTrueToObject(j, "fastopen");
+	    if (test->linger >= 0)
+		cJSON_AddNumberToObject(j, "linger", test->linger);
+	}
+	if (test->trains) {
+	    cJSON_AddNumberToObject(j, "trains", test->trains);
+	    cJSON_AddNumberToObject(j, "train_length", test->train_length);
+	}
 	if (test->settings->pacing_timer)
 	    cJSON_AddNumberToObject(j, "pacing_timer", test->settings->pacing_timer);
 	if (test->settings->burst)
@@ -2288,6 +2934,74 @@ get_parameters(struct iperf_test *test)
 	    test->settings->rate = j_p->valueint;
 	if ((j_p = cJSON_GetObjectItem(j, "fqrate")) != NULL)
 	    test->settings->fqrate = j_p->valueint;
+	if ((j_p = cJSON_GetObjectItem(j, "rate_control")) != NULL)
+	    test->rate_control = j_p->valueint;
+	if ((j_p = cJSON_GetObjectItem(j, "target_loss")) != NULL)
+	    test->target_loss = j_p->valuedouble;
+	if ((j_p = cJSON_GetObjectItem(j, "owd")) != NULL)
+	    test->owd = 1;
+	if ((j_p = cJSON_GetObjectItem(j, "histograms")) != NULL)
+	    test->histograms = 1;
+	if ((j_p = cJSON_GetObjectItem(j, "echo")) != NULL)
+	    test->echo = 1;
+	if ((j_p = cJSON_GetObjectItem(j, "loss_stats")) != NULL)
+	    test->loss_stats = 1;
+	if ((j_p = cJSON_GetObjectItem(j, "probe")) != NULL)
+	    test->probe_interval = j_p->valueint;
+	if ((j_p = cJSON_GetObjectItem(j, "tcp_sample_usecs")) != NULL)
+	    test->tcp_sample_usecs = j_p->valueint;
+	if ((j_p = cJSON_GetObjectItem(j, "bottleneck")) != NULL)
+	    test->bottleneck = 1;
+	if ((j_p = cJSON_GetObjectItem(j, "diag")) != NULL)
+	    test->diag = 1;
+	if ((j_p = cJSON_GetObjectItem(j, "queue_interval")) != NULL)
+	    test->queue_interval = j_p->valueint;
+	if ((j_p = cJSON_GetObjectItem(j, "notsent_lowat")) != NULL)
+	    test->notsent_lowat = j_p->valueint;
+	if ((j_p = cJSON_GetObjectItem(j, "tx_timestamps")) != NULL)
+	    test->tx_timestamps = 1;
+	if ((j_p = cJSON_GetObjectItem(j, "rcv_drain")) != NULL)
+	    test->rcv_drain = j_p->valueint;
+	if ((j_p = cJSON_GetObjectItem(j, "rcvlowat")) != NULL)
+	    test->rcvlowat = j_p->valueint;
+	if ((j_p = cJSON_GetObjectItem(j, "discard")) != NULL)
+	    test->discard = 1;
+	if ((j_p = cJSON_GetObjectItem(j, "rx_timestamps")) != NULL)
+	    test->rx_timestamps = j_p->valueint;
+	if ((j_p = cJSON_GetObjectItem(j, "busy_poll")) != NULL)
+	    test->busy_poll = j_p->valueint;
+	if ((j_p = cJSON_GetObjectItem(j, "busy_poll_budget")) != NULL) {
+	    test->prefer_busy_poll = 1;
+	    test->busy_poll_budget = j_p->valueint;
+	}
+	if ((j_p = cJSON_GetObjectItem(j, "place")) != NULL)
+	    test->place = 1;
+	if ((j_p = cJSON_GetObjectItem(j, "place_cpus")) != NULL && cJSON_IsString(j_p)) {
+	    free(test->place_cpus);
+	    test->place_cpus = strdup(j_p->valuestring);
+	}
+	if ((j_p = cJSON_GetObjectItem(j, "rr_request")) != NULL) {
+	    test->rr = 1;
+	    test->rr_request = j_p->valueint;
+	}
+	if ((j_p = cJSON_GetObjectItem(j, "rr_response")) != NULL)
+	    test->rr_response = j_p->valueint;
+	if ((j_p = cJSON_GetObjectItem(j, "rr_depth")) != NULL)
+	    test->rr_depth = j_p->valueint;
+	if ((j_p = cJSON_GetObjectItem(j, "crr")) != NULL)
+	    test->rr_connect = 1;
+	if ((j_p = cJSON_GetObjectItem(j, "rr_rate")) != NULL)
+	    test->rr_rate = j_p->valuedouble;
+	if ((j_p = cJSON_GetObjectItem(j, "rr_poisson")) != NULL)
+	    test->rr_poisson = 1;
+	if ((j_p = cJSON_GetObjectItem(j, "fastopen")) != NULL)
+	    test->fastopen = 1;
+	if ((j_p = cJSON_GetObjectItem(j, "linger")) != NULL)
+	    test->linger = j_p->valueint;
+	if ((j_p = cJSON_GetObjectItem(j, "trains")) != NULL)
+	    test->trains = j_p->valueint;
+	if ((j_p = cJSON_GetObjectItem(j, "train_length")) != NULL)
+	    test->train_length = j_p->valueint;
 	if ((j_p = cJSON_GetObjectItem(j, "pacing_timer")) != NULL)
 	    test->settings->pacing_timer = j_p->valueint;
 	if ((j_p = cJSON_GetObjectItem(j, "burst")) != NULL)
@@ -2331,6 +3045,51 @@ get_parameters(struct iperf_test *test)
 
 /*************************************************************/
 
+/*
+ * The view of a stream's sending or receiving end, as JSON.
+ */
+static cJSON *
+tcp_extra_json(const struct iperf_tcp_extra *x, int sender)
+{
+    if (sender)
+	return iperf_json_printf("lost: %d  dsack_dups: %d  delivery_bits_per_second: %d  bytes_retrans: %d  segs_out: %d  segs_in: %d",
+				 x->lost, x->dsack_dups, x->delivery_rate * 8, x->bytes_retrans, x->segs_out, x->segs_in);
+    return iperf_json_printf("rcv_rtt: %d  rcv_space: %d  rcv_ooopack: %d  reordering: %d  segs_out: %d  segs_in: %d",
+			     x->rcv_rtt, x->rcv_space, x->rcv_ooopack, x->reordering, x->segs_out, x->segs_in);
+}
+
+/*
+ * Take the other end's view from its results.
+ */
+static void
+tcp_extra_from_json(struct iperf_tcp_extra *x, cJSON *j)
+{
+    static const struct { const char *name; size_t offset; } fields[] = {
+	{ "rcv_rtt", offsetof(struct iperf_tcp_extra, rcv_rtt) },
+	{ "rcv_space", offsetof(struct iperf_tcp_extra, rcv_space) },
+	{ "rcv_ooopack", offsetof(struct iperf_tcp_extra, rcv_ooopack) },
+	{ "reordering", offsetof(struct iperf_tcp_extra, reordering) },
+	{ "lost", offsetof(struct iperf_tcp_extra, lost) },
+	{ "dsack_dups", offsetof(struct iperf_tcp_extra, dsack_dups) },
+	{ "bytes_retrans", offsetof(struct iperf_tcp_extra, bytes_retrans) },
+	{ "segs_out", offsetof(struct iperf_tcp_extra, segs_out) },
+	{ "segs_in", offsetof(struct iperf_tcp_extra, segs_in) },
+    };
+    cJSON *j_v;
+    size_t i;
+
+    memset(x, 0, sizeof(*x));
+    for (i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i)
+	if ((j_v = cJSON_GetObjectItem(j, fields[i].name)) != NULL)
+	    *(int64_t *) ((char *) x + fields[i].offset) = j_v->valuedouble;
+    /* Sent in bits/sec, like the other rates */
+    if ((j_v = cJSON_GetObjectItem(j, "delivery_bits_per_second")) != NULL)
+	x->delivery_rate = j_v->valuedouble / 8;
+    x->valid = 1;
+}
+
+/*************************************************************/
+
 static int
 send_results(struct iperf_test *test)
 {
@@ -2339,10 +3098,12 @@ send_results(struct iperf_test *test)
     cJSON *j_streams;
     struct iperf_stream *sp;
     cJSON *j_stream;
+    cJSON *j_hist;
     int sender_has_retransmits;
     iperf_size_t bytes_transferred;
     int retransmits;
     struct iperf_time temp_time;
+    struct iperf_tcp_extra tcp_extra;
     double start_time, end_time;
 
     j = cJSON_CreateObject();
@@ -2361,6 +3122,11 @@ send_results(struct iperf_test *test)
 	if ( test->congestion_used ) {
 	    cJSON_AddStringToObject(j, "congestion_used", test->congestion_used);
 	}
+	/* The receiver of packet trains has the samples; pass on the estimates */
+	if (test->train && test->train->samples) {
+	    iperf_train_analyze(test);
+	    cJSON_AddItemToObject(j, "train", iperf_train_results_json(test));
+	}
 
 	/* If on the server and sending server output, then do this */
 	if (test->role == 's' && test->get_server_output) {
@@ -2418,6 +3184,20 @@ send_results(struct iperf_test *test)
 		    end_time = iperf_time_in_secs(&temp_time);
 		    cJSON_AddNumberToObject(j_stream, "start_time", start_time);
 		    cJSON_AddNumberToObject(j_stream, "end_time", end_time);
+		    if (!sp->sender && sp->owd_total != NULL) {
+			iperf_owd_summarize(sp);
+			cJSON_AddItemToObject(j_stream, "owd", iperf_json_printf("packets: %d  min_ms: %f  avg_ms: %f  max_ms: %f  p99_ms: %f", (int64_t) sp->owd_count, sp->owd_min, sp->owd_avg, sp->owd_max, sp->owd_p99));
+		    }
+		    if (test->histograms && (j_hist = iperf_latency_results_json(sp)) != NULL)
+			cJSON_AddItemToObject(j_stream, "histograms", j_hist);
+		    if (test->loss_stats && sp->seq != NULL) {
+			iperf_seq_summarize(sp);
+			cJSON_AddItemToObject(j_stream, "sequence", iperf_seq_results_json(sp));
+		    }
+		    if (test->protocol->id == Ptcp && sp->result->tcp_extra.valid) {
+			tcp_extra_since(sp->result, &tcp_extra);
+			cJSON_AddItemToObject(j_stream, "tcp_info", tcp_extra_json(&tcp_extra, sp->sender));
+		    }
 
 		}
 	    }
@@ -2460,6 +3240,7 @@ get_results(struct iperf_test *test)
     cJSON *j_packets;
     cJSON *j_server_output;
     cJSON *j_start_time, *j_end_time;
+    cJSON *j_p;
     int sid, cerror, pcount;
     double jitter;
     iperf_size_t bytes_transferred;
@@ -2532,7 +3313,26 @@ get_results(struct iperf_test *test)
 				i_errno = IESTREAMID;
 				r = -1;
 			    } else {
+				if ((j_p = cJSON_GetObjectItem(j_stream, "histograms")) != NULL)
+				    iperf_latency_results_from_json(sp, j_p);
+				if ((j_p = cJSON_GetObjectItem(j_stream, "tcp_info")) != NULL)
+				    tcp_extra_from_json(&sp->result->peer_tcp_extra, j_p);
 				if (sp->sender) {
+				    if ((j_p = cJSON_GetObjectItem(j_stream, "sequence")) != NULL)
+					iperf_seq_results_from_json(sp, j_p);
+				    if ((j_p = cJSON_GetObjectItem(j_stream, "owd")) != NULL) {
+					cJSON *j_v;
+					if ((j_v = cJSON_GetObjectItem(j_p, "packets")) != NULL)
+					    sp->owd_count = j_v->valueint;
+					if ((j_v = cJSON_GetObjectItem(j_p, "min_ms")) != NULL)
+					    sp->owd_min = j_v->valuedouble;
+					if ((j_v = cJSON_GetObjectItem(j_p, "avg_ms")) != NULL)
+					    sp->owd_avg = j_v->valuedouble;
+					if ((j_v = cJSON_GetObjectItem(j_p, "max_ms")) != NULL)
+					    sp->owd_max = j_v->valuedouble;
+					if ((j_v = cJSON_GetObjectItem(j_p, "p99_ms")) != NULL)
+					    sp->owd_p99 = j_v->valuedouble;
+				    }
 				    sp->jitter = jitter;
 				    sp->cnt_error = cerror;
 				    sp->peer_packet_count = pcount;
@@ -2567,6 +3367,8 @@ get_results(struct iperf_test *test)
 			}
 		    }
 		}
+		if ((j_p = cJSON_GetObjectItem(j, "train")) != NULL)
+		    iperf_train_results_from_json(test, j_p);
 		/*
 		 * If we're the client and we're supposed to get remote results,
 		 * look them up and process accordingly.
@@ -2750,6 +3552,15 @@ iperf_new_test()
     }
     memset(test->bitrate_limit_intervals_traffic_bytes, 0, sizeof(sizeof(iperf_size_t) * MAX_INTERVAL));
 
+    test->timers = tmr_queue_new();
+    if (!test->timers) {
+        free(test->bitrate_limit_intervals_traffic_bytes);
+        free(test->settings);
+        free(test);
+	i_errno = IENEWTEST;
+	return NULL;
+    }
+
     /* By default all output goes to stdout */
     test->outfile = stdout;
 
@@ -2823,6 +3634,15 @@ iperf_defaults(struct iperf_test *testp)
     testp->settings->bitrate_limit_stats_per_interval = 0;
     testp->settings->fqrate = 0;
     testp->settings->pacing_timer = DEFAULT_PACING_TIMER;
+    testp->rate_control = RATE_CONTROL_NONE;
+    testp->target_loss = DEFAULT_TARGET_LOSS;
+    testp->train_length = DEFAULT_TRAIN_LENGTH;
+    testp->rr_request = testp->rr_response = DEFAULT_RR_SIZE;
+    testp->rr_depth = DEFAULT_RR_DEPTH;
+    testp->linger = -1;
+    testp->trace_records = DEFAULT_TRACE_RECORDS;
+    testp->crr_listener = -1;
+    testp->diag_fd = -1;
     testp->settings->burst = 0;
     testp->settings->mss = 0;
     testp->settings->bytes = 0;
@@ -2910,12 +3730,21 @@ iperf_free_test(struct iperf_test *test)
     struct protocol *prot;
     struct iperf_stream *sp;
 
+    /* What is left of the samples goes out with the streams' rings */
+    iperf_tcpsample_close(test);
+    iperf_diag_close(test);
+    iperf_queues_close(test);
+    iperf_place_stop(test);
+
     /* Free streams */
     while (!SLIST_EMPTY(&test->streams)) {
         sp = SLIST_FIRST(&test->streams);
         SLIST_REMOVE_HEAD(&test->streams, streams);
         iperf_free_stream(sp);
     }
+    iperf_rr_free(test);
+    iperf_probe_free(test);
+    iperf_trace_close(test);
     if (test->server_hostname)
 	free(test->server_hostname);
     if (test->tmp_template)
@@ -2962,6 +3791,11 @@ iperf_free_test(struct iperf_test *test)
 	free(test->title);
     if (test->extra_data)
 	free(test->extra_data);
+    iperf_search_free(test->search);
+    iperf_train_free(test);
+    iperf_histogram_free(test->hist_sum);
+    free(test->place_cpus);
+    free(test->place_peer_cpus);
     if (test->congestion)
 	free(test->congestion);
     if (test->congestion_used)
@@ -2978,6 +3812,7 @@ iperf_free_test(struct iperf_test *test)
 	tmr_cancel(test->stats_timer);
     if (test->reporter_timer != NULL)
 	tmr_cancel(test->reporter_timer);
+    tmr_queue_free(test->timers);
 
     /* Free protocol list */
     while (!SLIST_EMPTY(&test->protocols)) {
@@ -2992,6 +3827,11 @@ iperf_free_test(struct iperf_test *test)
         iperf_close_logfile(test);
     }
 
+    free(test->trace_file);
+    test->trace_file = NULL;
+    free(test->tcp_sample_file);
+    test->tcp_sample_file = NULL;
+
     if (test->server_output_text) {
 	free(test->server_output_text);
 	test->server_output_text = NULL;
@@ -3042,6 +3882,10 @@ iperf_reset_test(struct iperf_test *test)
     int i;
 
     iperf_close_logfile(test);
+    iperf_tcpsample_close(test);
+    iperf_diag_close(test);
+    iperf_queues_close(test);
+    iperf_place_stop(test);
 
     /* Free streams */
     while (!SLIST_EMPTY(&test->streams)) {
@@ -3065,6 +3909,7 @@ iperf_reset_test(struct iperf_test *test)
 	tmr_cancel(test->reporter_timer);
 	test->reporter_timer = NULL;
     }
+    iperf_train_free(test);
     test->done = 0;
 
     SLIST_INIT(&test->streams);
@@ -3119,6 +3964,46 @@ iperf_reset_test(struct iperf_test *test)
     test->settings->tos = 0;
     test->settings->dont_fragment = 0;
     test->zerocopy = 0;
+    test->rate_control = RATE_CONTROL_NONE;
+    test->target_loss = DEFAULT_TARGET_LOSS;
+    test->trains = 0;
+    test->train_length = DEFAULT_TRAIN_LENGTH;
+    test->owd = 0;
+    memset(test->owd_sync, 0, sizeof(test->owd_sync));
+    test->histograms = 0;
+    test->rr = 0;
+    test->rr_request = test->rr_response = DEFAULT_RR_SIZE;
+    test->rr_depth = DEFAULT_RR_DEPTH;
+    test->rr_connect = 0;
+    test->rr_rate = 0;
+    test->rr_poisson = 0;
+    test->fastopen = 0;
+    test->echo = 0;
+    test->loss_stats = 0;
+    test->probe_interval = 0;
+    test->probe_streams = 0;
+    test->tcp_sample_usecs = 0;
+    test->bottleneck = 0;
+    test->diag = 0;
+    test->queue_interval = 0;
+    test->notsent_lowat = 0;
+    test->tx_timestamps = 0;
+    test->rcv_drain = 0;
+    test->rcvlowat = 0;
+    test->discard = 0;
+    test->rx_timestamps = 0;
+    test->busy_poll = 0;
+    test->prefer_busy_poll = 0;
+    test->busy_poll_budget = 0;
+    test->place = 0;
+    free(test->place_cpus);
+    test->place_cpus = NULL;
+    free(test->place_peer_cpus);
+    test->place_peer_cpus = NULL;
+    iperf_probe_free(test);
+    iperf_trace_close(test);
+    test->linger = -1;
+    iperf_rr_free(test);
 
 #if defined(HAVE_SSL)
     if (test->settings->authtoken) {
@@ -3184,14 +4069,38 @@ iperf_reset_stats(struct iperf_test *test)
         rp->bytes_sent_omit = rp->bytes_sent;
         rp->bytes_received = 0;
         rp->bytes_sent_this_interval = rp->bytes_received_this_interval = 0;
-	if (test->sender_has_retransmits == 1) {
+	if (test->protocol->id == Ptcp && has_tcpinfo()) {
 	    struct iperf_interval_results ir; /* temporary results structure */
 	    save_tcpinfo(sp, &ir);
-	    rp->stream_prev_total_retrans = get_total_retransmits(&ir);
+	    if (test->sender_has_retransmits == 1)
+		rp->stream_prev_total_retrans = get_total_retransmits(&ir);
+	    get_tcp_extra(&ir, &rp->tcp_extra_base);
 	}
 	rp->stream_retrans = 0;
 	rp->start_time = now;
-    }
+	sp->rr_transactions = 0;
+	sp->rr_offered = 0;
+    }
+    if (test->echo)
+	iperf_echo_reset(test);
+    if (test->loss_stats)
+	iperf_seq_reset(test);
+    if (test->probe)
+	iperf_probe_reset(test);
+    if (test->histograms)
+	iperf_latency_reset(test);
+    if (test->tcp_sample_usecs)
+	iperf_tcpsample_reset(test);
+    if (test->queue_interval)
+	iperf_queues_reset(test);
+    if (test->tx_timestamps)
+	iperf_txstamp_reset(test);
+    if (test->rcv_drain || test->rcvlowat)
+	iperf_drain_reset(test);
+    if (test->rx_timestamps)
+	iperf_rxstamp_reset(test);
+    if (test->busy_poll)
+	iperf_busypoll_reset(test);
 }
 
 
@@ -3211,6 +4120,11 @@ iperf_stats_callback(struct iperf_test *test)
     iperf_size_t total_interval_bytes_transferred = 0;
 
     temp.omitted = test->omitting;
+    /* Every stream's TCP_INFO in one netlink dump, rather than one getsockopt() each */
+    if (test->diag)
+	iperf_diag_collect(test);
+    if (test->place)
+	iperf_place_interval(test);
     SLIST_FOREACH(sp, &test->streams, streams) {
         rp = sp->result;
 	temp.bytes_transferred = sp->sender ? rp->bytes_sent_this_interval : rp->bytes_received_this_interval;
@@ -3231,7 +4145,9 @@ iperf_stats_callback(struct iperf_test *test)
         temp.interval_duration = iperf_time_in_secs(&temp_time);
 	if (test->protocol->id == Ptcp) {
 	    if ( has_tcpinfo()) {
-		save_tcpinfo(sp, &temp);
+		if (!test->diag || iperf_diag_tcpinfo(sp, &temp) < 0)
+		    save_tcpinfo(sp, &temp);
+		get_tcp_extra(&temp, &rp->tcp_extra);
 		if (test->sender_has_retransmits == 1) {
 		    long total_retrans = get_total_retransmits(&temp);
 		    temp.interval_retrans = total_retrans - rp->stream_prev_total_retrans;
@@ -3262,6 +4178,8 @@ iperf_stats_callback(struct iperf_test *test)
 		    temp.rttvar = get_rttvar(&temp);
 		    temp.pmtu = get_pmtu(&temp);
 		}
+		if (test->bottleneck && sp->sender)
+		    iperf_bottleneck_interval(sp, &temp);
 	    }
 	} else {
 	    if (irp == NULL) {
@@ -3275,9 +4193,24 @@ iperf_stats_callback(struct iperf_test *test)
 	    }
 	    temp.packet_count = sp->packet_count;
 	    temp.jitter = sp->jitter;
+	    iperf_owd_interval(sp, &temp);
 	    temp.outoforder_packets = sp->outoforder_packets;
 	    temp.cnt_error = sp->cnt_error;
 	}
+	if (test->histograms)
+	    iperf_latency_interval(sp);
+	iperf_tcpsample_interval(sp, &temp);
+	if (test->queue_interval)
+	    iperf_queues_interval(sp, &temp);
+	if (test->tx_timestamps)
+	    iperf_txstamp_interval(sp);
+	if (test->rcv_drain || test->rcvlowat)
+	    iperf_drain_interval(sp, &temp);
+	if (test->rx_timestamps)
+	    iperf_rxstamp_interval(sp, &temp);
+	iperf_rr_interval(sp, &temp);
+	if (test->echo)
+	    iperf_echo_interval(sp, &temp);
         add_to_interval_list(rp, &temp);
         rp->bytes_sent_this_interval = rp->bytes_received_this_interval = 0;
     }
@@ -3286,6 +4219,13 @@ iperf_stats_callback(struct iperf_test *test)
     if (test->role == 's') {
 	iperf_check_total_rate(test, total_interval_bytes_transferred);
     }
+
+    /* Tell the sender what arrived so it can steer its rate */
+    if (test->rate_control && test->protocol->id == Pudp &&
+	test->state == TEST_RUNNING && !test->done) {
+	if (iperf_udp_send_feedback(test) < 0)
+	    iperf_err(test, "unable to send rate control feedback: %s", iperf_strerror(i_errno));
+    }
 }
 
 /**
@@ -3502,9 +4442,74 @@ iperf_print_intermediate(struct iperf_test *test)
                             iperf_printf(test, report_sum_bw_udp_format, mbuf, start_time, end_time, ubuf, nbuf, avg_jitter * 1000.0, lost_packets, total_packets, lost_percent, test->omitting?report_omitted:"");
                     }
                 }
+                if (test->rr)
+                    iperf_rr_print_interval_sum(test, stream_must_be_sender, json_interval == NULL ? NULL : cJSON_GetObjectItem(json_interval, sum_name), mbuf, start_time, end_time);
+                if (test->echo)
+                    iperf_echo_print_interval_sum(test, stream_must_be_sender, json_interval == NULL ? NULL : cJSON_GetObjectItem(json_interval, sum_name), mbuf, start_time, end_time);
+                if (test->histograms)
+                    iperf_latency_print_interval_sum(test, stream_must_be_sender, json_interval == NULL ? NULL : cJSON_GetObjectItem(json_interval, sum_name), mbuf, start_time, end_time);
             }
         }
     }
+
+    /* The probe connection is no stream, so it is in none of the sums above */
+    if (test->probe)
+        iperf_probe_print_interval(test, json_interval);
+}
+
+/* One end's TCP_INFO figures for a stream's summary: this end's, or the other's from its results */
+static void
+print_tcp_extra_results(struct iperf_test *test, struct iperf_stream *sp, cJSON *json_summary_stream, const char *mbuf, int sender)
+{
+    struct iperf_tcp_extra x;
+    cJSON *j_end;
+
+    if (test->protocol->id != Ptcp)
+	return;
+    if (sp->sender == sender)
+	tcp_extra_since(sp->result, &x);
+    else
+	x = sp->result->peer_tcp_extra;
+    if (!x.valid)
+	return;
+    if (test->json_output) {
+	j_end = json_summary_stream == NULL ? NULL : cJSON_GetObjectItem(json_summary_stream, sender ? "sender" : "receiver");
+	if (j_end != NULL)
+	    cJSON_AddItemToObject(j_end, "tcp_info", tcp_extra_json(&x, sender));
+    } else if (test->verbose)
+	print_tcp_extra(test, sp->socket, mbuf, &x, sender);
+}
+
+/**
+ * Print the CPU time the test cost per Gbit/s moved, here and at the
+ * peer, to compare receive modes (--discard) by.  A stream moved what
+ * its receiver counted, or failing that what was sent.
+ */
+static void
+print_cpu_per_gbit(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_time temp_time;
+    iperf_size_t bytes = 0;
+    double secs = 0.0, d, gbps;
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+        if (sp->result->bytes_received)
+            bytes += sp->result->bytes_received;
+        else
+            bytes += sp->result->bytes_sent - sp->result->bytes_sent_omit;
+        iperf_time_diff(&sp->result->start_time, &sp->result->end_time, &temp_time);
+        d = iperf_time_in_secs(&temp_time);
+        if (d > secs)
+            secs = d;
+    }
+    if (bytes == 0 || secs <= 0.0)
+        return;
+    gbps = bytes * 8 / secs / 1e9;
+    if (test->json_output)
+        cJSON_AddItemToObject(test->json_end, "cpu_percent_per_gbps", iperf_json_printf("host_total: %f  remote_total: %f  gbps: %f  discard: %b", test->cpu_util[0] / gbps, test->remote_cpu_util[0] / gbps, gbps, test->discard));
+    else
+        iperf_printf(test, report_cpu_per_gbit, test->cpu_util[0] / gbps, test->remote_cpu_util[0] / gbps, gbps, test->discard ? report_cpu_discard : "");
 }
 
 /**
@@ -3721,6 +4726,7 @@ iperf_print_results(struct iperf_test *test)
                                 iperf_printf(test, report_bw_format, sp->socket, mbuf, start_time, sender_time, ubuf, nbuf, report_sender);
                             }
                     }
+                    print_tcp_extra_results(test, sp, json_summary_stream, mbuf, 1);
                 } else {
                     /* Sender summary, UDP. */
                     if (sender_packet_count - sp->omitted_packet_count > 0) {
@@ -3811,6 +4817,7 @@ iperf_print_results(struct iperf_test *test)
                         else {
                             iperf_printf(test, report_bw_format, sp->socket, mbuf, start_time, receiver_time, ubuf, nbuf, report_receiver);
                         }
+                    print_tcp_extra_results(test, sp, json_summary_stream, mbuf, 0);
                 }
                 else {
                     /*
@@ -3968,6 +4975,8 @@ iperf_print_results(struct iperf_test *test)
 
         if (test->json_output && current_mode == upper_mode) {
             cJSON_AddItemToObject(test->json_end, "cpu_utilization_percent", iperf_json_printf("host_total: %f  host_user: %f  host_system: %f  remote_total: %f  remote_user: %f  remote_system: %f", (double) test->cpu_util[0], (double) test->cpu_util[1], (double) test->cpu_util[2], (double) test->remote_cpu_util[0], (double) test->remote_cpu_util[1], (double) test->remote_cpu_util[2]));
+            if (test->verbose || test->discard)
+                print_cpu_per_gbit(test);
             if (test->protocol->id == Ptcp) {
                 char *snd_congestion = NULL, *rcv_congestion = NULL;
                 if (stream_must_be_sender) {
@@ -4013,6 +5022,8 @@ iperf_print_results(struct iperf_test *test)
                     }
                 }
             }
+            if (!test->json_output && current_mode == upper_mode && (test->verbose || test->discard))
+                print_cpu_per_gbit(test);
 
             /* Print server output if we're on the client and it was requested/provided */
             if (test->role == 'c' && iperf_get_test_get_server_output(test) && !test->json_output) {
@@ -4031,6 +5042,77 @@ iperf_print_results(struct iperf_test *test)
         }
     }
 
+    if (test->search && test->role == 'c')
+        iperf_search_print_results(test);
+
+    if (test->train)
+        iperf_train_print_results(test);
+
+    if (test->owd)
+        iperf_owd_print_results(test);
+
+    if (test->rr)
+        iperf_rr_print_results(test);
+
+    if (test->echo)
+        iperf_echo_print_results(test);
+
+    if (test->loss_stats)
+        iperf_seq_print_results(test);
+
+    if (test->probe)
+        iperf_probe_print_results(test);
+
+    if (test->histograms)
+        iperf_latency_print_results(test);
+
+    if (test->tcp_sample_usecs)
+        iperf_tcpsample_print_results(test);
+
+    if (test->bottleneck)
+        iperf_bottleneck_print_results(test);
+
+    if (test->queue_interval)
+        iperf_queues_print_results(test);
+
+    if (test->tx_timestamps)
+        iperf_txstamp_print_results(test);
+
+    if (test->rcv_drain || test->rcvlowat)
+        iperf_drain_print_results(test);
+
+    if (test->rx_timestamps)
+        iperf_rxstamp_print_results(test);
+
+    if (test->busy_poll)
+        iperf_busypoll_print_results(test);
+
+    if (test->place)
+        iperf_place_print_results(test);
+
+    if (test->diag)
+        iperf_diag_print_results(test);
+
+    /* Where the closed-loop rate controller ended up on our sending streams */
+    if (test->rate_control) {
+        struct iperf_stream *sp;
+        uint64_t final_rate = 0;
+        const char *algorithm = test->rate_control == RATE_CONTROL_PID ? "pid" : "aimd";
+        char nbuf[UNIT_LEN];
+
+        SLIST_FOREACH(sp, &test->streams, streams)
+            if (sp->sender)
+                final_rate += sp->target;
+        if (final_rate > 0) {
+            if (test->json_output)
+                cJSON_AddItemToObject(test->json_end, "rate_control", iperf_json_printf("algorithm: %s  target_loss: %f  final_bitrate: %d", algorithm, test->target_loss, (int64_t) final_rate));
+            else {
+                unit_snprintf(nbuf, UNIT_LEN, (double) final_rate / 8, test->settings->unit_format);
+                iperf_printf(test, report_rate_control_summary, algorithm, nbuf, test->target_loss);
+            }
+        }
+    }
+
     /* Set real sender_has_retransmits for current side */
     if (test->mode == BIDIRECTIONAL)
         test->sender_has_retransmits = tmp_sender_has_retransmits;
@@ -4079,6 +5161,7 @@ print_interval_results(struct iperf_test *test, struct iperf_stream *sp, cJSON *
     struct iperf_time temp_time;
     struct iperf_interval_results *irp = NULL;
     double bandwidth, lost_percent;
+    cJSON *json_last = NULL;
 
     if (test->mode == BIDIRECTIONAL) {
         sprintf(mbuf, "[%s-%s]", sp->sender?"TX":"RX", test->role == 'c'?"C":"S");
@@ -4172,13 +5255,44 @@ print_interval_results(struct iperf_test *test, struct iperf_stream *sp, cJSON *
 	    else {
 		lost_percent = 0.0;
 	    }
-	    if (test->json_output)
-		cJSON_AddItemToArray(json_interval_streams, iperf_json_printf("socket: %d  start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  jitter_ms: %f  lost_packets: %d  packets: %d  lost_percent: %f  omitted: %b sender: %b", (int64_t) sp->socket, (double) st, (double) et, (double) irp->interval_duration, (int64_t) irp->bytes_transferred, bandwidth * 8, (double) irp->jitter * 1000.0, (int64_t) irp->interval_cnt_error, (int64_t) irp->interval_packet_count, (double) lost_percent, irp->omitted, sp->sender));
-	    else
+	    if (test->json_output) {
+		cJSON *json_stream = iperf_json_printf("socket: %d  start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  jitter_ms: %f  lost_packets: %d  packets: %d  lost_percent: %f  omitted: %b sender: %b", (int64_t) sp->socket, (double) st, (double) et, (double) irp->interval_duration, (int64_t) irp->bytes_transferred, bandwidth * 8, (double) irp->jitter * 1000.0, (int64_t) irp->interval_cnt_error, (int64_t) irp->interval_packet_count, (double) lost_percent, irp->omitted, sp->sender);
+		if (json_stream != NULL && irp->owd_count > 0)
+		    cJSON_AddItemToObject(json_stream, "owd", iperf_json_printf("min_ms: %f  avg_ms: %f  max_ms: %f  p99_ms: %f", irp->owd_min, irp->owd_avg, irp->owd_max, irp->owd_p99));
+		cJSON_AddItemToArray(json_interval_streams, json_stream);
+	    }
+	    else {
 		iperf_printf(test, report_bw_udp_format, sp->socket, mbuf, st, et, ubuf, nbuf, irp->jitter * 1000.0, irp->interval_cnt_error, irp->interval_packet_count, lost_percent, irp->omitted?report_omitted:"");
+		if (irp->owd_count > 0)
+		    iperf_printf(test, report_owd_interval, sp->socket, mbuf, st, et, irp->owd_min, irp->owd_avg, irp->owd_max, irp->owd_p99);
+	    }
 	}
     }
 
+    /* Transactions and percentiles go with the stream's line, or into the object just added */
+    if (json_interval_streams != NULL)
+	json_last = cJSON_GetArrayItem(json_interval_streams, cJSON_GetArraySize(json_interval_streams) - 1);
+    if (test->rr)
+	iperf_rr_print_interval(sp, irp, json_last, mbuf, st, et);
+    if (test->echo)
+	iperf_echo_print_interval(sp, irp, json_last, mbuf, st, et);
+    if (test->histograms)
+	iperf_latency_print_interval(sp, json_last, mbuf, st, et);
+    if (test->tcp_sample_usecs)
+	iperf_tcpsample_print_interval(sp, irp, json_last, mbuf, st, et);
+    if (test->bottleneck && sp->sender)
+	iperf_bottleneck_print_interval(sp, irp, json_last, mbuf, st, et);
+    if (test->queue_interval)
+	iperf_queues_print_interval(sp, irp, json_last, mbuf, st, et);
+    if (test->tx_timestamps)
+	iperf_txstamp_print_interval(sp, json_last, mbuf, st, et);
+    if (test->rcv_drain || test->rcvlowat)
+	iperf_drain_print_interval(sp, irp, json_last, mbuf, st, et);
+    if (test->rx_timestamps)
+	iperf_rxstamp_print_interval(sp, irp, json_last, mbuf, st, et);
+    if (test->diag)
+	iperf_diag_print_interval(sp, json_last, mbuf, st, et);
+
     if (test->logfile || test->forceflush)
         iflush(test);
 }
@@ -4201,6 +5315,14 @@ iperf_free_stream(struct iperf_stream *sp)
     free(sp->result);
     if (sp->send_timer != NULL)
 	tmr_cancel(sp->send_timer);
+    iperf_owd_free_stream(sp);
+    iperf_latency_free_stream(sp);
+    iperf_rr_free_stream(sp);
+    iperf_seq_free_stream(sp);
+    iperf_tcpsample_free_stream(sp);
+    iperf_diag_free_stream(sp);
+    iperf_txstamp_free_stream(sp);
+    iperf_rxstamp_free_stream(sp);
     free(sp);
 }
 
@@ -4554,6 +5676,9 @@ iperf_catch_sigend(void (*handler)(int))
 void
 iperf_got_sigend(struct iperf_test *test)
 {
+    /* The --place threads first, so what is dumped stands still */
+    iperf_place_stop(test);
+
     /*
      * If we're the client, or if we're a server and running a test,
      * then dump out the accumulated stats so far.
@@ -44,6 +44,9 @@ struct iperf_stream_result;
 struct iperf_interval_results;
 struct iperf_stream;
 struct iperf_time;
+struct iperf_tcp_sample;
+struct iperf_limited;
+struct iperf_tcp_extra;
 
 #if !defined(__IPERF_H)
 typedef uint64_t iperf_size_t;
@@ -90,6 +93,43 @@ typedef uint64_t iperf_size_t;
 #define OPT_DONT_FRAGMENT 26
 #define OPT_RCV_TIMEOUT 27
 #define OPT_SND_TIMEOUT 28
+#define OPT_CLOCK 29
+#define OPT_RATE_CONTROL 30
+#define OPT_TARGET_LOSS 31
+#define OPT_SEARCH 32
+#define OPT_SEARCH_SIZES 33
+#define OPT_TRIAL_TIME 34
+#define OPT_TRAINS 35
+#define OPT_OWD 36
+#define OPT_HISTOGRAMS 37
+#define OPT_RR 38
+#define OPT_RR_DEPTH 39
+#define OPT_CRR 40
+#define OPT_FASTOPEN 41
+#define OPT_LINGER 42
+#define OPT_ECHO 43
+#define OPT_PROBE 44
+#define OPT_PROBE_STREAMS 45
+#define OPT_RR_RATE 46
+#define OPT_RR_ARRIVALS 47
+#define OPT_LOSS_STATS 48
+/* Past the characters getopt_long returns for short options, such as -1, -4 and -6 */
+#define OPT_TRACE 128
+#define OPT_TRACE_RECORDS 129
+#define OPT_TCP_SAMPLE 130
+#define OPT_TCP_SAMPLE_FILE 131
+#define OPT_BOTTLENECK 132
+#define OPT_DIAG 133
+#define OPT_QUEUES 134
+#define OPT_NOTSENT_LOWAT 135
+#define OPT_TX_TIMESTAMPS 136
+#define OPT_RCV_DRAIN 137
+#define OPT_RCVLOWAT 138
+#define OPT_DISCARD 139
+#define OPT_RX_TIMESTAMPS 140
+#define OPT_BUSY_POLL 141
+#define OPT_PREFER_BUSY_POLL 142
+#define OPT_PLACE 143
 
 /* states */
 #define TEST_START 1
@@ -108,6 +148,8 @@ typedef uint64_t iperf_size_t;
 #define DISPLAY_RESULTS 14
 #define IPERF_START 15
 #define IPERF_DONE 16
+#define UDP_FEEDBACK 17 /* receiver report for --rate-control, not a state */
+#define UDP_FEEDBACK_REQUEST 18 /* ask the receiver for a UDP_FEEDBACK now */
 #define ACCESS_DENIED (-1)
 #define SERVER_ERROR (-2)
 
@@ -299,6 +341,13 @@ long get_total_retransmits(struct iperf_interval_results *irp);
 long get_snd_cwnd(struct iperf_interval_results *irp);
 long get_snd_wnd(struct iperf_interval_results *irp);
 long get_rtt(struct iperf_interval_results *irp);
+long get_rtt_now(struct iperf_stream *sp);
+int sample_tcpinfo(struct iperf_stream *sp, struct iperf_tcp_sample *s);
+int get_limited(struct iperf_interval_results *irp, struct iperf_limited *l);
+long get_min_rtt(struct iperf_interval_results *irp);
+int get_tcp_extra(struct iperf_interval_results *irp, struct iperf_tcp_extra *x);
+void tcp_extra_since(struct iperf_stream_result *rp, struct iperf_tcp_extra *x);
+void print_tcp_extra(struct iperf_test *test, int socket, const char *mbuf, const struct iperf_tcp_extra *x, int sender);
 long get_rttvar(struct iperf_interval_results *irp);
 long get_pmtu(struct iperf_interval_results *irp);
 void print_tcpinfo(struct iperf_test *test);
@@ -401,6 +450,33 @@ enum {
     IERCVTIMEOUT = 31,      // Illegal message receive timeout
     IERVRSONLYRCVTIMEOUT = 32,  // Client receive timeout is valid only in reverse mode
     IESNDTIMEOUT = 33,      // Illegal message send timeout
+    IECLOCK = 34,           // Unknown clock source
+    IERATECONTROL = 35,     // Rate control requires UDP
+    IETARGETLOSS = 36,      // Invalid target loss
+    IESEARCH = 37,          // Bad search method or unsupported test for --search
+    IESEARCHBOUND = 38,     // Binary search without -b
+    IESEARCHSIZES = 39,     // Bad --search-sizes list
+    IETRIALTIME = 40,       // Bad --trial-time
+    IETRAIN = 41,           // Bad --trains or unsupported test for --trains
+    IEOWD = 42,             // One-way delay requires UDP
+    IEHISTOGRAMS = 43,      // Latency histograms require TCP or UDP
+    IEREQRESP = 44,         // Bad --rr or --rr-depth, or unsupported test for --rr
+    IECRR = 45,             // --fastopen or --linger without --crr, or no TCP Fast Open
+    IEECHO = 46,            // Unsupported test for --echo
+    IEPROBE = 47,           // Bad --probe interval, or --probe-streams without --probe and TCP, or with -R
+    IERRRATE = 48,          // Bad --rr-rate or --rr-arrivals, or unsupported test for them
+    IELOSSSTATS = 49,       // --loss-stats requires UDP
+    IETRACERECORDS = 50,    // Bad --trace-records, or no --trace
+    IETCPSAMPLE = 51,       // Bad --tcp-sample interval, not TCP, or a client --tcp-sample-file without it or with -R
+    IEBOTTLENECK = 52,      // --bottleneck requires TCP
+    IEDIAG = 53,            // --diag requires TCP
+    IEQUEUES = 54,          // Bad --queues interval, or not TCP or UDP
+    IETXSTAMP = 55,         // Bad --notsent-lowat or it without TCP, or --tx-timestamps without TCP or UDP
+    IERCVDRAIN = 56,        // Bad --rcv-drain or --rcvlowat, or not TCP
+    IEDISCARD = 57,         // --discard without TCP or UDP
+    IERXSTAMP = 58,         // Bad --rx-timestamps, or not UDP
+    IEBUSYPOLL = 59,        // Bad --busy-poll or --prefer-busy-poll, or not TCP or UDP
+    IEPLACE = 60,           // Bad --place CPU list, or stream threads with a mode that needs the main loop
     /* Test errors */
     IENEWTEST = 100,        // Unable to create a new test (check perror)
     IEINITTEST = 101,       // Test initialization failed (check perror)
@@ -451,6 +527,15 @@ enum {
     IEBINDDEVNOSUPPORT = 146,  // `ip%%dev` is not supported as system does not support bind to device
     IEHOSTDEV = 147,        // host device name (ip%%<dev>) is supported (and required) only for IPv6 link-local address
     IESETUSERTIMEOUT = 148, // Unable to set TCP USER_TIMEOUT (check perror)
+    IECLOCKSYNC = 149,      // Unable to exchange clock readings with the other side (check perror)
+    IEPROBECONNECT = 150,   // Unable to set up the --probe connection (check perror)
+    IETRACE = 151,          // Unable to create or map the --trace file (check perror)
+    IETCPSAMPLEFILE = 152,  // Unable to create the --tcp-sample-file (check perror)
+    IEDIAGSOCKET = 153,     // Unable to open or query a NETLINK_SOCK_DIAG socket (check perror)
+    IESETTXSTAMP = 154,     // Unable to set TCP_NOTSENT_LOWAT or SO_TIMESTAMPING (check perror)
+    IESETRCVDRAIN = 155,    // Unable to set SO_RCVLOWAT or TCP_INQ (check perror)
+    IESETRXSTAMP = 156,     // Unable to set SO_TIMESTAMPING for receiving (check perror)
+    IEPLACETHREAD = 157,    // Unable to start or pin a --place stream thread (check perror)
     /* Stream errors */
     IECREATESTREAM = 200,   // Unable to create a new stream (check herror/perror)
     IEINITSTREAM = 201,     // Unable to initialize stream (check herror/perror)
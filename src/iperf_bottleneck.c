@@ -0,0 +1,228 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_bottleneck.h"
+#include "iperf_locale.h"
+#include "iperf_util.h"
+#include "iperf_time.h"
+#include "units.h"
+#include "cjson.h"
+
+/*
+ * Sender attribution (--bottleneck).
+ *
+ * Linux times each TCP sender in three states while it has data to
+ * send: sending, held back by the receiver's window, and held back by
+ * the send buffer; the rest of the time it had nothing to send.
+ * tcpi_busy_time is the sum of the three, tcpi_rwnd_limited and
+ * tcpi_sndbuf_limited the last two.  At each interval the counters
+ * read for the interval report are differenced with the last ones, so
+ * each interval's time splits four ways:
+ *
+ *   cwnd         sending: as fast as congestion control let it, so the
+ *                network set the pace
+ *   rwnd         the receiver's window was full
+ *   sndbuf       the socket buffer was full of unacknowledged data
+ *   application  nothing queued: iperf (-b, or a slow CPU) set the pace
+ *
+ * The kernel keeps them in jiffies, so a short interval's shares are
+ * rough.  Where a window held a stream back for LIMITED_HINT_PERCENT
+ * of the test, the summary compares it with twice the bandwidth-delay
+ * product seen, the highest interval rate by the lowest RTT: twice,
+ * because the window held the rate it was seen at down, and the
+ * kernel spends part of a buffer on overhead.  A smaller window gets
+ * a -w to try.  A receive window already that big was full because
+ * the receiver did not read fast enough, and the summary says so.
+ * The rate is what the interval report measured, not tcpi_delivery_rate:
+ * that is one ACK's sample, taken over a burst, and on a fast path it
+ * can be many times what the stream actually moved.
+ */
+
+#define SHARE_CWND 0
+#define SHARE_RWND 1
+#define SHARE_SNDBUF 2
+#define SHARE_APP 3
+#define SHARES 4
+
+static const char *share_names[SHARES] = { "cwnd", "rwnd", "sndbuf", "application" };
+
+static void
+shares(const struct iperf_limited *l, double pct[SHARES])
+{
+    uint64_t busy = l->busy < l->elapsed ? l->busy : l->elapsed;
+    uint64_t held = l->rwnd + l->sndbuf;
+
+    if (l->elapsed == 0) {
+	memset(pct, 0, SHARES * sizeof(double));
+	return;
+    }
+    pct[SHARE_CWND] = busy > held ? 100.0 * (busy - held) / l->elapsed : 0.0;
+    pct[SHARE_RWND] = 100.0 * l->rwnd / l->elapsed;
+    pct[SHARE_SNDBUF] = 100.0 * l->sndbuf / l->elapsed;
+    pct[SHARE_APP] = 100.0 * (l->elapsed - busy) / l->elapsed;
+}
+
+void
+iperf_bottleneck_interval(struct iperf_stream *sp, struct iperf_interval_results *irp)
+{
+    struct iperf_limited now;
+    double rate;
+    long rtt, wnd;
+
+    memset(&irp->limited, 0, sizeof(irp->limited));
+    if (get_limited(irp, &now) < 0)
+	return;
+    irp->limited.busy = now.busy - sp->limited_prev.busy;
+    irp->limited.rwnd = now.rwnd - sp->limited_prev.rwnd;
+    irp->limited.sndbuf = now.sndbuf - sp->limited_prev.sndbuf;
+    irp->limited.elapsed = irp->interval_duration * 1000000.0;
+    sp->limited_prev = now;
+    if (!irp->omitted) {
+	sp->limited_total.busy += irp->limited.busy;
+	sp->limited_total.rwnd += irp->limited.rwnd;
+	sp->limited_total.sndbuf += irp->limited.sndbuf;
+	sp->limited_total.elapsed += irp->limited.elapsed;
+    }
+
+    if (!irp->omitted && irp->interval_duration > 0) {
+	rate = irp->bytes_transferred / irp->interval_duration;
+	if (rate > sp->max_rate)
+	    sp->max_rate = rate;
+    }
+    if ((rtt = get_min_rtt(irp)) <= 0)
+	rtt = get_rtt(irp);
+    if (rtt > 0 && (sp->min_rtt == 0 || rtt < sp->min_rtt))
+	sp->min_rtt = rtt;
+    if ((wnd = get_snd_wnd(irp)) > sp->max_snd_wnd)
+	sp->max_snd_wnd = wnd;
+}
+
+void
+iperf_bottleneck_print_interval(struct iperf_stream *sp, struct iperf_interval_results *irp, cJSON *json_stream, const char *mbuf, double st, double et)
+{
+    struct iperf_test *test = sp->test;
+    double pct[SHARES];
+
+    if (irp->limited.elapsed == 0)
+	return;
+    shares(&irp->limited, pct);
+    if (test->json_output) {
+	if (json_stream != NULL)
+	    cJSON_AddItemToObject(json_stream, "limited",
+				  iperf_json_printf("cwnd_percent: %f  rwnd_percent: %f  sndbuf_percent: %f  application_percent: %f",
+						    pct[SHARE_CWND], pct[SHARE_RWND], pct[SHARE_SNDBUF], pct[SHARE_APP]));
+    } else
+	iperf_printf(test, report_bottleneck_interval, sp->socket, mbuf, st, et,
+		     pct[SHARE_CWND], pct[SHARE_RWND], pct[SHARE_SNDBUF], pct[SHARE_APP]);
+}
+
+/* The window that held the stream back the most: the peer's largest, or our send buffer; 0 if unknown */
+static uint64_t
+limiting_window(struct iperf_stream *sp, const double pct[SHARES])
+{
+    socklen_t len;
+    int sndbuf;
+
+    if (pct[SHARE_RWND] >= pct[SHARE_SNDBUF])
+	return sp->max_snd_wnd > 0 ? sp->max_snd_wnd : 0;
+    len = sizeof(sndbuf);
+    if (getsockopt(sp->socket, SOL_SOCKET, SO_SNDBUF, &sndbuf, &len) == 0 && sndbuf > 0)
+	return sndbuf;
+    return sp->settings->socket_bufsize;
+}
+
+void
+iperf_bottleneck_print_results(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    cJSON *j_bottleneck = NULL, *j_streams = NULL, *j_stream;
+    char mbuf[UNIT_LEN], rbuf[UNIT_LEN], bbuf[UNIT_LEN], wbuf[UNIT_LEN];
+    double pct[SHARES], bdp;
+    uint64_t window, want;
+    int rows = 0, held;
+
+    if (test->json_output) {
+	if ((j_bottleneck = cJSON_CreateObject()) == NULL)
+	    return;
+	if ((j_streams = cJSON_CreateArray()) == NULL) {
+	    cJSON_Delete(j_bottleneck);
+	    return;
+	}
+	cJSON_AddItemToObject(j_bottleneck, "streams", j_streams);
+	cJSON_AddItemToObject(test->json_end, "bottleneck", j_bottleneck);
+    }
+
+    if (test->mode == BIDIRECTIONAL)
+	sprintf(mbuf, "[TX-%s]", test->role == 'c' ? "C" : "S");
+    else
+	mbuf[0] = '\0';
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (!sp->sender || sp->limited_total.elapsed == 0)
+	    continue;
+	shares(&sp->limited_total, pct);
+	held = pct[SHARE_RWND] >= pct[SHARE_SNDBUF] ? SHARE_RWND : SHARE_SNDBUF;
+	bdp = sp->max_rate * sp->min_rtt / 1000000.0;
+	window = limiting_window(sp, pct);
+	want = 0;
+	if (pct[SHARE_RWND] + pct[SHARE_SNDBUF] >= LIMITED_HINT_PERCENT && bdp > 0 &&
+	    window > 0 && window < 2.0 * bdp)
+	    want = 2.0 * bdp;
+	if (test->json_output) {
+	    j_stream = iperf_json_printf("socket: %d  cwnd_percent: %f  rwnd_percent: %f  sndbuf_percent: %f  application_percent: %f  max_bits_per_second: %f  min_rtt: %d  bdp: %d  window: %d  suggested_window: %d",
+					 (int64_t) sp->socket, pct[SHARE_CWND], pct[SHARE_RWND], pct[SHARE_SNDBUF], pct[SHARE_APP],
+					 sp->max_rate * 8.0, (int64_t) sp->min_rtt, (int64_t) bdp, (int64_t) window, (int64_t) want);
+	    if (j_stream == NULL)
+		return;
+	    cJSON_AddItemToArray(j_streams, j_stream);
+	    continue;
+	}
+	if (rows++ == 0)
+	    iperf_printf(test, "%s", report_bottleneck_header);
+	iperf_printf(test, report_bottleneck_result, sp->socket, mbuf,
+		     pct[SHARE_CWND], pct[SHARE_RWND], pct[SHARE_SNDBUF], pct[SHARE_APP]);
+	if (pct[SHARE_RWND] + pct[SHARE_SNDBUF] < LIMITED_HINT_PERCENT || bdp <= 0 || window == 0)
+	    continue;
+	unit_snprintf(rbuf, UNIT_LEN, sp->max_rate, test->settings->unit_format);
+	unit_snprintf(bbuf, UNIT_LEN, bdp, 'A');
+	if (want > 0)
+	    iperf_printf(test, report_bottleneck_hint, sp->socket, mbuf, share_names[held],
+			 pct[SHARE_RWND] + pct[SHARE_SNDBUF], rbuf, sp->min_rtt / 1000.0, bbuf,
+			 (int) ((want + 1023) / 1024));
+	else if (held == SHARE_RWND) {
+	    unit_snprintf(wbuf, UNIT_LEN, window, 'A');
+	    iperf_printf(test, report_bottleneck_receiver, sp->socket, mbuf,
+			 pct[SHARE_RWND], wbuf, bbuf);
+	}
+    }
+}
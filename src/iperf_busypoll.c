@@ -0,0 +1,188 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <sched.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_busypoll.h"
+#include "iperf_locale.h"
+#include "iperf_time.h"
+#include "iperf_util.h"
+#include "net.h"
+#include "cjson.h"
+
+/*
+ * Busy-poll receive (--busy-poll, --prefer-busy-poll).
+ *
+ * While the test runs, the main loop normally sleeps in select() until
+ * a stream has data, and the wait for the interrupt, the softirq and
+ * the wakeup is part of every request/response or UDP round trip.
+ * --busy-poll[=#] keeps the loop from sleeping: select() is given a
+ * zero timeout, and every stream read from is read (non-blocking)
+ * each time round whether or not select() called it ready.
+ *
+ * SO_BUSY_POLL (# usec, default DEFAULT_BUSY_POLL) has those reads
+ * poll the device queue the socket's packets last came in on (NAPI)
+ * before giving up, so data can be picked up with no interrupt at
+ * all.  --prefer-busy-poll[=budget] adds SO_PREFER_BUSY_POLL, which
+ * with the device's napi_defer_hard_irqs leaves its interrupts off
+ * while the application polls, and the packets per poll.
+ *
+ * On loopback, veth and other devices without NAPI there is nothing
+ * to poll: the socket shows no NAPI id and only the spin is left.
+ * Raising SO_BUSY_POLL above net.core.busy_read needs CAP_NET_ADMIN.
+ * A spin after one that moved nothing yields the CPU, which costs next to
+ * nothing on a core of its own and keeps two ends on one core from
+ * taking turns a scheduler tick at a time.
+ * Neither stops the test; the summary says which streams had a NAPI
+ * id, whether the options took, and the CPU the spinning cost next to
+ * the spins that found nothing, to set against the latency figures.
+ */
+
+static struct timeval zero;
+
+static void
+set_opt(struct iperf_test *test, int fd, int opt, int val)
+{
+    if (setsockopt(fd, SOL_SOCKET, opt, &val, sizeof(val)) < 0 && test->busy_poll_errno == 0)
+	test->busy_poll_errno = errno;
+}
+
+int
+iperf_busypoll_init(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+
+    if (test->busy_poll == 0)
+	return 0;
+    test->busy_poll_errno = 0;
+    SLIST_FOREACH(sp, &test->streams, streams) {
+#if defined(SO_BUSY_POLL)
+	set_opt(test, sp->socket, SO_BUSY_POLL, test->busy_poll);
+#endif
+#if defined(SO_PREFER_BUSY_POLL) && defined(SO_BUSY_POLL_BUDGET)
+	if (test->prefer_busy_poll) {
+	    set_opt(test, sp->socket, SO_PREFER_BUSY_POLL, 1);
+	    if (test->busy_poll_budget)
+		set_opt(test, sp->socket, SO_BUSY_POLL_BUDGET, test->busy_poll_budget);
+	}
+#endif
+	/* A blocking read of an idle stream would stop the spin */
+	if (FD_ISSET(sp->socket, &test->read_set) && setnonblocking(sp->socket, 1) < 0) {
+	    i_errno = IEINITTEST;
+	    return -1;
+	}
+    }
+    return 0;
+}
+
+struct timeval *
+iperf_busypoll_timeout(struct iperf_test *test)
+{
+    return &zero;
+}
+
+void
+iperf_busypoll_ready(struct iperf_test *test, fd_set *read_set, int result)
+{
+    struct iperf_stream *sp;
+    iperf_size_t progress = test->bytes_sent + test->bytes_received;
+
+    /* The last spin moved nothing, and select() sees nothing now */
+    test->busy_spins++;
+    if (progress == test->busy_progress && result == 0) {
+	test->busy_idle++;
+	/* Let anything sharing the CPU, such as the peer on loopback, run */
+	sched_yield();
+    }
+    test->busy_progress = progress;
+    SLIST_FOREACH(sp, &test->streams, streams)
+	if (FD_ISSET(sp->socket, &test->read_set))
+	    FD_SET(sp->socket, read_set);
+}
+
+void
+iperf_busypoll_reset(struct iperf_test *test)
+{
+    test->busy_spins = test->busy_idle = 0;
+    test->busy_progress = test->bytes_sent + test->bytes_received;
+}
+
+/* Whether a socket's packets come in through a NAPI context that can be polled */
+static int
+has_napi(int fd)
+{
+#if defined(SO_INCOMING_NAPI_ID)
+    unsigned int id = 0;
+    socklen_t len = sizeof(id);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_INCOMING_NAPI_ID, &id, &len) == 0)
+	return id != 0;
+#endif
+    return 0;
+}
+
+void
+iperf_busypoll_print_results(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    int streams = 0, napi = 0;
+    double idle;
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	++streams;
+	napi += has_napi(sp->socket);
+    }
+    idle = test->busy_spins ? 100.0 * test->busy_idle / test->busy_spins : 0.0;
+
+    if (test->json_output) {
+	cJSON_AddItemToObject(test->json_end, "busy_poll",
+			      iperf_json_printf("usecs: %d  prefer: %b  budget: %d  error: %s  streams: %d  napi_streams: %d  spins: %d  idle_spins: %d  host_cpu_percent: %f  remote_cpu_percent: %f",
+						(int64_t) test->busy_poll, test->prefer_busy_poll,
+						(int64_t) test->busy_poll_budget,
+						test->busy_poll_errno ? strerror(test->busy_poll_errno) : "",
+						(int64_t) streams, (int64_t) napi, (int64_t) test->busy_spins,
+						(int64_t) test->busy_idle, test->cpu_util[0], test->remote_cpu_util[0]));
+	return;
+    }
+    iperf_printf(test, report_busypoll, test->busy_poll, test->prefer_busy_poll ? ", preferred" : "",
+		 napi, streams, napi < streams ? report_busypoll_no_napi : "");
+    if (test->busy_poll_errno)
+	iperf_printf(test, report_busypoll_error, strerror(test->busy_poll_errno));
+    iperf_printf(test, report_busypoll_cpu, (unsigned long long) test->busy_spins, idle,
+		 test->cpu_util[0], test->remote_cpu_util[0]);
+}
@@ -0,0 +1,67 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_BUSYPOLL_H
+#define __IPERF_BUSYPOLL_H
+
+#include <sys/select.h>
+#include <sys/time.h>
+
+/**
+ * iperf_busypoll_init -- set SO_BUSY_POLL, and SO_PREFER_BUSY_POLL and
+ * SO_BUSY_POLL_BUDGET if asked, on the streams, and make the ones read
+ * from non-blocking (--busy-poll)
+ *
+ */
+int iperf_busypoll_init(struct iperf_test *);
+
+/**
+ * iperf_busypoll_timeout -- the select() timeout while spinning: zero
+ *
+ */
+struct timeval *iperf_busypoll_timeout(struct iperf_test *);
+
+/**
+ * iperf_busypoll_ready -- count the spin, and mark the streams read
+ * from as ready whatever select() returned, so each is read at once
+ *
+ */
+void iperf_busypoll_ready(struct iperf_test *, fd_set *read_set, int result);
+
+/**
+ * iperf_busypoll_reset -- forget the spins made while omitting
+ *
+ */
+void iperf_busypoll_reset(struct iperf_test *);
+
+/**
+ * iperf_busypoll_print_results -- print what busy polling was in
+ * effect and its CPU cost, or add them to the JSON output
+ *
+ */
+void iperf_busypoll_print_results(struct iperf_test *);
+
+#endif
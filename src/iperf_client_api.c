@@ -42,6 +42,15 @@
 #include "iperf_util.h"
 #include "iperf_locale.h"
 #include "iperf_time.h"
+#include "iperf_udp.h"
+#include "iperf_train.h"
+#include "iperf_owd.h"
+#include "iperf_search.h"
+#include "iperf_rr.h"
+#include "iperf_echo.h"
+#include "iperf_probe.h"
+#include "iperf_busypoll.h"
+#include "iperf_place.h"
 #include "net.h"
 #include "timer.h"
 
@@ -182,23 +191,31 @@ create_client_timers(struct iperf_test * test)
     }
     cd.p = test;
     test->timer = test->stats_timer = test->reporter_timer = NULL;
-    if (test->duration != 0) {
+    if (test->trains != 0) {
+	/* the trains take a fraction of a second, plus time to arrive */
 	test->done = 0;
-        test->timer = tmr_create(&now, test_timer_proc, cd, ( test->duration + test->omit ) * SEC_TO_US, 0);
+        test->timer = tmr_create(test->timers, &now, test_timer_proc, cd, iperf_train_usecs(test), 0);
+        if (test->timer == NULL) {
+            i_errno = IEINITTEST;
+            return -1;
+	}
+    } else if (test->duration != 0) {
+	test->done = 0;
+        test->timer = tmr_create(test->timers, &now, test_timer_proc, cd, ( test->duration + test->omit ) * SEC_TO_US, 0);
         if (test->timer == NULL) {
             i_errno = IEINITTEST;
             return -1;
 	}
     }
     if (test->stats_interval != 0) {
-        test->stats_timer = tmr_create(&now, client_stats_timer_proc, cd, test->stats_interval * SEC_TO_US, 1);
+        test->stats_timer = tmr_create(test->timers, &now, client_stats_timer_proc, cd, test->stats_interval * SEC_TO_US, 1);
         if (test->stats_timer == NULL) {
             i_errno = IEINITTEST;
             return -1;
 	}
     }
     if (test->reporter_interval != 0) {
-        test->reporter_timer = tmr_create(&now, client_reporter_timer_proc, cd, test->reporter_interval * SEC_TO_US, 1);
+        test->reporter_timer = tmr_create(test->timers, &now, client_reporter_timer_proc, cd, test->reporter_interval * SEC_TO_US, 1);
         if (test->reporter_timer == NULL) {
             i_errno = IEINITTEST;
             return -1;
@@ -246,7 +263,7 @@ create_client_omit_timer(struct iperf_test * test)
 	}
 	test->omitting = 1;
 	cd.p = test;
-	test->omit_timer = tmr_create(&now, client_omit_timer_proc, cd, test->omit * SEC_TO_US, 0);
+	test->omit_timer = tmr_create(test->timers, &now, client_omit_timer_proc, cd, test->omit * SEC_TO_US, 0);
 	if (test->omit_timer == NULL) {
 	    i_errno = IEINITTEST;
 	    return -1;
@@ -260,6 +277,7 @@ iperf_handle_message_client(struct iperf_test *test)
 {
     int rval;
     int32_t err;
+    signed char msg;
 
     if (NULL == test)
     {
@@ -268,7 +286,7 @@ iperf_handle_message_client(struct iperf_test *test)
         return -1;
     }
     /*!!! Why is this read() and not Nread()? */
-    if ((rval = read(test->ctrl_sck, (char*) &test->state, sizeof(signed char))) <= 0) {
+    if ((rval = read(test->ctrl_sck, (char*) &msg, sizeof(signed char))) <= 0) {
         if (rval == 0) {
             i_errno = IECTRLCLOSE;
             return -1;
@@ -278,6 +296,11 @@ iperf_handle_message_client(struct iperf_test *test)
         }
     }
 
+    /* Rate control feedback travels on the control connection but is not a state change. */
+    if (msg == UDP_FEEDBACK)
+        return iperf_udp_recv_feedback(test);
+    test->state = msg;
+
     switch (test->state) {
         case PARAM_EXCHANGE:
             if (iperf_exchange_parameters(test) < 0)
@@ -286,6 +309,12 @@ iperf_handle_message_client(struct iperf_test *test)
                 test->on_connect(test);
             break;
         case CREATE_STREAMS:
+            if (test->owd && iperf_owd_sync(test, OWD_SYNC_BEFORE) < 0)
+                return -1;
+            if ((test->rr_connect || test->probe_interval) && iperf_crr_setup(test) < 0)
+                return -1;
+            if (test->probe_interval && iperf_probe_setup(test) < 0)
+                return -1;
             if (test->mode == BIDIRECTIONAL)
             {
                 if (iperf_create_streams(test, 1) < 0)
@@ -306,8 +335,13 @@ iperf_handle_message_client(struct iperf_test *test)
 	    if (test->mode)
 		if (iperf_create_send_timers(test) < 0)
 		    return -1;
+	    if (test->search)
+		if (iperf_search_start(test) < 0)
+		    return -1;
             break;
         case TEST_RUNNING:
+            if (test->probe && iperf_probe_start(test) < 0)
+                return -1;
             break;
         case EXCHANGE_RESULTS:
             if (iperf_exchange_results(test) < 0)
@@ -453,6 +487,15 @@ iperf_connect(struct iperf_test *test)
 	    else {
 		test->settings->blksize = DEFAULT_UDP_BLKSIZE;
 	    }
+	    /*
+	     * Packet trains go out back to back, and a train of MSS-sized
+	     * datagrams on a path with a large MTU (32K on loopback) can
+	     * overrun the receive buffer before the receiver gets to it.
+	     * Dispersion is measured with Ethernet-sized packets anyway.
+	     */
+	    if (test->trains && test->settings->blksize > DEFAULT_UDP_BLKSIZE) {
+		test->settings->blksize = DEFAULT_UDP_BLKSIZE;
+	    }
 	    if (test->verbose) {
 		printf("Setting UDP block size to %d\n", test->settings->blksize);
 	    }
@@ -485,6 +528,9 @@ iperf_client_end(struct iperf_test *test)
     }
     struct iperf_stream *sp;
 
+    /* Any --place threads are done with the sockets first */
+    iperf_place_stop(test);
+
     /* Close all stream sockets */
     SLIST_FOREACH(sp, &test->streams, streams) {
         close(sp->socket);
@@ -512,6 +558,7 @@ iperf_run_client(struct iperf_test * test)
 {
     int startup;
     int result = 0;
+    int moved;
     fd_set read_set, write_set;
     struct iperf_time now;
     struct timeval* timeout = NULL;
@@ -567,7 +614,7 @@ iperf_run_client(struct iperf_test * test)
 	memcpy(&read_set, &test->read_set, sizeof(fd_set));
 	memcpy(&write_set, &test->write_set, sizeof(fd_set));
 	iperf_time_now(&now);
-	timeout = tmr_timeout(&now);
+	timeout = tmr_timeout(test->timers, &now);
 
         // In reverse active mode client ensures data is received
         if (test->state == TEST_RUNNING && rcv_timeout_us > 0) {
@@ -584,7 +631,19 @@ iperf_run_client(struct iperf_test * test)
             timeout = &used_timeout;
         }
 
+	/* --busy-poll: spin instead of sleeping while the test runs */
+	if (test->busy_poll && test->state == TEST_RUNNING)
+	    timeout = iperf_busypoll_timeout(test);
+
+	/* --place threads run only while the main loop waits */
+	iperf_place_resume(test);
 	result = select(test->max_fd + 1, &read_set, &write_set, NULL, timeout);
+	if ((moved = iperf_place_pause(test)) < 0)
+	    goto cleanup_and_fail;
+	if (moved > 0 && rcv_timeout_us > 0)
+	    iperf_time_now(&last_receive_time);
+	if (test->busy_poll && test->state == TEST_RUNNING)
+	    iperf_busypoll_ready(test, &read_set, result);
 	if (result < 0 && errno != EINTR) {
   	    i_errno = IESELECT;
 	    goto cleanup_and_fail;
@@ -626,10 +685,15 @@ iperf_run_client(struct iperf_test * test)
 			setnonblocking(sp->socket, 1);
 		    }
 		}
+		if (iperf_place_start(test) < 0)
+		    goto cleanup_and_fail;
 	    }
 
 
-	    if (test->mode == BIDIRECTIONAL)
+	    if (test->rr) {
+                if (iperf_rr_run(test, &read_set, &write_set) < 0)
+                    goto cleanup_and_fail;
+	    } else if (test->mode == BIDIRECTIONAL)
 	    {
                 if (iperf_send(test, &write_set) < 0)
                     goto cleanup_and_fail;
@@ -644,11 +708,15 @@ iperf_run_client(struct iperf_test * test)
                 if (iperf_recv(test, &read_set) < 0)
                     goto cleanup_and_fail;
 	    }
+	    if (test->echo && iperf_echo_recv(test, &read_set) < 0)
+		goto cleanup_and_fail;
+	    if (test->probe)
+		iperf_probe_run(test, &read_set);
 
 
             /* Run the timers. */
             iperf_time_now(&now);
-            tmr_run(&now);
+            tmr_run(test->timers, &now);
 
 	    /*
 	     * Is the test done yet?  We have to be out of omitting
@@ -664,6 +732,7 @@ iperf_run_client(struct iperf_test * test)
 						 test->bytes_received >= test->settings->bytes)) ||
 	         (test->settings->blocks != 0 && (test->blocks_sent >= test->settings->blocks ||
 						  test->blocks_received >= test->settings->blocks)))) {
+		iperf_place_stop(test);
 
 		// Unset non-blocking for non-UDP tests
 		if (test->protocol->id != Pudp) {
@@ -0,0 +1,453 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#if defined(HAVE_LINUX_INET_DIAG_H) && defined(HAVE_LINUX_SOCK_DIAG_H)
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+#endif
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_diag.h"
+#include "iperf_locale.h"
+#include "iperf_util.h"
+#include "iperf_time.h"
+#include "units.h"
+#include "cjson.h"
+
+/*
+ * Socket diagnostics over netlink (--diag).
+ *
+ * Every interval, iperf reads TCP_INFO with a getsockopt() per stream:
+ * a system call and a socket lock each, which adds up with many
+ * streams and short intervals.  inet_diag, the interface ss(8) uses,
+ * returns the same struct for many sockets from one request on a
+ * NETLINK_SOCK_DIAG socket, along with what getsockopt() does not
+ * give:
+ *
+ *   skmem        the socket's memory: receive queue and buffer, send
+ *                queue and buffer, and drops
+ *   cong         the congestion control module's name
+ *   cc info      BBR's bandwidth and min RTT estimates and gains, or
+ *                DCTCP's alpha
+ *
+ * The request carries a bytecode filter so the kernel only returns
+ * sockets on the test's port: the remote port on the client, the
+ * local port on the server (listeners excluded).  That leaves the
+ * control connection and, on a server, any other client's, which
+ * are skipped; the rest are found by socket inode, the one key the
+ * dump and fstat() share, in an index sorted at the start of the
+ * test.  A dump per address family the streams use is taken at the
+ * start of each interval's statistics, and streams it did not have
+ * fall back to getsockopt().  t_diag compares the two at a thousand
+ * sockets.
+ */
+
+/* The streams, by socket inode */
+struct iperf_diag_index {
+    uint32_t  inode;
+    struct iperf_stream *sp;
+};
+
+#if defined(HAVE_LINUX_INET_DIAG_H) && defined(HAVE_LINUX_SOCK_DIAG_H)
+
+#define DIAG_TCP_LISTEN 10		/* not in linux/tcp.h */
+#define DIAG_EXT(x) (1 << ((x) - 1))
+
+int
+iperf_diag_open(void)
+{
+    return socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+}
+
+static void
+parse_entry(struct iperf_diag_stream *ds, struct nlmsghdr *h)
+{
+    struct inet_diag_msg *r = NLMSG_DATA(h);
+    struct rtattr *a;
+    struct tcp_bbr_info *bbr;
+    struct tcp_dctcp_info *dctcp;
+    int len = h->nlmsg_len - NLMSG_LENGTH(sizeof(*r));
+    unsigned int payload;
+
+    ds->valid = 1;
+    ds->tcp_info_len = 0;
+    ds->cong[0] = '\0';
+    ds->cc = DIAG_CC_NONE;
+    ds->has_skmem = 0;
+    for (a = (struct rtattr *) (r + 1); RTA_OK(a, len); a = RTA_NEXT(a, len)) {
+	payload = RTA_PAYLOAD(a);
+	switch (a->rta_type) {
+	    case INET_DIAG_INFO:
+		ds->tcp_info_len = payload < DIAG_TCP_INFO_MAX ? payload : DIAG_TCP_INFO_MAX;
+		memcpy(ds->tcp_info, RTA_DATA(a), ds->tcp_info_len);
+		break;
+	    case INET_DIAG_CONG:
+		snprintf(ds->cong, sizeof(ds->cong), "%.*s", (int) payload, (char *) RTA_DATA(a));
+		break;
+	    case INET_DIAG_BBRINFO:
+		if (payload < sizeof(*bbr))
+		    break;
+		bbr = RTA_DATA(a);
+		ds->cc = DIAG_CC_BBR;
+		ds->bbr_bw = (uint64_t) bbr->bbr_bw_hi << 32 | bbr->bbr_bw_lo;
+		ds->bbr_min_rtt = bbr->bbr_min_rtt;
+		ds->bbr_pacing_gain = bbr->bbr_pacing_gain;
+		ds->bbr_cwnd_gain = bbr->bbr_cwnd_gain;
+		break;
+	    case INET_DIAG_DCTCPINFO:
+		if (payload < sizeof(*dctcp))
+		    break;
+		dctcp = RTA_DATA(a);
+		if (!dctcp->dctcp_enabled)
+		    break;
+		ds->cc = DIAG_CC_DCTCP;
+		ds->dctcp_alpha = dctcp->dctcp_alpha;
+		ds->dctcp_ce_state = dctcp->dctcp_ce_state;
+		ds->dctcp_ab_ecn = dctcp->dctcp_ab_ecn;
+		ds->dctcp_ab_tot = dctcp->dctcp_ab_tot;
+		break;
+	    case INET_DIAG_SKMEMINFO:
+		memset(ds->skmem, 0, sizeof(ds->skmem));
+		payload /= sizeof(uint32_t);
+		memcpy(ds->skmem, RTA_DATA(a), (payload < DIAG_SKMEM_VARS ? payload : DIAG_SKMEM_VARS) * sizeof(uint32_t));
+		ds->has_skmem = 1;
+		break;
+	}
+    }
+}
+
+int
+iperf_diag_dump(int fd, char *buf, int family, int port, int sport, iperf_diag_lookup lookup, void *arg)
+{
+    static uint32_t seq;
+    struct {
+	struct nlmsghdr nlh;
+	struct inet_diag_req_v2 req;
+	struct rtattr rta;
+	struct inet_diag_bc_op ops[4];
+    } msg;
+    struct sockaddr_nl nladdr;
+    struct nlmsghdr *h;
+    struct inet_diag_msg *r;
+    struct iperf_diag_stream *ds;
+    int len, sockets = 0;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.nlh.nlmsg_len = sizeof(msg);
+    msg.nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+    msg.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    msg.nlh.nlmsg_seq = ++seq;
+    msg.req.sdiag_family = family;
+    msg.req.sdiag_protocol = IPPROTO_TCP;
+    msg.req.idiag_states = ~(1U << DIAG_TCP_LISTEN);
+    msg.req.idiag_ext = DIAG_EXT(INET_DIAG_INFO) | DIAG_EXT(INET_DIAG_VEGASINFO) |
+	DIAG_EXT(INET_DIAG_CONG) | DIAG_EXT(INET_DIAG_SKMEMINFO);
+
+    /*
+     * port <= p <= port: a failed comparison jumps past the end of the
+     * bytecode, which rejects the socket; running off the end exactly
+     * accepts it.
+     */
+    msg.rta.rta_type = INET_DIAG_REQ_BYTECODE;
+    msg.rta.rta_len = RTA_LENGTH(sizeof(msg.ops));
+    msg.ops[0].code = sport ? INET_DIAG_BC_S_GE : INET_DIAG_BC_D_GE;
+    msg.ops[0].yes = 2 * sizeof(struct inet_diag_bc_op);
+    msg.ops[0].no = sizeof(msg.ops) + 4;
+    msg.ops[1].no = port;
+    msg.ops[2].code = sport ? INET_DIAG_BC_S_LE : INET_DIAG_BC_D_LE;
+    msg.ops[2].yes = 2 * sizeof(struct inet_diag_bc_op);
+    msg.ops[2].no = 2 * sizeof(struct inet_diag_bc_op) + 4;
+    msg.ops[3].no = port;
+
+    memset(&nladdr, 0, sizeof(nladdr));
+    nladdr.nl_family = AF_NETLINK;
+    if (sendto(fd, &msg, sizeof(msg), 0, (struct sockaddr *) &nladdr, sizeof(nladdr)) < 0)
+	return -1;
+
+    for (;;) {
+	len = recv(fd, buf, DIAG_BUFSIZE, 0);
+	if (len < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	if (len == 0) {
+	    errno = EPIPE;
+	    return -1;
+	}
+	for (h = (struct nlmsghdr *) buf; NLMSG_OK(h, len); h = NLMSG_NEXT(h, len)) {
+	    if (h->nlmsg_seq != seq)
+		continue;		/* left from a dump that failed */
+	    if (h->nlmsg_type == NLMSG_DONE)
+		return sockets;
+	    if (h->nlmsg_type == NLMSG_ERROR) {
+		struct nlmsgerr *e = NLMSG_DATA(h);
+
+		errno = e->error ? -e->error : EPROTO;
+		return -1;
+	    }
+	    if (h->nlmsg_type != SOCK_DIAG_BY_FAMILY || h->nlmsg_len < NLMSG_LENGTH(sizeof(*r)))
+		continue;
+	    ++sockets;
+	    r = NLMSG_DATA(h);
+	    if ((ds = lookup(arg, r->idiag_inode)) != NULL)
+		parse_entry(ds, h);
+	}
+    }
+}
+
+#else /* HAVE_LINUX_INET_DIAG_H && HAVE_LINUX_SOCK_DIAG_H */
+
+int
+iperf_diag_open(void)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int
+iperf_diag_dump(int fd, char *buf, int family, int port, int sport, iperf_diag_lookup lookup, void *arg)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+#endif /* HAVE_LINUX_INET_DIAG_H && HAVE_LINUX_SOCK_DIAG_H */
+
+static int
+index_cmp(const void *a, const void *b)
+{
+    uint32_t x = ((const struct iperf_diag_index *) a)->inode;
+    uint32_t y = ((const struct iperf_diag_index *) b)->inode;
+
+    return x < y ? -1 : x > y;
+}
+
+static struct iperf_diag_stream *
+lookup_stream(void *arg, uint32_t inode)
+{
+    struct iperf_test *test = arg;
+    struct iperf_diag_index key, *found;
+
+    key.inode = inode;
+    found = bsearch(&key, test->diag_index, test->diag_streams, sizeof(key), index_cmp);
+    return found != NULL ? found->sp->diag : NULL;
+}
+
+int
+iperf_diag_init(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct sockaddr_storage sa;
+    socklen_t len;
+    struct stat st;
+    int n = 0;
+
+    if (!test->diag)
+	return 0;
+    iperf_diag_close(test);
+    test->diag_families = 0;
+    test->diag_dumps = test->diag_entries = test->diag_usecs = 0;
+    SLIST_FOREACH(sp, &test->streams, streams)
+	++n;
+    test->diag_index = (struct iperf_diag_index *) calloc(n > 0 ? n : 1, sizeof(struct iperf_diag_index));
+    test->diag_buf = (char *) malloc(DIAG_BUFSIZE);
+    if (test->diag_index == NULL || test->diag_buf == NULL) {
+	i_errno = IEINITTEST;
+	return -1;
+    }
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (sp->diag == NULL && (sp->diag = (struct iperf_diag_stream *) calloc(1, sizeof(struct iperf_diag_stream))) == NULL) {
+	    i_errno = IEINITTEST;
+	    return -1;
+	}
+	if (fstat(sp->socket, &st) < 0) {
+	    i_errno = IEDIAGSOCKET;
+	    return -1;
+	}
+	sp->diag->inode = st.st_ino;
+	sp->diag->valid = 0;
+	test->diag_index[test->diag_streams].inode = st.st_ino;
+	test->diag_index[test->diag_streams].sp = sp;
+	++test->diag_streams;
+	len = sizeof(sa);
+	if (getsockname(sp->socket, (struct sockaddr *) &sa, &len) == 0)
+	    test->diag_families |= sa.ss_family == AF_INET6 ? DIAG_INET6 : DIAG_INET;
+    }
+    qsort(test->diag_index, test->diag_streams, sizeof(struct iperf_diag_index), index_cmp);
+
+    if ((test->diag_fd = iperf_diag_open()) < 0) {
+	i_errno = IEDIAGSOCKET;
+	return -1;
+    }
+    return 0;
+}
+
+void
+iperf_diag_collect(struct iperf_test *test)
+{
+    struct iperf_time start, now, diff;
+    int i, found = 0;
+
+    if (test->diag_fd < 0)
+	return;
+    for (i = 0; i < test->diag_streams; ++i)
+	test->diag_index[i].sp->diag->valid = 0;
+    iperf_time_now(&start);
+    if (((test->diag_families & DIAG_INET) &&
+	 iperf_diag_dump(test->diag_fd, test->diag_buf, AF_INET, test->server_port, test->role == 's', lookup_stream, test) < 0) ||
+	((test->diag_families & DIAG_INET6) &&
+	 iperf_diag_dump(test->diag_fd, test->diag_buf, AF_INET6, test->server_port, test->role == 's', lookup_stream, test) < 0)) {
+	iperf_err(test, "inet_diag dump failed: %s; reading TCP_INFO per socket", strerror(errno));
+	close(test->diag_fd);
+	test->diag_fd = -1;
+	for (i = 0; i < test->diag_streams; ++i)
+	    test->diag_index[i].sp->diag->valid = 0;
+	return;
+    }
+    iperf_time_now(&now);
+    iperf_time_diff(&now, &start, &diff);
+    for (i = 0; i < test->diag_streams; ++i)
+	found += test->diag_index[i].sp->diag->valid;
+    ++test->diag_dumps;
+    test->diag_entries += found;
+    test->diag_usecs += iperf_time_in_usecs(&diff);
+}
+
+int
+iperf_diag_tcpinfo(struct iperf_stream *sp, struct iperf_interval_results *irp)
+{
+#if defined(linux) && defined(TCP_INFO)
+    struct iperf_diag_stream *ds = sp->diag;
+
+    if (ds == NULL || !ds->valid || ds->tcp_info_len == 0)
+	return -1;
+    memset(&irp->tcpInfo, 0, sizeof(irp->tcpInfo));
+    memcpy(&irp->tcpInfo, ds->tcp_info, ds->tcp_info_len < (int) sizeof(irp->tcpInfo) ? ds->tcp_info_len : (int) sizeof(irp->tcpInfo));
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+void
+iperf_diag_print_interval(struct iperf_stream *sp, cJSON *json_stream, const char *mbuf, double st, double et)
+{
+    struct iperf_test *test = sp->test;
+    struct iperf_diag_stream *ds = sp->diag;
+    const uint32_t *m;
+    cJSON *j_diag;
+    char cc[100], bwbuf[UNIT_LEN];
+
+    if (ds == NULL || !ds->valid || !ds->has_skmem)
+	return;
+    m = ds->skmem;
+    if (test->json_output) {
+	if (json_stream == NULL)
+	    return;
+	j_diag = iperf_json_printf("congestion: %s  rmem_alloc: %d  rcvbuf: %d  wmem_alloc: %d  sndbuf: %d  fwd_alloc: %d  wmem_queued: %d  optmem: %d  backlog: %d  drops: %d",
+				   ds->cong, (int64_t) m[0], (int64_t) m[1], (int64_t) m[2], (int64_t) m[3],
+				   (int64_t) m[4], (int64_t) m[5], (int64_t) m[6], (int64_t) m[7], (int64_t) m[8]);
+	if (j_diag == NULL)
+	    return;
+	if (ds->cc == DIAG_CC_BBR)
+	    cJSON_AddItemToObject(j_diag, "bbr",
+				  iperf_json_printf("bw: %f  min_rtt: %d  pacing_gain: %f  cwnd_gain: %f",
+						    ds->bbr_bw * 8.0, (int64_t) ds->bbr_min_rtt,
+						    ds->bbr_pacing_gain / 256.0, ds->bbr_cwnd_gain / 256.0));
+	else if (ds->cc == DIAG_CC_DCTCP)
+	    cJSON_AddItemToObject(j_diag, "dctcp",
+				  iperf_json_printf("alpha: %f  ce_state: %d  ab_ecn: %d  ab_tot: %d",
+						    ds->dctcp_alpha / 1024.0, (int64_t) ds->dctcp_ce_state,
+						    (int64_t) ds->dctcp_ab_ecn, (int64_t) ds->dctcp_ab_tot));
+	cJSON_AddItemToObject(json_stream, "diag", j_diag);
+	return;
+    }
+
+    cc[0] = '\0';
+    if (ds->cc == DIAG_CC_BBR) {
+	unit_snprintf(bwbuf, UNIT_LEN, (double) ds->bbr_bw, test->settings->unit_format);
+	snprintf(cc, sizeof(cc), report_diag_bbr, bwbuf, ds->bbr_min_rtt / 1000.0,
+		 ds->bbr_pacing_gain / 256.0, ds->bbr_cwnd_gain / 256.0);
+    } else if (ds->cc == DIAG_CC_DCTCP)
+	snprintf(cc, sizeof(cc), report_diag_dctcp, ds->dctcp_alpha / 1024.0,
+		 ds->dctcp_ab_ecn, ds->dctcp_ab_tot);
+    iperf_printf(test, report_diag_interval, sp->socket, mbuf, st, et,
+		 ds->cong[0] ? ds->cong : "-", m[0], m[1], m[5], m[3], m[8], cc);
+}
+
+void
+iperf_diag_print_results(struct iperf_test *test)
+{
+    double sockets, usecs;
+
+    if (test->diag_dumps == 0)
+	return;
+    sockets = (double) test->diag_entries / test->diag_dumps;
+    usecs = (double) test->diag_usecs / test->diag_dumps;
+    if (test->json_output)
+	cJSON_AddItemToObject(test->json_end, "diag",
+			      iperf_json_printf("dumps: %d  sockets: %f  usecs_per_dump: %f",
+						(int64_t) test->diag_dumps, sockets, usecs));
+    else
+	iperf_printf(test, report_diag_summary, (unsigned long long) test->diag_dumps, sockets, usecs);
+}
+
+void
+iperf_diag_close(struct iperf_test *test)
+{
+    if (test->diag_fd >= 0) {
+	close(test->diag_fd);
+	test->diag_fd = -1;
+    }
+    free(test->diag_index);
+    test->diag_index = NULL;
+    test->diag_streams = 0;
+    free(test->diag_buf);
+    test->diag_buf = NULL;
+}
+
+void
+iperf_diag_free_stream(struct iperf_stream *sp)
+{
+    free(sp->diag);
+    sp->diag = NULL;
+}
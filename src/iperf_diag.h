@@ -0,0 +1,100 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_DIAG_H
+#define __IPERF_DIAG_H
+
+#include <stdint.h>
+
+#include "cjson.h"
+
+/* Where a dump puts a socket's entry, by its inode; NULL to skip the socket */
+typedef struct iperf_diag_stream *(*iperf_diag_lookup)(void *arg, uint32_t inode);
+
+/**
+ * iperf_diag_open -- open a NETLINK_SOCK_DIAG socket, or return -1
+ * with errno set
+ *
+ */
+int iperf_diag_open(void);
+
+/**
+ * iperf_diag_dump -- ask the kernel in one request for the TCP sockets
+ * of a family whose local port (sport) or remote port is port, and
+ * fill in the entry lookup gives for each; buf takes DIAG_BUFSIZE
+ * bytes.  Returns how many sockets came back, or -1 with errno set.
+ *
+ */
+int iperf_diag_dump(int fd, char *buf, int family, int port, int sport, iperf_diag_lookup lookup, void *arg);
+
+/**
+ * iperf_diag_init -- index the test's streams by socket inode and open
+ * the netlink socket (--diag)
+ *
+ */
+int iperf_diag_init(struct iperf_test *);
+
+/**
+ * iperf_diag_collect -- one dump for every stream, at the start of an
+ * interval's statistics; falls back to getsockopt() if it fails
+ *
+ */
+void iperf_diag_collect(struct iperf_test *);
+
+/**
+ * iperf_diag_tcpinfo -- copy the stream's TCP_INFO from the last dump
+ * into irp, or return -1 if the dump did not have it
+ *
+ */
+int iperf_diag_tcpinfo(struct iperf_stream *, struct iperf_interval_results *);
+
+/**
+ * iperf_diag_print_interval -- print the stream's socket memory and
+ * congestion control state after its line, or add them to its JSON
+ * object
+ *
+ */
+void iperf_diag_print_interval(struct iperf_stream *, cJSON *json_stream, const char *mbuf, double st, double et);
+
+/**
+ * iperf_diag_print_results -- print what the dumps cost
+ *
+ */
+void iperf_diag_print_results(struct iperf_test *);
+
+/**
+ * iperf_diag_close -- close the netlink socket and free the index
+ *
+ */
+void iperf_diag_close(struct iperf_test *);
+
+/**
+ * iperf_diag_free_stream -- free a stream's entry
+ *
+ */
+void iperf_diag_free_stream(struct iperf_stream *);
+
+#endif
@@ -0,0 +1,321 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_drain.h"
+#include "iperf_locale.h"
+#include "iperf_time.h"
+#include "iperf_util.h"
+#include "net.h"
+#include "units.h"
+#include "cjson.h"
+
+/*
+ * Receive strategy (--rcv-drain, --rcvlowat).
+ *
+ * By default a TCP receiver makes one Nread() of -l bytes per stream
+ * each time select() finds it readable: a read() that usually returns
+ * what happened to be queued, and a second that fails with EAGAIN.  At
+ * high rates, or with many streams, that is a select() and two
+ * syscalls per few kilobytes.
+ *
+ * --rcv-drain keeps reading a readable stream, -l bytes at a time,
+ * until it would block or a budget is spent: # bytes (default 4M), or
+ * RCV_DRAIN_USECS, so one busy stream can't starve the others and the
+ * control connection.  With TCP_INQ (Linux 4.18) every read also
+ * brings the bytes it left queued, so the loop stops when that is
+ * zero instead of on a read that fails.
+ *
+ * --rcvlowat sets SO_RCVLOWAT, so select() reports a stream readable
+ * only once # bytes are queued (or the peer has closed) rather than
+ * on every segment.  Bytes left below it when the sender stops are
+ * read only at the close, after the test.
+ *
+ * With --discard the reads are MSG_TRUNC recv()s, copying nothing.
+ *
+ * Either option counts, per receiving stream, the wakeups, the reads
+ * (failed ones too) and the bytes, and reports reads per wakeup and
+ * bytes per read per interval and over the test; --rcvlowat 1, the
+ * kernel's default, gives the figures for the default strategy.
+ */
+
+static int
+rcv_inq(struct iperf_test *test)
+{
+#if defined(TCP_INQ)
+    return test->rcv_drain > 0;
+#else
+    return 0;
+#endif
+}
+
+int
+iperf_drain_init(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+#if defined(TCP_INQ)
+    int one = 1;
+#endif
+
+    if ((test->rcv_drain == 0 && test->rcvlowat == 0) || test->protocol->id != Ptcp)
+	return 0;
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (sp->sender)
+	    continue;
+	sp->rcv_inq = -1;
+	if (test->rcvlowat &&
+	    setsockopt(sp->socket, SOL_SOCKET, SO_RCVLOWAT, &test->rcvlowat, sizeof(test->rcvlowat)) < 0) {
+	    i_errno = IESETRCVDRAIN;
+	    return -1;
+	}
+#if defined(TCP_INQ)
+	if (rcv_inq(test) &&
+	    setsockopt(sp->socket, IPPROTO_TCP, TCP_INQ, &one, sizeof(one)) < 0) {
+	    i_errno = IESETRCVDRAIN;
+	    return -1;
+	}
+#endif
+    }
+    return 0;
+}
+
+/*
+ * A recv(), or with TCP_INQ a recvmsg() that notes the bytes it left
+ * queued; flags is MSG_TRUNC for --discard
+ */
+static ssize_t
+read_one(struct iperf_stream *sp, char *buf, size_t size, int flags)
+{
+#if defined(TCP_INQ)
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr msg;
+    struct cmsghdr *cm;
+    struct iovec iov;
+    ssize_t r;
+
+    if (!rcv_inq(sp->test))
+	return recv(sp->socket, buf, size, flags);
+    iov.iov_base = buf;
+    iov.iov_len = size;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if ((r = recvmsg(sp->socket, &msg, flags)) < 0)
+	return r;
+    sp->rcv_inq = -1;
+    for (cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm))
+	if (cm->cmsg_level == IPPROTO_TCP && cm->cmsg_type == TCP_CM_INQ)
+	    memcpy(&sp->rcv_inq, CMSG_DATA(cm), sizeof(sp->rcv_inq));
+    return r;
+#else
+    return recv(sp->socket, buf, size, flags);
+#endif
+}
+
+int
+iperf_drain_recv(struct iperf_stream *sp)
+{
+    struct iperf_test *test = sp->test;
+    struct iperf_time start, now, temp_time;
+    int blksize = sp->settings->blksize;
+    int fill, budget, size, flags = 0, total = 0, reads = 0;
+    char *buf = sp->buffer;
+    ssize_t r;
+
+    /*
+     * Without --rcv-drain, or when -F writes each read out of the one
+     * buffer, this is Nread(): fill the buffer once.
+     */
+    fill = test->rcv_drain == 0 || sp->diskfile_fd >= 0;
+    if (fill)
+	budget = blksize;
+    else {
+	budget = test->rcv_drain;
+	iperf_time_now(&start);
+    }
+#if defined(MSG_TRUNC)
+    if (test->discard && sp->diskfile_fd < 0)
+	flags = MSG_TRUNC;
+#endif
+    while (total < budget) {
+	size = budget - total;
+	if (fill)
+	    buf = sp->buffer + total;
+	else if (size > blksize)
+	    size = blksize;
+	r = read_one(sp, buf, size, flags);
+	++reads;
+	if (r < 0) {
+	    if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+		break;
+	    return NET_HARDERROR;
+	}
+	if (r == 0)
+	    break;
+	total += r;
+	if (sp->rcv_inq == 0)
+	    break;		/* TCP_INQ says the next read would block */
+	if (!fill) {
+	    iperf_time_now(&now);
+	    iperf_time_diff(&start, &now, &temp_time);
+	    if (iperf_time_in_usecs(&temp_time) >= RCV_DRAIN_USECS)
+		break;
+	}
+    }
+
+    if (test->state == TEST_RUNNING) {
+	sp->reads.wakeups++;
+	sp->reads.reads += reads;
+	sp->reads.bytes += total;
+    }
+    return total;
+}
+
+static void
+counts_diff(const struct iperf_read_counts *a, const struct iperf_read_counts *b, struct iperf_read_counts *d)
+{
+    d->wakeups = a->wakeups - b->wakeups;
+    d->reads = a->reads - b->reads;
+    d->bytes = a->bytes - b->bytes;
+}
+
+void
+iperf_drain_interval(struct iperf_stream *sp, struct iperf_interval_results *irp)
+{
+    counts_diff(&sp->reads, &sp->reads_prev, &irp->reads);
+    sp->reads_prev = sp->reads;
+}
+
+void
+iperf_drain_reset(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+
+    SLIST_FOREACH(sp, &test->streams, streams)
+	sp->reads_start = sp->reads;
+}
+
+static cJSON *
+counts_json(const struct iperf_read_counts *c)
+{
+    return iperf_json_printf("wakeups: %d  reads: %d  bytes: %d  reads_per_wakeup: %f  bytes_per_read: %f",
+			     (int64_t) c->wakeups, (int64_t) c->reads, (int64_t) c->bytes,
+			     c->wakeups ? (double) c->reads / c->wakeups : 0.0,
+			     c->reads ? (double) c->bytes / c->reads : 0.0);
+}
+
+static void
+print_counts(struct iperf_stream *sp, const struct iperf_read_counts *c, const char *mbuf, double st, double et)
+{
+    char ubuf[UNIT_LEN];
+
+    unit_snprintf(ubuf, UNIT_LEN, c->reads ? (double) c->bytes / c->reads : 0.0, 'A');
+    iperf_printf(sp->test, report_reads_interval, sp->socket, mbuf, st, et,
+		 (unsigned long long) c->wakeups, c->wakeups ? (double) c->reads / c->wakeups : 0.0, ubuf);
+}
+
+void
+iperf_drain_print_interval(struct iperf_stream *sp, struct iperf_interval_results *irp, cJSON *json_stream, const char *mbuf, double st, double et)
+{
+    if (sp->sender || irp->reads.wakeups == 0)
+	return;
+    if (sp->test->json_output) {
+	if (json_stream != NULL)
+	    cJSON_AddItemToObject(json_stream, "reads", counts_json(&irp->reads));
+    } else
+	print_counts(sp, &irp->reads, mbuf, st, et);
+}
+
+void
+iperf_drain_print_results(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_read_counts total;
+    struct iperf_time temp_time;
+    cJSON *j_reads = NULL, *j_streams = NULL, *j_stream;
+    char mbuf[UNIT_LEN], ubuf[UNIT_LEN];
+    double et;
+    int rows = 0;
+
+    if (test->json_output) {
+	if ((j_reads = iperf_json_printf("rcv_drain: %d  rcvlowat: %d  tcp_inq: %b",
+					 (int64_t) test->rcv_drain, (int64_t) test->rcvlowat,
+					 rcv_inq(test))) == NULL)
+	    return;
+	if ((j_streams = cJSON_CreateArray()) == NULL) {
+	    cJSON_Delete(j_reads);
+	    return;
+	}
+	cJSON_AddItemToObject(j_reads, "streams", j_streams);
+	cJSON_AddItemToObject(test->json_end, "reads", j_reads);
+    }
+
+    if (test->mode == BIDIRECTIONAL)
+	sprintf(mbuf, "[RX-%s]", test->role == 'c' ? "C" : "S");
+    else
+	mbuf[0] = '\0';
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (sp->sender)
+	    continue;
+	counts_diff(&sp->reads, &sp->reads_start, &total);
+	if (total.wakeups == 0)
+	    continue;
+	if (test->json_output) {
+	    if ((j_stream = counts_json(&total)) == NULL)
+		return;
+	    cJSON_AddNumberToObject(j_stream, "socket", sp->socket);
+	    cJSON_AddItemToArray(j_streams, j_stream);
+	    continue;
+	}
+	if (rows++ == 0) {
+	    if (test->rcv_drain) {
+		unit_snprintf(ubuf, UNIT_LEN, (double) test->rcv_drain, 'A');
+		iperf_printf(test, report_reads_drain, ubuf, RCV_DRAIN_USECS, rcv_inq(test) ? ", TCP_INQ" : "");
+	    }
+	    if (test->rcvlowat)
+		iperf_printf(test, report_reads_lowat, test->rcvlowat);
+	    iperf_printf(test, "%s", report_reads_header);
+	}
+	iperf_time_diff(&sp->result->start_time, &sp->result->end_time, &temp_time);
+	et = iperf_time_in_secs(&temp_time);
+	print_counts(sp, &total, mbuf, 0.0, et);
+    }
+}
@@ -0,0 +1,73 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_DRAIN_H
+#define __IPERF_DRAIN_H
+
+#include "cjson.h"
+
+/**
+ * iperf_drain_init -- set SO_RCVLOWAT (--rcvlowat) and TCP_INQ
+ * (--rcv-drain) on the receiving streams
+ *
+ */
+int iperf_drain_init(struct iperf_test *);
+
+/**
+ * iperf_drain_recv -- read what a wakeup brought, counting the reads;
+ * returns the bytes read or NET_HARDERROR
+ *
+ */
+int iperf_drain_recv(struct iperf_stream *);
+
+/**
+ * iperf_drain_interval -- move the interval's read counts into irp
+ *
+ */
+void iperf_drain_interval(struct iperf_stream *, struct iperf_interval_results *);
+
+/**
+ * iperf_drain_reset -- forget the reads made while omitting
+ *
+ */
+void iperf_drain_reset(struct iperf_test *);
+
+/**
+ * iperf_drain_print_interval -- print the interval's reads per wakeup
+ * and bytes per read after the stream's line, or add them to its JSON
+ * object
+ *
+ */
+void iperf_drain_print_interval(struct iperf_stream *, struct iperf_interval_results *, cJSON *json_stream, const char *mbuf, double st, double et);
+
+/**
+ * iperf_drain_print_results -- print each receiving stream's reads
+ * over the test, or add them to the JSON output
+ *
+ */
+void iperf_drain_print_results(struct iperf_test *);
+
+#endif
@@ -0,0 +1,336 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_echo.h"
+#include "iperf_histogram.h"
+#include "iperf_locale.h"
+#include "iperf_util.h"
+#include "iperf_time.h"
+#include "cjson.h"
+#include "portable_endian.h"
+
+/*
+ * UDP reflector mode (--echo), after TWAMP light (RFC 5357 appendix I).
+ *
+ * The client sends its UDP stream as usual.  The server accounts each
+ * datagram as usual too, then sends it straight back on the same
+ * socket, after writing into it when it read it, when it sent it back
+ * and a sequence number of its own:
+ *
+ *   0  sec, usec   client send time (the usual UDP header)
+ *   8  sequence    client, 32 or 64 bits
+ *  16  sec, usec   reflector receive time
+ *  24  sec, usec   reflector send time
+ *  32  sequence    reflector, 64 bits
+ *
+ * The client takes the reflector's time out of the round trip, so no
+ * clock needs to agree with another.  Forward losses are the client's
+ * sequence numbers that the reflector's never counted, reverse losses
+ * the reflector's that never came back; both go by the highest number
+ * back so far, so packets still in flight at the end aren't counted.
+ */
+
+#define ECHO_TIMES_OFFSET 16
+#define ECHO_SEQ_OFFSET 32
+
+int
+iperf_echo_init(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+
+    if (!test->echo)
+	return 0;
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	sp->echo_reflected = 0;
+	memset(&sp->echo, 0, sizeof(sp->echo));
+	sp->echo_start = sp->echo_last = sp->echo;
+	if (sp->sender)
+	    FD_SET(sp->socket, &test->read_set);
+    }
+    return 0;
+}
+
+/* The clock the UDP header's send time comes from */
+static void
+echo_now(struct iperf_test *test, struct iperf_time *now)
+{
+    if (test->owd)
+	iperf_time_now_wallclock(now);
+    else
+	iperf_time_now(now);
+}
+
+void
+iperf_echo_reflect(struct iperf_stream *sp, int size, struct iperf_time *arrival)
+{
+    struct iperf_time departure;
+    uint32_t times[4];
+    uint64_t seq;
+
+    if (size < ECHO_HEADER_LEN)
+	return;
+    seq = htobe64(++sp->echo_reflected);
+    echo_now(sp->test, &departure);
+    times[0] = htonl(arrival->secs);
+    times[1] = htonl(arrival->usecs);
+    times[2] = htonl(departure.secs);
+    times[3] = htonl(departure.usecs);
+    memcpy(sp->buffer + ECHO_TIMES_OFFSET, times, sizeof(times));
+    memcpy(sp->buffer + ECHO_SEQ_OFFSET, &seq, sizeof(seq));
+    /* If the socket buffer is full, that's a reverse loss like any other */
+    send(sp->socket, sp->buffer, size, MSG_DONTWAIT);
+}
+
+/* Account one reflection the client has read */
+static void
+echo_record(struct iperf_stream *sp, struct iperf_time *now)
+{
+    struct iperf_time sent, arrival, departure, rtt, held;
+    uint32_t sec, usec, times[4], pc;
+    uint64_t fwd, rev;
+    int64_t rtt_usecs, held_usecs;
+
+    memcpy(&sec, sp->buffer, sizeof(sec));
+    memcpy(&usec, sp->buffer + 4, sizeof(usec));
+    sent.secs = ntohl(sec);
+    sent.usecs = ntohl(usec);
+    if (sp->test->udp_counters_64bit) {
+	memcpy(&fwd, sp->buffer + 8, sizeof(fwd));
+	fwd = be64toh(fwd);
+    } else {
+	memcpy(&pc, sp->buffer + 8, sizeof(pc));
+	fwd = ntohl(pc);
+    }
+    memcpy(times, sp->buffer + ECHO_TIMES_OFFSET, sizeof(times));
+    arrival.secs = ntohl(times[0]);
+    arrival.usecs = ntohl(times[1]);
+    departure.secs = ntohl(times[2]);
+    departure.usecs = ntohl(times[3]);
+    memcpy(&rev, sp->buffer + ECHO_SEQ_OFFSET, sizeof(rev));
+    rev = be64toh(rev);
+
+    if (fwd > sp->echo.fwd_packets)
+	sp->echo.fwd_packets = fwd;
+    if (rev > sp->echo.rev_packets)
+	sp->echo.rev_packets = rev;
+    ++sp->echo.received;
+
+    iperf_time_diff(now, &sent, &rtt);
+    iperf_time_diff(&departure, &arrival, &held);
+    rtt_usecs = iperf_time_in_usecs(&rtt);
+    held_usecs = iperf_time_in_usecs(&held);
+    if (sp->hist[HIST_RTT] != NULL)
+	iperf_histogram_record(sp->hist[HIST_RTT], rtt_usecs > held_usecs ? rtt_usecs - held_usecs : 0);
+    if (sp->hist[HIST_REFLECT] != NULL)
+	iperf_histogram_record(sp->hist[HIST_REFLECT], held_usecs);
+}
+
+int
+iperf_echo_recv(struct iperf_test *test, fd_set *read_setP)
+{
+    struct iperf_stream *sp;
+    struct iperf_time now;
+    int r;
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (!sp->sender || !FD_ISSET(sp->socket, read_setP))
+	    continue;
+	FD_CLR(sp->socket, read_setP);
+	/* The sender rewrites its header for every datagram, so the buffer is free to read into */
+	for (;;) {
+	    r = recv(sp->socket, sp->buffer, sp->settings->blksize, MSG_DONTWAIT);
+	    if (r < 0) {
+		/* An ICMP error from the path is only a loss */
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNREFUSED)
+		    break;
+		i_errno = IESTREAMREAD;
+		return -1;
+	    }
+	    if (r < ECHO_HEADER_LEN || test->state != TEST_RUNNING)
+		continue;
+	    echo_now(test, &now);
+	    echo_record(sp, &now);
+	}
+    }
+    return 0;
+}
+
+/* The packets and losses in each direction between two sets of counts */
+static void
+echo_diff(struct iperf_echo_counts *to, struct iperf_echo_counts *from, struct iperf_echo_counts *d)
+{
+    d->fwd_packets = to->fwd_packets - from->fwd_packets;
+    d->rev_packets = to->rev_packets - from->rev_packets;
+    d->received = to->received - from->received;
+}
+
+static cJSON *
+echo_json(struct iperf_echo_counts *d)
+{
+    int64_t fwd_lost = d->fwd_packets - d->rev_packets, rev_lost = d->rev_packets - d->received;
+
+    return iperf_json_printf("forward_packets: %d  forward_lost: %d  forward_lost_percent: %f  reverse_packets: %d  reverse_lost: %d  reverse_lost_percent: %f",
+			     (int64_t) d->fwd_packets, fwd_lost, d->fwd_packets > 0 ? 100.0 * fwd_lost / d->fwd_packets : 0.0,
+			     (int64_t) d->rev_packets, rev_lost, d->rev_packets > 0 ? 100.0 * rev_lost / d->rev_packets : 0.0);
+}
+
+/* Print a line of d's losses; socket < 0 for a [SUM] line */
+static void
+echo_print(struct iperf_test *test, int socket, const char *mbuf, double st, double et, struct iperf_echo_counts *d)
+{
+    int64_t fwd_lost = d->fwd_packets - d->rev_packets, rev_lost = d->rev_packets - d->received;
+    double fwd_percent = d->fwd_packets > 0 ? 100.0 * fwd_lost / d->fwd_packets : 0.0;
+    double rev_percent = d->rev_packets > 0 ? 100.0 * rev_lost / d->rev_packets : 0.0;
+
+    if (socket < 0)
+	iperf_printf(test, report_sum_echo_interval, mbuf, st, et, (int) fwd_lost, (int) d->fwd_packets, fwd_percent,
+		     (int) rev_lost, (int) d->rev_packets, rev_percent);
+    else
+	iperf_printf(test, report_echo_interval, socket, mbuf, st, et, (int) fwd_lost, (int) d->fwd_packets, fwd_percent,
+		     (int) rev_lost, (int) d->rev_packets, rev_percent);
+}
+
+void
+iperf_echo_interval(struct iperf_stream *sp, struct iperf_interval_results *irp)
+{
+    echo_diff(&sp->echo, &sp->echo_last, &irp->echo);
+    sp->echo_last = sp->echo;
+}
+
+void
+iperf_echo_reset(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+
+    SLIST_FOREACH(sp, &test->streams, streams)
+	sp->echo_start = sp->echo_last = sp->echo;
+}
+
+void
+iperf_echo_print_interval(struct iperf_stream *sp, struct iperf_interval_results *irp, cJSON *json_stream, const char *mbuf, double st, double et)
+{
+    struct iperf_test *test = sp->test;
+
+    if (!sp->sender)
+	return;
+    if (test->json_output) {
+	if (json_stream != NULL)
+	    cJSON_AddItemToObject(json_stream, "echo", echo_json(&irp->echo));
+    } else
+	echo_print(test, sp->socket, mbuf, st, et, &irp->echo);
+}
+
+void
+iperf_echo_print_interval_sum(struct iperf_test *test, int sender, cJSON *json_sum, const char *mbuf, double st, double et)
+{
+    struct iperf_stream *sp;
+    struct iperf_interval_results *irp;
+    struct iperf_echo_counts sum;
+
+    if (!sender)
+	return;
+    memset(&sum, 0, sizeof(sum));
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	irp = TAILQ_LAST(&sp->result->interval_results, irlisthead);
+	if (!sp->sender || irp == NULL)
+	    continue;
+	sum.fwd_packets += irp->echo.fwd_packets;
+	sum.rev_packets += irp->echo.rev_packets;
+	sum.received += irp->echo.received;
+    }
+    if (test->json_output) {
+	if (json_sum != NULL)
+	    cJSON_AddItemToObject(json_sum, "echo", echo_json(&sum));
+    } else
+	echo_print(test, -1, mbuf, st, et, &sum);
+}
+
+void
+iperf_echo_print_results(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_time temp_time;
+    struct iperf_echo_counts d, sum;
+    cJSON *j_echo = NULL, *j_streams = NULL, *j_stream;
+    double duration = 0, seconds;
+
+    /* Only the client sees the reflections */
+    if (test->role != 'c')
+	return;
+
+    if (test->json_output) {
+	if ((j_echo = cJSON_CreateObject()) == NULL)
+	    return;
+	if ((j_streams = cJSON_CreateArray()) == NULL) {
+	    cJSON_Delete(j_echo);
+	    return;
+	}
+	cJSON_AddItemToObject(j_echo, "streams", j_streams);
+	cJSON_AddItemToObject(test->json_end, "echo", j_echo);
+    } else
+	iperf_printf(test, "%s", report_echo_header);
+
+    memset(&sum, 0, sizeof(sum));
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (!sp->sender)
+	    continue;
+	iperf_time_diff(&sp->result->start_time, &sp->result->end_time, &temp_time);
+	seconds = iperf_time_in_secs(&temp_time);
+	if (seconds > duration)
+	    duration = seconds;
+	echo_diff(&sp->echo, &sp->echo_start, &d);
+	sum.fwd_packets += d.fwd_packets;
+	sum.rev_packets += d.rev_packets;
+	sum.received += d.received;
+	if (test->json_output) {
+	    j_stream = echo_json(&d);
+	    if (j_stream == NULL)
+		return;
+	    cJSON_AddNumberToObject(j_stream, "socket", sp->socket);
+	    cJSON_AddNumberToObject(j_stream, "seconds", seconds);
+	    cJSON_AddItemToArray(j_streams, j_stream);
+	} else
+	    echo_print(test, sp->socket, "", 0.0, seconds, &d);
+    }
+    if (test->json_output) {
+	j_stream = echo_json(&sum);
+	if (j_stream != NULL) {
+	    cJSON_AddNumberToObject(j_stream, "seconds", duration);
+	    cJSON_AddItemToObject(j_echo, "sum", j_stream);
+	}
+    } else if (test->num_streams > 1)
+	echo_print(test, -1, "", 0.0, duration, &sum);
+}
@@ -0,0 +1,80 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_ECHO_H
+#define __IPERF_ECHO_H
+
+#include <sys/select.h>
+
+#include "cjson.h"
+
+/**
+ * iperf_echo_init -- start each stream's --echo counts afresh, and have
+ * the client's streams read their reflections
+ *
+ * returns 0 on success
+ *
+ */
+int iperf_echo_init(struct iperf_test *);
+
+/**
+ * iperf_echo_reflect -- send a datagram the server just read back to
+ * the client, with the server's receive and transmit times and its own
+ * sequence number; arrival is when it was read
+ *
+ */
+void iperf_echo_reflect(struct iperf_stream *, int size, struct iperf_time *arrival);
+
+/**
+ * iperf_echo_recv -- read the reflections that have come back to the
+ * client's streams and account their round trips and losses
+ *
+ * returns 0 on success, -1 (with i_errno set) on failure
+ *
+ */
+int iperf_echo_recv(struct iperf_test *, fd_set *read_setP);
+
+/**
+ * iperf_echo_interval -- move the stream's counts this interval into irp
+ *
+ */
+void iperf_echo_interval(struct iperf_stream *, struct iperf_interval_results *);
+
+/* Start the counts again when omitting ends */
+void iperf_echo_reset(struct iperf_test *);
+
+void iperf_echo_print_interval(struct iperf_stream *, struct iperf_interval_results *, cJSON *json_stream, const char *mbuf, double st, double et);
+void iperf_echo_print_interval_sum(struct iperf_test *, int sender, cJSON *json_sum, const char *mbuf, double st, double et);
+
+/**
+ * iperf_echo_print_results -- print each client stream's losses in
+ * each direction, or add them to the JSON output; the round trips are
+ * in the histograms
+ *
+ */
+void iperf_echo_print_results(struct iperf_test *);
+
+#endif
@@ -350,6 +350,87 @@ iperf_strerror(int int_errno)
             snprintf(errstr, len, "send timeout value is incorrect or not in range");
             perr = 1;
             break;
+        case IECLOCK:
+            snprintf(errstr, len, "clock source must be 'monotonic' or 'tsc'");
+            break;
+        case IERATECONTROL:
+            snprintf(errstr, len, "rate control must be 'aimd' or 'pid' and requires UDP (-u)");
+            break;
+        case IETARGETLOSS:
+            snprintf(errstr, len, "target loss must be a percentage between 0 and 100");
+            break;
+        case IESEARCH:
+            snprintf(errstr, len, "search method must be 'binary' or 'exponential' and requires a UDP (-u) test from client to server without --rate-control");
+            break;
+        case IESEARCHBOUND:
+            snprintf(errstr, len, "binary search needs an upper bound for the rate (-b)");
+            break;
+        case IESEARCHSIZES:
+            snprintf(errstr, len, "search sizes must be a comma-separated list of datagram sizes between %d and %d", MIN_UDP_BLOCKSIZE, MAX_UDP_BLOCKSIZE);
+            break;
+        case IETRIALTIME:
+            snprintf(errstr, len, "trial time must be between %.1f and %d seconds", MIN_INTERVAL, MAX_TIME);
+            break;
+        case IEOWD:
+            snprintf(errstr, len, "one-way delay measurement requires UDP");
+            break;
+        case IEHISTOGRAMS:
+            snprintf(errstr, len, "latency histograms require TCP or UDP");
+            break;
+        case IEREQRESP:
+            snprintf(errstr, len, "request/response mode needs TCP from client to server, no -n or -k, messages of 1 to %d bytes, a depth of 1 to %d and at most %d --crr connections", MAX_BLOCKSIZE, MAX_RR_DEPTH, MAX_CRR_CONNS);
+            break;
+        case IECRR:
+            snprintf(errstr, len, "--fastopen and --linger need --crr, and --fastopen needs TCP Fast Open");
+            break;
+        case IEECHO:
+            snprintf(errstr, len, "--echo needs UDP from client to server, no --trains or --search, and datagrams of at least %d bytes", ECHO_HEADER_LEN);
+            break;
+        case IEPROBE:
+            snprintf(errstr, len, "--probe takes an interval of 1 to %d ms, and --probe-streams needs --probe and TCP, without -R", MAX_PROBE_INTERVAL);
+            break;
+        case IERRRATE:
+            snprintf(errstr, len, "--rr-rate takes up to %d requests/sec and needs --rr without --crr or -b, with requests and responses (and -l) of at least %d bytes; --rr-arrivals is fixed or poisson", MAX_RR_RATE, RR_STAMP_LEN);
+            break;
+        case IELOSSSTATS:
+            snprintf(errstr, len, "--loss-stats requires UDP");
+            break;
+        case IETRACERECORDS:
+            snprintf(errstr, len, "--trace-records takes 1 to %d records, and needs --trace", MAX_TRACE_RECORDS);
+            break;
+        case IETCPSAMPLE:
+            snprintf(errstr, len, "--tcp-sample takes %g to %d ms and requires TCP, and a client's --tcp-sample-file needs --tcp-sample and no -R (the server's has the -R samples)", MIN_TCP_SAMPLE_USECS / 1000.0, MAX_TCP_SAMPLE_USECS / 1000);
+            break;
+        case IEBOTTLENECK:
+            snprintf(errstr, len, "--bottleneck requires TCP");
+            break;
+        case IEDIAG:
+            snprintf(errstr, len, "--diag requires TCP");
+            break;
+        case IEQUEUES:
+            snprintf(errstr, len, "--queues takes an interval of 1 to %d ms and requires TCP or UDP", MAX_QUEUE_INTERVAL);
+            break;
+        case IETXSTAMP:
+            snprintf(errstr, len, "--notsent-lowat takes a positive size and requires TCP, and --tx-timestamps requires TCP or UDP");
+            break;
+        case IERCVDRAIN:
+            snprintf(errstr, len, "--rcv-drain and --rcvlowat take a positive size and require TCP");
+            break;
+        case IEDISCARD:
+            snprintf(errstr, len, "--discard requires TCP or UDP");
+            break;
+        case IERXSTAMP:
+            snprintf(errstr, len, "--rx-timestamps takes nothing or hw, and requires UDP");
+            break;
+        case IEBUSYPOLL:
+            snprintf(errstr, len, "--busy-poll takes a positive number of usecs, --prefer-busy-poll a budget and --busy-poll, and they require TCP or UDP");
+            break;
+        case IEPLACE:
+            snprintf(errstr, len, "--place takes rx or a CPU list for each end, and its stream threads don't run with --rr, --crr, --echo, --trains, --search, --rate-control, --busy-poll, --trace or -F");
+            break;
+        case IETRAIN:
+            snprintf(errstr, len, "packet trains need UDP, one stream, one direction, and at most %d trains of 2 to %d datagrams", MAX_TRAINS, MAX_TRAIN_LENGTH);
+            break;
         case IERVRSONLYRCVTIMEOUT:
             snprintf(errstr, len, "client receive timeout is valid only in receiving mode");
             perr = 1;
@@ -462,6 +543,42 @@ iperf_strerror(int int_errno)
             snprintf(errstr, len, "unable to set TCP USER_TIMEOUT");
             perr = 1;
             break;
+        case IECLOCKSYNC:
+            snprintf(errstr, len, "unable to exchange clock readings for one-way delay");
+            perr = 1;
+            break;
+        case IEPROBECONNECT:
+            snprintf(errstr, len, "unable to set up the probe connection");
+            perr = 1;
+            break;
+        case IETRACE:
+            snprintf(errstr, len, "unable to create the trace file");
+            perr = 1;
+            break;
+        case IETCPSAMPLEFILE:
+            snprintf(errstr, len, "unable to write the TCP sample file");
+            perr = 1;
+            break;
+        case IEDIAGSOCKET:
+            snprintf(errstr, len, "unable to query socket diagnostics over netlink");
+            perr = 1;
+            break;
+        case IESETTXSTAMP:
+            snprintf(errstr, len, "unable to set TCP_NOTSENT_LOWAT or SO_TIMESTAMPING");
+            perr = 1;
+            break;
+        case IESETRCVDRAIN:
+            snprintf(errstr, len, "unable to set SO_RCVLOWAT or TCP_INQ");
+            perr = 1;
+            break;
+        case IESETRXSTAMP:
+            snprintf(errstr, len, "unable to set SO_TIMESTAMPING for receive timestamps");
+            perr = 1;
+            break;
+        case IEPLACETHREAD:
+            snprintf(errstr, len, "unable to start or pin a --place stream thread");
+            perr = 1;
+            break;
 	default:
 	    snprintf(errstr, len, "int_errno=%d", int_errno);
 	    perr = 1;
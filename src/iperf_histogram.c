@@ -0,0 +1,158 @@
+/*
+ * iperf, Copyright (c) 2014-2022, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "iperf_histogram.h"
+
+static int
+bucket_of(int64_t value)
+{
+    uint64_t v;
+    int msb, shift, index;
+
+    if (value < 2 * HIST_SUB_BUCKETS)
+	return value < 0 ? 0 : (int) value;
+    v = value;
+    for (msb = 0; v >> (msb + 1); ++msb)
+	;
+    shift = msb - HIST_SUB_BITS;
+    index = (shift + 1) * HIST_SUB_BUCKETS + (int) ((v >> shift) - HIST_SUB_BUCKETS);
+    return index < HIST_BUCKETS ? index : HIST_BUCKETS - 1;
+}
+
+/* The middle of a bucket's range, as its representative value */
+static int64_t
+value_of(int index)
+{
+    int shift;
+
+    if (index < 2 * HIST_SUB_BUCKETS)
+	return index;
+    shift = index / HIST_SUB_BUCKETS - 1;
+    return ((int64_t) (index % HIST_SUB_BUCKETS + HIST_SUB_BUCKETS) << shift) +
+	((int64_t) 1 << shift) / 2;
+}
+
+struct iperf_histogram *
+iperf_histogram_new(void)
+{
+    struct iperf_histogram *h;
+
+    h = malloc(sizeof(struct iperf_histogram));
+    if (h != NULL)
+	iperf_histogram_reset(h);
+    return h;
+}
+
+void
+iperf_histogram_free(struct iperf_histogram *h)
+{
+    free(h);
+}
+
+void
+iperf_histogram_reset(struct iperf_histogram *h)
+{
+    memset(h, 0, sizeof(struct iperf_histogram));
+}
+
+void
+iperf_histogram_record(struct iperf_histogram *h, int64_t value)
+{
+    if (h->count == 0 || value < h->min)
+	h->min = value;
+    if (h->count == 0 || value > h->max)
+	h->max = value;
+    ++h->count;
+    h->sum += value;
+    ++h->counts[bucket_of(value)];
+}
+
+void
+iperf_histogram_merge(struct iperf_histogram *dst, const struct iperf_histogram *src)
+{
+    int i;
+
+    if (src->count == 0)
+	return;
+    if (dst->count == 0 || src->min < dst->min)
+	dst->min = src->min;
+    if (dst->count == 0 || src->max > dst->max)
+	dst->max = src->max;
+    dst->count += src->count;
+    dst->sum += src->sum;
+    for (i = 0; i < HIST_BUCKETS; ++i)
+	dst->counts[i] += src->counts[i];
+}
+
+int64_t
+iperf_histogram_percentile(const struct iperf_histogram *h, double percent)
+{
+    uint64_t rank, seen = 0;
+    int64_t v;
+    int i;
+
+    if (h->count == 0)
+	return 0;
+    rank = (uint64_t) (percent / 100.0 * h->count + 0.5);
+    if (rank < 1)
+	rank = 1;
+    if (rank >= h->count)
+	return h->max;
+    for (i = 0; i < HIST_BUCKETS; ++i) {
+	seen += h->counts[i];
+	if (seen >= rank) {
+	    /* The bucket's midpoint may lie outside what was recorded. */
+	    v = value_of(i);
+	    if (v < h->min)
+		v = h->min;
+	    if (v > h->max)
+		v = h->max;
+	    return v;
+	}
+    }
+    return h->max;
+}
+
+double
+iperf_histogram_mean(const struct iperf_histogram *h)
+{
+    return h->count ? h->sum / h->count : 0;
+}
+
+void
+iperf_histogram_summarize(const struct iperf_histogram *h, struct iperf_hist_summary *sum)
+{
+    sum->samples = h->count;
+    sum->p50 = iperf_histogram_percentile(h, 50) / 1000.0;
+    sum->p90 = iperf_histogram_percentile(h, 90) / 1000.0;
+    sum->p99 = iperf_histogram_percentile(h, 99) / 1000.0;
+    sum->p999 = iperf_histogram_percentile(h, 99.9) / 1000.0;
+    sum->max = (h->count ? h->max : 0) / 1000.0;
+}
@@ -0,0 +1,84 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_HISTOGRAM_H
+#define __IPERF_HISTOGRAM_H
+
+#include <stdint.h>
+
+/*
+ * Log-linear histogram, in the style of HdrHistogram: values below
+ * 2 * HIST_SUB_BUCKETS get a bucket each, and every power of two above
+ * that is split into HIST_SUB_BUCKETS equal buckets, so a value is
+ * never off by more than 1/HIST_SUB_BUCKETS (about 1.6%).  The buckets
+ * are a fixed array, so recording never allocates.  Negative values are
+ * counted in the lowest bucket; values beyond the range in the highest.
+ * min, max and mean are kept exactly.
+ */
+#define HIST_SUB_BITS 6
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS 40		/* 2^40 us is about 12 days */
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+struct iperf_histogram {
+    uint64_t  count;
+    int64_t   min, max;
+    double    sum;
+    uint64_t  counts[HIST_BUCKETS];
+};
+
+/* What gets reported of a histogram of microsecond values, in ms */
+struct iperf_hist_summary {
+    uint64_t  samples;
+    double    p50, p90, p99, p999, max;
+};
+
+struct iperf_histogram *iperf_histogram_new(void);
+
+void iperf_histogram_free(struct iperf_histogram *);
+
+void iperf_histogram_reset(struct iperf_histogram *);
+
+void iperf_histogram_record(struct iperf_histogram *, int64_t value);
+
+/**
+ * iperf_histogram_merge -- add every value recorded in src to dst
+ *
+ */
+void iperf_histogram_merge(struct iperf_histogram *dst, const struct iperf_histogram *src);
+
+/**
+ * iperf_histogram_percentile -- value at or below which percent of the
+ * recorded values fall; 0 if nothing was recorded
+ *
+ */
+int64_t iperf_histogram_percentile(const struct iperf_histogram *, double percent);
+
+double iperf_histogram_mean(const struct iperf_histogram *);
+
+void iperf_histogram_summarize(const struct iperf_histogram *, struct iperf_hist_summary *);
+
+#endif
@@ -0,0 +1,441 @@
+/*
+ * iperf, Copyright (c) 2014-2022, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_latency.h"
+#include "iperf_histogram.h"
+#include "iperf_locale.h"
+#include "iperf_util.h"
+#include "iperf_time.h"
+#include "units.h"
+#include "cjson.h"
+
+/*
+ * Latency histograms (--histograms).
+ *
+ * Each stream keeps a log-linear histogram per metric, in
+ * microseconds, for the interval being filled, the last finished
+ * interval and the whole test:
+ *
+ *   jitter  UDP receiver: difference between consecutive datagrams'
+ *           transit times (RFC 3550 inter-arrival jitter, unsmoothed)
+ *   pdv     UDP receiver: transit time above the lowest seen so far
+ *           (RFC 5481 packet delay variation)
+ *   rtt     TCP sender: the kernel's smoothed RTT, sampled from the
+ *           send path at most every HIST_RTT_SAMPLE_USECS; UDP --echo
+ *           client: the round trip less the time in the reflector
+ *   rr      TCP --rr client: from sending a request to having all of
+ *           its response (with --crr, from calling connect())
+ *   connect TCP --crr client: the handshake, unless --fastopen hides it
+ *   first_byte  TCP --crr client: from connect() to the first byte of
+ *           the response
+ *   reflector  UDP --echo client: the time the reflector held each
+ *           datagram, by the reflector's clock
+ *
+ * The histograms are allocated with the streams, so recording does not
+ * allocate.  Because they are bucketed the same way everywhere they
+ * merge exactly: across streams for the [SUM] lines, and with the
+ * peer's, which come over in the results exchange as their non-empty
+ * buckets.
+ */
+
+static const char *metric_names[HIST_METRICS] = { "jitter", "pdv", "rtt", "rr", "connect", "first_byte", "reflector" };
+
+static int
+has_metric(struct iperf_test *test, int metric)
+{
+    if (test->protocol->id == Pudp)
+	return metric == HIST_JITTER || metric == HIST_PDV ||
+	    ((metric == HIST_RTT || metric == HIST_REFLECT) && test->echo);
+    if (test->protocol->id == Ptcp)
+	return metric == HIST_RTT || (metric == HIST_RR && test->rr) ||
+	    ((metric == HIST_CONNECT || metric == HIST_FIRST_BYTE) && test->rr_connect);
+    return 0;
+}
+
+static int
+measures(struct iperf_stream *sp, int metric)
+{
+    /* Jitter and PDV are the receiver's, the rest the sender's */
+    return has_metric(sp->test, metric) && sp->sender == (metric >= HIST_RTT);
+}
+
+int
+iperf_latency_init(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    int m;
+
+    if (!test->histograms)
+	return 0;
+    if (test->hist_sum == NULL && (test->hist_sum = iperf_histogram_new()) == NULL) {
+	i_errno = IEINITTEST;
+	return -1;
+    }
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	for (m = 0; m < HIST_METRICS; ++m) {
+	    if (!has_metric(test, m) || sp->hist_total[m] != NULL)
+		continue;
+	    /* Every stream can hold a total, if only the peer's */
+	    if ((sp->hist_total[m] = iperf_histogram_new()) == NULL) {
+		i_errno = IEINITTEST;
+		return -1;
+	    }
+	    if (!measures(sp, m))
+		continue;
+	    sp->hist[m] = iperf_histogram_new();
+	    sp->hist_last[m] = iperf_histogram_new();
+	    if (sp->hist[m] == NULL || sp->hist_last[m] == NULL) {
+		i_errno = IEINITTEST;
+		return -1;
+	    }
+	}
+    }
+    return 0;
+}
+
+void
+iperf_latency_record_udp(struct iperf_stream *sp, double transit, double delta, int first_packet)
+{
+    if (sp->hist[HIST_JITTER] == NULL)
+	return;
+    if (first_packet || transit < sp->min_transit)
+	sp->min_transit = transit;
+    if (!first_packet)
+	iperf_histogram_record(sp->hist[HIST_JITTER], (int64_t) (delta * 1000000.0));
+    iperf_histogram_record(sp->hist[HIST_PDV], (int64_t) ((transit - sp->min_transit) * 1000000.0));
+}
+
+void
+iperf_latency_sample_rtt(struct iperf_stream *sp)
+{
+    struct iperf_time now;
+    long rtt;
+
+    if (sp->hist[HIST_RTT] == NULL)
+	return;
+    iperf_time_now(&now);
+    if (iperf_time_in_usecs(&now) - iperf_time_in_usecs(&sp->rtt_sampled) < HIST_RTT_SAMPLE_USECS)
+	return;
+    sp->rtt_sampled = now;
+    rtt = get_rtt_now(sp);
+    if (rtt >= 0)
+	iperf_histogram_record(sp->hist[HIST_RTT], rtt);
+}
+
+void
+iperf_latency_interval(struct iperf_stream *sp)
+{
+    struct iperf_histogram *h;
+    int m;
+
+    for (m = 0; m < HIST_METRICS; ++m) {
+	if (sp->hist[m] == NULL)
+	    continue;
+	iperf_histogram_merge(sp->hist_total[m], sp->hist[m]);
+	h = sp->hist_last[m];
+	sp->hist_last[m] = sp->hist[m];
+	sp->hist[m] = h;
+	iperf_histogram_reset(h);
+    }
+}
+
+static cJSON *
+summary_json(const struct iperf_histogram *h)
+{
+    struct iperf_hist_summary s;
+
+    iperf_histogram_summarize(h, &s);
+    return iperf_json_printf("samples: %d  p50_ms: %f  p90_ms: %f  p99_ms: %f  p99_9_ms: %f  max_ms: %f",
+			     (int64_t) s.samples, s.p50, s.p90, s.p99, s.p999, s.max);
+}
+
+void
+iperf_latency_print_interval(struct iperf_stream *sp, cJSON *json_stream, const char *mbuf, double st, double et)
+{
+    struct iperf_test *test = sp->test;
+    struct iperf_hist_summary s;
+    cJSON *j_hist = NULL;
+    int m;
+
+    for (m = 0; m < HIST_METRICS; ++m) {
+	if (sp->hist_last[m] == NULL || sp->hist_last[m]->count == 0)
+	    continue;
+	if (test->json_output) {
+	    if (json_stream == NULL)
+		return;
+	    if (j_hist == NULL) {
+		if ((j_hist = cJSON_CreateObject()) == NULL)
+		    return;
+		cJSON_AddItemToObject(json_stream, "histograms", j_hist);
+	    }
+	    cJSON_AddItemToObject(j_hist, metric_names[m], summary_json(sp->hist_last[m]));
+	} else {
+	    iperf_histogram_summarize(sp->hist_last[m], &s);
+	    iperf_printf(test, report_hist_interval, sp->socket, mbuf, st, et, metric_names[m],
+			 s.p50, s.p90, s.p99, s.p999, s.max);
+	}
+    }
+}
+
+/* Merge one metric of the sending or receiving streams into test->hist_sum */
+static int
+merge_streams(struct iperf_test *test, int sender, int metric, int last)
+{
+    struct iperf_stream *sp;
+    struct iperf_histogram *h;
+
+    iperf_histogram_reset(test->hist_sum);
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	h = last ? sp->hist_last[metric] : sp->hist_total[metric];
+	if (sp->sender == sender && h != NULL)
+	    iperf_histogram_merge(test->hist_sum, h);
+    }
+    return test->hist_sum->count > 0;
+}
+
+void
+iperf_latency_print_interval_sum(struct iperf_test *test, int sender, cJSON *json_sum, const char *mbuf, double st, double et)
+{
+    struct iperf_hist_summary s;
+    cJSON *j_hist = NULL;
+    int m;
+
+    if (test->hist_sum == NULL)
+	return;
+    for (m = 0; m < HIST_METRICS; ++m) {
+	if (!merge_streams(test, sender, m, 1))
+	    continue;
+	if (test->json_output) {
+	    if (json_sum == NULL)
+		return;
+	    if (j_hist == NULL) {
+		if ((j_hist = cJSON_CreateObject()) == NULL)
+		    return;
+		cJSON_AddItemToObject(json_sum, "histograms", j_hist);
+	    }
+	    cJSON_AddItemToObject(j_hist, metric_names[m], summary_json(test->hist_sum));
+	} else {
+	    iperf_histogram_summarize(test->hist_sum, &s);
+	    iperf_printf(test, report_sum_hist_interval, mbuf, st, et, metric_names[m],
+			 s.p50, s.p90, s.p99, s.p999, s.max);
+	}
+    }
+}
+
+/* The same names the interval sums get: the server-to-client direction is the reverse one */
+static const char *
+sum_name(struct iperf_test *test, int sender)
+{
+    if (test->mode == BIDIRECTIONAL &&
+	((test->role == 'c' && !sender) || (test->role != 'c' && sender)))
+	return "sum_bidir_reverse";
+    return "sum";
+}
+
+static void
+direction_tag(struct iperf_test *test, int sender, char *mbuf)
+{
+    if (test->mode == BIDIRECTIONAL)
+	sprintf(mbuf, "[%s-%s]", sender ? "TX" : "RX", test->role == 'c' ? "C" : "S");
+    else
+	mbuf[0] = '\0';
+}
+
+void
+iperf_latency_print_results(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_hist_summary s;
+    cJSON *j_hist = NULL, *j_streams = NULL, *j_stream, *j_sum;
+    char mbuf[UNIT_LEN];
+    int m, sender, rows = 0;
+
+    if (!test->histograms || test->hist_sum == NULL)
+	return;
+
+    if (test->json_output) {
+	if ((j_hist = cJSON_CreateObject()) == NULL)
+	    return;
+	if ((j_streams = cJSON_CreateArray()) == NULL) {
+	    cJSON_Delete(j_hist);
+	    return;
+	}
+	cJSON_AddItemToObject(j_hist, "streams", j_streams);
+	cJSON_AddItemToObject(test->json_end, "histograms", j_hist);
+    }
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	direction_tag(test, sp->sender, mbuf);
+	j_stream = NULL;
+	for (m = 0; m < HIST_METRICS; ++m) {
+	    if (sp->hist_total[m] == NULL || sp->hist_total[m]->count == 0)
+		continue;
+	    if (test->json_output) {
+		if (j_stream == NULL) {
+		    j_stream = iperf_json_printf("socket: %d  sender: %b", (int64_t) sp->socket, sp->sender);
+		    if (j_stream == NULL)
+			return;
+		    cJSON_AddItemToArray(j_streams, j_stream);
+		}
+		cJSON_AddItemToObject(j_stream, metric_names[m], summary_json(sp->hist_total[m]));
+	    } else {
+		/* A server may have nothing until it has the client's results */
+		if (rows++ == 0)
+		    iperf_printf(test, "%s", report_hist_header);
+		iperf_histogram_summarize(sp->hist_total[m], &s);
+		iperf_printf(test, report_hist_result, sp->socket, mbuf, metric_names[m],
+			     (int) s.samples, s.p50, s.p90, s.p99, s.p999, s.max);
+	    }
+	}
+    }
+
+    if (test->num_streams < 2 && !test->json_output)
+	return;
+    for (sender = 1; sender >= 0; --sender) {
+	direction_tag(test, sender, mbuf);
+	j_sum = NULL;
+	for (m = 0; m < HIST_METRICS; ++m) {
+	    if (!merge_streams(test, sender, m, 0))
+		continue;
+	    if (test->json_output) {
+		if (j_sum == NULL) {
+		    if ((j_sum = cJSON_CreateObject()) == NULL)
+			return;
+		    cJSON_AddItemToObject(j_hist, sum_name(test, sender), j_sum);
+		}
+		cJSON_AddItemToObject(j_sum, metric_names[m], summary_json(test->hist_sum));
+	    } else {
+		iperf_histogram_summarize(test->hist_sum, &s);
+		iperf_printf(test, report_sum_hist_result, mbuf, metric_names[m],
+			     (int) s.samples, s.p50, s.p90, s.p99, s.p999, s.max);
+	    }
+	}
+    }
+}
+
+cJSON *
+iperf_latency_results_json(struct iperf_stream *sp)
+{
+    struct iperf_histogram *h;
+    cJSON *j, *j_metric, *j_buckets;
+    int m, i;
+
+    j = NULL;
+    for (m = 0; m < HIST_METRICS; ++m) {
+	h = sp->hist_total[m];
+	if (!measures(sp, m) || h == NULL || h->count == 0)
+	    continue;
+	if (j == NULL && (j = cJSON_CreateObject()) == NULL)
+	    return NULL;
+	j_metric = iperf_json_printf("count: %d  min: %d  max: %d  sum: %f",
+				     (int64_t) h->count, h->min, h->max, h->sum);
+	if (j_metric == NULL || (j_buckets = cJSON_CreateArray()) == NULL) {
+	    cJSON_Delete(j_metric);
+	    cJSON_Delete(j);
+	    return NULL;
+	}
+	/* Pairs of bucket index and count, for the buckets in use */
+	for (i = 0; i < HIST_BUCKETS; ++i) {
+	    if (h->counts[i] == 0)
+		continue;
+	    cJSON_AddItemToArray(j_buckets, cJSON_CreateNumber(i));
+	    cJSON_AddItemToArray(j_buckets, cJSON_CreateNumber((double) h->counts[i]));
+	}
+	cJSON_AddItemToObject(j_metric, "buckets", j_buckets);
+	cJSON_AddItemToObject(j, metric_names[m], j_metric);
+    }
+    return j;
+}
+
+void
+iperf_latency_results_from_json(struct iperf_stream *sp, cJSON *j)
+{
+    struct iperf_histogram *h;
+    cJSON *j_metric, *j_count, *j_min, *j_max, *j_sum, *j_buckets, *j_i, *j_n;
+    int m, n, i, index;
+
+    for (m = 0; m < HIST_METRICS; ++m) {
+	h = sp->hist_total[m];
+	if (h == NULL || measures(sp, m) ||
+	    (j_metric = cJSON_GetObjectItem(j, metric_names[m])) == NULL)
+	    continue;
+	j_count = cJSON_GetObjectItem(j_metric, "count");
+	j_min = cJSON_GetObjectItem(j_metric, "min");
+	j_max = cJSON_GetObjectItem(j_metric, "max");
+	j_sum = cJSON_GetObjectItem(j_metric, "sum");
+	j_buckets = cJSON_GetObjectItem(j_metric, "buckets");
+	if (j_count == NULL || j_min == NULL || j_max == NULL || j_sum == NULL || j_buckets == NULL)
+	    continue;
+	iperf_histogram_reset(h);
+	n = cJSON_GetArraySize(j_buckets);
+	for (i = 0; i + 1 < n; i += 2) {
+	    j_i = cJSON_GetArrayItem(j_buckets, i);
+	    j_n = cJSON_GetArrayItem(j_buckets, i + 1);
+	    index = j_i->valueint;
+	    if (index >= 0 && index < HIST_BUCKETS && j_n->valuedouble > 0)
+		h->counts[index] = (uint64_t) j_n->valuedouble;
+	}
+	h->count = j_count->valueint;
+	h->min = j_min->valueint;
+	h->max = j_max->valueint;
+	h->sum = j_sum->valuedouble;
+    }
+}
+
+void
+iperf_latency_reset(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    int m;
+
+    SLIST_FOREACH(sp, &test->streams, streams)
+	for (m = 0; m < HIST_METRICS; ++m) {
+	    if (sp->hist[m] != NULL)
+		iperf_histogram_reset(sp->hist[m]);
+	    if (sp->hist_total[m] != NULL)
+		iperf_histogram_reset(sp->hist_total[m]);
+	}
+}
+
+void
+iperf_latency_free_stream(struct iperf_stream *sp)
+{
+    int m;
+
+    for (m = 0; m < HIST_METRICS; ++m) {
+	iperf_histogram_free(sp->hist[m]);
+	iperf_histogram_free(sp->hist_last[m]);
+	iperf_histogram_free(sp->hist_total[m]);
+	sp->hist[m] = sp->hist_last[m] = sp->hist_total[m] = NULL;
+    }
+}
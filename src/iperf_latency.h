@@ -0,0 +1,100 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_LATENCY_H
+#define __IPERF_LATENCY_H
+
+#include "cjson.h"
+
+/**
+ * iperf_latency_init -- give each stream the histograms for the
+ * metrics its protocol has: jitter and delay variation for UDP, RTT
+ * for TCP
+ *
+ * returns 0 on success, -1 (with i_errno set) on failure
+ *
+ */
+int iperf_latency_init(struct iperf_test *);
+
+/**
+ * iperf_latency_record_udp -- account one datagram; transit and
+ * delta are its transit time and its change from the previous one's,
+ * in seconds
+ *
+ */
+void iperf_latency_record_udp(struct iperf_stream *, double transit, double delta, int first_packet);
+
+/**
+ * iperf_latency_sample_rtt -- record the stream's RTT, if the last
+ * sample is at least HIST_RTT_SAMPLE_USECS old
+ *
+ */
+void iperf_latency_sample_rtt(struct iperf_stream *);
+
+/**
+ * iperf_latency_interval -- end the stream's interval: its histograms
+ * go into the totals and become the ones the interval report prints
+ *
+ */
+void iperf_latency_interval(struct iperf_stream *);
+
+/**
+ * iperf_latency_print_interval -- print the stream's last interval, or
+ * add it to json_stream
+ *
+ */
+void iperf_latency_print_interval(struct iperf_stream *, cJSON *json_stream, const char *mbuf, double st, double et);
+
+/**
+ * iperf_latency_print_interval_sum -- merge the last interval of the
+ * sending (or receiving) streams and print it as [SUM], or add it to
+ * json_sum
+ *
+ */
+void iperf_latency_print_interval_sum(struct iperf_test *, int sender, cJSON *json_sum, const char *mbuf, double st, double et);
+
+void iperf_latency_print_results(struct iperf_test *);
+
+/**
+ * iperf_latency_results_json -- the stream's whole-test histograms,
+ * bucket by bucket, for the results exchange; NULL if there are none
+ *
+ */
+cJSON *iperf_latency_results_json(struct iperf_stream *);
+
+/**
+ * iperf_latency_results_from_json -- take the peer's histograms for
+ * the metrics only the peer measures
+ *
+ */
+void iperf_latency_results_from_json(struct iperf_stream *, cJSON *);
+
+/* Forget what was recorded, at the end of the omit period */
+void iperf_latency_reset(struct iperf_test *);
+
+void iperf_latency_free_stream(struct iperf_stream *);
+
+#endif
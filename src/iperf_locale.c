@@ -118,12 +118,23 @@ const char usage_longstr[] = "Usage: iperf3 [-s|-c host] [options]\n"
                            "  --forceflush              force flushing output at every interval\n"
                            "  --timestamps<=format>     emit a timestamp at the start of each output line\n"
                            "                            (optional \"=\" and format string as per strftime(3))\n"
+                           "  --trace f                 record every datagram or block sent and received\n"
+                           "                            in the binary ring file f (read it with iperf3-trace)\n"
+                           "  --trace-records #[KMG]    records the --trace ring holds (default %d)\n"
+                           "  --tcp-sample-file f       write every --tcp-sample sample this side takes\n"
+                           "                            to the text file f\n"
 
                            "  --rcv-timeout #           idle timeout for receiving data (default %d ms)\n"
 #if defined(HAVE_TCP_USER_TIMEOUT)
                            "  --snd-timeout #           timeout for unacknowledged TCP data\n"
                            "                            (in ms, default is system settings)\n"
 #endif /* HAVE_TCP_USER_TIMEOUT */
+                           "  --clock <monotonic|tsc>   clock used for timestamps and pacing\n"
+#if defined(HAVE_RDTSC)
+                           "                            (tsc: calibrated invariant TSC, default monotonic)\n"
+#else /* HAVE_RDTSC */
+                           "                            (tsc is not available on this system)\n"
+#endif /* HAVE_RDTSC */
                            "  -d, --debug[=#]           emit debugging output\n"
                            "                            (optional optional \"=\" and debug level: 1-4. Default is 4 - all messages)\n"
                            "  -v, --version             show version information and quit\n"
@@ -163,6 +174,78 @@ const char usage_longstr[] = "Usage: iperf3 [-s|-c host] [options]\n"
                            "  --fq-rate #[KMG]          enable fair-queuing based socket pacing in\n"
 			   "                            bits/sec (Linux only)\n"
 #endif
+                           "  --rate-control <aimd|pid> steer the UDP bitrate from receiver loss reports,\n"
+                           "                            starting at -b (needs interval reports, -i)\n"
+                           "  --target-loss #           highest loss for --rate-control and --search, in percent (default 1)\n"
+                           "  --search <binary|exponential> search for the highest UDP rate within\n"
+                           "                            --target-loss (binary: up to -b, exponential: from -b)\n"
+                           "  --search-sizes #[,#...]   datagram sizes to search (default -l)\n"
+                           "  --trial-time #            length of each search trial in seconds (default 1);\n"
+                           "                            -t sets the final confirmation run\n"
+                           "  --owd                     measure UDP one-way delay against the wall clock,\n"
+                           "                            correcting for the clock offset between the hosts\n"
+                           "  --trains #[/#]            estimate capacity from # UDP packet trains of\n"
+                           "                            -l sized datagrams (default 16 per train, of\n"
+                           "                            at most 1460 bytes)\n"
+                           "  --histograms              report latency percentiles per interval: UDP\n"
+                           "                            jitter and delay variation, TCP sampled RTT\n"
+                           "  --rr #[KMG][/#[KMG]]      TCP request/response test: send # byte requests,\n"
+                           "                            each answered with a / # byte response (default\n"
+                           "                            the same size); reports transactions/sec and\n"
+                           "                            latency percentiles, and implies -N\n"
+                           "  --rr-depth #              requests in flight per stream for --rr (default 1)\n"
+                           "  --rr-rate #               run --rr open loop: send # requests/sec per stream\n"
+                           "                            whether or not they are answered, and time each\n"
+                           "                            from when it was due\n"
+                           "  --rr-arrivals fixed|poisson  spacing of the --rr-rate requests (default fixed)\n"
+                           "  --crr                     make --rr open a connection per transaction;\n"
+                           "                            --rr-depth is then connections per stream\n"
+                           "  --fastopen                use TCP Fast Open for --crr connections\n"
+                           "  --linger #                set SO_LINGER to # seconds on --crr connections\n"
+                           "                            (0 resets them on close, skipping TIME_WAIT)\n"
+                           "  --echo                    UDP: have the server reflect each datagram, and\n"
+                           "                            report round trips and losses each way\n"
+                           "  --loss-stats              UDP: report duplicates, reorder extents, and\n"
+                           "                            the lengths of loss bursts and the gaps between\n"
+                           "                            them\n"
+                           "  --probe[=#]               time round trips on an extra connection every\n"
+                           "                            # ms (default %d) before and during the test\n"
+                           "  --probe-streams           with --probe, also sample the TCP streams' RTT\n"
+                           "  --tcp-sample #            read the sending TCP streams' TCP_INFO every # ms\n"
+                           "                            and report cwnd, RTT, delivery and pacing rate\n"
+                           "                            min/avg/max per interval\n"
+                           "  --bottleneck              report the share of time each TCP sender was\n"
+                           "                            limited by cwnd, the receive window, the send\n"
+                           "                            buffer or itself, and suggest a -w\n"
+                           "  --diag                    read TCP_INFO for all streams with one netlink\n"
+                           "                            inet_diag dump per interval, and report socket\n"
+                           "                            memory and BBR/DCTCP state\n"
+                           "  --queues[=#]              sample the streams' send, unsent and receive\n"
+                           "                            queue depths every # ms (default 10) and\n"
+                           "                            report their average and peak per interval\n"
+                           "  --notsent-lowat #[KMG]    set TCP_NOTSENT_LOWAT on the sending streams, so\n"
+                           "                            they write only when less than # is unsent\n"
+                           "  --tx-timestamps           report the time from write() to leaving the\n"
+                           "                            socket, reaching the driver and (TCP) being acked\n"
+                           "  --rcv-drain[=#[KMG]]      read a readable TCP stream until it would block\n"
+                           "                            or # bytes (default 4M) are read, and report\n"
+                           "                            reads per wakeup and bytes per read\n"
+                           "  --rcvlowat #[KMG]         set SO_RCVLOWAT on the receiving streams, so\n"
+                           "                            they wake up only with # bytes queued\n"
+                           "  --discard                 receive without copying the data out (MSG_TRUNC),\n"
+                           "                            and report CPU per Gbit/s\n"
+                           "  --rx-timestamps[=hw]      UDP jitter and delay from kernel (or NIC) receive\n"
+                           "                            timestamps, reported against user-space ones\n"
+                           "  --busy-poll[=#]           spin on non-blocking reads instead of sleeping,\n"
+                           "                            with SO_BUSY_POLL # usec (default 50)\n"
+                           "  --prefer-busy-poll[=#]    with --busy-poll, set SO_PREFER_BUSY_POLL and\n"
+                           "                            an SO_BUSY_POLL_BUDGET of # packets\n"
+                           "  --place[=CPUS|rx]         report each stream's receive CPU and NUMA node\n"
+                           "                            against iperf's, and its NIC's node, local CPUs\n"
+                           "                            and interrupt CPUs; with a CPU list, run each\n"
+                           "                            stream in a thread pinned round-robin to them,\n"
+                           "                            with rx on its receive CPU (CLIENT/SERVER for\n"
+                           "                            one each)\n"
                            "  -t, --time      #         time in seconds to transmit for (default %d secs)\n"
                            "  -n, --bytes     #[KMG]    number of bytes to transmit (instead of -t)\n"
                            "  -k, --blockcount #[KMG]   number of blocks (packets) to transmit (instead of -t or -n)\n"
@@ -407,6 +490,221 @@ const char report_omitted[] = "(omitted)";
 const char report_bw_separator[] =
 "- - - - - - - - - - - - - - - - - - - - - - - - -\n";
 
+const char report_rate_control[] =
+"[%3d] %6.2f sec  receiver lost %u/%u (%.2g%%)  jitter %.3f ms  rate -> %ss/sec\n";
+
+const char report_rate_control_summary[] =
+"Rate control (%s): final rate %ss/sec for %.2g%% target loss\n";
+
+const char report_search_trial[] =
+"[SRCH] %5d bytes  %ss/sec  %9.0f pps  lost %d/%d (%.3g%%)  %s\n";
+
+const char report_search_header[] =
+"Throughput search (%s, loss <= %.3g%%):\n"
+"[ Size]  Max rate          Packets/sec    Loss  Trials\n";
+
+const char report_search_result[] =
+"[%5d]  %ss/sec  %11.0f  %5.3g%%  %6d%s\n";
+
+const char report_train_header[] =
+"Packet trains: %d of %d trains of %d x %d bytes measured, %d pairs (%s timestamps)\n";
+
+const char report_train_result[] =
+"  Bottleneck capacity:  %ss/sec\n"
+"  Dispersion rate:      %ss/sec\n"
+"  Available bandwidth:  %ss/sec\n";
+
+const char report_train_none[] =
+"  Too few back-to-back datagrams arrived to estimate capacity\n";
+
+const char report_owd_interval[] =
+"[%3d]%s %6.2f-%-6.2f sec  one-way delay min/avg/max/p99 %.3f/%.3f/%.3f/%.3f ms\n";
+
+const char report_owd_header[] =
+"One-way delay (server clock ahead by %.3f ms +/- %.3f ms, drift %.2f ppm):\n";
+
+const char report_owd_result[] =
+"[%3d] %s  min/avg/max/p99 %.3f/%.3f/%.3f/%.3f ms  (%d datagrams)\n";
+
+const char report_hist_interval[] =
+"[%3d]%s %6.2f-%-6.2f sec  %-10s p50/p90/p99/p99.9/max %.3f/%.3f/%.3f/%.3f/%.3f ms\n";
+
+const char report_sum_hist_interval[] =
+"[SUM]%s %6.2f-%-6.2f sec  %-10s p50/p90/p99/p99.9/max %.3f/%.3f/%.3f/%.3f/%.3f ms\n";
+
+const char report_hist_header[] =
+"Latency histograms (ms):\n"
+"[ ID] Metric       Samples      p50      p90      p99    p99.9      max\n";
+
+const char report_hist_result[] =
+"[%3d]%s %-10s %9d %8.3f %8.3f %8.3f %8.3f %8.3f\n";
+
+const char report_sum_hist_result[] =
+"[SUM]%s %-10s %9d %8.3f %8.3f %8.3f %8.3f %8.3f\n";
+
+const char report_rr_interval[] =
+"[%3d]%s %6.2f-%-6.2f sec  %8.0f transactions  %10.1f trans/sec\n";
+
+const char report_sum_rr_interval[] =
+"[SUM]%s %6.2f-%-6.2f sec  %8.0f transactions  %10.1f trans/sec\n";
+
+const char report_rr_header[] =
+"Request/response: %d-byte requests, %d-byte responses, %d in flight per stream\n";
+
+const char report_rr_open_header[] =
+"Open-loop request/response: %d-byte requests, %d-byte responses, %.1f requests/sec per stream, %s arrivals\n";
+
+const char report_crr_header[] =
+"Connect/request/response: %d-byte requests, %d-byte responses, %d connections at a time per stream%s\n";
+
+const char report_crr_failures[] =
+"[%3d] %.0f connections failed\n";
+
+const char report_rr_result[] =
+"[%3d] %6.2f-%-6.2f sec  %8.0f transactions  %10.1f trans/sec\n";
+
+const char report_sum_rr_result[] =
+"[SUM] %6.2f-%-6.2f sec  %8.0f transactions  %10.1f trans/sec\n";
+
+const char report_rr_open_result[] =
+"[%3d]                    %8.0f offered       %10.1f req/sec    %.0f outstanding\n";
+
+const char report_sum_rr_open_result[] =
+"[SUM]                    %8.0f offered       %10.1f req/sec    %.0f outstanding\n";
+
+const char report_echo_interval[] =
+"[%3d]%s %6.2f-%-6.2f sec  forward lost %d/%d (%.2g%%)  reverse lost %d/%d (%.2g%%)\n";
+
+const char report_sum_echo_interval[] =
+"[SUM]%s %6.2f-%-6.2f sec  forward lost %d/%d (%.2g%%)  reverse lost %d/%d (%.2g%%)\n";
+
+const char report_echo_header[] =
+"Echo losses (forward: client to reflector, reverse: reflector to client):\n";
+
+const char report_seq_header[] =
+"Sequence analysis, as received (lengths in packets):\n";
+
+const char report_seq_loss[] =
+"[%3d] %8.0f lost in %.0f bursts  burst mean/p90/max %.1f/%.0f/%.0f  gap mean/p90/max %.1f/%.0f/%.0f\n";
+
+const char report_seq_reorder[] =
+"[%3d] %8.0f reordered  extent p50/p90/max %.0f/%.0f/%.0f  %.0f too late to place  %.0f duplicates\n";
+
+const char report_probe_interval[] =
+"[PRB] %6.2f-%-6.2f sec  %-7s %6d samples  p50/p90/max %.3f/%.3f/%.3f ms  %8.0f RPM\n";
+
+const char report_probe_header[] =
+"Responsiveness, probing every %d ms:\n";
+
+const char report_probe_result[] =
+"[PRB] %-7s %6d samples  p50/p90/p99/max %.3f/%.3f/%.3f/%.3f ms  %8.0f RPM\n";
+
+const char report_tcp_sample_interval[] =
+"[%3d]%s %6.2f-%-6.2f sec  %6d samples  min/avg/max  cwnd %s / %s / %s  rtt %.3f/%.3f/%.3f ms\n";
+
+const char report_tcp_sample_rates[] =
+"[%3d]%s %6.2f-%-6.2f sec  min/avg/max  delivery %s / %s / %s  pacing %s / %s / %s\n";
+
+const char report_tcp_sample_header[] =
+"TCP_INFO every %.3f ms, whole test:\n";
+
+const char report_bottleneck_interval[] =
+"[%3d]%s %6.2f-%-6.2f sec  limited by  cwnd %5.1f%%  rwnd %5.1f%%  sndbuf %5.1f%%  application %5.1f%%\n";
+
+const char report_tcp_sender_extra[] =
+"[%3d]%s  sender:    lost %lld  dsack dups %lld  retransmitted %s  segs out/in %lld/%lld  delivery rate %s\n";
+
+const char report_tcp_receiver_extra[] =
+"[%3d]%s  receiver:  rcv_rtt %.3f ms  rcv_space %s  out of order %lld  reordering %lld  segs in/out %lld/%lld\n";
+
+const char report_bottleneck_header[] =
+"Sender limited by:\n";
+
+const char report_bottleneck_result[] =
+"[%3d]%s  cwnd %5.1f%%  rwnd %5.1f%%  sndbuf %5.1f%%  application %5.1f%%\n";
+
+const char report_bottleneck_hint[] =
+"[%3d]%s  %s-limited %.0f%% of the time; %s at a %.3f ms RTT is a %s BDP: try -w %dK\n";
+
+const char report_bottleneck_receiver[] =
+"[%3d]%s  rwnd-limited %.0f%% of the time with a %s window, over twice the %s BDP: the receiver is not keeping up\n";
+
+const char report_diag_interval[] =
+"[%3d]%s %6.2f-%-6.2f sec  %-6s rmem %u/%u  wmem %u/%u  drops %u%s\n";
+
+const char report_diag_bbr[] =
+"  bw %ss/sec  min_rtt %.3f ms  gains %.2f/%.2f";
+
+const char report_diag_dctcp[] =
+"  alpha %.3f  ce %u/%u bytes";
+
+const char report_diag_summary[] =
+"inet_diag: %llu dumps, %.1f test sockets each, %.1f usec per dump\n";
+
+const char report_queue_send[] =
+"[%3d]%s %6.2f-%-6.2f sec  send queue avg %ss max %ss  unsent avg %ss max %ss  wmem %u/%u\n";
+
+const char report_queue_recv[] =
+"[%3d]%s %6.2f-%-6.2f sec  recv queue avg %ss max %ss  non-empty %5.1f%%  rmem %u/%u  drops %u\n";
+
+const char report_queue_header[] =
+"Socket queues every %d ms, whole test:\n";
+
+const char report_txstamp_lowat[] =
+"TCP_NOTSENT_LOWAT %d bytes\n";
+
+const char report_txstamp_header[] =
+"Send latency from write() (ms):\n"
+"[ ID] Stage        Samples      p50      p90      p99    p99.9      max\n";
+
+const char report_rxstamp_interval[] =
+"[%3d]%s %6.2f-%-6.2f sec  jitter %.3f ms kernel, %.3f ms user  stamped %llu/%llu  hardware %llu\n";
+
+const char report_rxstamp_header[] =
+"Receive timestamps (%s), whole test:\n";
+
+const char report_busypoll[] =
+"Busy poll: SO_BUSY_POLL %d usec%s, NAPI on %d of %d streams%s\n";
+
+const char report_busypoll_no_napi[] = " (loopback, veth or no NAPI: spinning only)";
+
+const char report_busypoll_error[] =
+"Busy poll: socket options not all set: %s\n";
+
+const char report_busypoll_cpu[] =
+"Busy poll: %llu spins, %.1f%% idle, CPU %.1f%% local, %.1f%% remote\n";
+
+const char report_place[] =
+"CPU placement: iperf on CPU %s, node %s\n";
+
+const char report_place_threads[] =
+"Each stream ran in a thread of its own, pinned to %s\n";
+
+const char report_place_header[] =
+"[ ID] Thread  RX CPU  Node  Moves  Local  Interface   NIC node  NIC CPUs         IRQs  IRQ CPUs\n";
+
+const char report_place_stream[] =
+"[%3d]%s %6s %7s %5s %6d  %-5s  %-10s %8s  %-15s %5d  %s\n";
+
+const char report_place_summary[] =
+"%d of %d streams received on the CPU or NUMA node that read them\n";
+
+const char report_reads_interval[] =
+"[%3d]%s %6.2f-%-6.2f sec  %llu wakeups  %.2f reads/wakeup  %ss/read\n";
+
+const char report_reads_drain[] =
+"Draining up to %ss or %d usec per wakeup%s\n";
+
+const char report_reads_lowat[] =
+"SO_RCVLOWAT %d bytes\n";
+
+const char report_reads_header[] =
+"Receive reads, whole test:\n";
+
+const char warn_owd_uncertain[] =
+"warning: clock uncertainty of %.3f ms is not small against an average delay of %.3f ms;\n"
+"         synchronize the clocks (NTP/PTP) for meaningful one-way delays\n";
+
 const char report_outoforder[] =
 "[%3d]%s %4.1f-%4.1f sec  %d datagrams received out-of-order\n";
 
@@ -437,6 +735,11 @@ const char reportCSV_peer[] =
 const char report_cpu[] =
 "CPU Utilization: %s/%s %.1f%% (%.1f%%u/%.1f%%s), %s/%s %.1f%% (%.1f%%u/%.1f%%s)\n";
 
+const char report_cpu_per_gbit[] =
+"CPU per Gbit/s: local %.2f%%, remote %.2f%% (%.2f Gbits/sec%s)\n";
+
+const char report_cpu_discard[] = ", discarding received data";
+
 const char report_local[] = "local";
 const char report_remote[] = "remote";
 const char report_sender[] = "sender";
@@ -93,10 +93,81 @@ extern const char report_mss_unsupported[] ;
 extern const char report_mss[] ;
 extern const char report_datagrams[] ;
 extern const char report_sum_datagrams[] ;
+extern const char report_rate_control[] ;
+extern const char report_rate_control_summary[] ;
+extern const char report_search_trial[] ;
+extern const char report_search_header[] ;
+extern const char report_search_result[] ;
+extern const char report_train_header[] ;
+extern const char report_train_result[] ;
+extern const char report_train_none[] ;
+extern const char report_owd_interval[] ;
+extern const char report_owd_header[] ;
+extern const char report_owd_result[] ;
+extern const char report_hist_interval[] ;
+extern const char report_sum_hist_interval[] ;
+extern const char report_hist_header[] ;
+extern const char report_hist_result[] ;
+extern const char report_sum_hist_result[] ;
+extern const char report_rr_interval[] ;
+extern const char report_sum_rr_interval[] ;
+extern const char report_rr_header[] ;
+extern const char report_rr_open_header[] ;
+extern const char report_crr_header[] ;
+extern const char report_crr_failures[] ;
+extern const char report_rr_result[] ;
+extern const char report_sum_rr_result[] ;
+extern const char report_rr_open_result[] ;
+extern const char report_sum_rr_open_result[] ;
+extern const char report_echo_interval[] ;
+extern const char report_sum_echo_interval[] ;
+extern const char report_echo_header[] ;
+extern const char report_seq_header[] ;
+extern const char report_seq_loss[] ;
+extern const char report_seq_reorder[] ;
+extern const char report_probe_interval[] ;
+extern const char report_probe_header[] ;
+extern const char report_probe_result[] ;
+extern const char report_tcp_sample_interval[] ;
+extern const char report_tcp_sample_rates[] ;
+extern const char report_tcp_sample_header[] ;
+extern const char report_bottleneck_interval[] ;
+extern const char report_tcp_sender_extra[] ;
+extern const char report_tcp_receiver_extra[] ;
+extern const char report_bottleneck_header[] ;
+extern const char report_bottleneck_result[] ;
+extern const char report_bottleneck_hint[] ;
+extern const char report_bottleneck_receiver[] ;
+extern const char report_diag_interval[] ;
+extern const char report_diag_bbr[] ;
+extern const char report_diag_dctcp[] ;
+extern const char report_diag_summary[] ;
+extern const char report_queue_send[] ;
+extern const char report_queue_recv[] ;
+extern const char report_queue_header[] ;
+extern const char report_txstamp_lowat[] ;
+extern const char report_txstamp_header[] ;
+extern const char report_rxstamp_interval[] ;
+extern const char report_rxstamp_header[] ;
+extern const char report_busypoll[] ;
+extern const char report_busypoll_no_napi[] ;
+extern const char report_busypoll_error[] ;
+extern const char report_busypoll_cpu[] ;
+extern const char report_place[] ;
+extern const char report_place_threads[] ;
+extern const char report_place_header[] ;
+extern const char report_place_stream[] ;
+extern const char report_place_summary[] ;
+extern const char report_reads_interval[] ;
+extern const char report_reads_drain[] ;
+extern const char report_reads_lowat[] ;
+extern const char report_reads_header[] ;
 extern const char server_reporting[] ;
 extern const char reportCSV_peer[] ;
 
 extern const char report_cpu[] ;
+extern const char report_cpu_per_gbit[] ;
+extern const char report_cpu_discard[] ;
 extern const char report_local[] ;
 extern const char report_remote[] ;
 extern const char report_sender[] ;
@@ -129,5 +200,6 @@ extern const char warn_buffer_too_small[] ;
 extern const char warn_invalid_single_threaded[] ;
 extern const char warn_invalid_report_style[] ;
 extern const char warn_invalid_report[] ;
+extern const char warn_owd_uncertain[] ;
 
 #endif
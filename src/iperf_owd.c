@@ -0,0 +1,289 @@
+/*
+ * iperf, Copyright (c) 2014-2022, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_owd.h"
+#include "iperf_histogram.h"
+#include "iperf_locale.h"
+#include "iperf_util.h"
+#include "iperf_time.h"
+#include "net.h"
+#include "cjson.h"
+#include "portable_endian.h"
+
+/*
+ * One-way delay (--owd).
+ *
+ * With --owd the UDP header carries the sender's wall clock (TAI or
+ * UTC) instead of its monotonic clock, and the receiver subtracts that
+ * from its own wall clock at arrival.  The two clocks are compared
+ * before the test, NTP style: the client sends its time t1, the server
+ * notes t2 on arrival and t3 on reply, and the client notes t4.  The
+ * server's clock is ahead by ((t2 - t1) + (t3 - t4)) / 2, give or take
+ * half the round trip (t4 - t1) - (t3 - t2); of OWD_SYNC_ROUNDS tries
+ * the one with the shortest round trip is kept.  The receiver corrects
+ * every delay by that offset.
+ *
+ * The comparison is repeated when the test ends, which gives the drift
+ * between the clocks.  The reported delays can be wrong by the sum of
+ * the offset's uncertainty and the drift over the test; when that is
+ * as large as the delays themselves, a warning says so.
+ */
+
+static int64_t
+wallclock_usecs(void)
+{
+    struct iperf_time now;
+
+    iperf_time_now_wallclock(&now);
+    return iperf_time_in_usecs(&now);
+}
+
+static void
+put_usecs(char *buf, int64_t usecs)
+{
+    uint64_t v = htobe64((uint64_t) usecs);
+
+    memcpy(buf, &v, sizeof(v));
+}
+
+static int64_t
+get_usecs(const char *buf)
+{
+    uint64_t v;
+
+    memcpy(&v, buf, sizeof(v));
+    return (int64_t) be64toh(v);
+}
+
+int
+iperf_owd_sync(struct iperf_test *test, int which)
+{
+    struct iperf_clock_sync *sync = &test->owd_sync[which];
+    char buf[24];
+    int64_t t1, t2, t3, t4, delay, best = -1;
+    int i;
+
+    if (test->role == 'c') {
+	for (i = 0; i < OWD_SYNC_ROUNDS; ++i) {
+	    t1 = wallclock_usecs();
+	    put_usecs(buf, t1);
+	    if (Nwrite(test->ctrl_sck, buf, 8, Ptcp) < 0 ||
+		Nread(test->ctrl_sck, buf, 16, Ptcp) != 16) {
+		i_errno = IECLOCKSYNC;
+		return -1;
+	    }
+	    t4 = wallclock_usecs();
+	    t2 = get_usecs(buf);
+	    t3 = get_usecs(buf + 8);
+	    delay = (t4 - t1) - (t3 - t2);
+	    if (best < 0 || delay < best) {
+		best = delay < 0 ? 0 : delay;
+		sync->offset = ((t2 - t1) + (t3 - t4)) / 2;
+		sync->at = t1;
+	    }
+	}
+	sync->uncertainty = (best + 1) / 2;
+	/* Tell the server what we found */
+	put_usecs(buf, sync->offset);
+	put_usecs(buf + 8, sync->uncertainty);
+	put_usecs(buf + 16, sync->at);
+	if (Nwrite(test->ctrl_sck, buf, 24, Ptcp) < 0) {
+	    i_errno = IECLOCKSYNC;
+	    return -1;
+	}
+    } else {
+	for (i = 0; i < OWD_SYNC_ROUNDS; ++i) {
+	    if (Nread(test->ctrl_sck, buf, 8, Ptcp) != 8) {
+		i_errno = IECLOCKSYNC;
+		return -1;
+	    }
+	    put_usecs(buf, wallclock_usecs());
+	    put_usecs(buf + 8, wallclock_usecs());
+	    if (Nwrite(test->ctrl_sck, buf, 16, Ptcp) < 0) {
+		i_errno = IECLOCKSYNC;
+		return -1;
+	    }
+	}
+	if (Nread(test->ctrl_sck, buf, 24, Ptcp) != 24) {
+	    i_errno = IECLOCKSYNC;
+	    return -1;
+	}
+	sync->offset = get_usecs(buf);
+	sync->uncertainty = get_usecs(buf + 8);
+	sync->at = get_usecs(buf + 16);
+    }
+    sync->valid = 1;
+
+    if (test->debug)
+	printf("clock sync %s: server ahead by %.3f ms, +/- %.3f ms\n",
+	       which == OWD_SYNC_BEFORE ? "before" : "after", sync->offset / 1000.0, sync->uncertainty / 1000.0);
+    return 0;
+}
+
+int
+iperf_owd_init(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+
+    if (!test->owd)
+	return 0;
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (sp->sender || sp->owd_interval != NULL)
+	    continue;
+	sp->owd_interval = iperf_histogram_new();
+	sp->owd_total = iperf_histogram_new();
+	if (sp->owd_interval == NULL || sp->owd_total == NULL) {
+	    i_errno = IEINITTEST;
+	    return -1;
+	}
+    }
+    return 0;
+}
+
+void
+iperf_owd_record(struct iperf_stream *sp, struct iperf_time *sent, struct iperf_time *arrival)
+{
+    struct iperf_test *test = sp->test;
+    int64_t offset, owd;
+
+    if (sp->owd_interval == NULL)
+	return;
+    /* The offset is server minus client, so it's the receiver's lead on the server. */
+    offset = test->owd_sync[OWD_SYNC_BEFORE].offset;
+    if (test->role == 'c')
+	offset = -offset;
+    owd = (int64_t) iperf_time_in_usecs(arrival) - (int64_t) iperf_time_in_usecs(sent) - offset;
+    iperf_histogram_record(sp->owd_interval, owd);
+    iperf_histogram_record(sp->owd_total, owd);
+}
+
+void
+iperf_owd_interval(struct iperf_stream *sp, struct iperf_interval_results *irp)
+{
+    struct iperf_histogram *h = sp->owd_interval;
+
+    irp->owd_count = 0;
+    if (h == NULL || h->count == 0)
+	return;
+    irp->owd_count = h->count;
+    irp->owd_min = h->min / 1000.0;
+    irp->owd_avg = iperf_histogram_mean(h) / 1000.0;
+    irp->owd_max = h->max / 1000.0;
+    irp->owd_p99 = iperf_histogram_percentile(h, 99) / 1000.0;
+    iperf_histogram_reset(h);
+}
+
+void
+iperf_owd_summarize(struct iperf_stream *sp)
+{
+    struct iperf_histogram *h = sp->owd_total;
+
+    if (h == NULL)
+	return;
+    sp->owd_count = h->count;
+    sp->owd_min = h->min / 1000.0;
+    sp->owd_avg = iperf_histogram_mean(h) / 1000.0;
+    sp->owd_max = h->max / 1000.0;
+    sp->owd_p99 = iperf_histogram_percentile(h, 99) / 1000.0;
+}
+
+void
+iperf_owd_print_results(struct iperf_test *test)
+{
+    struct iperf_clock_sync *before = &test->owd_sync[OWD_SYNC_BEFORE];
+    struct iperf_clock_sync *after = &test->owd_sync[OWD_SYNC_AFTER];
+    struct iperf_stream *sp;
+    cJSON *j_owd = NULL, *j_streams = NULL;
+    const char *direction;
+    double drift_ppm = 0, uncertainty_ms;
+    int64_t uncertainty, moved;
+    int uncertain;
+
+    if (!test->owd || !before->valid)
+	return;
+
+    /* Worst case error: the offset's own uncertainty plus how far it moved */
+    uncertainty = before->uncertainty;
+    if (after->valid) {
+	if (after->uncertainty > uncertainty)
+	    uncertainty = after->uncertainty;
+	moved = after->offset - before->offset;
+	uncertainty += moved < 0 ? -moved : moved;
+	if (after->at > before->at)
+	    drift_ppm = (double) moved * 1e6 / (after->at - before->at);
+    }
+    uncertainty_ms = uncertainty / 1000.0;
+
+    if (test->json_output) {
+	j_owd = iperf_json_printf("clock_offset_ms: %f  offset_uncertainty_ms: %f  drift_ppm: %f  uncertainty_ms: %f",
+				  before->offset / 1000.0, before->uncertainty / 1000.0, drift_ppm, uncertainty_ms);
+	if (j_owd == NULL)
+	    return;
+	j_streams = cJSON_CreateArray();
+	if (j_streams == NULL) {
+	    cJSON_Delete(j_owd);
+	    return;
+	}
+	cJSON_AddItemToObject(j_owd, "streams", j_streams);
+	cJSON_AddItemToObject(test->json_end, "one_way_delay", j_owd);
+    } else
+	iperf_printf(test, report_owd_header, before->offset / 1000.0,
+		     before->uncertainty / 1000.0, drift_ppm);
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (!sp->sender)
+	    iperf_owd_summarize(sp);
+	if (sp->owd_count == 0)
+	    continue;
+	direction = sp->sender == (test->role == 'c') ? "client->server" : "server->client";
+	uncertain = uncertainty_ms >= sp->owd_avg;
+	if (test->json_output)
+	    cJSON_AddItemToArray(j_streams, iperf_json_printf("socket: %d  direction: %s  packets: %d  min_ms: %f  avg_ms: %f  max_ms: %f  p99_ms: %f  uncertain: %b",
+							      (int64_t) sp->socket, direction, (int64_t) sp->owd_count,
+							      sp->owd_min, sp->owd_avg, sp->owd_max, sp->owd_p99, uncertain));
+	else {
+	    iperf_printf(test, report_owd_result, sp->socket, direction, sp->owd_min,
+			 sp->owd_avg, sp->owd_max, sp->owd_p99, (int) sp->owd_count);
+	    if (uncertain)
+		iperf_printf(test, warn_owd_uncertain, uncertainty_ms, sp->owd_avg);
+	}
+    }
+}
+
+void
+iperf_owd_free_stream(struct iperf_stream *sp)
+{
+    iperf_histogram_free(sp->owd_interval);
+    iperf_histogram_free(sp->owd_total);
+    sp->owd_interval = sp->owd_total = NULL;
+}
@@ -0,0 +1,79 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_OWD_H
+#define __IPERF_OWD_H
+
+/**
+ * iperf_owd_sync -- compare clocks with the other side over the control
+ * connection; both sides call it at the same point in the protocol, and
+ * the client drives the exchange.  which is OWD_SYNC_BEFORE or
+ * OWD_SYNC_AFTER.
+ *
+ * returns 0 on success, -1 (with i_errno set) on failure
+ *
+ */
+int iperf_owd_sync(struct iperf_test *, int which);
+
+/**
+ * iperf_owd_init -- give each receiving stream its delay histograms
+ *
+ * returns 0 on success
+ *
+ */
+int iperf_owd_init(struct iperf_test *);
+
+/**
+ * iperf_owd_record -- account one datagram's one-way delay; both times
+ * are from iperf_time_now_wallclock() on their own hosts
+ *
+ */
+void iperf_owd_record(struct iperf_stream *, struct iperf_time *sent, struct iperf_time *arrival);
+
+/**
+ * iperf_owd_interval -- move the interval's delays into irp and start
+ * a new interval
+ *
+ */
+void iperf_owd_interval(struct iperf_stream *, struct iperf_interval_results *);
+
+/**
+ * iperf_owd_summarize -- fill in the stream's whole-test totals from
+ * its histogram (receiving streams only)
+ *
+ */
+void iperf_owd_summarize(struct iperf_stream *);
+
+/**
+ * iperf_owd_print_results -- print each direction's delays and the
+ * clock comparison, or add them to the JSON output
+ *
+ */
+void iperf_owd_print_results(struct iperf_test *);
+
+void iperf_owd_free_stream(struct iperf_stream *);
+
+#endif
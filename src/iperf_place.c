@@ -0,0 +1,862 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+#include "iperf_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <ifaddrs.h>
+#include <sched.h>
+#if defined(HAVE_PTHREAD_SETAFFINITY_NP)
+#include <pthread.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#endif /* HAVE_PTHREAD_SETAFFINITY_NP */
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_place.h"
+#include "iperf_locale.h"
+#include "iperf_util.h"
+#include "net.h"
+#include "timer.h"
+#include "units.h"
+#include "cjson.h"
+
+/*
+ * CPU and NUMA placement (--place).
+ *
+ * -A pins the process to one CPU chosen beforehand.  What matters on a
+ * multi-socket box is where that CPU sits next to the ones the kernel
+ * handles the streams' packets on: the NIC's interrupt for the RX
+ * queue a flow hashes to raises a softirq on the CPU the IRQ is
+ * affine to, and the data is copied out on whichever CPU iperf runs
+ * on.  Apart, every byte crosses between caches, or between nodes.
+ *
+ * For every stream SO_INCOMING_CPU gives the CPU its packets were last
+ * processed on, sampled each interval; a flow whose RX queue or RPS
+ * CPU changes shows as moves.  The stream's NIC is found from its local
+ * address, and its NUMA node and local CPUs read from
+ * /sys/class/net/IF/device, and the CPUs its interrupts are affine to
+ * from the device's msi_irqs and /proc/irq/N.  Loopback and virtual
+ * devices have none of these and are reported as such.
+ *
+ * With a CPU list, or "rx", each stream instead runs in a thread of
+ * its own, pinned round-robin to the listed CPUs or kept on the CPU
+ * its packets are processed on, which is looked up again every
+ * PLACE_TIMER_USECS as RPS or the queue's IRQ may move it.  The main
+ * loop keeps the control connection and the timers.  The threads take
+ * a read lock around each read or write, and the main loop holds the
+ * write lock all but while it waits in select(), so everything it does
+ * (stats, reports, samplers) sees the streams standing still; the lock
+ * prefers writers, or a thread that always has something to send would
+ * keep the main loop out.  What a thread moved is added to the test's
+ * totals when the main loop next takes the lock, so -n and -k are met
+ * within PLACE_TIMER_USECS.  Anything that shares state between streams
+ * on the data path (--rr, --echo, --trains, --search, --rate-control,
+ * --busy-poll, --trace, -F) keeps to the single-threaded loop.
+ */
+
+#if defined(HAVE_SCHED_SETAFFINITY) && defined(SO_INCOMING_CPU)
+
+struct place_nic {
+    char      name[IFNAMSIZ];		/* "" if not found */
+    int       node;			/* NUMA node of the device; -1 if unknown */
+    char      cpus[PLACE_LIST_LEN];	/* CPUs local to it; "" if unknown */
+    int       irqs;			/* its MSI interrupts */
+    char      irq_cpus[PLACE_LIST_LEN];	/* the CPUs they are affine to */
+};
+
+/* The first line of a sysfs or procfs file */
+static int
+read_line(const char *path, char *buf, size_t len)
+{
+    FILE *fp;
+    char *nl;
+
+    if ((fp = fopen(path, "r")) == NULL)
+	return -1;
+    if (fgets(buf, len, fp) == NULL) {
+	fclose(fp);
+	return -1;
+    }
+    fclose(fp);
+    if ((nl = strchr(buf, '\n')) != NULL)
+	*nl = '\0';
+    return 0;
+}
+
+/* A list such as "0-3,8,10-11" into a CPU set */
+static void
+parse_cpulist(const char *list, cpu_set_t *set)
+{
+    const char *p = list;
+    char *end;
+    long lo, hi;
+
+    while (*p != '\0') {
+	lo = strtol(p, &end, 10);
+	if (end == p)
+	    return;
+	hi = lo;
+	if (*end == '-') {
+	    p = end + 1;
+	    hi = strtol(p, &end, 10);
+	    if (end == p)
+		return;
+	}
+	for (; lo <= hi && lo < CPU_SETSIZE; ++lo)
+	    if (lo >= 0)
+		CPU_SET(lo, set);
+	p = *end == ',' ? end + 1 : end;
+	if (*end != ',' && *end != '\0')
+	    return;
+    }
+}
+
+/* And back, "" for none; a list too long for len is cut at a whole range */
+static void
+format_cpulist(cpu_set_t *set, char *buf, size_t len)
+{
+    char range[32];
+    int cpu, last;
+    size_t used = 0;
+
+    buf[0] = '\0';
+    for (cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+	if (!CPU_ISSET(cpu, set))
+	    continue;
+	for (last = cpu; last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, set); ++last)
+	    ;
+	if (last == cpu)
+	    snprintf(range, sizeof(range), "%s%d", used ? "," : "", cpu);
+	else
+	    snprintf(range, sizeof(range), "%s%d-%d", used ? "," : "", cpu, last);
+	if (used + strlen(range) + 1 > len)
+	    return;
+	strcpy(buf + used, range);
+	used += strlen(range);
+	cpu = last;
+    }
+}
+
+/* The NUMA node a CPU belongs to, from its sysfs nodeN link */
+static int
+cpu_node(int cpu)
+{
+    char path[64];
+    DIR *dir;
+    struct dirent *de;
+    int node = -1;
+
+    if (cpu < 0)
+	return -1;
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    if ((dir = opendir(path)) == NULL)
+	return -1;
+    while ((de = readdir(dir)) != NULL)
+	if (strncmp(de->d_name, "node", 4) == 0 && de->d_name[4] >= '0' && de->d_name[4] <= '9') {
+	    node = atoi(de->d_name + 4);
+	    break;
+	}
+    closedir(dir);
+    return node;
+}
+
+static int
+incoming_cpu(struct iperf_stream *sp)
+{
+    int cpu = -1;
+    socklen_t len = sizeof(cpu);
+
+    if (getsockopt(sp->socket, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) < 0)
+	return -1;
+    return cpu;
+}
+
+/* Whether an interface address is the stream's local one, IPv4-mapped or not */
+static int
+same_addr(const struct sockaddr *ifa, const struct sockaddr_storage *local)
+{
+    const struct sockaddr_in6 *l6 = (const struct sockaddr_in6 *) local;
+
+    if (ifa->sa_family == AF_INET && local->ss_family == AF_INET)
+	return ((const struct sockaddr_in *) ifa)->sin_addr.s_addr ==
+	    ((const struct sockaddr_in *) local)->sin_addr.s_addr;
+    if (ifa->sa_family == AF_INET && local->ss_family == AF_INET6 &&
+	IN6_IS_ADDR_V4MAPPED(&l6->sin6_addr))
+	return memcmp(&((const struct sockaddr_in *) ifa)->sin_addr, &l6->sin6_addr.s6_addr[12], 4) == 0;
+    if (ifa->sa_family == AF_INET6 && local->ss_family == AF_INET6)
+	return memcmp(&((const struct sockaddr_in6 *) ifa)->sin6_addr, &l6->sin6_addr,
+		      sizeof(struct in6_addr)) == 0;
+    return 0;
+}
+
+/* The device a stream's local address is on, and where it and its interrupts sit */
+static void
+nic_info(struct iperf_stream *sp, struct place_nic *nic)
+{
+    struct ifaddrs *ifap, *ifa;
+    char path[PATH_MAX], buf[PLACE_LIST_LEN];
+    DIR *dir;
+    struct dirent *de;
+    cpu_set_t irq_set;
+
+    memset(nic, 0, sizeof(*nic));
+    nic->node = -1;
+    if (getifaddrs(&ifap) < 0)
+	return;
+    for (ifa = ifap; ifa != NULL; ifa = ifa->ifa_next)
+	if (ifa->ifa_addr != NULL && same_addr(ifa->ifa_addr, &sp->local_addr)) {
+	    snprintf(nic->name, sizeof(nic->name), "%s", ifa->ifa_name);
+	    break;
+	}
+    freeifaddrs(ifap);
+    if (nic->name[0] == '\0')
+	return;
+
+    snprintf(path, sizeof(path), "/sys/class/net/%s/device/numa_node", nic->name);
+    if (read_line(path, buf, sizeof(buf)) == 0)
+	nic->node = atoi(buf);
+    snprintf(path, sizeof(path), "/sys/class/net/%s/device/local_cpulist", nic->name);
+    if (read_line(path, buf, sizeof(buf)) == 0)
+	snprintf(nic->cpus, sizeof(nic->cpus), "%s", buf);
+
+    snprintf(path, sizeof(path), "/sys/class/net/%s/device/msi_irqs", nic->name);
+    if ((dir = opendir(path)) == NULL)
+	return;
+    CPU_ZERO(&irq_set);
+    while ((de = readdir(dir)) != NULL) {
+	if (de->d_name[0] < '0' || de->d_name[0] > '9')
+	    continue;
+	nic->irqs++;
+	snprintf(path, sizeof(path), "/proc/irq/%s/effective_affinity_list", de->d_name);
+	if (read_line(path, buf, sizeof(buf)) < 0 || buf[0] == '\0') {
+	    snprintf(path, sizeof(path), "/proc/irq/%s/smp_affinity_list", de->d_name);
+	    if (read_line(path, buf, sizeof(buf)) < 0)
+		continue;
+	}
+	parse_cpulist(buf, &irq_set);
+    }
+    closedir(dir);
+    format_cpulist(&irq_set, nic->irq_cpus, sizeof(nic->irq_cpus));
+}
+
+int
+iperf_place_init(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+
+    if (test->place == 0)
+	return 0;
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	sp->incoming_cpu = -1;
+	sp->incoming_moves = 0;
+	sp->place_cpu = sp->place_ran_on = -1;
+    }
+    return 0;
+}
+
+void
+iperf_place_interval(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    int cpu;
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	cpu = incoming_cpu(sp);
+	if (cpu < 0)
+	    continue;
+	if (sp->incoming_cpu >= 0 && cpu != sp->incoming_cpu)
+	    sp->incoming_moves++;
+	sp->incoming_cpu = cpu;
+    }
+}
+
+/* CPUs and nodes in JSON, left out where unknown */
+static void
+json_id(cJSON *j, const char *name, int n)
+{
+    if (n >= 0)
+	cJSON_AddNumberToObject(j, name, n);
+}
+
+static void
+print_id(char *buf, size_t len, int n)
+{
+    if (n < 0)
+	snprintf(buf, len, "-");
+    else
+	snprintf(buf, len, "%d", n);
+}
+
+void
+iperf_place_print_results(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct place_nic nic;
+    cJSON *j_place = NULL, *j_streams = NULL, *j_stream;
+    char mbuf[UNIT_LEN], cbuf[16], nbuf[16], nicbuf[16], tbuf[16];
+    int cpu, node, read_cpu, read_node, rx_node, local, same_cpu, rows = 0, locals = 0;
+
+    /* A last look, for tests shorter than an interval or run with -i 0 */
+    iperf_place_interval(test);
+    cpu = sched_getcpu();
+    node = cpu_node(cpu);
+
+    if (test->json_output) {
+	if ((j_place = cJSON_CreateObject()) == NULL)
+	    return;
+	json_id(j_place, "cpu", cpu);
+	json_id(j_place, "node", node);
+	if (test->place_cpus != NULL)
+	    cJSON_AddStringToObject(j_place, "threads", test->place_cpus);
+	if ((j_streams = cJSON_CreateArray()) == NULL) {
+	    cJSON_Delete(j_place);
+	    return;
+	}
+	cJSON_AddItemToObject(j_place, "streams", j_streams);
+	cJSON_AddItemToObject(test->json_end, "placement", j_place);
+    } else {
+	print_id(cbuf, sizeof(cbuf), cpu);
+	print_id(nbuf, sizeof(nbuf), node);
+	iperf_printf(test, report_place, cbuf, nbuf);
+	if (test->place_cpus != NULL)
+	    iperf_printf(test, report_place_threads,
+			 strcmp(test->place_cpus, "rx") == 0 ? "its receive CPU" : test->place_cpus);
+    }
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	nic_info(sp, &nic);
+	rx_node = cpu_node(sp->incoming_cpu);
+	/* Copied out by its own thread, or by the main loop */
+	read_cpu = sp->place_ran_on >= 0 ? sp->place_ran_on : cpu;
+	read_node = sp->place_ran_on >= 0 ? cpu_node(read_cpu) : node;
+	/* On the same node as the copy out, or unknown */
+	local = rx_node >= 0 && read_node >= 0 ? rx_node == read_node : -1;
+	same_cpu = sp->incoming_cpu >= 0 && sp->incoming_cpu == read_cpu;
+	locals += same_cpu || local == 1;
+	if (test->json_output) {
+	    if ((j_stream = iperf_json_printf("socket: %d  moves: %d  same_node: %b  same_cpu: %b  interface: %s  nic_cpus: %s  irqs: %d  irq_cpus: %s",
+					      (int64_t) sp->socket, (int64_t) sp->incoming_moves,
+					      local == 1, same_cpu, nic.name, nic.cpus,
+					      (int64_t) nic.irqs, nic.irq_cpus)) == NULL)
+		return;
+	    json_id(j_stream, "incoming_cpu", sp->incoming_cpu);
+	    json_id(j_stream, "incoming_node", rx_node);
+	    json_id(j_stream, "nic_node", nic.node);
+	    json_id(j_stream, "thread_cpu", sp->place_cpu);
+	    json_id(j_stream, "ran_on_cpu", sp->place_ran_on);
+	    cJSON_AddItemToArray(j_streams, j_stream);
+	    continue;
+	}
+	if (rows++ == 0)
+	    iperf_printf(test, "%s", report_place_header);
+	if (test->mode == BIDIRECTIONAL)
+	    sprintf(mbuf, "[%s-%s]", sp->sender ? "TX" : "RX", test->role == 'c' ? "C" : "S");
+	else
+	    mbuf[0] = '\0';
+	print_id(cbuf, sizeof(cbuf), sp->incoming_cpu);
+	print_id(nbuf, sizeof(nbuf), rx_node);
+	print_id(nicbuf, sizeof(nicbuf), nic.node);
+	print_id(tbuf, sizeof(tbuf), sp->place_cpu);
+	iperf_printf(test, report_place_stream, sp->socket, mbuf, tbuf, cbuf, nbuf, sp->incoming_moves,
+		     same_cpu ? "cpu" : local < 0 ? "-" : local ? "node" : "no",
+		     nic.name[0] ? nic.name : "-", nicbuf, nic.cpus[0] ? nic.cpus : "-",
+		     nic.irqs, nic.irq_cpus[0] ? nic.irq_cpus : "-");
+    }
+    if (!test->json_output && rows)
+	iperf_printf(test, report_place_summary, locals, rows);
+}
+
+#else /* HAVE_SCHED_SETAFFINITY && SO_INCOMING_CPU */
+
+/* --place is refused at parse time without these */
+int
+iperf_place_init(struct iperf_test *test)
+{
+    return 0;
+}
+
+void
+iperf_place_interval(struct iperf_test *test)
+{
+}
+
+void
+iperf_place_print_results(struct iperf_test *test)
+{
+}
+
+#endif /* HAVE_SCHED_SETAFFINITY && SO_INCOMING_CPU */
+
+#if defined(HAVE_SCHED_SETAFFINITY) && defined(SO_INCOMING_CPU) && defined(HAVE_PTHREAD_SETAFFINITY_NP)
+
+/* The stream threads' shared state */
+struct iperf_place {
+    pthread_rwlock_t lock;		/* read: a thread on its socket; write: the main loop */
+    int       held;			/* the main loop has the write lock */
+    int       stop;			/* the threads are to return */
+    int       rx;			/* "rx": follow each stream's receive CPU */
+    Timer    *timer;
+};
+
+struct iperf_place_worker {
+    struct iperf_stream *sp;
+    pthread_t thread;
+    iperf_size_t bytes;			/* moved since the main loop last looked */
+    iperf_size_t blocks;
+    int       error;			/* i_errno it stopped on, else 0 */
+    int       saved_errno;
+};
+
+/* One end's part of --place=: "rx" or a CPU list such as "0-3,8" */
+static int
+valid_spec(const char *spec)
+{
+    const char *p = spec;
+    char *end;
+    long lo, hi;
+
+    if (strcmp(spec, "rx") == 0)
+	return 1;
+    while (*p != '\0') {
+	if (*p < '0' || *p > '9')
+	    return 0;
+	lo = hi = strtol(p, &end, 10);
+	if (*end == '-') {
+	    p = end + 1;
+	    if (*p < '0' || *p > '9')
+		return 0;
+	    hi = strtol(p, &end, 10);
+	}
+	if (lo > hi || hi >= CPU_SETSIZE)
+	    return 0;
+	if (*end == ',' && end[1] != '\0')
+	    ++end;
+	else if (*end != '\0')
+	    return 0;
+	p = end;
+    }
+    return 1;
+}
+
+int
+iperf_place_parse(struct iperf_test *test, const char *arg)
+{
+    char *copy, *peer;
+    int ok;
+
+    if ((copy = strdup(arg)) == NULL) {
+	i_errno = IEPLACE;
+	return -1;
+    }
+    if ((peer = strchr(copy, '/')) != NULL)
+	*peer++ = '\0';
+    else
+	peer = copy;
+    ok = (copy[0] != '\0' || peer[0] != '\0') &&
+	(copy[0] == '\0' || valid_spec(copy)) && (peer[0] == '\0' || valid_spec(peer));
+    free(test->place_cpus);
+    free(test->place_peer_cpus);
+    test->place_cpus = ok && copy[0] != '\0' ? strdup(copy) : NULL;
+    test->place_peer_cpus = ok && peer[0] != '\0' ? strdup(peer) : NULL;
+    free(copy);
+    if (!ok) {
+	i_errno = IEPLACE;
+	return -1;
+    }
+    return 0;
+}
+
+int
+iperf_place_check(struct iperf_test *test)
+{
+    cpu_set_t set, allowed;
+    int cpu;
+
+    if (test->place_cpus == NULL || strcmp(test->place_cpus, "rx") == 0)
+	return 0;
+    CPU_ZERO(&set);
+    parse_cpulist(test->place_cpus, &set);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+	i_errno = IEPLACETHREAD;
+	return -1;
+    }
+    for (cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+	if (CPU_ISSET(cpu, &set) && !CPU_ISSET(cpu, &allowed)) {
+	    errno = EINVAL;
+	    i_errno = IEPLACETHREAD;
+	    return -1;
+	}
+    return 0;
+}
+
+/* A stream's thread: its reads or writes, one at a time under the read lock */
+static void *
+worker_main(void *arg)
+{
+    struct iperf_place_worker *w = arg;
+    struct iperf_stream *sp = w->sp;
+    struct iperf_test *test = sp->test;
+    struct iperf_place *pl = test->place_threads;
+    struct iperf_time now;
+    struct timespec ts;
+    struct pollfd pfd;
+    int r, idle = 0;
+
+    for (;;) {
+	pthread_rwlock_rdlock(&pl->lock);
+	if (pl->stop) {
+	    pthread_rwlock_unlock(&pl->lock);
+	    break;
+	}
+	sp->place_ran_on = sched_getcpu();
+	r = 0;
+	if (sp->sender) {
+	    if (!sp->green_light) {
+		iperf_time_now(&now);
+		iperf_check_throttle(sp, &now);
+	    }
+	    if (sp->green_light && (r = sp->snd(sp)) > 0) {
+		w->bytes += r;
+		if (!sp->pending_size)
+		    ++w->blocks;
+		if (test->settings->rate != 0) {
+		    iperf_time_now(&now);
+		    iperf_check_throttle(sp, &now);
+		}
+	    } else if (r < 0 && r != NET_SOFTERROR) {
+		w->error = IESTREAMWRITE;
+		w->saved_errno = errno;
+	    }
+	} else if ((r = sp->rcv(sp)) > 0) {
+	    w->bytes += r;
+	    ++w->blocks;
+	} else if (r < 0) {
+	    w->error = IESTREAMREAD;
+	    w->saved_errno = errno;
+	}
+	pthread_rwlock_unlock(&pl->lock);
+	if (w->error)
+	    break;
+	if (r > 0) {
+	    idle = 0;
+	    continue;
+	}
+
+	/*
+	 * Nothing moved: paced, or the socket is full or empty.  Wait for
+	 * it, not for long so a stop is seen; a receiver whose socket is
+	 * ready but still gives nothing is at end of file, so sleep.
+	 */
+	if (sp->sender && !sp->green_light) {
+	    ts.tv_sec = 0;
+	    ts.tv_nsec = (long) test->settings->pacing_timer * 1000;
+	    nanosleep(&ts, NULL);
+	    continue;
+	}
+	pfd.fd = sp->socket;
+	pfd.events = sp->sender ? POLLOUT : POLLIN;
+	if (poll(&pfd, 1, PLACE_POLL_MSECS) > 0 && ++idle > 1) {
+	    ts.tv_sec = 0;
+	    ts.tv_nsec = PLACE_POLL_MSECS * 1000000L;
+	    nanosleep(&ts, NULL);
+	}
+    }
+    return NULL;
+}
+
+/* Pin a stream's thread to a CPU; 0, or an errno */
+static int
+pin(struct iperf_stream *sp, int cpu)
+{
+    cpu_set_t set;
+    int rc;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if ((rc = pthread_setaffinity_np(sp->place_worker->thread, sizeof(set), &set)) == 0)
+	sp->place_cpu = cpu;
+    return rc;
+}
+
+/*
+ * Every PLACE_TIMER_USECS: keep "rx" threads on their streams' receive
+ * CPUs.  The wakeup also gets the threads' totals into the test for
+ * the -n and -k checks.
+ */
+static void
+place_timer_proc(TimerClientData client_data, struct iperf_time *nowP)
+{
+    struct iperf_test *test = client_data.p;
+    struct iperf_stream *sp;
+    int cpu;
+
+    if (!test->place_threads->rx)
+	return;
+    SLIST_FOREACH(sp, &test->streams, streams)
+	if (sp->place_worker != NULL && (cpu = incoming_cpu(sp)) >= 0 && cpu != sp->place_cpu)
+	    pin(sp, cpu);
+}
+
+int
+iperf_place_start(struct iperf_test *test)
+{
+    struct iperf_place *pl;
+    struct iperf_stream *sp;
+    pthread_rwlockattr_t attr;
+    TimerClientData cd;
+    struct iperf_time now;
+    sigset_t all, saved;
+    cpu_set_t set;
+    int cpus[CPU_SETSIZE], ncpus = 0, i = 0, cpu, rc;
+
+    if (test->place_cpus == NULL || test->place_threads != NULL)
+	return 0;
+    if ((pl = calloc(1, sizeof(*pl))) == NULL) {
+	i_errno = IEPLACETHREAD;
+	return -1;
+    }
+    pl->rx = strcmp(test->place_cpus, "rx") == 0;
+    if (!pl->rx) {
+	CPU_ZERO(&set);
+	parse_cpulist(test->place_cpus, &set);
+	for (cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+	    if (CPU_ISSET(cpu, &set))
+		cpus[ncpus++] = cpu;
+    }
+    pthread_rwlockattr_init(&attr);
+#if defined(__GLIBC__)
+    /* Or a thread that always has something to send keeps the main loop out */
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif /* __GLIBC__ */
+    rc = pthread_rwlock_init(&pl->lock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+    if (rc != 0) {
+	free(pl);
+	errno = rc;
+	i_errno = IEPLACETHREAD;
+	return -1;
+    }
+    /* The threads wait for the main loop's first select() */
+    pthread_rwlock_wrlock(&pl->lock);
+    pl->held = 1;
+    test->place_threads = pl;
+
+    /* Signals go to the main loop, whose handlers longjmp out of it */
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &saved);
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	FD_CLR(sp->socket, &test->read_set);
+	FD_CLR(sp->socket, &test->write_set);
+	if (sp->send_timer != NULL) {
+	    tmr_cancel(sp->send_timer);
+	    sp->send_timer = NULL;
+	}
+	if (!sp->sender)
+	    setnonblocking(sp->socket, 1);
+	if ((sp->place_worker = calloc(1, sizeof(*sp->place_worker))) == NULL) {
+	    rc = ENOMEM;
+	    goto fail;
+	}
+	sp->place_worker->sp = sp;
+	if ((rc = pthread_create(&sp->place_worker->thread, NULL, worker_main, sp->place_worker)) != 0) {
+	    free(sp->place_worker);
+	    sp->place_worker = NULL;
+	    goto fail;
+	}
+	cpu = pl->rx ? incoming_cpu(sp) : cpus[i++ % ncpus];
+	if (cpu >= 0 && (rc = pin(sp, cpu)) != 0 && !pl->rx)
+	    goto fail;
+    }
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+
+    cd.p = test;
+    iperf_time_now(&now);
+    if ((pl->timer = tmr_create(test->timers, &now, place_timer_proc, cd, PLACE_TIMER_USECS, 1)) == NULL) {
+	rc = ENOMEM;
+	goto fail;
+    }
+    return 0;
+
+  fail:
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    iperf_place_stop(test);
+    errno = rc;
+    i_errno = IEPLACETHREAD;
+    return -1;
+}
+
+/* Add what the threads moved to the test's totals; whether any was received */
+static int
+collect(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_place_worker *w;
+    int received = 0;
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if ((w = sp->place_worker) == NULL)
+	    continue;
+	if (sp->sender) {
+	    test->bytes_sent += w->bytes;
+	    test->blocks_sent += w->blocks;
+	} else {
+	    test->bytes_received += w->bytes;
+	    test->blocks_received += w->blocks;
+	    received |= w->bytes > 0;
+	}
+	w->bytes = w->blocks = 0;
+    }
+    return received;
+}
+
+int
+iperf_place_pause(struct iperf_test *test)
+{
+    struct iperf_place *pl = test->place_threads;
+    struct iperf_stream *sp;
+    int received;
+
+    if (pl == NULL)
+	return 0;
+    if (!pl->held) {
+	pthread_rwlock_wrlock(&pl->lock);
+	pl->held = 1;
+    }
+    received = collect(test);
+    SLIST_FOREACH(sp, &test->streams, streams)
+	if (sp->place_worker != NULL && sp->place_worker->error) {
+	    errno = sp->place_worker->saved_errno;
+	    i_errno = sp->place_worker->error;
+	    return -1;
+	}
+    return received;
+}
+
+void
+iperf_place_resume(struct iperf_test *test)
+{
+    struct iperf_place *pl = test->place_threads;
+
+    if (pl != NULL && pl->held) {
+	pl->held = 0;
+	pthread_rwlock_unlock(&pl->lock);
+    }
+}
+
+void
+iperf_place_stop(struct iperf_test *test)
+{
+    struct iperf_place *pl = test->place_threads;
+    struct iperf_stream *sp;
+
+    if (pl == NULL)
+	return;
+    if (!pl->held)
+	pthread_rwlock_wrlock(&pl->lock);
+    pl->stop = 1;
+    pthread_rwlock_unlock(&pl->lock);
+    SLIST_FOREACH(sp, &test->streams, streams)
+	if (sp->place_worker != NULL)
+	    pthread_join(sp->place_worker->thread, NULL);
+    collect(test);
+
+    /* The main loop has the sockets back */
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (sp->place_worker == NULL)
+	    continue;
+	free(sp->place_worker);
+	sp->place_worker = NULL;
+	if (sp->socket < 0)
+	    continue;
+	if (sp->sender)
+	    FD_SET(sp->socket, &test->write_set);
+	else
+	    FD_SET(sp->socket, &test->read_set);
+    }
+    if (pl->timer != NULL)
+	tmr_cancel(pl->timer);
+    pthread_rwlock_destroy(&pl->lock);
+    free(pl);
+    test->place_threads = NULL;
+}
+
+#else /* HAVE_SCHED_SETAFFINITY && SO_INCOMING_CPU && HAVE_PTHREAD_SETAFFINITY_NP */
+
+/* --place= is refused at parse time without these; a server still gets asked, and says no */
+int
+iperf_place_parse(struct iperf_test *test, const char *arg)
+{
+    i_errno = IEUNIMP;
+    return -1;
+}
+
+int
+iperf_place_check(struct iperf_test *test)
+{
+    if (test->place_cpus == NULL)
+	return 0;
+    i_errno = IEUNIMP;
+    return -1;
+}
+
+int
+iperf_place_start(struct iperf_test *test)
+{
+    return 0;
+}
+
+int
+iperf_place_pause(struct iperf_test *test)
+{
+    return 0;
+}
+
+void
+iperf_place_resume(struct iperf_test *test)
+{
+}
+
+void
+iperf_place_stop(struct iperf_test *test)
+{
+}
+
+#endif /* HAVE_SCHED_SETAFFINITY && SO_INCOMING_CPU && HAVE_PTHREAD_SETAFFINITY_NP */
@@ -0,0 +1,94 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_PLACE_H
+#define __IPERF_PLACE_H
+
+/**
+ * iperf_place_init -- forget the streams' receive CPUs
+ *
+ */
+int iperf_place_init(struct iperf_test *);
+
+/**
+ * iperf_place_interval -- note the CPU each stream's packets were
+ * last processed on (SO_INCOMING_CPU), and count its moves
+ *
+ */
+void iperf_place_interval(struct iperf_test *);
+
+/**
+ * iperf_place_print_results -- print each stream's receive CPU and
+ * NUMA node next to the process's and its NIC's, or add them to the
+ * JSON output
+ *
+ */
+void iperf_place_print_results(struct iperf_test *);
+
+/**
+ * iperf_place_parse -- take --place='s argument: "rx" or a CPU list,
+ * or one for each end as CLIENT/SERVER
+ *
+ */
+int iperf_place_parse(struct iperf_test *, const char *);
+
+/**
+ * iperf_place_check -- whether this end may run its stream threads on
+ * the CPUs it was given
+ *
+ */
+int iperf_place_check(struct iperf_test *);
+
+/**
+ * iperf_place_start -- with a CPU list or "rx", move each stream out
+ * of the main loop into a thread of its own, pinned; the main loop
+ * holds them until iperf_place_resume()
+ *
+ */
+int iperf_place_start(struct iperf_test *);
+
+/**
+ * iperf_place_pause -- stop the stream threads after select(), and add
+ * what they moved to the test's totals; 1 if any was received, or -1
+ * if a thread failed
+ *
+ */
+int iperf_place_pause(struct iperf_test *);
+
+/**
+ * iperf_place_resume -- let the stream threads run again, before select()
+ *
+ */
+void iperf_place_resume(struct iperf_test *);
+
+/**
+ * iperf_place_stop -- join the stream threads and give their sockets
+ * back to the main loop
+ *
+ */
+void iperf_place_stop(struct iperf_test *);
+
+#endif
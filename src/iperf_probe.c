@@ -0,0 +1,389 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_probe.h"
+#include "iperf_histogram.h"
+#include "iperf_locale.h"
+#include "iperf_util.h"
+#include "iperf_time.h"
+#include "timer.h"
+#include "net.h"
+#include "cjson.h"
+
+/*
+ * Latency under load (--probe), after the responsiveness test of
+ * draft-ietf-ippm-responsiveness.
+ *
+ * Besides its streams the client opens one more TCP connection, to the
+ * listener iperf_crr_setup gives the server, and sends a one-byte probe
+ * on it every probe_interval ms, which the server sends straight back.
+ * PROBE_IDLE_ROUNDS probes go before the streams start, for the idle
+ * round trip, and the rest while the streams are loading the path.  A
+ * probe waits for the one before it, so on a badly bloated path they
+ * go less often than asked.  With --probe-streams the client also
+ * reads the loaded TCP streams' own smoothed RTT at every probe.
+ *
+ * Responsiveness is round trips per minute (RPM) at the median round
+ * trip.  The probe connection is not a stream, so its bytes are in no
+ * stream's or sum's throughput.
+ */
+
+int
+iperf_probe_setup(struct iperf_test *test)
+{
+    struct iperf_probe *probe;
+    struct iperf_time start, now, diff;
+    struct timeval tv;
+    fd_set fds;
+    char c = 0;
+    int fd, i, opt = 1;
+
+    if ((probe = calloc(1, sizeof(*probe))) == NULL) {
+	i_errno = IEINITTEST;
+	return -1;
+    }
+    probe->fd = -1;
+    test->probe = probe;
+    probe->idle = iperf_histogram_new();
+    probe->loaded = iperf_histogram_new();
+    probe->loaded_total = iperf_histogram_new();
+    if (probe->idle == NULL || probe->loaded == NULL || probe->loaded_total == NULL) {
+	i_errno = IEINITTEST;
+	return -1;
+    }
+    if (test->probe_streams) {
+	probe->streams = iperf_histogram_new();
+	probe->streams_total = iperf_histogram_new();
+	if (probe->streams == NULL || probe->streams_total == NULL) {
+	    i_errno = IEINITTEST;
+	    return -1;
+	}
+    }
+
+    if (test->role == 'c') {
+	fd = socket(test->crr_addr.ss_family, SOCK_STREAM, 0);
+	if (fd < 0) {
+	    i_errno = IEPROBECONNECT;
+	    return -1;
+	}
+	probe->fd = fd;
+	if ((test->crr_locallen > 0 && bind(fd, (struct sockaddr *) &test->crr_local, test->crr_locallen) < 0) ||
+	    connect(fd, (struct sockaddr *) &test->crr_addr, test->crr_addrlen) < 0) {
+	    i_errno = IEPROBECONNECT;
+	    return -1;
+	}
+    } else {
+	FD_ZERO(&fds);
+	FD_SET(test->crr_listener, &fds);
+	tv.tv_sec = PROBE_ACCEPT_SECS;
+	tv.tv_usec = 0;
+	if (select(test->crr_listener + 1, &fds, NULL, NULL, &tv) <= 0 ||
+	    (fd = accept(test->crr_listener, NULL, NULL)) < 0) {
+	    i_errno = IEPROBECONNECT;
+	    return -1;
+	}
+	probe->fd = fd;
+	/* The listener was non-blocking; the probe connection mustn't start out that way */
+	if (setnonblocking(fd, 0) < 0) {
+	    i_errno = IEPROBECONNECT;
+	    return -1;
+	}
+    }
+    if (fd >= FD_SETSIZE) {
+	i_errno = IEPROBECONNECT;
+	return -1;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+    /* Nothing else is moving yet: these are the idle round trips */
+    for (i = 0; i < PROBE_IDLE_ROUNDS; ++i) {
+	iperf_time_now(&start);
+	if (test->role == 'c') {
+	    if (Nwrite(fd, &c, 1, Ptcp) < 0 || Nread(fd, &c, 1, Ptcp) != 1) {
+		i_errno = IEPROBECONNECT;
+		return -1;
+	    }
+	    iperf_time_now(&now);
+	    iperf_time_diff(&now, &start, &diff);
+	    iperf_histogram_record(probe->idle, iperf_time_in_usecs(&diff));
+	} else if (Nread(fd, &c, 1, Ptcp) != 1 || Nwrite(fd, &c, 1, Ptcp) < 0) {
+	    i_errno = IEPROBECONNECT;
+	    return -1;
+	}
+    }
+
+    if (setnonblocking(fd, 1) < 0) {
+	i_errno = IEPROBECONNECT;
+	return -1;
+    }
+    FD_SET(fd, &test->read_set);
+    if (fd > test->max_fd)
+	test->max_fd = fd;
+    return 0;
+}
+
+static void
+probe_timer_proc(TimerClientData client_data, struct iperf_time *nowP)
+{
+    struct iperf_test *test = client_data.p;
+    struct iperf_probe *probe = test->probe;
+    struct iperf_stream *sp;
+    long rtt;
+    char c = 0;
+
+    if (test->state != TEST_RUNNING || probe->fd < 0)
+	return;
+    if (probe->streams != NULL) {
+	SLIST_FOREACH(sp, &test->streams, streams) {
+	    if (sp->sender && (rtt = get_rtt_now(sp)) > 0)
+		iperf_histogram_record(probe->streams, rtt);
+	}
+    }
+    /* One at a time: a probe still out is itself the measurement */
+    if (probe->pending)
+	return;
+    if (send(probe->fd, &c, 1, MSG_DONTWAIT | MSG_NOSIGNAL) != 1)
+	return;
+    probe->pending = 1;
+    iperf_time_now(&probe->sent);
+}
+
+int
+iperf_probe_start(struct iperf_test *test)
+{
+    TimerClientData cd;
+
+    if (test->probe == NULL || test->probe->timer != NULL)
+	return 0;
+    cd.p = test;
+    test->probe->timer = tmr_create(test->timers, NULL, probe_timer_proc, cd, test->probe_interval * 1000LL, 1);
+    if (test->probe->timer == NULL) {
+	i_errno = IEINITTEST;
+	return -1;
+    }
+    return 0;
+}
+
+void
+iperf_probe_run(struct iperf_test *test, fd_set *read_setP)
+{
+    struct iperf_probe *probe = test->probe;
+    struct iperf_time now, diff;
+    char buf[64];
+    int r;
+
+    if (probe == NULL || probe->fd < 0 || !FD_ISSET(probe->fd, read_setP))
+	return;
+    FD_CLR(probe->fd, read_setP);
+    r = recv(probe->fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+	return;
+    if (r <= 0) {
+	/* The probes stop, but the test goes on */
+	FD_CLR(probe->fd, &test->read_set);
+	close(probe->fd);
+	probe->fd = -1;
+	return;
+    }
+    if (test->role == 's') {
+	send(probe->fd, buf, r, MSG_DONTWAIT | MSG_NOSIGNAL);
+	return;
+    }
+    if (probe->pending) {
+	iperf_time_now(&now);
+	iperf_time_diff(&now, &probe->sent, &diff);
+	iperf_histogram_record(probe->loaded, iperf_time_in_usecs(&diff));
+	probe->pending = 0;
+    }
+}
+
+static double
+rpm(struct iperf_hist_summary *s)
+{
+    return s->p50 > 0 ? 60000.0 / s->p50 : 0.0;
+}
+
+/*
+ * A histogram with no samples says nothing, and a line of zeros would
+ * read like a 0 ms RTT, so empty ones are left out of the output.
+ */
+static void
+add_summary(cJSON *j, const char *name, struct iperf_histogram *h)
+{
+    struct iperf_hist_summary s;
+
+    iperf_histogram_summarize(h, &s);
+    if (s.samples == 0)
+	return;
+    cJSON_AddItemToObject(j, name,
+			  iperf_json_printf("samples: %d  p50_ms: %f  p90_ms: %f  p99_ms: %f  max_ms: %f  rpm: %f",
+					    (int64_t) s.samples, s.p50, s.p90, s.p99, s.max, rpm(&s)));
+}
+
+static void
+print_interval_line(struct iperf_test *test, const char *name, struct iperf_histogram *h, double st, double et)
+{
+    struct iperf_hist_summary s;
+
+    iperf_histogram_summarize(h, &s);
+    if (s.samples == 0)
+	return;
+    iperf_printf(test, report_probe_interval, st, et, name, (int) s.samples, s.p50, s.p90, s.max, rpm(&s));
+}
+
+void
+iperf_probe_print_interval(struct iperf_test *test, cJSON *json_interval)
+{
+    struct iperf_probe *probe = test->probe;
+    struct iperf_stream *sp = SLIST_FIRST(&test->streams);
+    struct iperf_interval_results *irp;
+    struct iperf_time temp_time;
+    cJSON *j_probe;
+    double st = 0, et = 0;
+
+    if (probe == NULL || test->role != 'c')
+	return;
+    if (sp != NULL && (irp = TAILQ_LAST(&sp->result->interval_results, irlisthead)) != NULL) {
+	iperf_time_diff(&sp->result->start_time, &irp->interval_start_time, &temp_time);
+	st = iperf_time_in_secs(&temp_time);
+	iperf_time_diff(&sp->result->start_time, &irp->interval_end_time, &temp_time);
+	et = iperf_time_in_secs(&temp_time);
+    }
+
+    if (test->json_output) {
+	if (json_interval != NULL && (j_probe = cJSON_CreateObject()) != NULL) {
+	    add_summary(j_probe, "loaded", probe->loaded);
+	    if (probe->streams != NULL)
+		add_summary(j_probe, "streams", probe->streams);
+	    cJSON_AddItemToObject(json_interval, "probe", j_probe);
+	}
+    } else {
+	print_interval_line(test, "probe", probe->loaded, st, et);
+	if (probe->streams != NULL)
+	    print_interval_line(test, "streams", probe->streams, st, et);
+    }
+
+    iperf_histogram_merge(probe->loaded_total, probe->loaded);
+    iperf_histogram_reset(probe->loaded);
+    if (probe->streams != NULL) {
+	iperf_histogram_merge(probe->streams_total, probe->streams);
+	iperf_histogram_reset(probe->streams);
+    }
+}
+
+void
+iperf_probe_reset(struct iperf_test *test)
+{
+    struct iperf_probe *probe = test->probe;
+
+    if (probe == NULL)
+	return;
+    iperf_histogram_reset(probe->loaded);
+    iperf_histogram_reset(probe->loaded_total);
+    if (probe->streams != NULL) {
+	iperf_histogram_reset(probe->streams);
+	iperf_histogram_reset(probe->streams_total);
+    }
+}
+
+static void
+print_result_line(struct iperf_test *test, const char *name, struct iperf_histogram *h)
+{
+    struct iperf_hist_summary s;
+
+    iperf_histogram_summarize(h, &s);
+    if (s.samples == 0)
+	return;
+    iperf_printf(test, report_probe_result, name, (int) s.samples, s.p50, s.p90, s.p99, s.max, rpm(&s));
+}
+
+void
+iperf_probe_print_results(struct iperf_test *test)
+{
+    struct iperf_probe *probe = test->probe;
+    cJSON *j_probe;
+
+    if (probe == NULL || test->role != 'c')
+	return;
+    /* Whatever came in after the last interval line */
+    iperf_histogram_merge(probe->loaded_total, probe->loaded);
+    iperf_histogram_reset(probe->loaded);
+    if (probe->streams != NULL) {
+	iperf_histogram_merge(probe->streams_total, probe->streams);
+	iperf_histogram_reset(probe->streams);
+    }
+
+    if (test->json_output) {
+	j_probe = iperf_json_printf("interval_ms: %d", (int64_t) test->probe_interval);
+	if (j_probe == NULL)
+	    return;
+	add_summary(j_probe, "idle", probe->idle);
+	add_summary(j_probe, "loaded", probe->loaded_total);
+	if (probe->streams != NULL)
+	    add_summary(j_probe, "streams", probe->streams_total);
+	cJSON_AddItemToObject(test->json_end, "responsiveness", j_probe);
+    } else {
+	iperf_printf(test, report_probe_header, test->probe_interval);
+	print_result_line(test, "idle", probe->idle);
+	print_result_line(test, "loaded", probe->loaded_total);
+	if (probe->streams != NULL)
+	    print_result_line(test, "streams", probe->streams_total);
+    }
+}
+
+void
+iperf_probe_free(struct iperf_test *test)
+{
+    struct iperf_probe *probe = test->probe;
+
+    if (probe == NULL)
+	return;
+    if (probe->timer != NULL)
+	tmr_cancel(probe->timer);
+    if (probe->fd >= 0) {
+	FD_CLR(probe->fd, &test->read_set);
+	close(probe->fd);
+    }
+    iperf_histogram_free(probe->idle);
+    iperf_histogram_free(probe->loaded);
+    iperf_histogram_free(probe->loaded_total);
+    iperf_histogram_free(probe->streams);
+    iperf_histogram_free(probe->streams_total);
+    free(probe);
+    test->probe = NULL;
+}
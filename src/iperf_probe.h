@@ -0,0 +1,81 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_PROBE_H
+#define __IPERF_PROBE_H
+
+#include <sys/select.h>
+
+#include "cjson.h"
+
+/**
+ * iperf_probe_setup -- open the probe connection, to the listener
+ * iperf_crr_setup opened, and time PROBE_IDLE_ROUNDS round trips on it
+ * before any stream is sending; both sides call it straight after
+ * iperf_crr_setup
+ *
+ * returns 0 on success, -1 (with i_errno set) on failure
+ *
+ */
+int iperf_probe_setup(struct iperf_test *);
+
+/**
+ * iperf_probe_start -- have the client send a probe every
+ * probe_interval ms from now on
+ *
+ * returns 0 on success, -1 (with i_errno set) on failure
+ *
+ */
+int iperf_probe_start(struct iperf_test *);
+
+/**
+ * iperf_probe_run -- time the responses that have come back (client),
+ * or answer the probes that have come in (server)
+ *
+ */
+void iperf_probe_run(struct iperf_test *, fd_set *read_setP);
+
+/**
+ * iperf_probe_print_interval -- print the interval's probe round trips
+ * as a line of their own, or add them to the interval's JSON object,
+ * and start a new interval
+ *
+ */
+void iperf_probe_print_interval(struct iperf_test *, cJSON *json_interval);
+
+/* Start the loaded totals again when omitting ends */
+void iperf_probe_reset(struct iperf_test *);
+
+/**
+ * iperf_probe_print_results -- print idle and loaded round trips and
+ * responsiveness, or add them to the JSON output
+ *
+ */
+void iperf_probe_print_results(struct iperf_test *);
+
+void iperf_probe_free(struct iperf_test *);
+
+#endif
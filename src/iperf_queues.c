@@ -0,0 +1,332 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#if defined(HAVE_LINUX_SOCKIOS_H)
+#include <linux/sockios.h>
+#endif
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_queues.h"
+#include "iperf_locale.h"
+#include "iperf_util.h"
+#include "iperf_time.h"
+#include "timer.h"
+#include "units.h"
+#include "cjson.h"
+
+/*
+ * Socket queue occupancy (--queues).
+ *
+ * Bytes can queue inside the hosts as well as in the network: in the
+ * sender's socket, either not yet sent or sent and waiting to be
+ * acknowledged, and in the receiver's, delivered by the kernel but
+ * not yet read.  A periodic timer asks each stream's socket every
+ * queue_interval ms, a sample also being taken at each stats tick:
+ *
+ *   SIOCOUTQ     sender: bytes in the send queue (FIONWRITE on BSD)
+ *   SIOCOUTQNSD  sender, TCP: of those, not yet sent; the rest are
+ *                in flight
+ *   SIOCINQ      receiver: bytes waiting to be read
+ *
+ * Each interval reports their average and peak, and the share of
+ * samples that found the receive queue non-empty: the time the
+ * receiving application was behind.  SO_MEMINFO, where there is one,
+ * is read at the tick for the socket's memory against its buffers and
+ * the packets it dropped.  The sampling runs from the main loop, so
+ * it sees the queues between reads and writes; two samples that
+ * would come back to back after a long one are taken as one.
+ */
+
+#define SKMEM_RMEM_ALLOC 0		/* SK_MEMINFO_ */
+#define SKMEM_RCVBUF 1
+#define SKMEM_SNDBUF 3
+#define SKMEM_WMEM_QUEUED 5
+#define SKMEM_DROPS 8
+
+static const char *skmem_names[DIAG_SKMEM_VARS] = {
+    "rmem_alloc", "rcvbuf", "wmem_alloc", "sndbuf", "fwd_alloc", "wmem_queued", "optmem", "backlog", "drops"
+};
+
+static void
+sample(struct iperf_stream *sp, struct iperf_queue_stats *q)
+{
+    int v;
+
+    if (sp->sender) {
+#if defined(SIOCOUTQ) || defined(FIONWRITE)
+#if defined(SIOCOUTQ)
+	if (ioctl(sp->socket, SIOCOUTQ, &v) == 0 && v >= 0) {
+#else
+	if (ioctl(sp->socket, FIONWRITE, &v) == 0 && v >= 0) {
+#endif
+	    q->outq_sum += v;
+	    if (v > q->outq_max)
+		q->outq_max = v;
+	}
+#endif
+#if defined(SIOCOUTQNSD)
+	if (sp->test->protocol->id == Ptcp && ioctl(sp->socket, SIOCOUTQNSD, &v) == 0 && v >= 0) {
+	    q->notsent_sum += v;
+	    if (v > q->notsent_max)
+		q->notsent_max = v;
+	}
+#endif
+    } else if (ioctl(sp->socket, FIONREAD, &v) == 0 && v >= 0) {
+	q->inq_sum += v;
+	if (v > q->inq_max)
+	    q->inq_max = v;
+	if (v > 0)
+	    q->inq_busy++;
+    }
+    q->samples++;
+}
+
+static int
+read_meminfo(struct iperf_stream *sp, uint32_t meminfo[DIAG_SKMEM_VARS])
+{
+#if defined(SO_MEMINFO)
+    socklen_t len = DIAG_SKMEM_VARS * sizeof(uint32_t);
+
+    memset(meminfo, 0, len);
+    if (getsockopt(sp->socket, SOL_SOCKET, SO_MEMINFO, meminfo, &len) == 0)
+	return 0;
+#endif
+    return -1;
+}
+
+static void
+queue_timer_proc(TimerClientData client_data, struct iperf_time *nowP)
+{
+    struct iperf_test *test = client_data.p;
+    struct iperf_stream *sp;
+    struct iperf_time diff;
+
+    if (test->state != TEST_RUNNING)
+	return;
+    iperf_time_diff(nowP, &test->queue_last, &diff);
+    if (iperf_time_in_usecs(&diff) < test->queue_interval * 500)
+	return;
+    test->queue_last = *nowP;
+    SLIST_FOREACH(sp, &test->streams, streams)
+	sample(sp, &sp->queue_acc);
+}
+
+int
+iperf_queues_init(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    TimerClientData cd;
+    uint32_t meminfo[DIAG_SKMEM_VARS];
+
+    if (test->queue_interval == 0 || test->queue_timer != NULL)
+	return 0;
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	memset(&sp->queue_acc, 0, sizeof(sp->queue_acc));
+	memset(&sp->queue_total, 0, sizeof(sp->queue_total));
+	sp->queue_prev_drops = read_meminfo(sp, meminfo) == 0 ? meminfo[SKMEM_DROPS] : 0;
+    }
+    iperf_time_now(&test->queue_last);
+    cd.p = test;
+    test->queue_timer = tmr_create(test->timers, NULL, queue_timer_proc, cd, test->queue_interval * 1000, 1);
+    if (test->queue_timer == NULL) {
+	i_errno = IEINITTEST;
+	return -1;
+    }
+    return 0;
+}
+
+static void
+add_stats(struct iperf_queue_stats *to, const struct iperf_queue_stats *q)
+{
+    to->samples += q->samples;
+    to->inq_busy += q->inq_busy;
+    to->outq_sum += q->outq_sum;
+    to->notsent_sum += q->notsent_sum;
+    to->inq_sum += q->inq_sum;
+    if (q->outq_max > to->outq_max)
+	to->outq_max = q->outq_max;
+    if (q->notsent_max > to->notsent_max)
+	to->notsent_max = q->notsent_max;
+    if (q->inq_max > to->inq_max)
+	to->inq_max = q->inq_max;
+    if (q->has_meminfo) {
+	to->has_meminfo = 1;
+	memcpy(to->meminfo, q->meminfo, sizeof(to->meminfo));
+    }
+    to->drops += q->drops;
+}
+
+void
+iperf_queues_interval(struct iperf_stream *sp, struct iperf_interval_results *irp)
+{
+    struct iperf_queue_stats *q = &irp->queues;
+
+    /* The tick is a sample too, so no interval goes without one */
+    sample(sp, &sp->queue_acc);
+    *q = sp->queue_acc;
+    memset(&sp->queue_acc, 0, sizeof(sp->queue_acc));
+    if (read_meminfo(sp, q->meminfo) == 0) {
+	q->has_meminfo = 1;
+	q->drops = q->meminfo[SKMEM_DROPS] - sp->queue_prev_drops;
+	sp->queue_prev_drops = q->meminfo[SKMEM_DROPS];
+    }
+    if (!irp->omitted)
+	add_stats(&sp->queue_total, q);
+}
+
+void
+iperf_queues_reset(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	memset(&sp->queue_acc, 0, sizeof(sp->queue_acc));
+	memset(&sp->queue_total, 0, sizeof(sp->queue_total));
+    }
+}
+
+static cJSON *
+stats_json(struct iperf_stream *sp, const struct iperf_queue_stats *q)
+{
+    cJSON *j, *j_mem;
+    int i;
+
+    if (sp->sender)
+	j = iperf_json_printf("samples: %d  send_queue_avg: %f  send_queue_max: %d  unsent_avg: %f  unsent_max: %d  in_flight_avg: %f",
+			      (int64_t) q->samples, (double) q->outq_sum / q->samples, (int64_t) q->outq_max,
+			      (double) q->notsent_sum / q->samples, (int64_t) q->notsent_max,
+			      (double) (q->outq_sum - q->notsent_sum) / q->samples);
+    else
+	j = iperf_json_printf("samples: %d  recv_queue_avg: %f  recv_queue_max: %d  recv_nonempty_percent: %f",
+			      (int64_t) q->samples, (double) q->inq_sum / q->samples, (int64_t) q->inq_max,
+			      100.0 * q->inq_busy / q->samples);
+    if (j == NULL || !q->has_meminfo)
+	return j;
+    cJSON_AddNumberToObject(j, "drops", q->drops);
+    if ((j_mem = cJSON_CreateObject()) == NULL)
+	return j;
+    for (i = 0; i < DIAG_SKMEM_VARS; ++i)
+	cJSON_AddNumberToObject(j_mem, skmem_names[i], q->meminfo[i]);
+    cJSON_AddItemToObject(j, "meminfo", j_mem);
+    return j;
+}
+
+static void
+print_stats(struct iperf_stream *sp, const struct iperf_queue_stats *q, const char *mbuf, double st, double et)
+{
+    struct iperf_test *test = sp->test;
+    char abuf[UNIT_LEN], mxbuf[UNIT_LEN], ubuf[UNIT_LEN], umbuf[UNIT_LEN];
+
+    if (sp->sender) {
+	unit_snprintf(abuf, UNIT_LEN, (double) q->outq_sum / q->samples, 'A');
+	unit_snprintf(mxbuf, UNIT_LEN, q->outq_max, 'A');
+	unit_snprintf(ubuf, UNIT_LEN, (double) q->notsent_sum / q->samples, 'A');
+	unit_snprintf(umbuf, UNIT_LEN, q->notsent_max, 'A');
+	iperf_printf(test, report_queue_send, sp->socket, mbuf, st, et, abuf, mxbuf, ubuf, umbuf,
+		     q->meminfo[SKMEM_WMEM_QUEUED], q->meminfo[SKMEM_SNDBUF]);
+    } else {
+	unit_snprintf(abuf, UNIT_LEN, (double) q->inq_sum / q->samples, 'A');
+	unit_snprintf(mxbuf, UNIT_LEN, q->inq_max, 'A');
+	iperf_printf(test, report_queue_recv, sp->socket, mbuf, st, et, abuf, mxbuf,
+		     100.0 * q->inq_busy / q->samples,
+		     q->meminfo[SKMEM_RMEM_ALLOC], q->meminfo[SKMEM_RCVBUF], q->drops);
+    }
+}
+
+void
+iperf_queues_print_interval(struct iperf_stream *sp, struct iperf_interval_results *irp, cJSON *json_stream, const char *mbuf, double st, double et)
+{
+    if (irp->queues.samples == 0)
+	return;
+    if (sp->test->json_output) {
+	if (json_stream != NULL)
+	    cJSON_AddItemToObject(json_stream, "queues", stats_json(sp, &irp->queues));
+    } else
+	print_stats(sp, &irp->queues, mbuf, st, et);
+}
+
+void
+iperf_queues_print_results(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_time temp_time;
+    cJSON *j_queues = NULL, *j_streams = NULL, *j_stream;
+    char mbuf[UNIT_LEN];
+    double et;
+    int rows = 0;
+
+    if (test->json_output) {
+	if ((j_queues = iperf_json_printf("interval_ms: %d", (int64_t) test->queue_interval)) == NULL)
+	    return;
+	if ((j_streams = cJSON_CreateArray()) == NULL) {
+	    cJSON_Delete(j_queues);
+	    return;
+	}
+	cJSON_AddItemToObject(j_queues, "streams", j_streams);
+	cJSON_AddItemToObject(test->json_end, "queues", j_queues);
+    }
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (sp->queue_total.samples == 0)
+	    continue;
+	if (test->json_output) {
+	    if ((j_stream = stats_json(sp, &sp->queue_total)) == NULL)
+		return;
+	    cJSON_AddNumberToObject(j_stream, "socket", sp->socket);
+	    cJSON_AddBoolToObject(j_stream, "sender", sp->sender);
+	    cJSON_AddItemToArray(j_streams, j_stream);
+	    continue;
+	}
+	if (rows++ == 0)
+	    iperf_printf(test, report_queue_header, test->queue_interval);
+	if (test->mode == BIDIRECTIONAL)
+	    sprintf(mbuf, "[%s-%s]", sp->sender ? "TX" : "RX", test->role == 'c' ? "C" : "S");
+	else
+	    mbuf[0] = '\0';
+	iperf_time_diff(&sp->result->start_time, &sp->result->end_time, &temp_time);
+	et = iperf_time_in_secs(&temp_time);
+	print_stats(sp, &sp->queue_total, mbuf, 0.0, et);
+    }
+}
+
+void
+iperf_queues_close(struct iperf_test *test)
+{
+    if (test->queue_timer != NULL) {
+	tmr_cancel(test->queue_timer);
+	test->queue_timer = NULL;
+    }
+}
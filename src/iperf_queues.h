@@ -0,0 +1,72 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_QUEUES_H
+#define __IPERF_QUEUES_H
+
+#include "cjson.h"
+
+/**
+ * iperf_queues_init -- start sampling the streams' socket queues every
+ * queue_interval ms (--queues)
+ *
+ */
+int iperf_queues_init(struct iperf_test *);
+
+/**
+ * iperf_queues_interval -- take a sample at the stats tick and move the
+ * interval's samples, with SO_MEMINFO, into irp
+ *
+ */
+void iperf_queues_interval(struct iperf_stream *, struct iperf_interval_results *);
+
+/**
+ * iperf_queues_reset -- forget the samples taken while omitting
+ *
+ */
+void iperf_queues_reset(struct iperf_test *);
+
+/**
+ * iperf_queues_print_interval -- print the interval's queue depths
+ * after the stream's line, or add them to its JSON object
+ *
+ */
+void iperf_queues_print_interval(struct iperf_stream *, struct iperf_interval_results *, cJSON *json_stream, const char *mbuf, double st, double et);
+
+/**
+ * iperf_queues_print_results -- print each stream's queue depths over
+ * the test, or add them to the JSON output
+ *
+ */
+void iperf_queues_print_results(struct iperf_test *);
+
+/**
+ * iperf_queues_close -- stop sampling
+ *
+ */
+void iperf_queues_close(struct iperf_test *);
+
+#endif
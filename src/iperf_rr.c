@@ -0,0 +1,945 @@
+/*
+ * iperf, Copyright (c) 2014-2022, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_rr.h"
+#include "iperf_latency.h"
+#include "iperf_histogram.h"
+#include "iperf_locale.h"
+#include "iperf_util.h"
+#include "iperf_time.h"
+#include "timer.h"
+#include "units.h"
+#include "net.h"
+#include "cjson.h"
+#include "portable_endian.h"
+
+/*
+ * Request/response mode (--rr), after netperf's TCP_RR.
+ *
+ * Each client stream sends a request of rr_request bytes, and the
+ * server answers each complete request with rr_response bytes.  With
+ * --rr-depth above one the client keeps that many requests in flight.
+ * A transaction is counted when the client has the whole response (on
+ * the server, when it has the whole request), and its latency, from
+ * the first byte of the request going out, goes into the stream's
+ * HIST_RR histogram; --rr turns on --histograms for that.
+ *
+ * The sockets are non-blocking.  Client streams always wait to read;
+ * either side waits to write only while a message is part written.
+ * Requests and responses are read into the stream's buffer and only
+ * counted, so a read can take several pipelined messages at once.
+ *
+ * With --crr (netperf's TCP_CRR) every transaction has a connection of
+ * its own: the client connects, sends one request, reads the response
+ * and closes, and --rr-depth is the number of connections each stream
+ * keeps going at once.  They go to a listener the server opens for the
+ * test on an ephemeral port, so they don't need the cookie handshake of
+ * the stream connections, which stay open but idle; the first byte of
+ * each request names its stream.  The server accepts up to
+ * CRR_ACCEPT_BATCH connections per wakeup into a fixed table of slots,
+ * and leaves the closing to the client, so TIME_WAIT lands there.
+ * Besides the transaction latency the client records the handshake
+ * and the time to the first byte of the response.
+ *
+ * With --rr-rate the client runs open loop: requests come due at a
+ * fixed rate, or with --rr-arrivals poisson at exponentially spread
+ * times, whether or not the earlier ones have been answered, and
+ * --rr-depth no longer applies.  Each request starts with the time it
+ * was due, RR_STAMP_LEN bytes of the client's clock, and the server
+ * puts the same stamp at the start of the matching response.  The
+ * latency is taken from that stamp rather than from when the request
+ * actually went out, so a client that falls behind (a stalled socket,
+ * a slow server) sees the queueing as latency instead of quietly
+ * sending less -- no coordinated omission.  A one-shot timer wakes the
+ * loop when the next request is due, and a client that is late sends
+ * the overdue requests back to back.  The server holds up to
+ * RR_OPEN_QUEUE stamps per stream, and stops reading while they are
+ * all taken.
+ */
+
+int
+iperf_rr_parse(struct iperf_test *test, const char *arg)
+{
+    char buf[64], *slash;
+    iperf_size_t request, response;
+
+    if (strlen(arg) >= sizeof(buf)) {
+	i_errno = IEREQRESP;
+	return -1;
+    }
+    strcpy(buf, arg);
+    slash = strchr(buf, '/');
+    if (slash != NULL)
+	*slash++ = '\0';
+    request = unit_atoi(buf);
+    response = slash != NULL ? unit_atoi(slash) : request;
+    if (request < 1 || request > MAX_BLOCKSIZE || response < 1 || response > MAX_BLOCKSIZE) {
+	i_errno = IEREQRESP;
+	return -1;
+    }
+    test->rr = 1;
+    test->rr_request = request;
+    test->rr_response = response;
+    return 0;
+}
+
+static void
+set_port(struct sockaddr_storage *sa, int port)
+{
+    if (sa->ss_family == AF_INET6)
+	((struct sockaddr_in6 *) sa)->sin6_port = htons(port);
+    else
+	((struct sockaddr_in *) sa)->sin_port = htons(port);
+}
+
+int
+iperf_crr_setup(struct iperf_test *test)
+{
+    struct sockaddr_storage sa;
+    socklen_t len = sizeof(sa);
+    uint16_t port;
+    int s;
+
+    if (test->role == 'c') {
+	if (Nread(test->ctrl_sck, (char *) &port, sizeof(port), Ptcp) != sizeof(port)) {
+	    i_errno = IECTRLREAD;
+	    return -1;
+	}
+	test->crr_port = ntohs(port);
+	/* Connect where the control connection did, on the new port */
+	test->crr_addrlen = sizeof(test->crr_addr);
+	if (getpeername(test->ctrl_sck, (struct sockaddr *) &test->crr_addr, &test->crr_addrlen) < 0) {
+	    i_errno = IEINITTEST;
+	    return -1;
+	}
+	set_port(&test->crr_addr, test->crr_port);
+	test->crr_locallen = 0;
+	if (test->bind_address != NULL) {
+	    test->crr_locallen = sizeof(test->crr_local);
+	    if (getsockname(test->ctrl_sck, (struct sockaddr *) &test->crr_local, &test->crr_locallen) < 0) {
+		i_errno = IEINITTEST;
+		return -1;
+	    }
+	    set_port(&test->crr_local, 0);
+	}
+	return 0;
+    }
+
+    s = netannounce(test->settings->domain, Ptcp, test->bind_address, test->bind_dev, 0);
+    if (s < 0) {
+	i_errno = IELISTEN;
+	return -1;
+    }
+#if defined(TCP_FASTOPEN)
+    if (test->fastopen) {
+	int qlen = MAX_CRR_CONNS;
+
+	if (setsockopt(s, IPPROTO_TCP, TCP_FASTOPEN, &qlen, sizeof(qlen)) < 0) {
+	    close(s);
+	    i_errno = IECRR;
+	    return -1;
+	}
+    }
+#endif /* TCP_FASTOPEN */
+    if (getsockname(s, (struct sockaddr *) &sa, &len) < 0 || setnonblocking(s, 1) < 0) {
+	close(s);
+	i_errno = IELISTEN;
+	return -1;
+    }
+    test->crr_listener = s;
+    test->crr_port = sa.ss_family == AF_INET6 ?
+	ntohs(((struct sockaddr_in6 *) &sa)->sin6_port) : ntohs(((struct sockaddr_in *) &sa)->sin_port);
+    port = htons(test->crr_port);
+    if (Nwrite(test->ctrl_sck, (char *) &port, sizeof(port), Ptcp) < 0) {
+	i_errno = IECTRLWRITE;
+	return -1;
+    }
+    return 0;
+}
+
+static int
+crr_init(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    int i;
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	sp->rr_transactions = sp->rr_transactions_interval = 0;
+	sp->crr_failures = 0;
+	/* The stream connections only carry the accounting */
+	FD_CLR(sp->socket, &test->read_set);
+	FD_CLR(sp->socket, &test->write_set);
+	if (!sp->sender || sp->crr != NULL)
+	    continue;
+	sp->crr = calloc(test->rr_depth, sizeof(struct iperf_crr_conn));
+	if (sp->crr == NULL) {
+	    i_errno = IEINITTEST;
+	    return -1;
+	}
+	for (i = 0; i < test->rr_depth; ++i)
+	    sp->crr[i].fd = -1;
+    }
+
+    if (test->role == 'c')
+	return 0;
+
+    if (test->crr_conns == NULL) {
+	test->crr_slots = 2 * test->num_streams * test->rr_depth + CRR_ACCEPT_BATCH;
+	test->crr_conns = calloc(test->crr_slots, sizeof(struct iperf_crr_conn));
+	if (test->crr_conns == NULL) {
+	    i_errno = IEINITTEST;
+	    return -1;
+	}
+	for (i = 0; i < test->crr_slots; ++i)
+	    test->crr_conns[i].fd = -1;
+    }
+    FD_SET(test->crr_listener, &test->read_set);
+    if (test->crr_listener > test->max_fd)
+	test->max_fd = test->crr_listener;
+    return 0;
+}
+
+/* Socket options both ends put on --crr connections */
+static void
+crr_sockopts(struct iperf_test *test, int fd)
+{
+    struct linger lg;
+    int opt = 1;
+
+    if (test->no_delay)
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    if (test->linger >= 0) {
+	lg.l_onoff = 1;
+	lg.l_linger = test->linger;
+	setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    }
+}
+
+static void
+crr_close(struct iperf_test *test, struct iperf_crr_conn *c)
+{
+    FD_CLR(c->fd, &test->read_set);
+    FD_CLR(c->fd, &test->write_set);
+    close(c->fd);
+    c->fd = -1;
+}
+
+/* Start a client connection; -1 if it failed before it got going */
+static int
+crr_connect(struct iperf_stream *sp, struct iperf_crr_conn *c)
+{
+    struct iperf_test *test = sp->test;
+    int fd, opt = 1;
+
+    fd = socket(test->crr_addr.ss_family, SOCK_STREAM, 0);
+    if (fd < 0)
+	return -1;
+    if (fd >= FD_SETSIZE) {
+	close(fd);
+	return -1;
+    }
+    /* Ports in TIME_WAIT can be bound again */
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    crr_sockopts(test, fd);
+#if defined(TCP_FASTOPEN_CONNECT)
+    /* connect() returns at once, and the request goes out with the SYN */
+    if (test->fastopen)
+	setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &opt, sizeof(opt));
+#endif /* TCP_FASTOPEN_CONNECT */
+    if (setnonblocking(fd, 1) < 0 ||
+	(test->crr_locallen > 0 && bind(fd, (struct sockaddr *) &test->crr_local, test->crr_locallen) < 0)) {
+	close(fd);
+	return -1;
+    }
+    iperf_time_now(&c->start);
+    if (connect(fd, (struct sockaddr *) &test->crr_addr, test->crr_addrlen) < 0 && errno != EINPROGRESS) {
+	close(fd);
+	return -1;
+    }
+    c->fd = fd;
+    c->in = 0;
+    c->out = test->rr_request;
+    c->phase = test->fastopen ? CRR_REQUEST : CRR_CONNECTING;
+    if (fd > test->max_fd)
+	test->max_fd = fd;
+    FD_SET(fd, &test->write_set);
+    return 0;
+}
+
+static void
+record_since(struct iperf_stream *sp, int metric, struct iperf_time *start, struct iperf_time *now)
+{
+    struct iperf_time diff;
+
+    iperf_time_diff(now, start, &diff);
+    if (sp->hist[metric] != NULL)
+	iperf_histogram_record(sp->hist[metric], iperf_time_in_usecs(&diff));
+}
+
+/* Take one client connection as far as it will go */
+static void
+crr_client(struct iperf_stream *sp, struct iperf_crr_conn *c, fd_set *read_setP, fd_set *write_setP)
+{
+    struct iperf_test *test = sp->test;
+    struct iperf_time now;
+    int readable, writable, r, n, err;
+    socklen_t len;
+
+    if (c->fd < 0) {
+	if (crr_connect(sp, c) < 0) {
+	    ++sp->crr_failures;
+	    return;
+	}
+	/* Only a Fast Open connection can be written before the handshake */
+	readable = 0;
+	writable = c->phase == CRR_REQUEST;
+    } else {
+	readable = FD_ISSET(c->fd, read_setP);
+	writable = FD_ISSET(c->fd, write_setP);
+    }
+
+    if (c->phase == CRR_CONNECTING) {
+	if (!writable)
+	    return;
+	len = sizeof(err);
+	if (getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0)
+	    goto failed;
+	iperf_time_now(&now);
+	record_since(sp, HIST_CONNECT, &c->start, &now);
+	c->phase = CRR_REQUEST;
+    }
+
+    if (c->phase == CRR_REQUEST) {
+	if (!writable)
+	    return;
+	while (c->out > 0) {
+	    /* The first byte says which stream this is */
+	    if (c->out == test->rr_request)
+		sp->buffer[0] = (char) sp->id;
+	    n = c->out < sp->settings->blksize ? c->out : sp->settings->blksize;
+	    r = write(c->fd, sp->buffer, n);
+	    if (r < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS || errno == EINTR)
+		    return;
+		goto failed;
+	    }
+	    c->out -= r;
+	    sp->result->bytes_sent += r;
+	    sp->result->bytes_sent_this_interval += r;
+	    test->bytes_sent += r;
+	}
+	FD_CLR(c->fd, &test->write_set);
+	FD_SET(c->fd, &test->read_set);
+	c->phase = CRR_RESPONSE;
+	return;
+    }
+
+    if (c->phase == CRR_RESPONSE && readable) {
+	r = read(c->fd, sp->buffer, sp->settings->blksize);
+	if (r < 0) {
+	    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+		return;
+	    goto failed;
+	}
+	if (r == 0)
+	    goto failed;
+	iperf_time_now(&now);
+	if (c->in == 0)
+	    record_since(sp, HIST_FIRST_BYTE, &c->start, &now);
+	c->in += r;
+	if (c->in >= test->rr_response) {
+	    record_since(sp, HIST_RR, &c->start, &now);
+	    ++sp->rr_transactions;
+	    ++sp->rr_transactions_interval;
+	    crr_close(test, c);
+	    /* Nothing would wake select for the next one, so start it now */
+	    crr_client(sp, c, read_setP, write_setP);
+	}
+    }
+    return;
+
+  failed:
+    ++sp->crr_failures;
+    crr_close(test, c);
+}
+
+static void
+crr_accept(struct iperf_test *test)
+{
+    struct iperf_crr_conn *c;
+    int i, n, fd;
+
+    for (i = 0, n = 0; i < test->crr_slots && n < CRR_ACCEPT_BATCH; ++i) {
+	c = &test->crr_conns[i];
+	if (c->fd >= 0)
+	    continue;
+	fd = accept(test->crr_listener, NULL, NULL);
+	if (fd < 0) {
+	    if (errno == EINTR || errno == ECONNABORTED)
+		continue;
+	    return;
+	}
+	++n;
+	if (fd >= FD_SETSIZE || setnonblocking(fd, 1) < 0) {
+	    close(fd);
+	    continue;
+	}
+	crr_sockopts(test, fd);
+	c->fd = fd;
+	c->phase = CRR_REQUEST;
+	c->in = 0;
+	c->sp = NULL;
+	FD_SET(fd, &test->read_set);
+	if (fd > test->max_fd)
+	    test->max_fd = fd;
+    }
+}
+
+/* Take one server connection as far as it will go */
+static void
+crr_server(struct iperf_test *test, struct iperf_crr_conn *c, fd_set *read_setP, fd_set *write_setP)
+{
+    struct iperf_stream *sp;
+    char *buf;
+    int r, n;
+
+    if (c->phase == CRR_REQUEST || c->phase == CRR_CLOSING) {
+	if (!FD_ISSET(c->fd, read_setP))
+	    return;
+	/* Any stream's buffer will do to read into */
+	buf = SLIST_FIRST(&test->streams)->buffer;
+	r = read(c->fd, buf, SLIST_FIRST(&test->streams)->settings->blksize);
+	if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+	    return;
+	if (r <= 0 || c->phase == CRR_CLOSING) {
+	    crr_close(test, c);
+	    return;
+	}
+	if (c->sp == NULL) {
+	    SLIST_FOREACH(sp, &test->streams, streams)
+		if ((unsigned char) sp->id == (unsigned char) buf[0])
+		    break;
+	    if (sp == NULL) {
+		crr_close(test, c);
+		return;
+	    }
+	    c->sp = sp;
+	}
+	sp = c->sp;
+	sp->result->bytes_received += r;
+	sp->result->bytes_received_this_interval += r;
+	test->bytes_received += r;
+	c->in += r;
+	if (c->in < test->rr_request)
+	    return;
+	++sp->rr_transactions;
+	++sp->rr_transactions_interval;
+	c->phase = CRR_RESPONSE;
+	c->out = test->rr_response;
+    } else if (!FD_ISSET(c->fd, write_setP))
+	return;
+
+    sp = c->sp;
+    while (c->out > 0) {
+	n = c->out < sp->settings->blksize ? c->out : sp->settings->blksize;
+	r = write(c->fd, sp->buffer, n);
+	if (r < 0) {
+	    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+		FD_SET(c->fd, &test->write_set);
+		return;
+	    }
+	    crr_close(test, c);
+	    return;
+	}
+	c->out -= r;
+    }
+    FD_CLR(c->fd, &test->write_set);
+    c->phase = CRR_CLOSING;
+}
+
+static int
+crr_run(struct iperf_test *test, fd_set *read_setP, fd_set *write_setP)
+{
+    struct iperf_stream *sp;
+    int i;
+
+    if (test->role == 'c') {
+	SLIST_FOREACH(sp, &test->streams, streams)
+	    for (i = 0; i < test->rr_depth; ++i)
+		crr_client(sp, &sp->crr[i], read_setP, write_setP);
+	return 0;
+    }
+    if (FD_ISSET(test->crr_listener, read_setP))
+	crr_accept(test);
+    for (i = 0; i < test->crr_slots; ++i)
+	if (test->crr_conns[i].fd >= 0)
+	    crr_server(test, &test->crr_conns[i], read_setP, write_setP);
+    return 0;
+}
+
+int
+iperf_rr_init(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_time now;
+
+    if (!test->rr)
+	return 0;
+    if (test->rr_connect)
+	return crr_init(test);
+    iperf_time_now(&now);
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	sp->rr_head = sp->rr_pending = sp->rr_in = sp->rr_out = 0;
+	sp->rr_transactions = sp->rr_transactions_interval = 0;
+	sp->rr_offered = 0;
+	sp->rr_due = iperf_time_in_usecs(&now);
+	if (!sp->sender) {
+	    if (test->rr_rate > 0 && sp->rr_stamps == NULL) {
+		sp->rr_stamps = calloc(RR_OPEN_QUEUE, sizeof(uint64_t));
+		if (sp->rr_stamps == NULL) {
+		    i_errno = IEINITTEST;
+		    return -1;
+		}
+	    }
+	    continue;
+	}
+	if (test->rr_rate == 0 && sp->rr_sent == NULL) {
+	    sp->rr_sent = calloc(test->rr_depth, sizeof(struct iperf_time));
+	    if (sp->rr_sent == NULL) {
+		i_errno = IEINITTEST;
+		return -1;
+	    }
+	}
+	/* The requests go out from the start; the responses come in */
+	FD_SET(sp->socket, &test->read_set);
+    }
+    return 0;
+}
+
+/* Microseconds from one open-loop request to the next */
+static double
+rr_gap(struct iperf_test *test)
+{
+    double u;
+
+    if (!test->rr_poisson)
+	return 1e6 / test->rr_rate;
+    /* Exponential gaps make the arrivals a Poisson process; u is in (0, 1] */
+    u = (random() + 1.0) / ((double) RAND_MAX + 1.0);
+    return -log(u) * 1e6 / test->rr_rate;
+}
+
+static int rr_write(struct iperf_stream *sp);
+
+static void
+rr_timer_proc(TimerClientData client_data, struct iperf_time *nowP)
+{
+    struct iperf_stream *sp = client_data.p;
+
+    /*
+     * Send what has come due and arm the timer for the next one, since
+     * it may have expired after the loop's own rr_write() last looked.
+     * A write error shows again at the loop's next rr_write().
+     */
+    sp->send_timer = NULL;
+    rr_write(sp);
+}
+
+/* Start the next message to write; 0 if nothing is owed yet */
+static int
+rr_next(struct iperf_stream *sp, struct iperf_time *now)
+{
+    struct iperf_test *test = sp->test;
+
+    if (sp->sender && test->rr_rate > 0) {
+	if (iperf_time_in_usecs(now) < sp->rr_due)
+	    return 0;
+	/* Stamped with when it should have gone, not when it does */
+	sp->rr_stamp_out = htobe64((uint64_t) sp->rr_due);
+	sp->rr_due += rr_gap(test);
+	++sp->rr_offered;
+	++sp->rr_pending;
+	sp->rr_out = test->rr_request;
+    } else if (sp->sender) {
+	if (sp->rr_pending >= test->rr_depth)
+	    return 0;
+	sp->rr_sent[(sp->rr_head + sp->rr_pending) % test->rr_depth] = *now;
+	++sp->rr_pending;
+	sp->rr_out = test->rr_request;
+    } else {
+	if (sp->rr_pending == 0)
+	    return 0;
+	if (test->rr_rate > 0) {
+	    sp->rr_stamp_out = sp->rr_stamps[sp->rr_head];
+	    sp->rr_head = (sp->rr_head + 1) % RR_OPEN_QUEUE;
+	    /* There's room for another stamp, so read again */
+	    FD_SET(sp->socket, &test->read_set);
+	}
+	--sp->rr_pending;
+	sp->rr_out = test->rr_response;
+    }
+    return 1;
+}
+
+/* Write what's owed: on the client, requests up to the depth or as they come due; on the server, responses */
+static int
+rr_write(struct iperf_stream *sp)
+{
+    struct iperf_test *test = sp->test;
+    struct iperf_time now;
+    TimerClientData cd;
+    int r, n, size, done;
+    char *buf;
+
+    iperf_time_now(&now);
+    size = sp->sender ? test->rr_request : test->rr_response;
+    for (;;) {
+	if (sp->rr_out == 0 && !rr_next(sp, &now))
+	    break;
+	buf = sp->buffer;
+	n = sp->rr_out < sp->settings->blksize ? sp->rr_out : sp->settings->blksize;
+	done = size - sp->rr_out;
+	if (test->rr_rate > 0 && done < RR_STAMP_LEN) {
+	    /* Reads land in the same buffer, so put the stamp back each time */
+	    memcpy(sp->buffer, &sp->rr_stamp_out, RR_STAMP_LEN);
+	    buf += done;
+	    if (n > sp->settings->blksize - done)
+		n = sp->settings->blksize - done;
+	}
+	r = write(sp->socket, buf, n);
+	if (r < 0) {
+	    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+		break;
+	    i_errno = IESTREAMWRITE;
+	    return -1;
+	}
+	sp->rr_out -= r;
+	if (sp->sender) {
+	    sp->result->bytes_sent += r;
+	    sp->result->bytes_sent_this_interval += r;
+	    test->bytes_sent += r;
+	}
+    }
+    /* Wait for room only while a message is part written */
+    if (sp->rr_out > 0)
+	FD_SET(sp->socket, &test->write_set);
+    else {
+	FD_CLR(sp->socket, &test->write_set);
+	/* Nothing else would wake the loop when the next request is due */
+	if (sp->sender && test->rr_rate > 0 && sp->send_timer == NULL) {
+	    cd.p = sp;
+	    sp->send_timer = tmr_create(test->timers, &now, rr_timer_proc, cd,
+					(int64_t) (sp->rr_due - iperf_time_in_usecs(&now)) + 1, 0);
+	    if (sp->send_timer == NULL) {
+		i_errno = IEINITTEST;
+		return -1;
+	    }
+	}
+    }
+    if (sp->sender && test->histograms)
+	iperf_latency_sample_rtt(sp);
+    return 0;
+}
+
+/* Read what has arrived and count the complete messages in it */
+static int
+rr_read(struct iperf_stream *sp)
+{
+    struct iperf_test *test = sp->test;
+    struct iperf_time now, diff;
+    int64_t want;
+    int r, n, m, p, size;
+
+    size = sp->sender ? test->rr_response : test->rr_request;
+    want = sp->settings->blksize;
+    if (!sp->sender && test->rr_rate > 0) {
+	/* No more than there's room to hold the stamps of */
+	want = (int64_t) (RR_OPEN_QUEUE - sp->rr_pending) * size - sp->rr_in;
+	if (want <= 0) {
+	    FD_CLR(sp->socket, &test->read_set);
+	    return 0;
+	}
+	if (want > sp->settings->blksize)
+	    want = sp->settings->blksize;
+    }
+    r = read(sp->socket, sp->buffer, want);
+    if (r < 0) {
+	if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+	    return 0;
+	i_errno = IESTREAMREAD;
+	return -1;
+    }
+    if (r == 0) {
+	i_errno = IESTREAMREAD;
+	return -1;
+    }
+    if (!sp->sender) {
+	sp->result->bytes_received += r;
+	sp->result->bytes_received_this_interval += r;
+	test->bytes_received += r;
+    }
+
+    if (sp->sender)
+	iperf_time_now(&now);
+    for (p = 0; p < r; p += n) {
+	n = size - sp->rr_in;
+	if (n > r - p)
+	    n = r - p;
+	if (test->rr_rate > 0 && sp->rr_in < RR_STAMP_LEN) {
+	    m = RR_STAMP_LEN - sp->rr_in < n ? RR_STAMP_LEN - sp->rr_in : n;
+	    memcpy((char *) &sp->rr_stamp_in + sp->rr_in, sp->buffer + p, m);
+	}
+	sp->rr_in += n;
+	if (sp->rr_in < size)
+	    break;
+	sp->rr_in = 0;
+	++sp->rr_transactions;
+	++sp->rr_transactions_interval;
+	if (!sp->sender) {
+	    if (test->rr_rate > 0)
+		sp->rr_stamps[(sp->rr_head + sp->rr_pending) % RR_OPEN_QUEUE] = sp->rr_stamp_in;
+	    ++sp->rr_pending;
+	    continue;
+	}
+	if (sp->rr_pending == 0) {
+	    /* A response to nothing; the server is confused */
+	    i_errno = IESTREAMREAD;
+	    return -1;
+	}
+	if (test->rr_rate > 0) {
+	    if (sp->hist[HIST_RR] != NULL)
+		iperf_histogram_record(sp->hist[HIST_RR], (int64_t) (iperf_time_in_usecs(&now) - be64toh(sp->rr_stamp_in)));
+	} else {
+	    iperf_time_diff(&now, &sp->rr_sent[sp->rr_head], &diff);
+	    if (sp->hist[HIST_RR] != NULL)
+		iperf_histogram_record(sp->hist[HIST_RR], iperf_time_in_usecs(&diff));
+	    sp->rr_head = (sp->rr_head + 1) % test->rr_depth;
+	}
+	--sp->rr_pending;
+    }
+    if (!sp->sender && test->rr_rate > 0 && sp->rr_pending == RR_OPEN_QUEUE)
+	FD_CLR(sp->socket, &test->read_set);
+    return 0;
+}
+
+int
+iperf_rr_run(struct iperf_test *test, fd_set *read_setP, fd_set *write_setP)
+{
+    struct iperf_stream *sp;
+
+    if (test->rr_connect)
+	return crr_run(test, read_setP, write_setP);
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (FD_ISSET(sp->socket, read_setP)) {
+	    if (rr_read(sp) < 0)
+		return -1;
+	    FD_CLR(sp->socket, read_setP);
+	}
+	/* Clients can always try to send; the server only once there's something owed */
+	if (sp->sender || sp->rr_pending > 0 || FD_ISSET(sp->socket, write_setP)) {
+	    if (rr_write(sp) < 0)
+		return -1;
+	    FD_CLR(sp->socket, write_setP);
+	}
+    }
+    return 0;
+}
+
+void
+iperf_rr_interval(struct iperf_stream *sp, struct iperf_interval_results *irp)
+{
+    irp->transactions = sp->rr_transactions_interval;
+    sp->rr_transactions_interval = 0;
+}
+
+void
+iperf_rr_print_interval(struct iperf_stream *sp, struct iperf_interval_results *irp, cJSON *json_stream, const char *mbuf, double st, double et)
+{
+    struct iperf_test *test = sp->test;
+    double rate = irp->interval_duration > 0 ? irp->transactions / irp->interval_duration : 0;
+
+    if (test->json_output) {
+	if (json_stream != NULL) {
+	    cJSON_AddNumberToObject(json_stream, "transactions", irp->transactions);
+	    cJSON_AddNumberToObject(json_stream, "transactions_per_second", rate);
+	}
+    } else
+	iperf_printf(test, report_rr_interval, sp->socket, mbuf, st, et, (double) irp->transactions, rate);
+}
+
+void
+iperf_rr_print_interval_sum(struct iperf_test *test, int sender, cJSON *json_sum, const char *mbuf, double st, double et)
+{
+    struct iperf_stream *sp;
+    struct iperf_interval_results *irp;
+    iperf_size_t transactions = 0;
+    double rate;
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	irp = TAILQ_LAST(&sp->result->interval_results, irlisthead);
+	if (sp->sender == sender && irp != NULL)
+	    transactions += irp->transactions;
+    }
+    rate = et > st ? transactions / (et - st) : 0;
+    if (test->json_output) {
+	if (json_sum != NULL) {
+	    cJSON_AddNumberToObject(json_sum, "transactions", transactions);
+	    cJSON_AddNumberToObject(json_sum, "transactions_per_second", rate);
+	}
+    } else
+	iperf_printf(test, report_sum_rr_interval, mbuf, st, et, (double) transactions, rate);
+}
+
+void
+iperf_rr_print_results(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_time temp_time;
+    cJSON *j_rr = NULL, *j_streams = NULL;
+    iperf_size_t total = 0, failures = 0, offered = 0, outstanding = 0;
+    double duration = 0, seconds, rate;
+    const char *arrivals = test->rr_poisson ? "poisson" : "fixed";
+
+    if (test->json_output) {
+	j_rr = iperf_json_printf("request_size: %d  response_size: %d  depth: %d  connect_per_transaction: %b  fastopen: %b",
+				 (int64_t) test->rr_request, (int64_t) test->rr_response, (int64_t) test->rr_depth,
+				 test->rr_connect, test->fastopen);
+	if (j_rr == NULL)
+	    return;
+	if ((j_streams = cJSON_CreateArray()) == NULL) {
+	    cJSON_Delete(j_rr);
+	    return;
+	}
+	if (test->rr_rate > 0) {
+	    cJSON_AddNumberToObject(j_rr, "offered_rate", test->rr_rate);
+	    cJSON_AddStringToObject(j_rr, "arrivals", arrivals);
+	}
+	cJSON_AddItemToObject(j_rr, "streams", j_streams);
+	cJSON_AddItemToObject(test->json_end, "request_response", j_rr);
+    } else if (test->rr_connect)
+	iperf_printf(test, report_crr_header, test->rr_request, test->rr_response, test->rr_depth,
+		     test->fastopen ? ", TCP Fast Open" : "");
+    else if (test->rr_rate > 0)
+	iperf_printf(test, report_rr_open_header, test->rr_request, test->rr_response, test->rr_rate, arrivals);
+    else
+	iperf_printf(test, report_rr_header, test->rr_request, test->rr_response, test->rr_depth);
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	iperf_time_diff(&sp->result->start_time, &sp->result->end_time, &temp_time);
+	seconds = iperf_time_in_secs(&temp_time);
+	rate = seconds > 0 ? sp->rr_transactions / seconds : 0;
+	total += sp->rr_transactions;
+	failures += sp->crr_failures;
+	if (seconds > duration)
+	    duration = seconds;
+	if (test->json_output) {
+	    cJSON *j_stream = iperf_json_printf("socket: %d  seconds: %f  transactions: %d  transactions_per_second: %f  failed_connections: %d",
+						(int64_t) sp->socket, seconds, (int64_t) sp->rr_transactions, rate, (int64_t) sp->crr_failures);
+	    if (j_stream != NULL && test->rr_rate > 0 && sp->sender) {
+		cJSON_AddNumberToObject(j_stream, "offered", sp->rr_offered);
+		cJSON_AddNumberToObject(j_stream, "offered_per_second", seconds > 0 ? sp->rr_offered / seconds : 0);
+		cJSON_AddNumberToObject(j_stream, "outstanding", sp->rr_pending);
+	    }
+	    cJSON_AddItemToArray(j_streams, j_stream);
+	} else {
+	    iperf_printf(test, report_rr_result, sp->socket, 0.0, seconds, (double) sp->rr_transactions, rate);
+	    if (sp->crr_failures > 0)
+		iperf_printf(test, report_crr_failures, sp->socket, (double) sp->crr_failures);
+	}
+	if (test->rr_rate > 0 && sp->sender) {
+	    offered += sp->rr_offered;
+	    outstanding += sp->rr_pending;
+	    if (!test->json_output)
+		iperf_printf(test, report_rr_open_result, sp->socket, (double) sp->rr_offered,
+			     seconds > 0 ? sp->rr_offered / seconds : 0, (double) sp->rr_pending);
+	}
+    }
+    rate = duration > 0 ? total / duration : 0;
+    if (test->json_output) {
+	cJSON *j_sum = iperf_json_printf("seconds: %f  transactions: %d  transactions_per_second: %f  failed_connections: %d",
+					 duration, (int64_t) total, rate, (int64_t) failures);
+	if (j_sum != NULL && test->rr_rate > 0 && test->role == 'c') {
+	    cJSON_AddNumberToObject(j_sum, "offered", offered);
+	    cJSON_AddNumberToObject(j_sum, "offered_per_second", duration > 0 ? offered / duration : 0);
+	    cJSON_AddNumberToObject(j_sum, "outstanding", outstanding);
+	}
+	cJSON_AddItemToObject(j_rr, "sum", j_sum);
+    } else if (test->num_streams > 1) {
+	iperf_printf(test, report_sum_rr_result, 0.0, duration, (double) total, rate);
+	if (test->rr_rate > 0 && test->role == 'c')
+	    iperf_printf(test, report_sum_rr_open_result, (double) offered,
+			 duration > 0 ? offered / duration : 0, (double) outstanding);
+    }
+}
+
+void
+iperf_rr_free_stream(struct iperf_stream *sp)
+{
+    int i;
+
+    free(sp->rr_sent);
+    sp->rr_sent = NULL;
+    free(sp->rr_stamps);
+    sp->rr_stamps = NULL;
+    if (sp->crr != NULL) {
+	for (i = 0; i < sp->test->rr_depth; ++i)
+	    if (sp->crr[i].fd >= 0)
+		crr_close(sp->test, &sp->crr[i]);
+	free(sp->crr);
+	sp->crr = NULL;
+    }
+}
+
+void
+iperf_rr_free(struct iperf_test *test)
+{
+    int i;
+
+    if (test->crr_conns != NULL) {
+	for (i = 0; i < test->crr_slots; ++i)
+	    if (test->crr_conns[i].fd >= 0)
+		crr_close(test, &test->crr_conns[i]);
+	free(test->crr_conns);
+	test->crr_conns = NULL;
+    }
+    if (test->crr_listener >= 0) {
+	FD_CLR(test->crr_listener, &test->read_set);
+	close(test->crr_listener);
+	test->crr_listener = -1;
+    }
+}
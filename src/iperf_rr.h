@@ -0,0 +1,96 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_RR_H
+#define __IPERF_RR_H
+
+#include <sys/select.h>
+
+#include "cjson.h"
+
+/**
+ * iperf_rr_parse -- parse an --rr request[/response] argument; sizes
+ * take the usual K/M suffixes
+ *
+ * returns 0 on success, -1 (with i_errno set) on a bad argument
+ *
+ */
+int iperf_rr_parse(struct iperf_test *, const char *);
+
+/**
+ * iperf_crr_setup -- with --crr or --probe, the server opens a listener
+ * for the extra connections and tells the client its port, and the
+ * client works out where to connect; both sides call it once the
+ * server has sent CREATE_STREAMS
+ *
+ * returns 0 on success, -1 (with i_errno set) on failure
+ *
+ */
+int iperf_crr_setup(struct iperf_test *);
+
+/**
+ * iperf_rr_init -- give each client stream room to time the requests
+ * it has in flight, or its --crr connections; the server gets its
+ * --crr connection table, or room for the --rr-rate stamps it owes
+ *
+ * returns 0 on success, -1 (with i_errno set) on failure
+ *
+ */
+int iperf_rr_init(struct iperf_test *);
+
+/**
+ * iperf_rr_run -- move the streams' requests and responses along;
+ * called from the client and server loops instead of iperf_send and
+ * iperf_recv
+ *
+ * returns 0 on success, -1 (with i_errno set) on failure
+ *
+ */
+int iperf_rr_run(struct iperf_test *, fd_set *read_setP, fd_set *write_setP);
+
+/**
+ * iperf_rr_interval -- move the stream's transactions this interval
+ * into irp
+ *
+ */
+void iperf_rr_interval(struct iperf_stream *, struct iperf_interval_results *);
+
+void iperf_rr_print_interval(struct iperf_stream *, struct iperf_interval_results *, cJSON *json_stream, const char *mbuf, double st, double et);
+void iperf_rr_print_interval_sum(struct iperf_test *, int sender, cJSON *json_sum, const char *mbuf, double st, double et);
+
+/**
+ * iperf_rr_print_results -- print each stream's transaction rate, or
+ * add it to the JSON output; the latencies are in the histograms
+ *
+ */
+void iperf_rr_print_results(struct iperf_test *);
+
+void iperf_rr_free_stream(struct iperf_stream *);
+
+/* Close the server's --crr connections and listener */
+void iperf_rr_free(struct iperf_test *);
+
+#endif
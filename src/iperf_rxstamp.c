@@ -0,0 +1,289 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#if defined(HAVE_LINUX_NET_TSTAMP_H)
+#include <linux/net_tstamp.h>
+#endif
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_rxstamp.h"
+#include "iperf_histogram.h"
+#include "iperf_locale.h"
+#include "iperf_time.h"
+#include "iperf_util.h"
+#include "units.h"
+#include "cjson.h"
+
+/*
+ * Kernel receive timestamps for UDP (--rx-timestamps).
+ *
+ * A UDP receiver takes each datagram's arrival time after recv()
+ * returns, so jitter and one-way delay include however long select()
+ * and the scheduler took to get to it.  With SO_TIMESTAMPING the
+ * kernel stamps the datagram as it comes in, and recvmsg() hands the
+ * stamp over: software (CLOCK_REALTIME, as the stack gets the packet)
+ * and, with --rx-timestamps=hw and a NIC set to timestamp received
+ * packets (hwstamp_ctl, or SIOCSHWTSTAMP), hardware (the NIC's clock).
+ *
+ * The software stamp is moved onto the clock the arrival is taken on
+ * by subtracting the wait, CLOCK_REALTIME now less the stamp, from
+ * the user-space arrival; jitter, --owd and the histograms then work
+ * from that.  The hardware clock isn't the sender's or ours, but
+ * jitter only takes differences: when two datagrams in a row carry
+ * hardware stamps, the jitter delta is theirs.
+ *
+ * The user-space jitter is kept alongside, and intervals and the
+ * summary give both, how many datagrams had each kind of stamp, and
+ * percentiles of the wait in ms.
+ */
+
+int
+iperf_rxstamp_init(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+#if defined(HAVE_LINUX_NET_TSTAMP_H) && defined(SO_TIMESTAMPING)
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+
+    if (test->rx_timestamps == RXSTAMP_HW)
+	flags |= SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+#endif
+
+    if (!test->rx_timestamps || test->protocol->id != Pudp)
+	return 0;
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (sp->sender || sp->rx_wait_hist != NULL)
+	    continue;
+	sp->rx_wait_hist = iperf_histogram_new();
+	sp->rx_wait_last = iperf_histogram_new();
+	sp->rx_wait_total = iperf_histogram_new();
+	if (sp->rx_wait_hist == NULL || sp->rx_wait_last == NULL || sp->rx_wait_total == NULL) {
+	    i_errno = IEINITTEST;
+	    return -1;
+	}
+#if defined(HAVE_LINUX_NET_TSTAMP_H) && defined(SO_TIMESTAMPING)
+	if (setsockopt(sp->socket, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0) {
+	    i_errno = IESETRXSTAMP;
+	    return -1;
+	}
+#endif
+    }
+    return 0;
+}
+
+double
+iperf_rxstamp_record(struct iperf_stream *sp, struct iperf_time *sent, struct iperf_time *arrival, uint64_t stamp_ns, uint64_t hw_ns, int first_packet)
+{
+    struct iperf_time temp_time;
+    struct timespec now;
+    double transit, d, delta = -1;
+    int64_t wait_ns;
+    uint64_t usecs;
+
+    sp->rxstamps.datagrams++;
+
+    /* What jitter would have been without the stamps */
+    iperf_time_diff(arrival, sent, &temp_time);
+    transit = iperf_time_in_secs(&temp_time);
+    if (first_packet)
+	sp->prev_transit_user = transit;
+    d = transit - sp->prev_transit_user;
+    if (d < 0)
+	d = -d;
+    sp->prev_transit_user = transit;
+    sp->jitter_user += (d - sp->jitter_user) / 16.0;
+
+    if (stamp_ns != 0) {
+	sp->rxstamps.kernel++;
+	clock_gettime(CLOCK_REALTIME, &now);
+	wait_ns = (int64_t) now.tv_sec * 1000000000 + now.tv_nsec - (int64_t) stamp_ns;
+	if (wait_ns < 0)
+	    wait_ns = 0;
+	if (sp->rx_wait_hist != NULL)
+	    iperf_histogram_record(sp->rx_wait_hist, wait_ns / 1000);
+	usecs = iperf_time_in_usecs(arrival) - wait_ns / 1000;
+	arrival->secs = usecs / SEC_TO_US;
+	arrival->usecs = usecs % SEC_TO_US;
+    }
+
+    if (hw_ns != 0) {
+	sp->rxstamps.hw++;
+	transit = hw_ns / 1e9 - (sent->secs + sent->usecs / 1e6);
+	if (sp->prev_hw && !first_packet) {
+	    delta = transit - sp->prev_transit_hw;
+	    if (delta < 0)
+		delta = -delta;
+	}
+	sp->prev_transit_hw = transit;
+    }
+    sp->prev_hw = hw_ns != 0;
+    return delta;
+}
+
+void
+iperf_rxstamp_interval(struct iperf_stream *sp, struct iperf_interval_results *irp)
+{
+    struct iperf_histogram *h;
+
+    irp->rxstamps.datagrams = sp->rxstamps.datagrams - sp->rxstamps_prev.datagrams;
+    irp->rxstamps.kernel = sp->rxstamps.kernel - sp->rxstamps_prev.kernel;
+    irp->rxstamps.hw = sp->rxstamps.hw - sp->rxstamps_prev.hw;
+    irp->jitter_user = sp->jitter_user;
+    sp->rxstamps_prev = sp->rxstamps;
+    if (sp->rx_wait_hist == NULL)
+	return;
+    iperf_histogram_merge(sp->rx_wait_total, sp->rx_wait_hist);
+    h = sp->rx_wait_last;
+    sp->rx_wait_last = sp->rx_wait_hist;
+    sp->rx_wait_hist = h;
+    iperf_histogram_reset(h);
+}
+
+void
+iperf_rxstamp_reset(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	sp->rxstamps_start = sp->rxstamps;
+	if (sp->rx_wait_total != NULL)
+	    iperf_histogram_reset(sp->rx_wait_total);
+    }
+}
+
+static cJSON *
+stats_json(const struct iperf_rxstamp_counts *c, double jitter, double jitter_user, const struct iperf_histogram *h)
+{
+    struct iperf_hist_summary s;
+    cJSON *j;
+
+    if ((j = iperf_json_printf("datagrams: %d  kernel_stamped: %d  hw_stamped: %d  jitter_ms: %f  jitter_user_ms: %f",
+			       (int64_t) c->datagrams, (int64_t) c->kernel, (int64_t) c->hw,
+			       jitter * 1000.0, jitter_user * 1000.0)) == NULL)
+	return NULL;
+    if (h->count != 0) {
+	iperf_histogram_summarize(h, &s);
+	cJSON_AddItemToObject(j, "wait", iperf_json_printf("p50_ms: %f  p90_ms: %f  p99_ms: %f  p99_9_ms: %f  max_ms: %f",
+							    s.p50, s.p90, s.p99, s.p999, s.max));
+    }
+    return j;
+}
+
+static void
+print_stats(struct iperf_stream *sp, const struct iperf_rxstamp_counts *c, double jitter, double jitter_user, const struct iperf_histogram *h, const char *mbuf, double st, double et)
+{
+    struct iperf_hist_summary s;
+
+    iperf_printf(sp->test, report_rxstamp_interval, sp->socket, mbuf, st, et,
+		 jitter * 1000.0, jitter_user * 1000.0, (unsigned long long) c->kernel,
+		 (unsigned long long) c->datagrams, (unsigned long long) c->hw);
+    if (h->count == 0)
+	return;
+    iperf_histogram_summarize(h, &s);
+    iperf_printf(sp->test, report_hist_interval, sp->socket, mbuf, st, et, "rx_wait",
+		 s.p50, s.p90, s.p99, s.p999, s.max);
+}
+
+void
+iperf_rxstamp_print_interval(struct iperf_stream *sp, struct iperf_interval_results *irp, cJSON *json_stream, const char *mbuf, double st, double et)
+{
+    if (sp->rx_wait_last == NULL || irp->rxstamps.datagrams == 0)
+	return;
+    if (sp->test->json_output) {
+	if (json_stream != NULL)
+	    cJSON_AddItemToObject(json_stream, "rx_timestamps", stats_json(&irp->rxstamps, irp->jitter, irp->jitter_user, sp->rx_wait_last));
+    } else
+	print_stats(sp, &irp->rxstamps, irp->jitter, irp->jitter_user, sp->rx_wait_last, mbuf, st, et);
+}
+
+void
+iperf_rxstamp_print_results(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_rxstamp_counts total;
+    struct iperf_time temp_time;
+    cJSON *j_stamps = NULL, *j_streams = NULL, *j_stream;
+    char mbuf[UNIT_LEN];
+    double et;
+    int rows = 0;
+
+    if (test->json_output) {
+	if ((j_stamps = iperf_json_printf("hardware: %b", test->rx_timestamps == RXSTAMP_HW)) == NULL)
+	    return;
+	if ((j_streams = cJSON_CreateArray()) == NULL) {
+	    cJSON_Delete(j_stamps);
+	    return;
+	}
+	cJSON_AddItemToObject(j_stamps, "streams", j_streams);
+	cJSON_AddItemToObject(test->json_end, "rx_timestamps", j_stamps);
+    }
+
+    if (test->mode == BIDIRECTIONAL)
+	sprintf(mbuf, "[RX-%s]", test->role == 'c' ? "C" : "S");
+    else
+	mbuf[0] = '\0';
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (sp->rx_wait_total == NULL)
+	    continue;
+	total.datagrams = sp->rxstamps.datagrams - sp->rxstamps_start.datagrams;
+	total.kernel = sp->rxstamps.kernel - sp->rxstamps_start.kernel;
+	total.hw = sp->rxstamps.hw - sp->rxstamps_start.hw;
+	if (total.datagrams == 0)
+	    continue;
+	if (test->json_output) {
+	    if ((j_stream = stats_json(&total, sp->jitter, sp->jitter_user, sp->rx_wait_total)) == NULL)
+		return;
+	    cJSON_AddNumberToObject(j_stream, "socket", sp->socket);
+	    cJSON_AddItemToArray(j_streams, j_stream);
+	    continue;
+	}
+	if (rows++ == 0)
+	    iperf_printf(test, report_rxstamp_header,
+			 test->rx_timestamps == RXSTAMP_HW ? "software and hardware" : "software");
+	iperf_time_diff(&sp->result->start_time, &sp->result->end_time, &temp_time);
+	et = iperf_time_in_secs(&temp_time);
+	print_stats(sp, &total, sp->jitter, sp->jitter_user, sp->rx_wait_total, mbuf, 0.0, et);
+    }
+}
+
+void
+iperf_rxstamp_free_stream(struct iperf_stream *sp)
+{
+    iperf_histogram_free(sp->rx_wait_hist);
+    iperf_histogram_free(sp->rx_wait_last);
+    iperf_histogram_free(sp->rx_wait_total);
+    sp->rx_wait_hist = sp->rx_wait_last = sp->rx_wait_total = NULL;
+}
@@ -0,0 +1,84 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_RXSTAMP_H
+#define __IPERF_RXSTAMP_H
+
+#include <stdint.h>
+
+#include "cjson.h"
+
+/**
+ * iperf_rxstamp_init -- turn on kernel receive timestamps on the
+ * receiving UDP streams (--rx-timestamps)
+ *
+ */
+int iperf_rxstamp_init(struct iperf_test *);
+
+/**
+ * iperf_rxstamp_record -- move a datagram's user-space arrival time
+ * back to when the kernel stamped it, given the stamps recvmsg()
+ * brought (0 if none); returns the jitter delta from hardware stamps,
+ * or -1 when there isn't one
+ *
+ */
+double iperf_rxstamp_record(struct iperf_stream *, struct iperf_time *sent, struct iperf_time *arrival, uint64_t stamp_ns, uint64_t hw_ns, int first_packet);
+
+/**
+ * iperf_rxstamp_interval -- move the interval's counts and user-space
+ * jitter into irp and finish its histogram
+ *
+ */
+void iperf_rxstamp_interval(struct iperf_stream *, struct iperf_interval_results *);
+
+/**
+ * iperf_rxstamp_reset -- forget what was recorded while omitting
+ *
+ */
+void iperf_rxstamp_reset(struct iperf_test *);
+
+/**
+ * iperf_rxstamp_print_interval -- print the interval's kernel and
+ * user-space jitter and receive wait after the stream's line, or add
+ * them to its JSON object
+ *
+ */
+void iperf_rxstamp_print_interval(struct iperf_stream *, struct iperf_interval_results *, cJSON *json_stream, const char *mbuf, double st, double et);
+
+/**
+ * iperf_rxstamp_print_results -- print each receiving stream's figures
+ * over the test, or add them to the JSON output
+ *
+ */
+void iperf_rxstamp_print_results(struct iperf_test *);
+
+/**
+ * iperf_rxstamp_free_stream -- free a stream's histograms
+ *
+ */
+void iperf_rxstamp_free_stream(struct iperf_stream *);
+
+#endif
@@ -0,0 +1,404 @@
+/*
+ * iperf, Copyright (c) 2014-2022, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/select.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_search.h"
+#include "iperf_locale.h"
+#include "iperf_util.h"
+#include "net.h"
+#include "timer.h"
+#include "units.h"
+#include "cjson.h"
+
+/*
+ * RFC 2544-style UDP throughput search (--search).
+ *
+ * The whole search runs inside one test, so the control connection and
+ * the data streams are set up once.  Each trial sends at a fixed rate
+ * and datagram size for --trial-time seconds, then goes quiet for
+ * SEARCH_SETTLE_USECS so the last datagrams can arrive, and then asks
+ * the receiver for its counters with UDP_FEEDBACK_REQUEST.  The reply
+ * says how many datagrams arrived since the previous reply, which is
+ * exactly the trial, so the sender knows the trial's loss.
+ *
+ * For each size, the binary method bisects between zero and -b,
+ * starting with a trial at -b itself.  The exponential method starts
+ * at -b and doubles the rate until a trial fails, then bisects.  The
+ * highest passing rate then gets a confirmation run of -t seconds; if
+ * that fails, the search continues below it.
+ */
+
+static void trial_end_proc(TimerClientData client_data, struct iperf_time *nowP);
+
+int
+iperf_search_parse_sizes(struct iperf_test *test, const char *list)
+{
+    struct iperf_search *search = test->search;
+    const char *p = list;
+    char *end;
+    long size;
+    int *sizes;
+
+    for (;;) {
+	size = strtol(p, &end, 10);
+	if (end == p || size < MIN_UDP_BLOCKSIZE || size > MAX_UDP_BLOCKSIZE ||
+	    (*end != ',' && *end != '\0')) {
+	    i_errno = IESEARCHSIZES;
+	    return -1;
+	}
+	sizes = realloc(search->sizes, (search->nsizes + 1) * sizeof(int));
+	if (sizes == NULL) {
+	    i_errno = IESEARCHSIZES;
+	    return -1;
+	}
+	search->sizes = sizes;
+	search->sizes[search->nsizes++] = size;
+	if (*end == '\0')
+	    break;
+	p = end + 1;
+    }
+    return 0;
+}
+
+static void
+sender_totals(struct iperf_test *test, iperf_size_t *packets, iperf_size_t *bytes)
+{
+    struct iperf_stream *sp;
+
+    *packets = *bytes = 0;
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (!sp->sender)
+	    continue;
+	*packets += sp->packet_count;
+	*bytes += sp->result->bytes_sent;
+    }
+}
+
+static int
+start_trial(struct iperf_test *test, struct iperf_time *nowP)
+{
+    struct iperf_search *search = test->search;
+    struct iperf_stream *sp;
+    TimerClientData cd;
+    uint64_t per_stream;
+
+    per_stream = search->rate / test->num_streams;
+    if (per_stream == 0)
+	per_stream = 1;
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (!sp->sender)
+	    continue;
+	sp->target = per_stream;
+	sp->target_start = *nowP;
+	sp->target_start_bytes = sp->result->bytes_sent;
+	sp->green_light = 1;
+	FD_SET(sp->socket, &test->write_set);
+    }
+
+    search->trial_start = *nowP;
+    sender_totals(test, &search->packets_start, &search->bytes_start);
+    search->received = 0;
+    search->sending = 1;
+    ++search->trials;
+
+    cd.p = test;
+    search->timer = tmr_create(test->timers, nowP, trial_end_proc, cd,
+			       search->phase == SEARCH_CONFIRM ? search->confirm_usecs : search->trial_usecs, 0);
+    if (search->timer == NULL) {
+	i_errno = IEINITTEST;
+	return -1;
+    }
+    return 0;
+}
+
+/* After the quiet period, ask the receiver what arrived. */
+static void
+settle_proc(TimerClientData client_data, struct iperf_time *nowP)
+{
+    struct iperf_test *test = client_data.p;
+    signed char msg = UDP_FEEDBACK_REQUEST;
+
+    test->search->timer = NULL;
+    if (Nwrite(test->ctrl_sck, (char *) &msg, sizeof(msg), Ptcp) < 0) {
+	iperf_err(test, "unable to request search feedback: %s", strerror(errno));
+	test->done = 1;
+    }
+}
+
+static void
+trial_end_proc(TimerClientData client_data, struct iperf_time *nowP)
+{
+    struct iperf_test *test = client_data.p;
+    struct iperf_search *search = test->search;
+    struct iperf_stream *sp;
+    struct iperf_time temp_time;
+    iperf_size_t packets, bytes;
+    TimerClientData cd;
+
+    /* iperf_check_throttle keeps the streams quiet from here on */
+    search->sending = 0;
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (!sp->sender)
+	    continue;
+	sp->green_light = 0;
+	FD_CLR(sp->socket, &test->write_set);
+    }
+
+    sender_totals(test, &packets, &bytes);
+    search->packets_sent = packets - search->packets_start;
+    search->bytes = bytes - search->bytes_start;
+    iperf_time_diff(&search->trial_start, nowP, &temp_time);
+    search->trial_secs = iperf_time_in_secs(&temp_time);
+
+    cd.p = test;
+    search->timer = tmr_create(test->timers, nowP, settle_proc, cd, SEARCH_SETTLE_USECS, 0);
+    if (search->timer == NULL) {
+	iperf_err(test, "unable to schedule the search settle timer");
+	test->done = 1;
+    }
+}
+
+static void
+begin_size(struct iperf_test *test)
+{
+    struct iperf_search *search = test->search;
+
+    test->settings->blksize = search->sizes[search->cur];
+    search->trials = 0;
+    search->lo = 0;
+    search->hi = search->start_rate;
+    search->rate = search->start_rate;
+    search->phase = search->method == SEARCH_BINARY ? SEARCH_BISECT : SEARCH_PROBE;
+}
+
+int
+iperf_search_start(struct iperf_test *test)
+{
+    struct iperf_search *search = test->search;
+    struct iperf_time now;
+    int i;
+
+    /* default to the datagram size the test would have used */
+    if (search->nsizes == 0) {
+	search->sizes = malloc(sizeof(int));
+	if (search->sizes == NULL) {
+	    i_errno = IEINITTEST;
+	    return -1;
+	}
+	search->sizes[0] = test->settings->blksize;
+	search->nsizes = 1;
+    }
+    search->results = calloc(search->nsizes, sizeof(struct iperf_search_result));
+    if (search->results == NULL) {
+	i_errno = IEINITTEST;
+	return -1;
+    }
+    for (i = 0; i < search->nsizes; ++i)
+	search->results[i].size = search->sizes[i];
+    search->max_size = test->settings->blksize;
+    search->start_rate = test->settings->rate;
+    search->cur = 0;
+
+    if (test->json_output)
+	cJSON_AddItemToObject(test->json_top, "search_trials", cJSON_CreateArray());
+
+    begin_size(test);
+    iperf_time_now(&now);
+    return start_trial(test, &now);
+}
+
+void
+iperf_search_feedback(struct iperf_test *test, struct iperf_stream *sp, uint32_t packets, uint32_t lost)
+{
+    if (sp->sender && packets > lost)
+	test->search->received += packets - lost;
+}
+
+/* Keep the best passing rate for the current size and move on. */
+static void
+finish_size(struct iperf_test *test, int confirmed)
+{
+    struct iperf_search *search = test->search;
+    struct iperf_search_result *res = &search->results[search->cur];
+
+    res->trials = search->trials;
+    res->confirmed = confirmed;
+    if (++search->cur < search->nsizes)
+	begin_size(test);
+}
+
+int
+iperf_search_trial_done(struct iperf_test *test)
+{
+    struct iperf_search *search = test->search;
+    struct iperf_search_result *res = &search->results[search->cur];
+    struct iperf_time now;
+    iperf_size_t lost;
+    double loss, achieved;
+    int pass, short_of_rate;
+    const char *verdict;
+    char nbuf[UNIT_LEN];
+    cJSON *json_trials;
+    uint64_t floor;
+
+    if (search->sending || search->cur >= search->nsizes)
+	return 0;
+
+    lost = search->packets_sent > search->received ? search->packets_sent - search->received : 0;
+    loss = search->packets_sent ? 100.0 * lost / search->packets_sent : 100.0;
+    achieved = search->trial_secs > 0 ? search->bytes * 8 / search->trial_secs : 0;
+    short_of_rate = achieved < (1.0 - SEARCH_SHORTFALL) * search->rate;
+    pass = loss <= test->target_loss && !short_of_rate;
+
+    if (search->phase == SEARCH_CONFIRM)
+	verdict = pass ? "confirmed" : "not confirmed";
+    else if (short_of_rate)
+	verdict = "sender limited";
+    else
+	verdict = pass ? "pass" : "fail";
+
+    if (test->json_output) {
+	json_trials = cJSON_GetObjectItem(test->json_top, "search_trials");
+	if (json_trials)
+	    cJSON_AddItemToArray(json_trials, iperf_json_printf("size: %d  target_bitrate: %d  bits_per_second: %f  packets: %d  lost_packets: %d  lost_percent: %f  seconds: %f  result: %s", (int64_t) search->sizes[search->cur], (int64_t) search->rate, achieved, (int64_t) search->packets_sent, (int64_t) lost, loss, search->trial_secs, verdict));
+    } else {
+	unit_snprintf(nbuf, UNIT_LEN, achieved / 8, test->settings->unit_format);
+	iperf_printf(test, report_search_trial, search->sizes[search->cur], nbuf, search->packets_sent / search->trial_secs, (int) lost, (int) search->packets_sent, loss, verdict);
+    }
+
+    if (pass) {
+	res->rate = (uint64_t) achieved;
+	res->pps = search->packets_sent / search->trial_secs;
+	res->loss = loss;
+    }
+
+    floor = search->sizes[search->cur] * 8;
+    switch (search->phase) {
+	case SEARCH_PROBE:
+	    if (pass) {
+		search->lo = search->rate;
+		search->rate *= 2;
+	    } else {
+		search->hi = search->rate;
+		search->phase = SEARCH_BISECT;
+	    }
+	    break;
+	case SEARCH_BISECT:
+	    if (pass)
+		search->lo = search->rate;
+	    else
+		search->hi = search->rate;
+	    break;
+	case SEARCH_CONFIRM:
+	    if (pass) {
+		finish_size(test, 1);
+		goto next;
+	    }
+	    /* the bisection was too optimistic; search below it */
+	    res->rate = 0;
+	    res->pps = res->loss = 0;
+	    search->hi = search->lo;
+	    search->lo = 0;
+	    search->phase = SEARCH_BISECT;
+	    break;
+    }
+
+    if (search->phase == SEARCH_BISECT) {
+	if (search->hi - search->lo <= SEARCH_RESOLUTION * search->hi || search->hi <= floor) {
+	    if (search->lo == 0) {
+		finish_size(test, 0);
+		goto next;
+	    }
+	    search->phase = SEARCH_CONFIRM;
+	    search->rate = search->lo;
+	} else
+	    search->rate = (search->lo + search->hi) / 2;
+    }
+    if (search->trials >= SEARCH_MAX_TRIALS)
+	finish_size(test, 0);
+
+  next:
+    if (search->cur >= search->nsizes) {
+	test->settings->blksize = search->max_size;
+	test->done = 1;
+	return 0;
+    }
+    iperf_time_now(&now);
+    return start_trial(test, &now);
+}
+
+void
+iperf_search_print_results(struct iperf_test *test)
+{
+    struct iperf_search *search = test->search;
+    struct iperf_search_result *res;
+    const char *method = search->method == SEARCH_BINARY ? "binary" : "exponential";
+    char nbuf[UNIT_LEN];
+    cJSON *json_results = NULL;
+    int i;
+
+    if (search->results == NULL)
+	return;
+
+    if (test->json_output) {
+	json_results = cJSON_CreateArray();
+	if (json_results == NULL)
+	    return;
+	cJSON_AddItemToObject(test->json_end, "throughput_search", iperf_json_printf("method: %s  target_loss: %f", method, test->target_loss));
+	cJSON_AddItemToObject(cJSON_GetObjectItem(test->json_end, "throughput_search"), "results", json_results);
+    } else
+	iperf_printf(test, report_search_header, method, test->target_loss);
+
+    for (i = 0; i < search->nsizes; ++i) {
+	res = &search->results[i];
+	if (test->json_output)
+	    cJSON_AddItemToArray(json_results, iperf_json_printf("size: %d  bits_per_second: %d  packets_per_second: %f  lost_percent: %f  trials: %d  confirmed: %b", (int64_t) res->size, (int64_t) res->rate, res->pps, res->loss, (int64_t) res->trials, res->confirmed));
+	else {
+	    unit_snprintf(nbuf, UNIT_LEN, (double) res->rate / 8, test->settings->unit_format);
+	    iperf_printf(test, report_search_result, res->size, nbuf, res->pps, res->loss, res->trials,
+			 res->confirmed ? "" : res->rate ? "  (unconfirmed)" : "  (no passing rate)");
+	}
+    }
+}
+
+void
+iperf_search_free(struct iperf_search *search)
+{
+    if (search == NULL)
+	return;
+    free(search->sizes);
+    free(search->results);
+    free(search);
+}
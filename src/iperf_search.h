@@ -0,0 +1,72 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_SEARCH_H
+#define __IPERF_SEARCH_H
+
+/**
+ * iperf_search_parse_sizes -- parse a --search-sizes list into test->search
+ *
+ * returns 0 on success, -1 (with i_errno set) on a bad list
+ *
+ */
+int iperf_search_parse_sizes(struct iperf_test *, const char *);
+
+/**
+ * iperf_search_start -- begin the first trial; called by the sending
+ * client when the test starts
+ *
+ * returns 0 on success
+ *
+ */
+int iperf_search_start(struct iperf_test *);
+
+/**
+ * iperf_search_feedback -- account one stream's UDP_FEEDBACK record
+ * against the trial that just ended
+ *
+ */
+void iperf_search_feedback(struct iperf_test *, struct iperf_stream *, uint32_t packets, uint32_t lost);
+
+/**
+ * iperf_search_trial_done -- judge the trial once all feedback records
+ * are in, and start the next trial or end the test
+ *
+ * returns 0 on success
+ *
+ */
+int iperf_search_trial_done(struct iperf_test *);
+
+/**
+ * iperf_search_print_results -- print the size vs. rate table, or add it
+ * to the JSON output
+ *
+ */
+void iperf_search_print_results(struct iperf_test *);
+
+void iperf_search_free(struct iperf_search *);
+
+#endif
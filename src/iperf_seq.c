@@ -0,0 +1,384 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_seq.h"
+#include "iperf_histogram.h"
+#include "iperf_locale.h"
+#include "iperf_util.h"
+#include "cjson.h"
+
+/*
+ * UDP sequence bookkeeping.
+ *
+ * Each receiving stream keeps a bitmap of the last SEQ_WINDOW sequence
+ * numbers up to the highest seen, one bit each for whether it has
+ * arrived.  A datagram past the highest moves the window up; one
+ * inside it is a duplicate if its bit is already set and a late
+ * arrival filling a gap if not, so duplicates no longer pass for
+ * reordered datagrams and cancel out losses.  One further back than
+ * the window can't be told from a duplicate, and is taken as late.
+ *
+ * Sequence numbers leaving the bottom of the window are settled: the
+ * retired bits are scanned a word at a time, counting the zeros
+ * before the next one (or the ones before the next zero) to measure
+ * the runs, so each sequence number costs O(1) once on the way in and
+ * once on the way out.  Runs of losses are the loss bursts, and runs
+ * of arrivals between two bursts the gaps, in the sense of RFC 3357.
+ *
+ * For each missing sequence number the window also remembers the
+ * arrival index of the datagram that first went past it.  When it
+ * turns up late, the difference from its own arrival index is its
+ * reorder extent (RFC 4737, section 4.2.2): how many datagrams it
+ * arrived behind the first one it should have preceded.
+ *
+ * --loss-stats reports the counts and the distributions of extents,
+ * burst and gap lengths; the receiver sends its summary back with the
+ * results so the client can print it whichever way the data went.
+ */
+
+int
+iperf_seq_init(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_seq *seq;
+
+    if (test->protocol->id != Pudp)
+	return 0;
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	memset(&sp->seq_result, 0, sizeof(sp->seq_result));
+	if (sp->sender)
+	    continue;
+	if (sp->seq == NULL && (sp->seq = calloc(1, sizeof(struct iperf_seq))) == NULL) {
+	    i_errno = IEINITTEST;
+	    return -1;
+	}
+	seq = sp->seq;
+	if (test->loss_stats && seq->extent == NULL) {
+	    seq->extent = iperf_histogram_new();
+	    seq->burst = iperf_histogram_new();
+	    seq->gap = iperf_histogram_new();
+	    if (seq->extent == NULL || seq->burst == NULL || seq->gap == NULL) {
+		i_errno = IEINITTEST;
+		return -1;
+	    }
+	}
+    }
+    return 0;
+}
+
+/* The run being retired has ended */
+static void
+end_run(struct iperf_seq *seq)
+{
+    if (seq->run == 0)
+	return;
+    if (seq->losing) {
+	++seq->bursts;
+	seq->lost += seq->run;
+	if (seq->burst != NULL)
+	    iperf_histogram_record(seq->burst, seq->run);
+    } else if (seq->bursts > 0 && seq->gap != NULL)
+	/* Only a run between two bursts is a gap */
+	iperf_histogram_record(seq->gap, seq->run);
+}
+
+/* Retire n settled sequence numbers, the lowest first, as bits: 1 arrived, 0 lost */
+static void
+retire_bits(struct iperf_seq *seq, uint64_t bits, int n)
+{
+    uint64_t mask, other;
+    int k;
+
+    while (n > 0) {
+	mask = n < 64 ? ((uint64_t) 1 << n) - 1 : ~(uint64_t) 0;
+	/* The run goes on up to the first bit of the other kind */
+	other = (seq->losing ? bits : ~bits) & mask;
+	k = other != 0 ? __builtin_ctzll(other) : n;
+	seq->run += k;
+	if (k < n) {
+	    end_run(seq);
+	    seq->losing = !seq->losing;
+	    seq->run = 0;
+	}
+	bits = k < 64 ? bits >> k : 0;
+	n -= k;
+    }
+}
+
+/* Retire n sequence numbers that never got into the window */
+static void
+retire_lost(struct iperf_seq *seq, uint64_t n)
+{
+    if (!seq->losing) {
+	end_run(seq);
+	seq->losing = 1;
+	seq->run = 0;
+    }
+    seq->run += n;
+}
+
+/* Settle everything up to and including upto */
+static void
+retire(struct iperf_seq *seq, uint64_t upto)
+{
+    uint64_t s = seq->retired + 1, end, bits;
+    int pos, n;
+
+    end = upto < seq->top ? upto : seq->top;
+    while (s <= end) {
+	pos = s % SEQ_WINDOW;
+	n = 64 - pos % 64;
+	if (n > end - s + 1)
+	    n = end - s + 1;
+	bits = seq->bits[pos / 64] >> (pos % 64);
+	retire_bits(seq, bits, n);
+	s += n;
+    }
+    if (s <= upto)
+	retire_lost(seq, upto - s + 1);
+    seq->retired = upto;
+}
+
+/* Move the window up so that s is the highest */
+static void
+advance(struct iperf_seq *seq, uint64_t s, uint32_t arrival)
+{
+    uint64_t lo, q;
+    int pos, n;
+
+    if (s > SEQ_WINDOW && s - SEQ_WINDOW > seq->retired)
+	retire(seq, s - SEQ_WINDOW);
+
+    /* The ones skipped over are missing until they turn up */
+    lo = seq->top + 1;
+    if (s > SEQ_WINDOW && lo <= s - SEQ_WINDOW)
+	lo = s - SEQ_WINDOW + 1;
+    for (q = lo; q < s; ++q)
+	seq->passed[q % SEQ_WINDOW] = arrival;
+    for (q = lo; q <= s; q += n) {
+	pos = q % SEQ_WINDOW;
+	n = 64 - pos % 64;
+	if (n > s - q + 1)
+	    n = s - q + 1;
+	seq->bits[pos / 64] &= ~((n < 64 ? ((uint64_t) 1 << n) - 1 : ~(uint64_t) 0) << (pos % 64));
+    }
+    seq->bits[(s % SEQ_WINDOW) / 64] |= (uint64_t) 1 << (s % 64);
+    seq->top = s;
+}
+
+int
+iperf_seq_record(struct iperf_stream *sp, uint64_t pcount)
+{
+    struct iperf_seq *seq = sp->seq;
+    uint64_t *word, bit;
+    uint32_t arrival;
+
+    arrival = (uint32_t) ++seq->arrivals;
+    if (pcount > seq->top) {
+	/* Count a gap as lost for now */
+	if (pcount > seq->top + 1)
+	    sp->cnt_error += pcount - seq->top - 1;
+	advance(seq, pcount, arrival);
+	sp->packet_count = pcount;
+	return SEQ_NEXT;
+    }
+
+    if (pcount == 0 || pcount + SEQ_WINDOW <= seq->top) {
+	/* Long since settled as lost; take it as late rather than a duplicate */
+	++seq->late;
+	sp->outoforder_packets++;
+	if (sp->cnt_error > 0)
+	    sp->cnt_error--;
+	return SEQ_LATE;
+    }
+
+    word = &seq->bits[(pcount % SEQ_WINDOW) / 64];
+    bit = (uint64_t) 1 << (pcount % 64);
+    if (*word & bit) {
+	++seq->duplicates;
+	return SEQ_DUPLICATE;
+    }
+    *word |= bit;
+    ++seq->reordered;
+    sp->outoforder_packets++;
+    /* It fills a gap that was counted as a loss */
+    if (sp->cnt_error > 0)
+	sp->cnt_error--;
+    if (seq->extent != NULL)
+	iperf_histogram_record(seq->extent, (uint32_t) (arrival - seq->passed[pcount % SEQ_WINDOW]));
+    return SEQ_REORDERED;
+}
+
+void
+iperf_seq_reset(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_seq *seq;
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if ((seq = sp->seq) == NULL)
+	    continue;
+	/* The window stays as it is; only what gets reported starts again */
+	seq->lost = seq->bursts = seq->reordered = seq->late = seq->duplicates = 0;
+	seq->run = 0;
+	if (seq->extent != NULL) {
+	    iperf_histogram_reset(seq->extent);
+	    iperf_histogram_reset(seq->burst);
+	    iperf_histogram_reset(seq->gap);
+	}
+    }
+}
+
+void
+iperf_seq_summarize(struct iperf_stream *sp)
+{
+    struct iperf_seq *seq = sp->seq;
+    struct iperf_seq_summary *r = &sp->seq_result;
+
+    if (seq == NULL || seq->finished)
+	return;
+    seq->finished = 1;
+    /* Whatever is still missing at the end is lost */
+    retire(seq, seq->top);
+    if (seq->losing)
+	end_run(seq);
+
+    memset(r, 0, sizeof(*r));
+    r->valid = 1;
+    r->lost = seq->lost;
+    r->bursts = seq->bursts;
+    r->reordered = seq->reordered;
+    r->late = seq->late;
+    r->duplicates = seq->duplicates;
+    if (seq->extent == NULL)
+	return;
+    r->burst_mean = iperf_histogram_mean(seq->burst);
+    r->burst_p90 = iperf_histogram_percentile(seq->burst, 90);
+    r->burst_max = seq->burst->count > 0 ? seq->burst->max : 0;
+    r->gap_mean = iperf_histogram_mean(seq->gap);
+    r->gap_p90 = iperf_histogram_percentile(seq->gap, 90);
+    r->gap_max = seq->gap->count > 0 ? seq->gap->max : 0;
+    r->extent_p50 = iperf_histogram_percentile(seq->extent, 50);
+    r->extent_p90 = iperf_histogram_percentile(seq->extent, 90);
+    r->extent_max = seq->extent->count > 0 ? seq->extent->max : 0;
+}
+
+cJSON *
+iperf_seq_results_json(struct iperf_stream *sp)
+{
+    struct iperf_seq_summary *r = &sp->seq_result;
+
+    return iperf_json_printf("lost: %d  loss_bursts: %d  burst_mean: %f  burst_p90: %f  burst_max: %f  gap_mean: %f  gap_p90: %f  gap_max: %f  reordered: %d  extent_p50: %f  extent_p90: %f  extent_max: %f  late: %d  duplicates: %d",
+			     (int64_t) r->lost, (int64_t) r->bursts, r->burst_mean, r->burst_p90, r->burst_max,
+			     r->gap_mean, r->gap_p90, r->gap_max, (int64_t) r->reordered,
+			     r->extent_p50, r->extent_p90, r->extent_max, (int64_t) r->late, (int64_t) r->duplicates);
+}
+
+static double
+number(cJSON *j, const char *name)
+{
+    cJSON *j_p = cJSON_GetObjectItem(j, name);
+
+    return j_p != NULL ? j_p->valuedouble : 0;
+}
+
+void
+iperf_seq_results_from_json(struct iperf_stream *sp, cJSON *j)
+{
+    struct iperf_seq_summary *r = &sp->seq_result;
+
+    r->valid = 1;
+    r->lost = number(j, "lost");
+    r->bursts = number(j, "loss_bursts");
+    r->burst_mean = number(j, "burst_mean");
+    r->burst_p90 = number(j, "burst_p90");
+    r->burst_max = number(j, "burst_max");
+    r->gap_mean = number(j, "gap_mean");
+    r->gap_p90 = number(j, "gap_p90");
+    r->gap_max = number(j, "gap_max");
+    r->reordered = number(j, "reordered");
+    r->extent_p50 = number(j, "extent_p50");
+    r->extent_p90 = number(j, "extent_p90");
+    r->extent_max = number(j, "extent_max");
+    r->late = number(j, "late");
+    r->duplicates = number(j, "duplicates");
+}
+
+void
+iperf_seq_print_results(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_seq_summary *r;
+    cJSON *j_streams = NULL, *j_stream;
+    int header = 0;
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	iperf_seq_summarize(sp);
+	r = &sp->seq_result;
+	if (!r->valid)
+	    continue;
+	if (test->json_output) {
+	    if (j_streams == NULL) {
+		if ((j_streams = cJSON_CreateArray()) == NULL)
+		    return;
+		cJSON_AddItemToObject(test->json_end, "sequence", j_streams);
+	    }
+	    if ((j_stream = iperf_seq_results_json(sp)) == NULL)
+		return;
+	    cJSON_AddNumberToObject(j_stream, "socket", sp->socket);
+	    cJSON_AddBoolToObject(j_stream, "sender", sp->sender);
+	    cJSON_AddItemToArray(j_streams, j_stream);
+	    continue;
+	}
+	if (!header) {
+	    iperf_printf(test, "%s", report_seq_header);
+	    header = 1;
+	}
+	iperf_printf(test, report_seq_loss, sp->socket, (double) r->lost, (double) r->bursts,
+		     r->burst_mean, r->burst_p90, r->burst_max, r->gap_mean, r->gap_p90, r->gap_max);
+	iperf_printf(test, report_seq_reorder, sp->socket, (double) r->reordered,
+		     r->extent_p50, r->extent_p90, r->extent_max, (double) r->late, (double) r->duplicates);
+    }
+}
+
+void
+iperf_seq_free_stream(struct iperf_stream *sp)
+{
+    if (sp->seq == NULL)
+	return;
+    iperf_histogram_free(sp->seq->extent);
+    iperf_histogram_free(sp->seq->burst);
+    iperf_histogram_free(sp->seq->gap);
+    free(sp->seq);
+    sp->seq = NULL;
+}
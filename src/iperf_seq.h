@@ -0,0 +1,79 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_SEQ_H
+#define __IPERF_SEQ_H
+
+#include "cjson.h"
+
+/* What iperf_seq_record made of a datagram */
+#define SEQ_NEXT 0			/* the highest yet, perhaps past a gap */
+#define SEQ_REORDERED 1			/* filled a gap inside the window */
+#define SEQ_DUPLICATE 2			/* already had it */
+#define SEQ_LATE 3			/* too far behind to tell which */
+
+/**
+ * iperf_seq_init -- give each UDP receiving stream its sequence window,
+ * and with --loss-stats the histograms to fill
+ *
+ * returns 0 on success, -1 (with i_errno set) on failure
+ *
+ */
+int iperf_seq_init(struct iperf_test *);
+
+/**
+ * iperf_seq_record -- account a datagram's sequence number: update the
+ * stream's highest sequence number, losses and out-of-order count
+ *
+ * returns one of the SEQ_ kinds above
+ *
+ */
+int iperf_seq_record(struct iperf_stream *, uint64_t pcount);
+
+/* Start the --loss-stats counts again when omitting ends */
+void iperf_seq_reset(struct iperf_test *);
+
+/**
+ * iperf_seq_summarize -- settle what's left in the receiver's window
+ * and fill in sp->seq_result; only the first call does anything
+ *
+ */
+void iperf_seq_summarize(struct iperf_stream *);
+
+/* The receiver's summary for the results exchange, and back */
+cJSON *iperf_seq_results_json(struct iperf_stream *);
+void iperf_seq_results_from_json(struct iperf_stream *, cJSON *);
+
+/**
+ * iperf_seq_print_results -- print each stream's duplicates, reordering
+ * and loss bursts, or add them to the JSON output
+ *
+ */
+void iperf_seq_print_results(struct iperf_test *);
+
+void iperf_seq_free_stream(struct iperf_stream *);
+
+#endif
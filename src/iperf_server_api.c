@@ -52,6 +52,10 @@
 #include "iperf_api.h"
 #include "iperf_udp.h"
 #include "iperf_tcp.h"
+#include "iperf_rr.h"
+#include "iperf_probe.h"
+#include "iperf_busypoll.h"
+#include "iperf_place.h"
 #include "iperf_util.h"
 #include "timer.h"
 #include "iperf_time.h"
@@ -183,9 +187,10 @@ iperf_handle_message_server(struct iperf_test *test)
 {
     int rval;
     struct iperf_stream *sp;
+    signed char msg;
 
     // XXX: Need to rethink how this behaves to fit API
-    if ((rval = Nread(test->ctrl_sck, (char*) &test->state, sizeof(signed char), Ptcp)) <= 0) {
+    if ((rval = Nread(test->ctrl_sck, (char*) &msg, sizeof(signed char), Ptcp)) <= 0) {
         if (rval == 0) {
 	    iperf_err(test, "the client has unexpectedly closed the connection");
             i_errno = IECTRLCLOSE;
@@ -197,11 +202,19 @@ iperf_handle_message_server(struct iperf_test *test)
         }
     }
 
+    /* Rate control feedback travels on the control connection but is not a state change. */
+    if (msg == UDP_FEEDBACK)
+        return iperf_udp_recv_feedback(test);
+    if (msg == UDP_FEEDBACK_REQUEST)
+        return iperf_udp_send_feedback(test);
+    test->state = msg;
+
     switch(test->state) {
         case TEST_START:
             break;
         case TEST_END:
 	    test->done = 1;
+	    iperf_place_stop(test);
             cpu_util(test->cpu_util);
             test->stats_callback(test);
             SLIST_FOREACH(sp, &test->streams, streams) {
@@ -223,6 +236,7 @@ iperf_handle_message_server(struct iperf_test *test)
             break;
         case CLIENT_TERMINATE:
             i_errno = IECLIENTTERM;
+	    iperf_place_stop(test);
 
 	    // Temporarily be in DISPLAY_RESULTS phase so we can get
 	    // ending summary statistics.
@@ -259,6 +273,7 @@ server_timer_proc(TimerClientData client_data, struct iperf_time *nowP)
     if (test->done)
         return;
     test->done = 1;
+    iperf_place_stop(test);
     /* Free streams */
     while (!SLIST_EMPTY(&test->streams)) {
         sp = SLIST_FIRST(&test->streams);
@@ -309,7 +324,7 @@ create_server_timers(struct iperf_test * test)
     test->timer = test->stats_timer = test->reporter_timer = NULL;
     if (test->duration != 0 ) {
         test->done = 0;
-        test->timer = tmr_create(&now, server_timer_proc, cd, (test->duration + test->omit + grace_period) * SEC_TO_US, 0);
+        test->timer = tmr_create(test->timers, &now, server_timer_proc, cd, (test->duration + test->omit + grace_period) * SEC_TO_US, 0);
         if (test->timer == NULL) {
             i_errno = IEINITTEST;
             return -1;
@@ -318,14 +333,14 @@ create_server_timers(struct iperf_test * test)
 
     test->stats_timer = test->reporter_timer = NULL;
     if (test->stats_interval != 0) {
-        test->stats_timer = tmr_create(&now, server_stats_timer_proc, cd, test->stats_interval * SEC_TO_US, 1);
+        test->stats_timer = tmr_create(test->timers, &now, server_stats_timer_proc, cd, test->stats_interval * SEC_TO_US, 1);
         if (test->stats_timer == NULL) {
             i_errno = IEINITTEST;
             return -1;
 	}
     }
     if (test->reporter_interval != 0) {
-        test->reporter_timer = tmr_create(&now, server_reporter_timer_proc, cd, test->reporter_interval * SEC_TO_US, 1);
+        test->reporter_timer = tmr_create(test->timers, &now, server_reporter_timer_proc, cd, test->reporter_interval * SEC_TO_US, 1);
         if (test->reporter_timer == NULL) {
             i_errno = IEINITTEST;
             return -1;
@@ -368,7 +383,7 @@ create_server_omit_timer(struct iperf_test * test)
 	}
 	test->omitting = 1;
 	cd.p = test;
-	test->omit_timer = tmr_create(&now, server_omit_timer_proc, cd, test->omit * SEC_TO_US, 0);
+	test->omit_timer = tmr_create(test->timers, &now, server_omit_timer_proc, cd, test->omit * SEC_TO_US, 0);
 	if (test->omit_timer == NULL) {
 	    i_errno = IEINITTEST;
 	    return -1;
@@ -383,6 +398,9 @@ cleanup_server(struct iperf_test *test)
 {
     struct iperf_stream *sp;
 
+    /* Any --place threads are done with the sockets first */
+    iperf_place_stop(test);
+
     /* Close open streams */
     SLIST_FOREACH(sp, &test->streams, streams) {
 	if (sp->socket > -1) {
@@ -434,7 +452,7 @@ cleanup_server(struct iperf_test *test)
 int
 iperf_run_server(struct iperf_test *test)
 {
-    int result, s;
+    int result, s, moved;
     int send_streams_accepted, rec_streams_accepted;
     int streams_to_send = 0, streams_to_rec = 0;
 #if defined(HAVE_TCP_CONGESTION)
@@ -504,7 +522,7 @@ iperf_run_server(struct iperf_test *test)
         memcpy(&write_set, &test->write_set, sizeof(fd_set));
 
 	iperf_time_now(&now);
-	timeout = tmr_timeout(&now);
+	timeout = tmr_timeout(test->timers, &now);
 
         // Ensure select() will timeout to allow handling error cases that require server restart
         if (test->state == IPERF_START) {       // In idle mode server may need to restart
@@ -527,7 +545,21 @@ iperf_run_server(struct iperf_test *test)
             timeout = &used_timeout;
         }
 
+        /* --busy-poll: spin instead of sleeping while the test runs */
+        if (test->busy_poll && test->state == TEST_RUNNING)
+            timeout = iperf_busypoll_timeout(test);
+
+        /* --place threads run only while the main loop waits */
+        iperf_place_resume(test);
         result = select(test->max_fd + 1, &read_set, &write_set, NULL, timeout);
+        if ((moved = iperf_place_pause(test)) < 0) {
+            cleanup_server(test);
+            return -1;
+        }
+        if (moved > 0)
+            iperf_time_now(&last_receive_time);
+        if (test->busy_poll && test->state == TEST_RUNNING)
+            iperf_busypoll_ready(test, &read_set, result);
         if (result < 0 && errno != EINTR) {
             cleanup_server(test);
             i_errno = IESELECT;
@@ -794,6 +826,10 @@ iperf_run_server(struct iperf_test *test)
 			    cleanup_server(test);
 			    return -1;
 			}
+		    if (iperf_place_start(test) < 0) {
+			cleanup_server(test);
+                        return -1;
+		    }
 		    if (iperf_set_send_state(test, TEST_RUNNING) != 0) {
 			cleanup_server(test);
                         return -1;
@@ -802,7 +838,12 @@ iperf_run_server(struct iperf_test *test)
             }
 
             if (test->state == TEST_RUNNING) {
-                if (test->mode == BIDIRECTIONAL) {
+                if (test->rr) {
+                    if (iperf_rr_run(test, &read_set, &write_set) < 0) {
+                        cleanup_server(test);
+                        return -1;
+                    }
+                } else if (test->mode == BIDIRECTIONAL) {
                     if (iperf_recv(test, &read_set) < 0) {
                         cleanup_server(test);
                         return -1;
@@ -824,6 +865,8 @@ iperf_run_server(struct iperf_test *test)
                         return -1;
 		    }
                 }
+                if (test->probe)
+                    iperf_probe_run(test, &read_set);
 	    }
         }
 
@@ -831,7 +874,7 @@ iperf_run_server(struct iperf_test *test)
 	    (timeout != NULL && timeout->tv_sec == 0 && timeout->tv_usec == 0)) {
 	    /* Run the timers. */
 	    iperf_time_now(&now);
-	    tmr_run(&now);
+	    tmr_run(test->timers, &now);
 	}
     }
 
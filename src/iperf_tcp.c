@@ -41,6 +41,10 @@
 #include "iperf.h"
 #include "iperf_api.h"
 #include "iperf_tcp.h"
+#include "iperf_latency.h"
+#include "iperf_trace.h"
+#include "iperf_txstamp.h"
+#include "iperf_drain.h"
 #include "net.h"
 #include "cjson.h"
 
@@ -57,7 +61,12 @@ iperf_tcp_recv(struct iperf_stream *sp)
 {
     int r;
 
-    r = Nread(sp->socket, sp->buffer, sp->settings->blksize, Ptcp);
+    if (sp->test->rcv_drain || sp->test->rcvlowat)
+	r = iperf_drain_recv(sp);
+    else if (sp->test->discard && sp->diskfile_fd < 0)
+	r = Ndiscard(sp->socket, sp->buffer, sp->settings->blksize, Ptcp);
+    else
+	r = Nread(sp->socket, sp->buffer, sp->settings->blksize, Ptcp);
 
     if (r < 0)
         return r;
@@ -66,6 +75,13 @@ iperf_tcp_recv(struct iperf_stream *sp)
     if (sp->test->state == TEST_RUNNING) {
 	sp->result->bytes_received += r;
 	sp->result->bytes_received_this_interval += r;
+	if (sp->test->trace != NULL && r > 0) {
+	    struct iperf_time now;
+
+	    iperf_time_now(&now);
+	    iperf_trace_record(sp, sp->trace_offset, 0, iperf_time_in_usecs(&now), r);
+	    sp->trace_offset += r;
+	}
     }
     else {
 	if (sp->test->debug)
@@ -83,11 +99,15 @@ iperf_tcp_recv(struct iperf_stream *sp)
 int
 iperf_tcp_send(struct iperf_stream *sp)
 {
+    struct timespec written;
     int r;
 
     if (!sp->pending_size)
 	sp->pending_size = sp->settings->blksize;
 
+    if (sp->txstamps != NULL)
+	iperf_txstamp_before_write(sp, &written);
+
     if (sp->test->zerocopy)
 	r = Nsendfile(sp->buffer_fd, sp->socket, sp->buffer, sp->pending_size);
     else
@@ -96,10 +116,24 @@ iperf_tcp_send(struct iperf_stream *sp)
     if (r < 0)
         return r;
 
+    if (sp->txstamps != NULL && r > 0)
+	iperf_txstamp_after_write(sp, &written, r);
+
     sp->pending_size -= r;
     sp->result->bytes_sent += r;
     sp->result->bytes_sent_this_interval += r;
 
+    if (sp->test->histograms)
+	iperf_latency_sample_rtt(sp);
+
+    if (sp->test->trace != NULL && r > 0) {
+	struct iperf_time now;
+
+	iperf_time_now(&now);
+	iperf_trace_record(sp, sp->trace_offset, iperf_time_in_usecs(&now), 0, r);
+	sp->trace_offset += r;
+    }
+
     if (sp->test->debug_level >=  DEBUG_LEVEL_DEBUG)
 	printf("sent %d bytes of %d, pending %d, total %" PRIu64 "\n",
 	    r, sp->settings->blksize, sp->pending_size, sp->result->bytes_sent);
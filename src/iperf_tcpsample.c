@@ -0,0 +1,340 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_tcpsample.h"
+#include "iperf_locale.h"
+#include "iperf_util.h"
+#include "iperf_time.h"
+#include "timer.h"
+#include "units.h"
+#include "cjson.h"
+
+/*
+ * TCP_INFO sampling (--tcp-sample).
+ *
+ * The interval reports read TCP_INFO once per interval, so whatever
+ * cwnd and RTT did in between is lost.  With --tcp-sample a periodic
+ * timer reads it for every sending TCP stream every tcp_sample_usecs
+ * into a ring allocated with the stream, big enough for two reporting
+ * intervals' worth.  At each interval the min/avg/max of cwnd, RTT,
+ * delivery rate and pacing rate are derived from the samples taken
+ * since the last one; the whole-test figures are kept as the samples
+ * come.  With --tcp-sample-file every sample is written out as a line
+ * of text, a ring at a time: at the intervals, before the ring would
+ * wrap, and at the end.
+ *
+ * The timer runs from the main loop, so a sample can be late by as
+ * long as a write takes; two that would come back to back after such
+ * a wait are taken as one.
+ */
+
+static const char *metric_names[TCP_SAMPLE_METRICS] = { "snd_cwnd", "rtt_us", "delivery_rate", "pacing_rate" };
+
+static void
+add_sample(struct iperf_tcp_sample_stats *st, const struct iperf_tcp_sample *s)
+{
+    double v[TCP_SAMPLE_METRICS];
+    int m;
+
+    v[TCP_SAMPLE_CWND] = s->snd_cwnd;
+    v[TCP_SAMPLE_RTT] = s->rtt;
+    /* Bytes/sec, as unit_snprintf() takes them; JSON gives bits */
+    v[TCP_SAMPLE_DELIVERY] = s->delivery_rate;
+    v[TCP_SAMPLE_PACING] = s->pacing_rate;
+    for (m = 0; m < TCP_SAMPLE_METRICS; ++m) {
+	if (st->samples == 0 || v[m] < st->min[m])
+	    st->min[m] = v[m];
+	if (st->samples == 0 || v[m] > st->max[m])
+	    st->max[m] = v[m];
+	st->sum[m] += v[m];
+    }
+    st->samples++;
+}
+
+static void
+dump(struct iperf_stream *sp)
+{
+    FILE *fp = sp->test->tcp_sample_fp;
+    struct iperf_tcp_sample *s;
+
+    if (fp == NULL)
+	return;
+    /* Samples overwritten before they could go out are lost */
+    if (sp->tcp_samples_written - sp->tcp_samples_dumped > sp->tcp_samples_mask + 1)
+	sp->tcp_samples_dumped = sp->tcp_samples_written - (sp->tcp_samples_mask + 1);
+    for (; sp->tcp_samples_dumped < sp->tcp_samples_written; ++sp->tcp_samples_dumped) {
+	s = &sp->tcp_samples[sp->tcp_samples_dumped & sp->tcp_samples_mask];
+	fprintf(fp, "%d %.6f %u %u %u %u %" PRIu64 " %" PRIu64 "\n",
+		sp->id, s->usecs / 1000000.0, s->snd_cwnd, s->rtt, s->rttvar, s->total_retrans,
+		s->delivery_rate * 8, s->pacing_rate * 8);
+    }
+}
+
+static void
+sample_timer_proc(TimerClientData client_data, struct iperf_time *nowP)
+{
+    struct iperf_test *test = client_data.p;
+    struct iperf_stream *sp;
+    struct iperf_tcp_sample *s;
+    struct iperf_time diff;
+    int64_t usecs;
+
+    if (test->state != TEST_RUNNING)
+	return;
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (sp->tcp_samples == NULL)
+	    continue;
+	iperf_time_diff(nowP, &sp->result->start_time_fixed, &diff);
+	usecs = iperf_time_in_usecs(&diff);
+	if (sp->tcp_samples_written > 0 &&
+	    usecs - sp->tcp_samples[(sp->tcp_samples_written - 1) & sp->tcp_samples_mask].usecs < test->tcp_sample_usecs / 2)
+	    continue;
+	/* The oldest is about to go: out with it, and the rest */
+	if (sp->tcp_samples_written - sp->tcp_samples_dumped > sp->tcp_samples_mask)
+	    dump(sp);
+	s = &sp->tcp_samples[sp->tcp_samples_written & sp->tcp_samples_mask];
+	if (sample_tcpinfo(sp, s) < 0)
+	    continue;
+	s->usecs = usecs;
+	sp->tcp_samples_written++;
+	if (!test->omitting)
+	    add_sample(&sp->tcp_sample_total, s);
+    }
+}
+
+int
+iperf_tcpsample_init(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    TimerClientData cd;
+    uint64_t want, capacity;
+
+    if (test->tcp_sample_usecs == 0 || test->protocol->id != Ptcp || test->tcp_sample_timer != NULL)
+	return 0;
+
+    /* Two intervals' worth, so a late report still finds its samples */
+    want = MIN_TCP_SAMPLES;
+    if (test->stats_interval > 0)
+	want = (uint64_t) (test->stats_interval * 2.0 * SEC_TO_US / test->tcp_sample_usecs) + 1;
+    for (capacity = MIN_TCP_SAMPLES; capacity < want && capacity < MAX_TCP_SAMPLES; capacity <<= 1)
+	;
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (!sp->sender || sp->tcp_samples != NULL)
+	    continue;
+	if ((sp->tcp_samples = calloc(capacity, sizeof(struct iperf_tcp_sample))) == NULL) {
+	    i_errno = IEINITTEST;
+	    return -1;
+	}
+	sp->tcp_samples_mask = capacity - 1;
+    }
+
+    if (test->tcp_sample_file != NULL && test->tcp_sample_fp == NULL) {
+	if ((test->tcp_sample_fp = fopen(test->tcp_sample_file, "w")) == NULL) {
+	    i_errno = IETCPSAMPLEFILE;
+	    return -1;
+	}
+	fprintf(test->tcp_sample_fp, "# iperf3 --tcp-sample %.3f ms, %s side\n",
+		test->tcp_sample_usecs / 1000.0, test->role == 'c' ? "client" : "server");
+	fprintf(test->tcp_sample_fp, "# stream seconds snd_cwnd rtt_us rttvar_us total_retrans delivery_rate pacing_rate\n");
+    }
+
+    cd.p = test;
+    test->tcp_sample_timer = tmr_create(test->timers, NULL, sample_timer_proc, cd, test->tcp_sample_usecs, 1);
+    if (test->tcp_sample_timer == NULL) {
+	i_errno = IEINITTEST;
+	return -1;
+    }
+    return 0;
+}
+
+void
+iperf_tcpsample_interval(struct iperf_stream *sp, struct iperf_interval_results *irp)
+{
+    uint64_t i;
+
+    memset(&irp->tcp_sample, 0, sizeof(irp->tcp_sample));
+    if (sp->tcp_samples == NULL)
+	return;
+    /* A ring too small for the interval keeps its latest */
+    i = sp->tcp_samples_mark;
+    if (sp->tcp_samples_written - i > sp->tcp_samples_mask + 1)
+	i = sp->tcp_samples_written - (sp->tcp_samples_mask + 1);
+    for (; i < sp->tcp_samples_written; ++i)
+	add_sample(&irp->tcp_sample, &sp->tcp_samples[i & sp->tcp_samples_mask]);
+    sp->tcp_samples_mark = sp->tcp_samples_written;
+    dump(sp);
+}
+
+void
+iperf_tcpsample_reset(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+
+    SLIST_FOREACH(sp, &test->streams, streams)
+	memset(&sp->tcp_sample_total, 0, sizeof(sp->tcp_sample_total));
+}
+
+static cJSON *
+stats_json(const struct iperf_tcp_sample_stats *st)
+{
+    cJSON *j, *j_metric;
+    double scale;
+    int m;
+
+    if ((j = iperf_json_printf("samples: %d", (int64_t) st->samples)) == NULL)
+	return NULL;
+    for (m = 0; m < TCP_SAMPLE_METRICS; ++m) {
+	/* Rates in bits/sec, like the rest of iperf's JSON */
+	scale = m == TCP_SAMPLE_DELIVERY || m == TCP_SAMPLE_PACING ? 8.0 : 1.0;
+	j_metric = iperf_json_printf("min: %f  avg: %f  max: %f",
+				     st->min[m] * scale, st->sum[m] * scale / st->samples, st->max[m] * scale);
+	if (j_metric != NULL)
+	    cJSON_AddItemToObject(j, metric_names[m], j_metric);
+    }
+    return j;
+}
+
+static void
+print_stats(struct iperf_test *test, const struct iperf_tcp_sample_stats *st, const char *fmt, const char *rates_fmt,
+	    int socket, const char *mbuf, double st_time, double et_time)
+{
+    char cbuf[3][UNIT_LEN], dbuf[3][UNIT_LEN], pbuf[3][UNIT_LEN];
+    double v[3];
+    int k, m;
+
+    for (m = 0; m < TCP_SAMPLE_METRICS; ++m) {
+	v[0] = st->min[m];
+	v[1] = st->sum[m] / st->samples;
+	v[2] = st->max[m];
+	for (k = 0; k < 3; ++k) {
+	    if (m == TCP_SAMPLE_CWND)
+		unit_snprintf(cbuf[k], UNIT_LEN, v[k], 'A');
+	    else if (m == TCP_SAMPLE_DELIVERY)
+		unit_snprintf(dbuf[k], UNIT_LEN, v[k], test->settings->unit_format);
+	    else if (m == TCP_SAMPLE_PACING)
+		unit_snprintf(pbuf[k], UNIT_LEN, v[k], test->settings->unit_format);
+	}
+    }
+    iperf_printf(test, fmt, socket, mbuf, st_time, et_time, st->samples,
+		 cbuf[0], cbuf[1], cbuf[2],
+		 st->min[TCP_SAMPLE_RTT] / 1000.0, st->sum[TCP_SAMPLE_RTT] / st->samples / 1000.0,
+		 st->max[TCP_SAMPLE_RTT] / 1000.0);
+    /* Nothing to say where the system has no rates */
+    if (st->max[TCP_SAMPLE_DELIVERY] > 0 || st->max[TCP_SAMPLE_PACING] > 0)
+	iperf_printf(test, rates_fmt, socket, mbuf, st_time, et_time,
+		     dbuf[0], dbuf[1], dbuf[2], pbuf[0], pbuf[1], pbuf[2]);
+}
+
+void
+iperf_tcpsample_print_interval(struct iperf_stream *sp, struct iperf_interval_results *irp, cJSON *json_stream, const char *mbuf, double st, double et)
+{
+    struct iperf_test *test = sp->test;
+
+    if (irp->tcp_sample.samples == 0)
+	return;
+    if (test->json_output) {
+	if (json_stream != NULL)
+	    cJSON_AddItemToObject(json_stream, "tcp_samples", stats_json(&irp->tcp_sample));
+    } else
+	print_stats(test, &irp->tcp_sample, report_tcp_sample_interval, report_tcp_sample_rates,
+		    sp->socket, mbuf, st, et);
+}
+
+void
+iperf_tcpsample_print_results(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_time temp_time;
+    cJSON *j_samples = NULL, *j_streams = NULL, *j_stream;
+    char mbuf[UNIT_LEN];
+    double et;
+    int rows = 0;
+
+    if (test->json_output) {
+	j_samples = iperf_json_printf("interval_ms: %f", test->tcp_sample_usecs / 1000.0);
+	if (j_samples == NULL)
+	    return;
+	if ((j_streams = cJSON_CreateArray()) == NULL) {
+	    cJSON_Delete(j_samples);
+	    return;
+	}
+	cJSON_AddItemToObject(j_samples, "streams", j_streams);
+	cJSON_AddItemToObject(test->json_end, "tcp_samples", j_samples);
+    }
+
+    if (test->mode == BIDIRECTIONAL)
+	sprintf(mbuf, "[TX-%s]", test->role == 'c' ? "C" : "S");
+    else
+	mbuf[0] = '\0';
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (sp->tcp_samples == NULL || sp->tcp_sample_total.samples == 0)
+	    continue;
+	if (test->json_output) {
+	    if ((j_stream = stats_json(&sp->tcp_sample_total)) == NULL)
+		return;
+	    cJSON_AddNumberToObject(j_stream, "socket", sp->socket);
+	    cJSON_AddItemToArray(j_streams, j_stream);
+	} else {
+	    if (rows++ == 0)
+		iperf_printf(test, report_tcp_sample_header, test->tcp_sample_usecs / 1000.0);
+	    iperf_time_diff(&sp->result->start_time, &sp->result->end_time, &temp_time);
+	    et = iperf_time_in_secs(&temp_time);
+	    print_stats(test, &sp->tcp_sample_total, report_tcp_sample_interval, report_tcp_sample_rates,
+			sp->socket, mbuf, 0.0, et);
+	}
+    }
+}
+
+void
+iperf_tcpsample_close(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+
+    if (test->tcp_sample_timer != NULL) {
+	tmr_cancel(test->tcp_sample_timer);
+	test->tcp_sample_timer = NULL;
+    }
+    if (test->tcp_sample_fp == NULL)
+	return;
+    SLIST_FOREACH(sp, &test->streams, streams)
+	dump(sp);
+    fclose(test->tcp_sample_fp);
+    test->tcp_sample_fp = NULL;
+}
+
+void
+iperf_tcpsample_free_stream(struct iperf_stream *sp)
+{
+    free(sp->tcp_samples);
+    sp->tcp_samples = NULL;
+}
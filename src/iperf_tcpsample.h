@@ -0,0 +1,77 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_TCPSAMPLE_H
+#define __IPERF_TCPSAMPLE_H
+
+#include "cjson.h"
+
+/**
+ * iperf_tcpsample_init -- give each sending TCP stream its sample
+ * ring, create the --tcp-sample-file and start sampling every
+ * tcp_sample_usecs
+ *
+ * returns 0 on success, -1 (with i_errno set) on failure
+ *
+ */
+int iperf_tcpsample_init(struct iperf_test *);
+
+/**
+ * iperf_tcpsample_interval -- derive the interval's min/avg/max from
+ * the samples taken since the last call into irp, and write them out
+ * to the --tcp-sample-file
+ *
+ */
+void iperf_tcpsample_interval(struct iperf_stream *, struct iperf_interval_results *);
+
+/* Start the whole-test figures again when omitting ends */
+void iperf_tcpsample_reset(struct iperf_test *);
+
+/**
+ * iperf_tcpsample_print_interval -- print the interval's figures after
+ * the stream's line, or add them to its JSON object
+ *
+ */
+void iperf_tcpsample_print_interval(struct iperf_stream *, struct iperf_interval_results *, cJSON *json_stream, const char *mbuf, double st, double et);
+
+/**
+ * iperf_tcpsample_print_results -- print each sending stream's
+ * whole-test figures, or add them to the JSON output
+ *
+ */
+void iperf_tcpsample_print_results(struct iperf_test *);
+
+/**
+ * iperf_tcpsample_close -- stop sampling, and write out what is left
+ * of the rings and close the --tcp-sample-file; call it before the
+ * streams are freed
+ *
+ */
+void iperf_tcpsample_close(struct iperf_test *);
+
+void iperf_tcpsample_free_stream(struct iperf_stream *);
+
+#endif
@@ -31,12 +31,14 @@
 #include "iperf_config.h"
 #include "iperf_time.h"
 
+static int clock_source = IPERF_CLOCK_MONOTONIC;
+
 #ifdef HAVE_CLOCK_GETTIME
 
 #include <time.h>
 
-int
-iperf_time_now(struct iperf_time *time1)
+static int
+iperf_time_now_monotonic(struct iperf_time *time1)
 {
     struct timespec ts;
     int result;
@@ -52,18 +54,258 @@ iperf_time_now(struct iperf_time *time1)
 
 #include <sys/time.h>
 
+static int
+iperf_time_now_monotonic(struct iperf_time *time1)
+{
+    struct timeval tv;
+    int result;
+    result = gettimeofday(&tv, NULL);
+    time1->secs = tv.tv_sec;
+    time1->usecs = tv.tv_usec;
+    return result;
+}
+
+#endif
+
+#if defined(HAVE_RDTSC) && defined(HAVE_CLOCK_GETTIME)
+
+/*
+ * Calibrated TSC clock.
+ *
+ * Reading an invariant TSC costs a few nanoseconds, against tens of
+ * nanoseconds for clock_gettime(), and iperf_time_now() sits on the
+ * per-packet path of rate-limited and UDP tests.  The TSC is converted
+ * to nanoseconds with a slope measured against CLOCK_MONOTONIC, and the
+ * result is kept in the CLOCK_MONOTONIC time base.
+ *
+ * Once a second the clock is re-anchored: the slope is re-measured over
+ * the whole previous period, and any offset that has built up against
+ * CLOCK_MONOTONIC is slewed out over the next period rather than
+ * stepped, so the clock stays continuous and never goes backwards.
+ */
+
+#include <x86intrin.h>
+#include <cpuid.h>
+
+#define TSC_CALIBRATE_NS	10000000LL	/* initial calibration, 10 ms */
+#define TSC_RECALIBRATE_NS	1000000000LL	/* re-anchor every second */
+#define TSC_MAX_SLEW_NS		1000000LL	/* step rather than slew beyond 1 ms */
+
+static struct {
+    uint64_t anchor_tsc;	/* TSC value at the last anchor */
+    uint64_t anchor_mono;	/* CLOCK_MONOTONIC at the last anchor, in ns */
+    uint64_t base_ns;		/* clock value reported at anchor_tsc */
+    uint64_t recal_ticks;	/* TSC ticks between anchors */
+    uint64_t last_ns;		/* last value handed out */
+    double ns_per_tick;
+} tsc;
+
+static uint64_t
+mono_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Read the TSC and CLOCK_MONOTONIC as close together as possible, by
+ * keeping the tightest of a few TSC-bracketed reads.
+ */
+static void
+tsc_sample(uint64_t *tscp, uint64_t *nsp)
+{
+    uint64_t t0, t1, ns, best = UINT64_MAX;
+    int i;
+
+    for (i = 0; i < 5; ++i) {
+	t0 = __rdtsc();
+	ns = mono_ns();
+	t1 = __rdtsc();
+	if (t1 - t0 < best) {
+	    best = t1 - t0;
+	    *tscp = t0 + (t1 - t0) / 2;
+	    *nsp = ns;
+	}
+    }
+}
+
+/* CPUID.80000007H:EDX[8] advertises a TSC that runs at a constant rate
+ * in all ACPI P-, C- and T-states.  Without it the TSC is useless as a
+ * clock.
+ */
+static int
+tsc_invariant(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+	return 0;
+    return (edx & (1 << 8)) != 0;
+}
+
+static int
+tsc_calibrate(void)
+{
+    uint64_t t0, n0, t1, n1;
+
+    if (!tsc_invariant())
+	return -1;
+    tsc_sample(&t0, &n0);
+    do
+	tsc_sample(&t1, &n1);
+    while (n1 - n0 < TSC_CALIBRATE_NS);
+    if (t1 <= t0)
+	return -1;
+
+    tsc.ns_per_tick = (double) (n1 - n0) / (double) (t1 - t0);
+    tsc.recal_ticks = (uint64_t) (TSC_RECALIBRATE_NS / tsc.ns_per_tick);
+    tsc.anchor_tsc = t1;
+    tsc.anchor_mono = n1;
+    tsc.base_ns = n1;
+    if (tsc.last_ns < n1)
+	tsc.last_ns = n1;
+    return 0;
+}
+
+static void
+tsc_recalibrate(void)
+{
+    uint64_t t, mono, reported;
+    int64_t err;
+    double rate;
+
+    tsc_sample(&t, &mono);
+    rate = (double) (mono - tsc.anchor_mono) / (double) (t - tsc.anchor_tsc);
+    reported = tsc.base_ns + (uint64_t) ((t - tsc.anchor_tsc) * tsc.ns_per_tick);
+    err = (int64_t) (mono - reported);
+    if (err > TSC_MAX_SLEW_NS || err < -TSC_MAX_SLEW_NS) {
+	/* Too far off to slew (suspend, migration to an unsynchronized
+	 * socket...): step forward to CLOCK_MONOTONIC.
+	 */
+	reported = mono > tsc.last_ns ? mono : tsc.last_ns;
+	err = 0;
+    }
+
+    tsc.ns_per_tick = rate * (1.0 + (double) err / TSC_RECALIBRATE_NS);
+    tsc.anchor_tsc = t;
+    tsc.anchor_mono = mono;
+    tsc.base_ns = reported;
+}
+
+static int
+iperf_time_now_tsc(struct iperf_time *time1)
+{
+    uint64_t t, ns;
+
+    t = __rdtsc();
+    if (t - tsc.anchor_tsc >= tsc.recal_ticks) {
+	tsc_recalibrate();
+	t = __rdtsc();
+    }
+    ns = tsc.base_ns + (uint64_t) ((t - tsc.anchor_tsc) * tsc.ns_per_tick);
+    if (ns < tsc.last_ns)
+	ns = tsc.last_ns;
+    else
+	tsc.last_ns = ns;
+
+    time1->secs = (uint32_t) (ns / 1000000000ULL);
+    time1->usecs = (uint32_t) (ns % 1000000000ULL) / 1000;
+    return 0;
+}
+
+#endif /* HAVE_RDTSC && HAVE_CLOCK_GETTIME */
+
+/* iperf_time_now_wallclock
+ *
+ * Read a clock that means the same thing on both ends of a test (TAI
+ * where the system has it, otherwise UTC), for one-way delay.  Unlike
+ * iperf_time_now() it steps when the system clock is set.
+ */
 int
-iperf_time_now(struct iperf_time *time1)
+iperf_time_now_wallclock(struct iperf_time *time1)
 {
+#ifdef HAVE_CLOCK_GETTIME
+    struct timespec ts;
+    int result;
+#if defined(CLOCK_TAI)
+    result = clock_gettime(CLOCK_TAI, &ts);
+#else
+    result = clock_gettime(CLOCK_REALTIME, &ts);
+#endif
+    if (result == 0) {
+        time1->secs = (uint32_t) ts.tv_sec;
+        time1->usecs = (uint32_t) ts.tv_nsec / 1000;
+    }
+    return result;
+#else
     struct timeval tv;
     int result;
     result = gettimeofday(&tv, NULL);
     time1->secs = tv.tv_sec;
     time1->usecs = tv.tv_usec;
     return result;
+#endif
+}
+
+int
+iperf_time_now(struct iperf_time *time1)
+{
+#if defined(HAVE_RDTSC) && defined(HAVE_CLOCK_GETTIME)
+    if (clock_source == IPERF_CLOCK_TSC)
+	return iperf_time_now_tsc(time1);
+#endif /* HAVE_RDTSC && HAVE_CLOCK_GETTIME */
+    return iperf_time_now_monotonic(time1);
+}
+
+/* iperf_time_set_clock
+ *
+ * Select the clock behind iperf_time_now() for the whole process.
+ * Selecting the TSC calibrates it, which takes about 10 ms.
+ *
+ * Returns 0 on success, or -1 if the requested clock is not usable on
+ * this system, in which case the current clock is kept.
+ */
+int
+iperf_time_set_clock(int source)
+{
+    switch (source) {
+	case IPERF_CLOCK_MONOTONIC:
+	    clock_source = source;
+	    return 0;
+	case IPERF_CLOCK_TSC:
+#if defined(HAVE_RDTSC) && defined(HAVE_CLOCK_GETTIME)
+	    if (tsc_calibrate() == 0) {
+		clock_source = source;
+		return 0;
+	    }
+#endif /* HAVE_RDTSC && HAVE_CLOCK_GETTIME */
+	    return -1;
+	default:
+	    return -1;
+    }
+}
+
+int
+iperf_time_get_clock(void)
+{
+    return clock_source;
 }
 
+const char *
+iperf_time_clock_name(int source)
+{
+    switch (source) {
+	case IPERF_CLOCK_TSC:
+	    return "tsc";
+	default:
+#ifdef HAVE_CLOCK_GETTIME
+	    return "monotonic";
+#else
+	    return "gettimeofday";
 #endif
+    }
+}
 
 /* iperf_time_add_usecs
  *
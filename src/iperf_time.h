@@ -34,8 +34,20 @@ struct iperf_time {
     uint32_t usecs;
 };
 
+/* Clock sources for iperf_time_now() */
+#define IPERF_CLOCK_MONOTONIC 0
+#define IPERF_CLOCK_TSC 1
+
 int iperf_time_now(struct iperf_time *time1);
 
+int iperf_time_now_wallclock(struct iperf_time *time1);
+
+int iperf_time_set_clock(int source);
+
+int iperf_time_get_clock(void);
+
+const char *iperf_time_clock_name(int source);
+
 void iperf_time_add_usecs(struct iperf_time *time1, uint64_t usecs);
 
 int iperf_time_compare(struct iperf_time *time1, struct iperf_time *time2);
@@ -0,0 +1,147 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_trace.h"
+
+/*
+ * Per-packet trace (--trace).
+ *
+ * The file is created at its full size when the test starts, with
+ * its blocks allocated where the system can do that, and mapped
+ * shared, with the pages faulted in up front where it can do that
+ * too.  Recording is then a store of 32 bytes into the mapping and a
+ * store of the count into the header: no system call, no allocation,
+ * and no I/O until the kernel writes the dirty pages back in its own
+ * time.  The ring wraps rather than stopping, so a long test keeps its
+ * last --trace-records records.  See iperf_trace.h for the format, and
+ * iperf3-trace for a reader.
+ */
+
+int
+iperf_trace_open(struct iperf_test *test)
+{
+    struct iperf_trace *t;
+    uint64_t capacity;
+    size_t len;
+    void *map;
+    int fd;
+
+    if (test->trace_file == NULL || test->trace != NULL)
+	return 0;
+    /* A power of two, so the slot is a mask away */
+    for (capacity = 1; capacity < test->trace_records; capacity <<= 1)
+	;
+    len = sizeof(struct iperf_trace_header) + capacity * sizeof(struct iperf_trace_record);
+
+    fd = open(test->trace_file, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+	i_errno = IETRACE;
+	return -1;
+    }
+    if (ftruncate(fd, len) < 0) {
+	close(fd);
+	i_errno = IETRACE;
+	return -1;
+    }
+#if defined(HAVE_POSIX_FALLOCATE)
+    /* Not every filesystem can; the mapping works without */
+    (void) posix_fallocate(fd, 0, len);
+#endif /* HAVE_POSIX_FALLOCATE */
+#if defined(MAP_POPULATE)
+    map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+#else
+    map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+#endif /* MAP_POPULATE */
+    if (map == MAP_FAILED) {
+	close(fd);
+	i_errno = IETRACE;
+	return -1;
+    }
+    if ((t = calloc(1, sizeof(*t))) == NULL) {
+	munmap(map, len);
+	close(fd);
+	i_errno = IETRACE;
+	return -1;
+    }
+    t->fd = fd;
+    t->len = len;
+    t->mask = capacity - 1;
+    t->header = map;
+    t->records = (struct iperf_trace_record *) (t->header + 1);
+    memcpy(t->header->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    t->header->version = TRACE_VERSION;
+    t->header->record_size = sizeof(struct iperf_trace_record);
+    t->header->capacity = capacity;
+    t->header->written = 0;
+    t->header->flags = test->owd ? TRACE_WALLCLOCK : 0;
+    t->header->role = test->role;
+    test->trace = t;
+    return 0;
+}
+
+void
+iperf_trace_record(struct iperf_stream *sp, uint64_t seq, uint64_t sent_us, uint64_t recv_us, int size)
+{
+    struct iperf_trace *t = sp->test->trace;
+    struct iperf_trace_record *rec;
+
+    rec = &t->records[t->written & t->mask];
+    rec->sent_us = sent_us;
+    rec->recv_us = recv_us;
+    rec->seq = seq;
+    rec->size = size;
+    rec->stream = sp->id;
+    rec->flags = (recv_us != 0 ? TRACE_RECEIVED : 0) |
+	(sp->test->protocol->id == Ptcp ? TRACE_TCP : 0) |
+	(sp->test->omitting ? TRACE_OMITTED : 0);
+    rec->reserved = 0;
+    /* The header's count is only ever read back by a reader, so one store will do */
+    t->header->written = ++t->written;
+}
+
+void
+iperf_trace_close(struct iperf_test *test)
+{
+    struct iperf_trace *t = test->trace;
+
+    if (t == NULL)
+	return;
+    munmap(t->header, t->len);
+    close(t->fd);
+    free(t);
+    test->trace = NULL;
+}
@@ -0,0 +1,103 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_TRACE_H
+#define __IPERF_TRACE_H
+
+#include <stdint.h>
+
+/*
+ * Trace file format (--trace), version 1.
+ *
+ * A struct iperf_trace_header, then room for capacity records of
+ * struct iperf_trace_record, all in the recording host's byte order
+ * (a reader on the other byte order sees the version swapped).  The
+ * records are a ring: record n (counting from 0) is at slot
+ * n % capacity, and written says how many there have been, so the file
+ * holds the last min(written, capacity) of them, oldest at slot
+ * written % capacity once it has wrapped.
+ *
+ * Times are microseconds of the recording side's clock as iperf reads
+ * it: the monotonic clock, or the wall clock with --owd
+ * (TRACE_WALLCLOCK).  For a received UDP datagram sent_us is the
+ * sender's, from the datagram; for TCP only the local time is known.
+ * seq is the UDP sequence number, or for TCP the byte offset of the
+ * block in the stream.
+ */
+#define TRACE_MAGIC "IPRFTRC"		/* and a NUL, 8 bytes */
+#define TRACE_VERSION 1
+
+struct iperf_trace_header {
+    char      magic[8];
+    uint32_t  version;
+    uint32_t  record_size;		/* sizeof(struct iperf_trace_record) */
+    uint64_t  capacity;			/* records the ring holds, a power of two */
+    uint64_t  written;			/* records written in all */
+    uint32_t  flags;			/* TRACE_WALLCLOCK */
+    uint32_t  role;			/* 'c' or 's' */
+    uint64_t  reserved[3];
+};					/* 64 bytes */
+
+#define TRACE_WALLCLOCK 1
+
+struct iperf_trace_record {
+    uint64_t  sent_us;			/* when it was sent; 0 if not known */
+    uint64_t  recv_us;			/* when it was read; 0 for a record of a send */
+    uint64_t  seq;
+    uint32_t  size;			/* bytes */
+    uint16_t  stream;			/* stream id */
+    uint8_t   flags;			/* TRACE_ */
+    uint8_t   reserved;
+};					/* 32 bytes */
+
+#define TRACE_RECEIVED 1		/* else sent */
+#define TRACE_TCP 2			/* else UDP */
+#define TRACE_OMITTED 4			/* during the -O omit period */
+
+struct iperf_test;
+struct iperf_stream;
+
+/**
+ * iperf_trace_open -- create the --trace file with room for the ring
+ * and map it; the records go straight into the mapping, so recording
+ * one costs no system call
+ *
+ * returns 0 on success, -1 (with i_errno set) on failure
+ *
+ */
+int iperf_trace_open(struct iperf_test *);
+
+/**
+ * iperf_trace_record -- append a record of a datagram or block the
+ * stream sent (recv_us 0) or received
+ *
+ */
+void iperf_trace_record(struct iperf_stream *, uint64_t seq, uint64_t sent_us, uint64_t recv_us, int size);
+
+/* Unmap and close the trace file, leaving what was recorded */
+void iperf_trace_close(struct iperf_test *);
+
+#endif
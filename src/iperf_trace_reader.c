@@ -0,0 +1,222 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "iperf_trace.h"
+
+/*
+ * iperf3-trace: print a file written by iperf3 --trace, one record a
+ * line oldest first, or with -s a summary for each stream and
+ * direction.  It maps the file rather than reading it, so a large
+ * ring costs no more than the pages it touches.
+ */
+
+#define MAX_SUMMARIES 1024
+
+struct summary {
+    unsigned  stream;
+    int       flags;			/* TRACE_RECEIVED | TRACE_TCP */
+    uint64_t  records, bytes;
+    uint64_t  first_us, last_us;
+    int64_t   transit_min, transit_max;	/* received UDP only */
+    double    transit_sum;
+};
+
+static void
+usage(void)
+{
+    fprintf(stderr, "Usage: iperf3-trace [-s] file\n"
+	    "  -s    summarize each stream and direction instead of printing the records\n");
+    exit(1);
+}
+
+static const char *
+direction(int flags)
+{
+    return flags & TRACE_RECEIVED ? "rx" : "tx";
+}
+
+static const char *
+protocol(int flags)
+{
+    return flags & TRACE_TCP ? "tcp" : "udp";
+}
+
+static struct summary *
+find(struct summary *sums, int *n, unsigned stream, int flags)
+{
+    int i;
+
+    flags &= TRACE_RECEIVED | TRACE_TCP;
+    for (i = 0; i < *n; ++i)
+	if (sums[i].stream == stream && sums[i].flags == flags)
+	    return &sums[i];
+    if (*n == MAX_SUMMARIES)
+	return NULL;
+    memset(&sums[*n], 0, sizeof(sums[*n]));
+    sums[*n].stream = stream;
+    sums[*n].flags = flags;
+    return &sums[(*n)++];
+}
+
+static void
+add(struct summary *s, const struct iperf_trace_record *rec)
+{
+    uint64_t t = rec->flags & TRACE_RECEIVED ? rec->recv_us : rec->sent_us;
+    int64_t transit;
+
+    if (s->records == 0 || t < s->first_us)
+	s->first_us = t;
+    if (t > s->last_us)
+	s->last_us = t;
+    if ((rec->flags & (TRACE_RECEIVED | TRACE_TCP)) == TRACE_RECEIVED) {
+	transit = (int64_t) (rec->recv_us - rec->sent_us);
+	if (s->records == 0 || transit < s->transit_min)
+	    s->transit_min = transit;
+	if (s->records == 0 || transit > s->transit_max)
+	    s->transit_max = transit;
+	s->transit_sum += transit;
+    }
+    ++s->records;
+    s->bytes += rec->size;
+}
+
+static void
+print_summaries(struct summary *sums, int n)
+{
+    struct summary *s;
+    double seconds;
+    int i;
+
+    printf("stream dir proto    records          bytes   seconds      Mbit/s  transit min/avg/max us\n");
+    for (i = 0; i < n; ++i) {
+	s = &sums[i];
+	seconds = (s->last_us - s->first_us) / 1e6;
+	printf("%6u %-3s %-5s %10" PRIu64 " %14" PRIu64 " %9.3f %11.3f",
+	       s->stream, direction(s->flags), protocol(s->flags), s->records, s->bytes,
+	       seconds, seconds > 0 ? s->bytes * 8 / seconds / 1e6 : 0.0);
+	if ((s->flags & (TRACE_RECEIVED | TRACE_TCP)) == TRACE_RECEIVED)
+	    printf("  %" PRId64 "/%.1f/%" PRId64, s->transit_min, s->transit_sum / s->records, s->transit_max);
+	printf("\n");
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    struct iperf_trace_header *h;
+    struct iperf_trace_record *recs, *rec;
+    struct summary *sums = NULL;
+    struct stat st;
+    uint64_t i, first, count;
+    void *map;
+    int fd, c, summarize = 0, nsums = 0;
+
+    while ((c = getopt(argc, argv, "s")) != -1) {
+	if (c == 's')
+	    summarize = 1;
+	else
+	    usage();
+    }
+    if (optind != argc - 1)
+	usage();
+
+    if ((fd = open(argv[optind], O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+	perror(argv[optind]);
+	exit(1);
+    }
+    if ((size_t) st.st_size < sizeof(*h)) {
+	fprintf(stderr, "%s: too short for a trace file\n", argv[optind]);
+	exit(1);
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+	perror(argv[optind]);
+	exit(1);
+    }
+    h = map;
+    if (memcmp(h->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0) {
+	fprintf(stderr, "%s: not an iperf3 trace file\n", argv[optind]);
+	exit(1);
+    }
+    if (h->version != TRACE_VERSION || h->record_size != sizeof(struct iperf_trace_record)) {
+	fprintf(stderr, "%s: trace format version %u, or written on a host of the other byte order\n",
+		argv[optind], h->version);
+	exit(1);
+    }
+    if (h->capacity == 0 || h->capacity > (st.st_size - sizeof(*h)) / sizeof(struct iperf_trace_record)) {
+	fprintf(stderr, "%s: truncated\n", argv[optind]);
+	exit(1);
+    }
+    recs = (struct iperf_trace_record *) (h + 1);
+
+    /* Oldest first: once the ring has wrapped, that's the slot written next */
+    count = h->written < h->capacity ? h->written : h->capacity;
+    first = h->written - count;
+
+    if (summarize) {
+	if ((sums = calloc(MAX_SUMMARIES, sizeof(struct summary))) == NULL) {
+	    perror("calloc");
+	    exit(1);
+	}
+    } else {
+	printf("# %s trace, %s clock, %" PRIu64 " records of %" PRIu64 " written\n",
+	       h->role == 's' ? "server" : "client", h->flags & TRACE_WALLCLOCK ? "wall" : "monotonic",
+	       count, h->written);
+	printf("# stream dir proto seq size sent_us recv_us omitted\n");
+    }
+    for (i = first; i < h->written; ++i) {
+	rec = &recs[i % h->capacity];
+	if (summarize) {
+	    struct summary *s = find(sums, &nsums, rec->stream, rec->flags);
+
+	    if (s != NULL)
+		add(s, rec);
+	} else
+	    printf("%u %s %s %" PRIu64 " %u %" PRIu64 " %" PRIu64 " %d\n",
+		   rec->stream, direction(rec->flags), protocol(rec->flags), rec->seq, rec->size,
+		   rec->sent_us, rec->recv_us, (rec->flags & TRACE_OMITTED) != 0);
+    }
+    if (summarize) {
+	print_summaries(sums, nsums);
+	free(sums);
+    }
+
+    munmap(map, st.st_size);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,407 @@
+/*
+ * iperf, Copyright (c) 2014-2022, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_train.h"
+#include "iperf_locale.h"
+#include "iperf_util.h"
+#include "net.h"
+#include "timer.h"
+#include "units.h"
+#include "cjson.h"
+
+/*
+ * Packet-train capacity estimation (--trains).
+ *
+ * Instead of saturating the path, the sender sends a handful of short
+ * trains of back-to-back datagrams, TRAIN_GAP_USECS apart, using the
+ * normal UDP header (send time and sequence number).  The bottleneck
+ * spreads each train out; the receiver timestamps every datagram on
+ * arrival, preferably in the kernel, and estimates from the spread:
+ *
+ *  - capacity: the median over all back-to-back pairs of size / gap
+ *    (packet-pair dispersion);
+ *  - dispersion rate: the median over trains of the rate at which the
+ *    whole train arrived, which cross traffic pulls below capacity;
+ *  - available bandwidth: from the probe gap model, cross traffic
+ *    X = Ri * C / Ro - Ri, where Ri is the rate the train entered the
+ *    bottleneck at (taken from the send times in the headers, and never
+ *    above capacity) and Ro the rate it left at; A = C - X.
+ *
+ * The sequence number says which train and slot a datagram belongs to,
+ * so loss and reordering within a train simply drop pairs.  The
+ * receiver does the analysis and hands the numbers to the client along
+ * with the rest of the results.
+ */
+
+int
+iperf_train_parse(struct iperf_test *test, const char *arg)
+{
+    const char *p;
+    char *end;
+    long trains, length = DEFAULT_TRAIN_LENGTH;
+
+    trains = strtol(arg, &end, 10);
+    if (end != arg && *end == '/') {
+	p = end + 1;
+	length = strtol(p, &end, 10);
+	if (end == p)
+	    length = 0;
+    }
+    if (end == arg || *end != '\0' || trains < 1 || trains > MAX_TRAINS ||
+	length < 2 || length > MAX_TRAIN_LENGTH) {
+	i_errno = IETRAIN;
+	return -1;
+    }
+    test->trains = trains;
+    test->train_length = length;
+    return 0;
+}
+
+int
+iperf_train_init(struct iperf_test *test)
+{
+    struct iperf_train *train;
+    struct iperf_stream *sp;
+
+    if (test->trains == 0)
+	return 0;
+    iperf_train_free(test);
+    train = calloc(1, sizeof(struct iperf_train));
+    if (train == NULL) {
+	i_errno = IEINITTEST;
+	return -1;
+    }
+    test->train = train;
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (sp->sender)
+	    continue;
+	/* Allocate once up front; nothing is allocated per datagram. */
+	train->samples = calloc((size_t) test->trains * test->train_length, sizeof(struct iperf_train_sample));
+	if (train->samples == NULL) {
+	    i_errno = IEINITTEST;
+	    return -1;
+	}
+#if defined(HAVE_SO_TIMESTAMPNS)
+	{
+	    int opt = 1;
+	    if (setsockopt(sp->socket, SOL_SOCKET, SO_TIMESTAMPNS, &opt, sizeof(opt)) == 0)
+		train->kernel_timestamps = 1;
+	    else if (test->debug)
+		printf("SO_TIMESTAMPNS failed, using user space arrival times: %s\n", strerror(errno));
+	}
+#endif /* HAVE_SO_TIMESTAMPNS */
+	break;
+    }
+    return 0;
+}
+
+static void
+train_proc(TimerClientData client_data, struct iperf_time *nowP)
+{
+    struct iperf_test *test = client_data.p;
+    struct iperf_train *train = test->train;
+    struct iperf_stream *sp;
+    int i, r;
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (!sp->sender)
+	    continue;
+	for (i = 0; i < test->train_length; ++i) {
+	    r = sp->snd(sp);
+	    if (r == NET_HARDERROR) {
+		iperf_err(test, "unable to send a packet train: %s", strerror(errno));
+		test->done = 1;
+		break;
+	    }
+	    /* A datagram that didn't go out is just a loss to the receiver. */
+	    if (r > 0) {
+		test->bytes_sent += r;
+		++test->blocks_sent;
+	    }
+	}
+    }
+
+    if (++train->sent >= test->trains) {
+	tmr_cancel(train->timer);
+	train->timer = NULL;
+    }
+}
+
+int
+iperf_train_start(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    TimerClientData cd;
+
+    /* The main loop never sends; the train timer does it all. */
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (!sp->sender)
+	    continue;
+	sp->green_light = 0;
+	FD_CLR(sp->socket, &test->write_set);
+    }
+
+    cd.p = test;
+    test->train->timer = tmr_create(test->timers, NULL, train_proc, cd, TRAIN_GAP_USECS, 1);
+    if (test->train->timer == NULL) {
+	i_errno = IEINITTEST;
+	return -1;
+    }
+    return 0;
+}
+
+int64_t
+iperf_train_usecs(struct iperf_test *test)
+{
+    return (int64_t) test->trains * TRAIN_GAP_USECS + TRAIN_DRAIN_USECS;
+}
+
+void
+iperf_train_record(struct iperf_stream *sp, int size, uint64_t pcount, struct iperf_time *sent, uint64_t stamp_ns)
+{
+    struct iperf_test *test = sp->test;
+    struct iperf_train_sample *sample;
+    struct iperf_time now;
+
+    if (test->train == NULL || test->train->samples == NULL ||
+	pcount < 1 || pcount > (uint64_t) test->trains * test->train_length)
+	return;
+    sample = &test->train->samples[pcount - 1];
+    test->train->size = size;
+
+    if (stamp_ns == 0) {
+#if defined(HAVE_SO_TIMESTAMPNS)
+	/* Stay on the kernel's clock if it just failed to stamp this one. */
+	if (test->train->kernel_timestamps) {
+	    struct timespec ts;
+	    clock_gettime(CLOCK_REALTIME, &ts);
+	    stamp_ns = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+	} else
+#endif /* HAVE_SO_TIMESTAMPNS */
+	{
+	    iperf_time_now(&now);
+	    stamp_ns = (uint64_t) now.secs * 1000000000 + (uint64_t) now.usecs * 1000;
+	}
+    }
+    sample->sent_us = (uint64_t) sent->secs * SEC_TO_US + sent->usecs;
+    sample->arrived_ns = stamp_ns;
+}
+
+static int
+compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+static double
+median(double *v, int n)
+{
+    if (n == 0)
+	return 0;
+    qsort(v, n, sizeof(double), compare_doubles);
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+void
+iperf_train_analyze(struct iperf_test *test)
+{
+    struct iperf_train *train = test->train;
+    struct iperf_train_sample *s;
+    double bits;
+    double *pairs, *out_rates, *in_rates, *avail;
+    double c, ri;
+    int len = test->train_length;
+    int t, i, first, last, prev;
+    int npairs = 0, ntrains = 0;
+
+    if (train == NULL || train->samples == NULL || train->analyzed)
+	return;
+    train->analyzed = 1;
+    bits = train->size * 8.0;
+
+    pairs = malloc(sizeof(double) * test->trains * (len - 1));
+    out_rates = malloc(sizeof(double) * test->trains * 3);
+    if (pairs == NULL || out_rates == NULL) {
+	free(pairs);
+	free(out_rates);
+	return;
+    }
+    in_rates = out_rates + test->trains;
+    avail = in_rates + test->trains;
+
+    for (t = 0; t < test->trains; ++t) {
+	s = &train->samples[t * len];
+	first = last = prev = -1;
+	for (i = 0; i < len; ++i) {
+	    if (s[i].arrived_ns == 0)
+		continue;
+	    ++train->received;
+	    if (prev >= 0 && prev == i - 1 && s[i].arrived_ns > s[prev].arrived_ns)
+		pairs[npairs++] = bits * 1e9 / (s[i].arrived_ns - s[prev].arrived_ns);
+	    if (first < 0)
+		first = i;
+	    last = prev = i;
+	}
+	if (last <= first || s[last].arrived_ns <= s[first].arrived_ns)
+	    continue;
+	out_rates[ntrains] = (last - first) * bits * 1e9 / (s[last].arrived_ns - s[first].arrived_ns);
+	/* 0: the whole train left within one tick of the sender's clock */
+	in_rates[ntrains] = s[last].sent_us > s[first].sent_us ?
+	    (last - first) * bits * 1e6 / (s[last].sent_us - s[first].sent_us) : 0;
+	++ntrains;
+    }
+
+    train->trains_received = ntrains;
+    train->pairs = npairs;
+    c = train->capacity = median(pairs, npairs);
+    for (t = 0; t < ntrains; ++t) {
+	ri = in_rates[t] == 0 || in_rates[t] > c ? c : in_rates[t];
+	avail[t] = c - ri * (c / out_rates[t] - 1);
+	if (avail[t] < 0)
+	    avail[t] = 0;
+	else if (avail[t] > c)
+	    avail[t] = c;
+    }
+    train->available = median(avail, ntrains);
+    train->dispersion = median(out_rates, ntrains);
+
+    free(pairs);
+    free(out_rates);
+}
+
+cJSON *
+iperf_train_results_json(struct iperf_test *test)
+{
+    struct iperf_train *train = test->train;
+
+    return iperf_json_printf("size: %d  trains_received: %d  datagrams_received: %d  pairs: %d  kernel_timestamps: %b  capacity_bps: %f  dispersion_bps: %f  available_bps: %f",
+			     (int64_t) train->size, (int64_t) train->trains_received,
+			     (int64_t) train->received, (int64_t) train->pairs,
+			     train->kernel_timestamps, train->capacity,
+			     train->dispersion, train->available);
+}
+
+void
+iperf_train_results_from_json(struct iperf_test *test, cJSON *j)
+{
+    struct iperf_train *train = test->train;
+    cJSON *j_p;
+
+    if (train == NULL)
+	return;
+    if ((j_p = cJSON_GetObjectItem(j, "size")) != NULL)
+	train->size = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j, "trains_received")) != NULL)
+	train->trains_received = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j, "datagrams_received")) != NULL)
+	train->received = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j, "pairs")) != NULL)
+	train->pairs = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j, "kernel_timestamps")) != NULL)
+	train->kernel_timestamps = cJSON_IsTrue(j_p);
+    if ((j_p = cJSON_GetObjectItem(j, "capacity_bps")) != NULL)
+	train->capacity = j_p->valuedouble;
+    if ((j_p = cJSON_GetObjectItem(j, "dispersion_bps")) != NULL)
+	train->dispersion = j_p->valuedouble;
+    if ((j_p = cJSON_GetObjectItem(j, "available_bps")) != NULL)
+	train->available = j_p->valuedouble;
+    train->analyzed = 1;
+}
+
+void
+iperf_train_print_results(struct iperf_test *test)
+{
+    struct iperf_train *train = test->train;
+    char cbuf[UNIT_LEN], dbuf[UNIT_LEN], abuf[UNIT_LEN];
+    char str[WARN_STR_LEN];
+    int total = test->trains * test->train_length;
+    double lost;
+    cJSON *j;
+
+    if (train == NULL || !train->analyzed)
+	return;
+
+    /*
+     * Datagrams lost within a train drop their pairs and shorten the
+     * train, so heavy loss leaves the estimates resting on little, and
+     * usually means the trains overran a buffer on the way.
+     */
+    lost = 100.0 * (total - train->received) / total;
+    if (lost > TRAIN_LOSS_WARN) {
+	snprintf(str, sizeof(str),
+		 "%.0f%% of the packet train datagrams were lost; try a smaller -l or shorter trains", lost);
+	warning(str);
+    }
+
+    if (test->json_output) {
+	j = iperf_train_results_json(test);
+	if (j == NULL)
+	    return;
+	cJSON_AddNumberToObject(j, "trains", test->trains);
+	cJSON_AddNumberToObject(j, "train_length", test->train_length);
+	cJSON_AddItemToObject(test->json_end, "packet_trains", j);
+	return;
+    }
+
+    iperf_printf(test, report_train_header, train->trains_received, test->trains,
+		 test->train_length, train->size, train->pairs,
+		 train->kernel_timestamps ? "kernel" : "user space");
+    if (train->pairs == 0) {
+	iperf_printf(test, "%s", report_train_none);
+	return;
+    }
+    unit_snprintf(cbuf, UNIT_LEN, train->capacity / 8, test->settings->unit_format);
+    unit_snprintf(dbuf, UNIT_LEN, train->dispersion / 8, test->settings->unit_format);
+    unit_snprintf(abuf, UNIT_LEN, train->available / 8, test->settings->unit_format);
+    iperf_printf(test, report_train_result, cbuf, dbuf, abuf);
+}
+
+void
+iperf_train_free(struct iperf_test *test)
+{
+    struct iperf_train *train = test->train;
+
+    if (train == NULL)
+	return;
+    if (train->timer != NULL)
+	tmr_cancel(train->timer);
+    free(train->samples);
+    free(train);
+    test->train = NULL;
+}
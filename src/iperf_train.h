@@ -0,0 +1,90 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_TRAIN_H
+#define __IPERF_TRAIN_H
+
+#include "cjson.h"
+
+/**
+ * iperf_train_parse -- parse a --trains n[/len] argument
+ *
+ * returns 0 on success, -1 (with i_errno set) on a bad argument
+ *
+ */
+int iperf_train_parse(struct iperf_test *, const char *);
+
+/**
+ * iperf_train_init -- set up train state when the test starts; the
+ * receiver gets its sample array and asks for kernel timestamps
+ *
+ * returns 0 on success
+ *
+ */
+int iperf_train_init(struct iperf_test *);
+
+/**
+ * iperf_train_start -- hold the sending stream back and schedule the
+ * trains; called from iperf_create_send_timers
+ *
+ * returns 0 on success
+ *
+ */
+int iperf_train_start(struct iperf_test *);
+
+/**
+ * iperf_train_usecs -- how long the client keeps the test running
+ *
+ */
+int64_t iperf_train_usecs(struct iperf_test *);
+
+/**
+ * iperf_train_record -- note the arrival of one datagram of size bytes; stamp_ns is
+ * the kernel receive timestamp, or 0 if there is none
+ *
+ */
+void iperf_train_record(struct iperf_stream *, int size, uint64_t pcount, struct iperf_time *sent, uint64_t stamp_ns);
+
+/**
+ * iperf_train_analyze -- estimate capacity and available bandwidth
+ * from the receiver's samples
+ *
+ */
+void iperf_train_analyze(struct iperf_test *);
+
+cJSON *iperf_train_results_json(struct iperf_test *);
+void iperf_train_results_from_json(struct iperf_test *, cJSON *);
+
+/**
+ * iperf_train_print_results -- print the estimates, or add them to the
+ * JSON output
+ *
+ */
+void iperf_train_print_results(struct iperf_test *);
+
+void iperf_train_free(struct iperf_test *);
+
+#endif
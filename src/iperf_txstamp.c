@@ -0,0 +1,378 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#if defined(HAVE_LINUX_NET_TSTAMP_H) && defined(HAVE_LINUX_ERRQUEUE_H)
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+#endif
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_txstamp.h"
+#include "iperf_histogram.h"
+#include "iperf_locale.h"
+#include "iperf_util.h"
+#include "units.h"
+#include "cjson.h"
+
+/*
+ * Low-latency bulk sending (--notsent-lowat) and send latency
+ * (--tx-timestamps).
+ *
+ * A TCP sender that keeps its socket buffer full keeps up to -w bytes
+ * queued ahead of anything written after them.  TCP_NOTSENT_LOWAT
+ * caps the bytes queued but not yet sent: past it, writes return
+ * EAGAIN and select() stops reporting the socket writable until the
+ * stack has sent enough to drop below it.  iperf's TCP streams are
+ * non-blocking and written only when select() says so, so with the
+ * option set the sender is woken by the stack's progress instead of
+ * by free buffer space.
+ *
+ * To see what that buys, SO_TIMESTAMPING has the kernel report, for
+ * the last byte of each write(), the time it
+ *
+ *   in_socket  left the socket for the packet scheduler (SCHED)
+ *   to_wire    was handed to the driver: its departure, as near as
+ *              software can tell (SND)
+ *   to_ack     was acknowledged by the receiver (ACK)
+ *
+ * through the socket's error queue, keyed by the byte's offset since
+ * timestamping was turned on.  The time each write() started goes
+ * into a ring with that key, and the reports are matched to it in
+ * order, stage by stage: the stack merges a small write into the next
+ * one's segment, and then only the later one is reported.  The error
+ * queue is read before every write, and again at each interval, into
+ * one log-linear histogram per stage; intervals and the summary give
+ * their percentiles, in ms.  The timestamps and the write times are
+ * both CLOCK_REALTIME.
+ *
+ * A UDP sender gets the same reports, keyed by datagram instead of by
+ * byte, and no to_ack: the time each datagram spent in the sending
+ * host, which the timestamp in its header can't include.
+ */
+
+static const char *stage_names[TXSTAMP_STAGES] = { "in_socket", "to_wire", "to_ack" };
+
+static int64_t
+ts_nsecs(const struct timespec *ts)
+{
+    return (int64_t) ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+int
+iperf_txstamp_init(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    int k;
+#if defined(HAVE_LINUX_NET_TSTAMP_H) && defined(HAVE_LINUX_ERRQUEUE_H) && defined(SO_TIMESTAMPING)
+    int flags = SOF_TIMESTAMPING_TX_SCHED | SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_TX_ACK |
+	SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+#endif
+
+    if ((test->notsent_lowat == 0 && !test->tx_timestamps) ||
+	(test->protocol->id != Ptcp && test->protocol->id != Pudp))
+	return 0;
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (!sp->sender)
+	    continue;
+#if defined(TCP_NOTSENT_LOWAT)
+	if (test->notsent_lowat &&
+	    setsockopt(sp->socket, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &test->notsent_lowat, sizeof(test->notsent_lowat)) < 0) {
+	    i_errno = IESETTXSTAMP;
+	    return -1;
+	}
+#endif
+	if (!test->tx_timestamps || sp->txstamps != NULL)
+	    continue;
+	if ((sp->txstamps = calloc(TXSTAMP_RING, sizeof(struct iperf_txstamp))) == NULL) {
+	    i_errno = IEINITTEST;
+	    return -1;
+	}
+	for (k = 0; k < TXSTAMP_STAGES; ++k) {
+	    sp->txstamp_hist[k] = iperf_histogram_new();
+	    sp->txstamp_last[k] = iperf_histogram_new();
+	    sp->txstamp_total[k] = iperf_histogram_new();
+	    if (sp->txstamp_hist[k] == NULL || sp->txstamp_last[k] == NULL || sp->txstamp_total[k] == NULL) {
+		i_errno = IEINITTEST;
+		return -1;
+	    }
+	}
+#if defined(HAVE_LINUX_NET_TSTAMP_H) && defined(HAVE_LINUX_ERRQUEUE_H) && defined(SO_TIMESTAMPING)
+	/* A TCP stream's byte count starts here, after the cookie */
+	if (setsockopt(sp->socket, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0) {
+	    i_errno = IESETTXSTAMP;
+	    return -1;
+	}
+#endif
+    }
+    return 0;
+}
+
+#if defined(HAVE_LINUX_NET_TSTAMP_H) && defined(HAVE_LINUX_ERRQUEUE_H) && defined(SO_TIMESTAMPING)
+/* Match a report to its write, skipping those whose report the stack merged into a later one */
+static void
+record(struct iperf_stream *sp, int stage, uint32_t key, int64_t nsecs)
+{
+    struct iperf_txstamp *w;
+    uint64_t i;
+    int32_t ahead;
+
+    i = sp->txstamps_next[stage];
+    if (sp->txstamps_written - i > TXSTAMP_RING)
+	i = sp->txstamps_written - TXSTAMP_RING;
+    for (; i < sp->txstamps_written; ++i) {
+	w = &sp->txstamps[i & (TXSTAMP_RING - 1)];
+	ahead = (int32_t) (key - w->key);
+	if (ahead < 0)
+	    break;		/* for a write the ring no longer holds */
+	if (ahead == 0) {
+	    iperf_histogram_record(sp->txstamp_hist[stage], (nsecs - w->written) / 1000);
+	    ++i;
+	    break;
+	}
+    }
+    sp->txstamps_next[stage] = i;
+}
+
+static void
+drain(struct iperf_stream *sp)
+{
+    char control[512];
+    struct msghdr msg;
+    struct cmsghdr *cm;
+    struct scm_timestamping *tss;
+    struct sock_extended_err *serr;
+    int stage;
+
+    for (;;) {
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	if (recvmsg(sp->socket, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+	    return;
+	tss = NULL;
+	serr = NULL;
+	for (cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+	    if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPING)
+		tss = (struct scm_timestamping *) CMSG_DATA(cm);
+	    else if ((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+		     (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+		serr = (struct sock_extended_err *) CMSG_DATA(cm);
+	}
+	if (tss == NULL || serr == NULL || serr->ee_errno != ENOMSG ||
+	    serr->ee_origin != SO_EE_ORIGIN_TIMESTAMPING)
+	    continue;
+	switch (serr->ee_info) {
+	    case SCM_TSTAMP_SCHED:
+		stage = TXSTAMP_SCHED;
+		break;
+	    case SCM_TSTAMP_SND:
+		stage = TXSTAMP_SND;
+		break;
+	    case SCM_TSTAMP_ACK:
+		stage = TXSTAMP_ACK;
+		break;
+	    default:
+		continue;
+	}
+	record(sp, stage, serr->ee_data, ts_nsecs(&tss->ts[0]));
+    }
+}
+#else
+static void
+drain(struct iperf_stream *sp)
+{
+}
+#endif
+
+void
+iperf_txstamp_before_write(struct iperf_stream *sp, struct timespec *ts)
+{
+    drain(sp);
+    clock_gettime(CLOCK_REALTIME, ts);
+}
+
+void
+iperf_txstamp_after_write(struct iperf_stream *sp, const struct timespec *ts, int n)
+{
+    struct iperf_txstamp *w;
+
+    sp->txstamp_count += n;
+    w = &sp->txstamps[sp->txstamps_written & (TXSTAMP_RING - 1)];
+    w->key = (uint32_t) (sp->txstamp_count - 1);
+    w->written = ts_nsecs(ts);
+    sp->txstamps_written++;
+}
+
+void
+iperf_txstamp_interval(struct iperf_stream *sp)
+{
+    struct iperf_histogram *h;
+    int k;
+
+    if (sp->txstamps == NULL)
+	return;
+    drain(sp);
+    for (k = 0; k < TXSTAMP_STAGES; ++k) {
+	iperf_histogram_merge(sp->txstamp_total[k], sp->txstamp_hist[k]);
+	h = sp->txstamp_last[k];
+	sp->txstamp_last[k] = sp->txstamp_hist[k];
+	sp->txstamp_hist[k] = h;
+	iperf_histogram_reset(h);
+    }
+}
+
+void
+iperf_txstamp_reset(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    int k;
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (sp->txstamps == NULL)
+	    continue;
+	for (k = 0; k < TXSTAMP_STAGES; ++k)
+	    iperf_histogram_reset(sp->txstamp_total[k]);
+    }
+}
+
+static cJSON *
+summary_json(const struct iperf_histogram *h)
+{
+    struct iperf_hist_summary s;
+
+    iperf_histogram_summarize(h, &s);
+    return iperf_json_printf("samples: %d  p50_ms: %f  p90_ms: %f  p99_ms: %f  p99_9_ms: %f  max_ms: %f",
+			     (int64_t) s.samples, s.p50, s.p90, s.p99, s.p999, s.max);
+}
+
+void
+iperf_txstamp_print_interval(struct iperf_stream *sp, cJSON *json_stream, const char *mbuf, double st, double et)
+{
+    struct iperf_test *test = sp->test;
+    struct iperf_hist_summary s;
+    cJSON *j_lat = NULL;
+    int k;
+
+    if (sp->txstamps == NULL)
+	return;
+    for (k = 0; k < TXSTAMP_STAGES; ++k) {
+	if (sp->txstamp_last[k]->count == 0)
+	    continue;
+	if (test->json_output) {
+	    if (json_stream == NULL)
+		return;
+	    if (j_lat == NULL) {
+		if ((j_lat = cJSON_CreateObject()) == NULL)
+		    return;
+		cJSON_AddItemToObject(json_stream, "send_latency", j_lat);
+	    }
+	    cJSON_AddItemToObject(j_lat, stage_names[k], summary_json(sp->txstamp_last[k]));
+	} else {
+	    iperf_histogram_summarize(sp->txstamp_last[k], &s);
+	    iperf_printf(test, report_hist_interval, sp->socket, mbuf, st, et, stage_names[k],
+			 s.p50, s.p90, s.p99, s.p999, s.max);
+	}
+    }
+}
+
+void
+iperf_txstamp_print_results(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_hist_summary s;
+    cJSON *j_lat = NULL, *j_streams = NULL, *j_stream;
+    char mbuf[UNIT_LEN];
+    int k, rows = 0;
+
+    if (test->json_output) {
+	if ((j_lat = iperf_json_printf("notsent_lowat: %d", (int64_t) test->notsent_lowat)) == NULL)
+	    return;
+	if ((j_streams = cJSON_CreateArray()) == NULL) {
+	    cJSON_Delete(j_lat);
+	    return;
+	}
+	cJSON_AddItemToObject(j_lat, "streams", j_streams);
+	cJSON_AddItemToObject(test->json_end, "send_latency", j_lat);
+    }
+
+    if (test->mode == BIDIRECTIONAL)
+	sprintf(mbuf, "[TX-%s]", test->role == 'c' ? "C" : "S");
+    else
+	mbuf[0] = '\0';
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (sp->txstamps == NULL)
+	    continue;
+	j_stream = NULL;
+	for (k = 0; k < TXSTAMP_STAGES; ++k) {
+	    if (sp->txstamp_total[k]->count == 0)
+		continue;
+	    if (test->json_output) {
+		if (j_stream == NULL) {
+		    if ((j_stream = iperf_json_printf("socket: %d", (int64_t) sp->socket)) == NULL)
+			return;
+		    cJSON_AddItemToArray(j_streams, j_stream);
+		}
+		cJSON_AddItemToObject(j_stream, stage_names[k], summary_json(sp->txstamp_total[k]));
+		continue;
+	    }
+	    if (rows++ == 0) {
+		if (test->notsent_lowat)
+		    iperf_printf(test, report_txstamp_lowat, test->notsent_lowat);
+		iperf_printf(test, "%s", report_txstamp_header);
+	    }
+	    iperf_histogram_summarize(sp->txstamp_total[k], &s);
+	    iperf_printf(test, report_hist_result, sp->socket, mbuf, stage_names[k],
+			 (int) s.samples, s.p50, s.p90, s.p99, s.p999, s.max);
+	}
+    }
+}
+
+void
+iperf_txstamp_free_stream(struct iperf_stream *sp)
+{
+    int k;
+
+    free(sp->txstamps);
+    sp->txstamps = NULL;
+    for (k = 0; k < TXSTAMP_STAGES; ++k) {
+	iperf_histogram_free(sp->txstamp_hist[k]);
+	iperf_histogram_free(sp->txstamp_last[k]);
+	iperf_histogram_free(sp->txstamp_total[k]);
+	sp->txstamp_hist[k] = sp->txstamp_last[k] = sp->txstamp_total[k] = NULL;
+    }
+}
@@ -0,0 +1,87 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_TXSTAMP_H
+#define __IPERF_TXSTAMP_H
+
+#include <time.h>
+
+#include "cjson.h"
+
+/**
+ * iperf_txstamp_init -- set TCP_NOTSENT_LOWAT (--notsent-lowat) and
+ * turn on transmit timestamps (--tx-timestamps) on the sending streams
+ *
+ */
+int iperf_txstamp_init(struct iperf_test *);
+
+/**
+ * iperf_txstamp_before_write -- read the timestamps that have come in,
+ * and note the time a write starts at
+ *
+ */
+void iperf_txstamp_before_write(struct iperf_stream *, struct timespec *);
+
+/**
+ * iperf_txstamp_after_write -- remember a write started at ts, to match
+ * its timestamps to: n bytes for TCP, 1 for a UDP datagram
+ *
+ */
+void iperf_txstamp_after_write(struct iperf_stream *, const struct timespec *, int n);
+
+/**
+ * iperf_txstamp_interval -- finish the interval's histograms
+ *
+ */
+void iperf_txstamp_interval(struct iperf_stream *);
+
+/**
+ * iperf_txstamp_reset -- forget what was recorded while omitting
+ *
+ */
+void iperf_txstamp_reset(struct iperf_test *);
+
+/**
+ * iperf_txstamp_print_interval -- print the interval's send latency
+ * after the stream's line, or add it to its JSON object
+ *
+ */
+void iperf_txstamp_print_interval(struct iperf_stream *, cJSON *json_stream, const char *mbuf, double st, double et);
+
+/**
+ * iperf_txstamp_print_results -- print each sending stream's send
+ * latency over the test, or add it to the JSON output
+ *
+ */
+void iperf_txstamp_print_results(struct iperf_test *);
+
+/**
+ * iperf_txstamp_free_stream -- free a stream's ring and histograms
+ *
+ */
+void iperf_txstamp_free_stream(struct iperf_stream *);
+
+#endif
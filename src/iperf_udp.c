@@ -38,16 +38,28 @@
 #include <stdint.h>
 #endif
 #include <sys/time.h>
+#include <time.h>
 #include <sys/select.h>
 
 #include "iperf.h"
 #include "iperf_api.h"
 #include "iperf_util.h"
 #include "iperf_udp.h"
+#include "iperf_search.h"
+#include "iperf_train.h"
+#include "iperf_owd.h"
+#include "iperf_latency.h"
+#include "iperf_echo.h"
+#include "iperf_seq.h"
+#include "iperf_trace.h"
+#include "iperf_rxstamp.h"
+#include "iperf_txstamp.h"
+#include "iperf_locale.h"
 #include "timer.h"
 #include "net.h"
 #include "cjson.h"
 #include "portable_endian.h"
+#include "units.h"
 
 #if defined(HAVE_INTTYPES_H)
 # include <inttypes.h>
@@ -61,6 +73,58 @@
 # endif
 #endif
 
+/*
+ * Read one datagram.  While packet trains are being measured, or with
+ * --rx-timestamps, use recvmsg() to pick up the kernel's receive
+ * timestamps as well; *stamp_ns and *hw_ns are left at 0 if there
+ * isn't one.  With MSG_TRUNC in flags, the return is the datagram's
+ * full length however little of it size takes.
+ */
+static int
+udp_read(struct iperf_stream *sp, int size, int flags, uint64_t *stamp_ns, uint64_t *hw_ns)
+{
+    *stamp_ns = *hw_ns = 0;
+#if defined(HAVE_SO_TIMESTAMPNS)
+    if ((sp->test->train != NULL && sp->test->train->kernel_timestamps) || sp->test->rx_timestamps) {
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	struct timespec ts, tss[3];
+	char control[CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(tss))];
+	int r;
+
+	iov.iov_base = sp->buffer;
+	iov.iov_len = size;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	r = recvmsg(sp->socket, &msg, flags);
+	if (r < 0)
+	    return r;
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+	    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+		memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+		*stamp_ns = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+	    }
+#if defined(SCM_TIMESTAMPING)
+	    /* Software, deprecated, raw hardware */
+	    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+		memcpy(tss, CMSG_DATA(cmsg), sizeof(tss));
+		if (tss[0].tv_sec != 0)
+		    *stamp_ns = (uint64_t) tss[0].tv_sec * 1000000000 + tss[0].tv_nsec;
+		if (tss[2].tv_sec != 0)
+		    *hw_ns = (uint64_t) tss[2].tv_sec * 1000000000 + tss[2].tv_nsec;
+	    }
+#endif /* SCM_TIMESTAMPING */
+	}
+	return r;
+    }
+#endif /* HAVE_SO_TIMESTAMPNS */
+    return recv(sp->socket, sp->buffer, size, flags);
+}
+
 /* iperf_udp_recv
  *
  * receives the data for UDP
@@ -72,11 +136,30 @@ iperf_udp_recv(struct iperf_stream *sp)
     uint64_t  pcount;
     int       r;
     int       size = sp->settings->blksize;
+    int       flags = 0;
     int       first_packet = 0;
-    double    transit = 0, d = 0;
+    int       seq;
+    double    transit = 0, d = 0, d_hw = -1;
     struct iperf_time sent_time, arrival_time, temp_time;
+    uint64_t  stamp_ns, hw_ns;
 
-    r = Nread(sp->socket, sp->buffer, size, Pudp);
+    /*
+     * One read is one datagram.  Nread() would keep reading to fill the
+     * buffer, swallowing the next datagram whenever the sender's
+     * datagrams are shorter than ours (as during a --search).  With
+     * --discard only the header is copied out.
+     */
+    if (sp->test->discard && sp->diskfile_fd < 0) {
+	size = MIN_UDP_BLOCKSIZE;
+	flags = MSG_TRUNC;
+    }
+    r = udp_read(sp, size, flags, &stamp_ns, &hw_ns);
+    if (r < 0) {
+        if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+            r = 0;
+        else
+            r = NET_HARDERROR;
+    }
 
     /*
      * If we got an error in the read, or if we didn't read anything
@@ -127,48 +210,20 @@ iperf_udp_recv(struct iperf_stream *sp)
 	    fprintf(stderr, "pcount %" PRIu64 " packet_count %d\n", pcount, sp->packet_count);
 
 	/*
-	 * Try to handle out of order packets.  The way we do this
-	 * uses a constant amount of storage but might not be
-	 * correct in all cases.  In particular we seem to have the
-	 * assumption that packets can't be duplicated in the network,
-	 * because duplicate packets will possibly cause some problems here.
-	 *
-	 * First figure out if the sequence numbers are going forward.
-	 * Note that pcount is the sequence number read from the packet,
-	 * and sp->packet_count is the highest sequence number seen so
-	 * far (so we're expecting to see the packet with sequence number
-	 * sp->packet_count + 1 arrive next).
+	 * Account the sequence number: the highest seen so far, losses
+	 * (a gap counts as lost until its datagrams turn up) and
+	 * out-of-order arrivals, with duplicates told apart.
 	 */
-	if (pcount >= sp->packet_count + 1) {
-
-	    /* Forward, but is there a gap in sequence numbers? */
-	    if (pcount > sp->packet_count + 1) {
-		/* There's a gap so count that as a loss. */
-		sp->cnt_error += (pcount - 1) - sp->packet_count;
-	    }
-	    /* Update the highest sequence number seen so far. */
-	    sp->packet_count = pcount;
-	} else {
-
-	    /*
-	     * Sequence number went backward (or was stationary?!?).
-	     * This counts as an out-of-order packet.
-	     */
-	    sp->outoforder_packets++;
-
-	    /*
-	     * If we have lost packets, then the fact that we are now
-	     * seeing an out-of-order packet offsets a prior sequence
-	     * number gap that was counted as a loss.  So we can take
-	     * away a loss.
-	     */
-	    if (sp->cnt_error > 0)
-		sp->cnt_error--;
-
+	seq = iperf_seq_record(sp, pcount);
+	if (seq == SEQ_REORDERED || seq == SEQ_LATE) {
 	    /* Log the out-of-order packet */
 	    if (sp->test->debug)
 		fprintf(stderr, "OUT OF ORDER - incoming packet sequence %" PRIu64 " but expected sequence %d on stream %d", pcount, sp->packet_count + 1, sp->socket);
-	}
+	} else if (seq == SEQ_DUPLICATE && sp->test->debug)
+	    fprintf(stderr, "DUPLICATE - incoming packet sequence %" PRIu64 " on stream %d", pcount, sp->socket);
+
+	if (sp->test->train != NULL)
+	    iperf_train_record(sp, r, pcount, &sent_time, sp->test->train->kernel_timestamps ? stamp_ns : 0);
 
 	/*
 	 * jitter measurement
@@ -181,7 +236,17 @@ iperf_udp_recv(struct iperf_stream *sp)
 	 * computation does not require knowing the round-trip
 	 * time.
 	 */
-	iperf_time_now(&arrival_time);
+	if (sp->test->owd)
+	    iperf_time_now_wallclock(&arrival_time);
+	else
+	    iperf_time_now(&arrival_time);
+	if (sp->test->rx_timestamps)
+	    d_hw = iperf_rxstamp_record(sp, &sent_time, &arrival_time, stamp_ns, hw_ns, first_packet);
+	if (sp->test->owd)
+	    iperf_owd_record(sp, &sent_time, &arrival_time);
+
+	if (sp->test->trace != NULL)
+	    iperf_trace_record(sp, pcount, iperf_time_in_usecs(&sent_time), iperf_time_in_usecs(&arrival_time), r);
 
 	iperf_time_diff(&arrival_time, &sent_time, &temp_time);
 	transit = iperf_time_in_secs(&temp_time);
@@ -193,8 +258,14 @@ iperf_udp_recv(struct iperf_stream *sp)
 	d = transit - sp->prev_transit;
 	if (d < 0)
 	    d = -d;
+	if (d_hw >= 0)
+	    d = d_hw;
 	sp->prev_transit = transit;
 	sp->jitter += (d - sp->jitter) / 16.0;
+	if (sp->test->histograms)
+	    iperf_latency_record_udp(sp, transit, d, first_packet);
+	if (sp->test->echo)
+	    iperf_echo_reflect(sp, r, &arrival_time);
     }
     else {
 	if (sp->test->debug)
@@ -215,8 +286,13 @@ iperf_udp_send(struct iperf_stream *sp)
     int r;
     int       size = sp->settings->blksize;
     struct iperf_time before;
+    struct timespec written;
 
-    iperf_time_now(&before);
+    /* --owd: the receiver compares this with its own wall clock */
+    if (sp->test->owd)
+	iperf_time_now_wallclock(&before);
+    else
+	iperf_time_now(&before);
 
     ++sp->packet_count;
 
@@ -248,14 +324,23 @@ iperf_udp_send(struct iperf_stream *sp)
 
     }
 
+    if (sp->txstamps != NULL)
+	iperf_txstamp_before_write(sp, &written);
+
     r = Nwrite(sp->socket, sp->buffer, size, Pudp);
 
     if (r < 0)
 	return r;
 
+    if (sp->txstamps != NULL && r > 0)
+	iperf_txstamp_after_write(sp, &written, 1);
+
     sp->result->bytes_sent += r;
     sp->result->bytes_sent_this_interval += r;
 
+    if (sp->test->trace != NULL)
+	iperf_trace_record(sp, sp->packet_count, iperf_time_in_usecs(&before), 0, r);
+
     if (sp->test->debug_level >=  DEBUG_LEVEL_DEBUG)
 	printf("sent %d bytes of %d, total %" PRIu64 "\n", r, sp->settings->blksize, sp->result->bytes_sent);
 
@@ -615,3 +700,235 @@ iperf_udp_init(struct iperf_test *test)
 {
     return 0;
 }
+
+
+/**************************************************************************/
+
+/*
+ * Closed-loop rate control (--rate-control).
+ *
+ * Once per reporting interval the receiving side of each UDP stream
+ * sends a UDP_FEEDBACK message on the control connection; a throughput
+ * search (--search) asks for one with UDP_FEEDBACK_REQUEST instead.  It
+ * is the message byte followed by a 32-bit record count and one
+ * fixed-size record per receiving stream, all in network byte order:
+ *
+ *	int32_t  stream id
+ *	uint32_t datagrams expected since the previous feedback
+ *	uint32_t datagrams lost since the previous feedback
+ *	uint32_t jitter, in microseconds
+ *	uint64_t highest sequence number seen
+ *
+ * The sending side feeds each record into the controller for the
+ * matching stream, which moves that stream's target rate (sp->target),
+ * or into the search.
+ */
+
+#define UDP_FEEDBACK_RECORD_LEN 24
+
+/* AIMD parameters */
+#define RC_AIMD_DECREASE 0.85	/* multiplicative decrease on excess loss */
+#define RC_AIMD_STEP 0.05	/* additive step, as a fraction of the rate at first loss */
+
+/* PID parameters; the error is normalized to the target loss */
+#define RC_PID_KP 0.10
+#define RC_PID_KI 0.02
+#define RC_PID_KD 0.05
+#define RC_PID_INTEGRAL_MAX 10.0
+
+int
+iperf_udp_send_feedback(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    char *buf, *p;
+    signed char msg = UDP_FEEDBACK;
+    uint32_t count = 0, u32;
+    int32_t i32;
+    uint64_t u64;
+    int lost, r;
+    size_t len;
+
+    SLIST_FOREACH(sp, &test->streams, streams)
+	if (!sp->sender)
+	    ++count;
+    if (count == 0)
+	return 0;
+
+    len = sizeof(msg) + sizeof(count) + count * UDP_FEEDBACK_RECORD_LEN;
+    if ((buf = malloc(len)) == NULL) {
+	i_errno = IESENDMESSAGE;
+	return -1;
+    }
+    p = buf;
+    memcpy(p, &msg, sizeof(msg));
+    p += sizeof(msg);
+    u32 = htonl(count);
+    memcpy(p, &u32, sizeof(u32));
+    p += sizeof(u32);
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (sp->sender)
+	    continue;
+	i32 = htonl(sp->id);
+	memcpy(p, &i32, sizeof(i32));
+	u32 = htonl((uint32_t) (sp->packet_count - sp->feedback_packet_count));
+	memcpy(p + 4, &u32, sizeof(u32));
+	/* late out-of-order arrivals can make the count go negative */
+	lost = sp->cnt_error - sp->feedback_cnt_error;
+	u32 = htonl(lost > 0 ? (uint32_t) lost : 0);
+	memcpy(p + 8, &u32, sizeof(u32));
+	u32 = htonl((uint32_t) (sp->jitter * 1000000.0));
+	memcpy(p + 12, &u32, sizeof(u32));
+	u64 = htobe64((uint64_t) sp->packet_count);
+	memcpy(p + 16, &u64, sizeof(u64));
+	p += UDP_FEEDBACK_RECORD_LEN;
+	sp->feedback_packet_count = sp->packet_count;
+	sp->feedback_cnt_error = sp->cnt_error;
+    }
+
+    r = Nwrite(test->ctrl_sck, buf, len, Ptcp);
+    free(buf);
+    if (r < 0) {
+	i_errno = IESENDMESSAGE;
+	return -1;
+    }
+    return 0;
+}
+
+/*
+ * Compute a stream's next target rate from one interval of receiver
+ * feedback.  Both controllers start by doubling the rate every interval
+ * until the first interval that exceeds the target loss.
+ */
+static uint64_t
+rate_control_update(struct iperf_stream *sp, double loss, double achieved)
+{
+    struct iperf_test *test = sp->test;
+    double rate = sp->target;
+    double floor = sp->settings->blksize * 8.0;
+    double e, u;
+
+    if (sp->rc_step == 0) {
+	if (loss <= test->target_loss)
+	    rate *= 2;
+	else {
+	    /* end of the probe; rc_step also marks that for the PID controller */
+	    sp->rc_step = rate * RC_AIMD_STEP;
+	    if (sp->rc_step == 0)
+		sp->rc_step = 1;
+	    rate *= RC_AIMD_DECREASE;
+	}
+    } else if (test->rate_control == RATE_CONTROL_AIMD) {
+	if (loss > test->target_loss)
+	    rate *= RC_AIMD_DECREASE;
+	else
+	    rate += sp->rc_step;
+    } else {
+	e = (test->target_loss - loss) / (test->target_loss > 0.1 ? test->target_loss : 0.1);
+	sp->rc_integral += e;
+	if (sp->rc_integral > RC_PID_INTEGRAL_MAX)
+	    sp->rc_integral = RC_PID_INTEGRAL_MAX;
+	else if (sp->rc_integral < -RC_PID_INTEGRAL_MAX)
+	    sp->rc_integral = -RC_PID_INTEGRAL_MAX;
+	u = RC_PID_KP * e + RC_PID_KI * sp->rc_integral + RC_PID_KD * (e - sp->rc_prev_error);
+	sp->rc_prev_error = e;
+	if (u > 1.0)
+	    u = 1.0;
+	else if (u < -0.5)
+	    u = -0.5;
+	rate *= 1.0 + u;
+    }
+
+    /* Don't run away from a sender that can't keep up with its target. */
+    if (achieved > 0 && rate > 2 * achieved)
+	rate = 2 * achieved;
+    if (rate < floor)
+	rate = floor;
+    return (uint64_t) rate;
+}
+
+int
+iperf_udp_recv_feedback(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_time now, temp_time;
+    char rec[UDP_FEEDBACK_RECORD_LEN];
+    char nbuf[UNIT_LEN];
+    uint32_t count, packets, lost, jitter_us;
+    int32_t id;
+    uint64_t seq;
+    double loss, achieved, elapsed;
+    cJSON *json_rc;
+
+    if (Nread(test->ctrl_sck, (char *) &count, sizeof(count), Ptcp) != sizeof(count)) {
+	i_errno = IERECVMESSAGE;
+	return -1;
+    }
+    count = ntohl(count);
+    if (count > MAX_STREAMS) {
+	i_errno = IERECVMESSAGE;
+	return -1;
+    }
+
+    iperf_time_now(&now);
+    while (count-- > 0) {
+	if (Nread(test->ctrl_sck, rec, sizeof(rec), Ptcp) != sizeof(rec)) {
+	    i_errno = IERECVMESSAGE;
+	    return -1;
+	}
+	memcpy(&id, rec, sizeof(id));
+	id = ntohl(id);
+	memcpy(&packets, rec + 4, sizeof(packets));
+	packets = ntohl(packets);
+	memcpy(&lost, rec + 8, sizeof(lost));
+	lost = ntohl(lost);
+	memcpy(&jitter_us, rec + 12, sizeof(jitter_us));
+	jitter_us = ntohl(jitter_us);
+	memcpy(&seq, rec + 16, sizeof(seq));
+	seq = be64toh(seq);
+
+	/* Feedback can still be in flight as the test winds down. */
+	if (test->state != TEST_RUNNING || test->done)
+	    continue;
+
+	SLIST_FOREACH(sp, &test->streams, streams)
+	    if (sp->sender && sp->id == id)
+		break;
+	if (sp == NULL)
+	    continue;
+	if (test->search) {
+	    iperf_search_feedback(test, sp, packets, lost);
+	    continue;
+	}
+	if (sp->target == 0 || packets == 0)
+	    continue;
+
+	loss = 100.0 * lost / packets;
+	iperf_time_diff(&sp->target_start, &now, &temp_time);
+	elapsed = iperf_time_in_secs(&temp_time);
+	achieved = elapsed > 0 ? (sp->result->bytes_sent - sp->target_start_bytes) * 8 / elapsed : 0;
+
+	sp->target = rate_control_update(sp, loss, achieved);
+	sp->target_start = now;
+	sp->target_start_bytes = sp->result->bytes_sent;
+
+	iperf_time_diff(&sp->result->start_time_fixed, &now, &temp_time);
+	elapsed = iperf_time_in_secs(&temp_time);
+	if (test->json_output) {
+	    json_rc = cJSON_GetObjectItem(test->json_top, "rate_control");
+	    if (json_rc == NULL) {
+		json_rc = cJSON_CreateArray();
+		if (json_rc == NULL)
+		    continue;
+		cJSON_AddItemToObject(test->json_top, "rate_control", json_rc);
+	    }
+	    cJSON_AddItemToArray(json_rc, iperf_json_printf("socket: %d  time: %f  packets: %d  lost_packets: %d  lost_percent: %f  jitter_ms: %f  highest_seq: %d  target_bitrate: %d", (int64_t) sp->socket, elapsed, (int64_t) packets, (int64_t) lost, loss, jitter_us / 1000.0, (int64_t) seq, (int64_t) sp->target));
+	} else {
+	    unit_snprintf(nbuf, UNIT_LEN, (double) sp->target / 8, test->settings->unit_format);
+	    iperf_printf(test, report_rate_control, sp->socket, elapsed, lost, packets, loss, jitter_us / 1000.0, nbuf);
+	}
+    }
+    if (test->search && test->state == TEST_RUNNING && !test->done)
+	return iperf_search_trial_done(test);
+    return 0;
+}
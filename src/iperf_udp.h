@@ -60,5 +60,23 @@ int iperf_udp_connect(struct iperf_test *);
 
 int iperf_udp_init(struct iperf_test *);
 
+/**
+ * iperf_udp_send_feedback -- receiver side of --rate-control: report the
+ * last interval of every receiving stream on the control connection
+ *
+ * returns 0 on success
+ *
+ */
+int iperf_udp_send_feedback(struct iperf_test *);
+
+/**
+ * iperf_udp_recv_feedback -- sender side of --rate-control: read a
+ * UDP_FEEDBACK message and adjust the target rate of each stream
+ *
+ * returns 0 on success
+ *
+ */
+int iperf_udp_recv_feedback(struct iperf_test *);
+
 
 #endif
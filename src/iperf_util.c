@@ -307,6 +307,26 @@ get_optional_features(void)
     numfeatures++;
 #endif /* HAVE_SO_MAX_PACING_RATE */
 
+#if defined(HAVE_SO_TIMESTAMPNS)
+    if (numfeatures > 0) {
+	strncat(features, ", ",
+		sizeof(features) - strlen(features) - 1);
+    }
+    strncat(features, "kernel receive timestamps",
+	sizeof(features) - strlen(features) - 1);
+    numfeatures++;
+#endif /* HAVE_SO_TIMESTAMPNS */
+
+#if defined(HAVE_RDTSC)
+    if (numfeatures > 0) {
+	strncat(features, ", ",
+		sizeof(features) - strlen(features) - 1);
+    }
+    strncat(features, "TSC clock",
+	sizeof(features) - strlen(features) - 1);
+    numfeatures++;
+#endif /* HAVE_RDTSC */
+
 #if defined(HAVE_SSL)
     if (numfeatures > 0) {
 	strncat(features, ", ",
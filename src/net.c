@@ -390,6 +390,37 @@ Nread(int fd, char *buf, size_t count, int prot)
 }
 
 
+/*
+ * Discards up to 'count' bytes from a TCP socket like Nread(), but
+ * without copying them out: Linux's recv() drops TCP data given
+ * MSG_TRUNC.  Elsewhere this is Nread() into buf.
+ */
+int
+Ndiscard(int fd, char *buf, size_t count, int prot)
+{
+#if defined(linux) && defined(MSG_TRUNC)
+    register ssize_t r;
+    register size_t nleft = count;
+
+    while (nleft > 0) {
+        r = recv(fd, NULL, nleft, MSG_TRUNC);
+        if (r < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            else
+                return NET_HARDERROR;
+        } else if (r == 0)
+            break;
+
+        nleft -= r;
+    }
+    return count - nleft;
+#else
+    return Nread(fd, buf, count, prot);
+#endif
+}
+
+
 /*
  *                      N W R I T E
  */
@@ -0,0 +1,221 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "iperf.h"
+#include "iperf_diag.h"
+#include "iperf_time.h"
+
+
+#define BENCH_SOCKETS 1024
+#define BENCH_ROUNDS 20
+#define SKIP 77			/* automake's exit status for a skipped test */
+
+
+static struct iperf_diag_stream *entries;
+static int nentries;
+
+
+static int
+entry_cmp(const void *a, const void *b)
+{
+    uint32_t x = ((const struct iperf_diag_stream *) a)->inode;
+    uint32_t y = ((const struct iperf_diag_stream *) b)->inode;
+
+    return x < y ? -1 : x > y;
+}
+
+
+static struct iperf_diag_stream *
+lookup(void *arg, uint32_t inode)
+{
+    struct iperf_diag_stream key;
+
+    key.inode = inode;
+    return bsearch(&key, entries, nentries, sizeof(key), entry_cmp);
+}
+
+
+static struct iperf_diag_stream *
+skip_all(void *arg, uint32_t inode)
+{
+    return NULL;
+}
+
+
+static double
+elapsed_us( struct iperf_time *start, int ops )
+{
+    struct iperf_time now, diff;
+
+    iperf_time_now(&now);
+    iperf_time_diff(&now, start, &diff);
+    return (double) iperf_time_in_usecs(&diff) / ops;
+}
+
+
+int
+main(int argc, char **argv)
+{
+#if defined(HAVE_LINUX_INET_DIAG_H) && defined(HAVE_LINUX_SOCK_DIAG_H) && defined(TCP_INFO)
+    struct sockaddr_in sa;
+    socklen_t len;
+    struct rlimit rl;
+    struct stat st;
+    struct tcp_info ti;
+    struct iperf_time start;
+    char *buf;
+    int *fds, *peers;
+    int nl, lfd, port, n, i, r, got;
+    double us;
+
+    if ((nl = iperf_diag_open()) < 0) {
+	printf("no NETLINK_SOCK_DIAG, skipping\n");
+	exit(SKIP);
+    }
+
+    /* Two descriptors a connection, and a few for stdio and the rest */
+    n = BENCH_SOCKETS;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < 2 * n + 16) {
+	rl.rlim_cur = rl.rlim_max < 2 * n + 16 ? rl.rlim_max : 2 * n + 16;
+	setrlimit(RLIMIT_NOFILE, &rl);
+	getrlimit(RLIMIT_NOFILE, &rl);
+	if (rl.rlim_cur < 2 * n + 16)
+	    n = ((int) rl.rlim_cur - 16) / 2;
+    }
+    if (n < 16) {
+	printf("too few file descriptors, skipping\n");
+	exit(SKIP);
+    }
+
+    fds = (int *) malloc(n * sizeof(int));
+    peers = (int *) malloc(n * sizeof(int));
+    entries = (struct iperf_diag_stream *) calloc(n, sizeof(struct iperf_diag_stream));
+    buf = (char *) malloc(DIAG_BUFSIZE);
+    if (!fds || !peers || !entries || !buf) {
+	printf("out of memory\n");
+	exit(-1);
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    len = sizeof(sa);
+    if ((lfd = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+	bind(lfd, (struct sockaddr *) &sa, sizeof(sa)) < 0 ||
+	listen(lfd, 128) < 0 ||
+	getsockname(lfd, (struct sockaddr *) &sa, &len) < 0) {
+	printf("failed to listen on loopback\n");
+	exit(SKIP);
+    }
+    port = ntohs(sa.sin_port);
+
+    for (i = 0; i < n; ++i) {
+	if ((fds[i] = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+	    connect(fds[i], (struct sockaddr *) &sa, sizeof(sa)) < 0 ||
+	    (peers[i] = accept(lfd, NULL, NULL)) < 0) {
+	    printf("failed to make connection %d\n", i);
+	    exit(-1);
+	}
+	fstat(fds[i], &st);
+	entries[i].inode = st.st_ino;
+    }
+    nentries = n;
+    qsort(entries, n, sizeof(struct iperf_diag_stream), entry_cmp);
+
+    /* The clients' remote port is the listener's: every one, and nothing else */
+    got = iperf_diag_dump(nl, buf, AF_INET, port, 0, lookup, NULL);
+    if (got != n) {
+	printf("dump by remote port returned %d sockets, wanted %d\n", got, n);
+	exit(-1);
+    }
+    for (i = 0; i < n; ++i) {
+	if (!entries[i].valid || entries[i].tcp_info_len < (int) offsetof(struct tcp_info, tcpi_rtt) ||
+	    ((struct tcp_info *) entries[i].tcp_info)->tcpi_state != 1 /* TCP_ESTABLISHED */ ||
+	    !entries[i].has_skmem || entries[i].cong[0] == '\0') {
+	    printf("dump missed socket %d's TCP_INFO, skmem or congestion control\n", i);
+	    exit(-1);
+	}
+    }
+
+    /* Their peers have it as the local port; the listener is left out */
+    got = iperf_diag_dump(nl, buf, AF_INET, port, 1, skip_all, NULL);
+    if (got != n) {
+	printf("dump by local port returned %d sockets, wanted %d\n", got, n);
+	exit(-1);
+    }
+
+    /* What each way costs for the whole set, as iperf does every interval */
+    iperf_time_now(&start);
+    for (r = 0; r < BENCH_ROUNDS; ++r)
+	for (i = 0; i < n; ++i) {
+	    len = sizeof(ti);
+	    if (getsockopt(fds[i], IPPROTO_TCP, TCP_INFO, &ti, &len) < 0) {
+		printf("getsockopt(TCP_INFO) failed\n");
+		exit(-1);
+	    }
+	}
+    us = elapsed_us(&start, BENCH_ROUNDS);
+    printf("getsockopt(TCP_INFO): %8.1f us per %d sockets, %6.1f ns/socket\n", us, n, us * 1000.0 / n);
+
+    iperf_time_now(&start);
+    for (r = 0; r < BENCH_ROUNDS; ++r)
+	if (iperf_diag_dump(nl, buf, AF_INET, port, 0, lookup, NULL) != n) {
+	    printf("dump failed\n");
+	    exit(-1);
+	}
+    us = elapsed_us(&start, BENCH_ROUNDS);
+    printf("inet_diag dump:       %8.1f us per %d sockets, %6.1f ns/socket\n", us, n, us * 1000.0 / n);
+
+    for (i = 0; i < n; ++i) {
+	close(fds[i]);
+	close(peers[i]);
+    }
+    close(lfd);
+    close(nl);
+    free(fds);
+    free(peers);
+    free(entries);
+    free(buf);
+    exit(0);
+#else
+    printf("no inet_diag, skipping\n");
+    exit(SKIP);
+#endif
+}
@@ -0,0 +1,120 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "iperf_histogram.h"
+
+
+/* Is the estimate within the histogram's relative precision of want? */
+static int
+close_to(int64_t got, int64_t want)
+{
+    int64_t err = got > want ? got - want : want - got;
+
+    return err * HIST_SUB_BUCKETS <= want + HIST_SUB_BUCKETS;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    struct iperf_histogram *h, *h2;
+    int64_t v;
+
+    h = iperf_histogram_new();
+    h2 = iperf_histogram_new();
+    if (h == NULL || h2 == NULL) {
+	printf("failed to create histograms\n");
+	exit(-1);
+    }
+
+    if (iperf_histogram_percentile(h, 99) != 0 || iperf_histogram_mean(h) != 0) {
+	printf("empty histogram should report 0\n");
+	exit(-1);
+    }
+
+    /* Small values are exact */
+    for (v = 1; v <= 100; ++v)
+	iperf_histogram_record(h, v);
+    if (iperf_histogram_percentile(h, 50) != 50 ||
+	iperf_histogram_percentile(h, 99) != 99 ||
+	iperf_histogram_percentile(h, 100) != 100) {
+	printf("wrong percentiles for 1..100: %lld %lld %lld\n",
+	       (long long) iperf_histogram_percentile(h, 50),
+	       (long long) iperf_histogram_percentile(h, 99),
+	       (long long) iperf_histogram_percentile(h, 100));
+	exit(-1);
+    }
+    if (h->min != 1 || h->max != 100 || iperf_histogram_mean(h) != 50.5) {
+	printf("wrong min/max/mean for 1..100\n");
+	exit(-1);
+    }
+
+    /* Large values are within the relative precision */
+    iperf_histogram_reset(h);
+    for (v = 1; v <= 100000; ++v)
+	iperf_histogram_record(h, v * 1000);
+    if (!close_to(iperf_histogram_percentile(h, 50), 50000000) ||
+	!close_to(iperf_histogram_percentile(h, 99), 99000000) ||
+	!close_to(iperf_histogram_percentile(h, 99.9), 99900000)) {
+	printf("percentiles out of precision: %lld %lld %lld\n",
+	       (long long) iperf_histogram_percentile(h, 50),
+	       (long long) iperf_histogram_percentile(h, 99),
+	       (long long) iperf_histogram_percentile(h, 99.9));
+	exit(-1);
+    }
+
+    /* Out of range values are clamped into the end buckets, not lost */
+    iperf_histogram_reset(h);
+    iperf_histogram_record(h, -5);
+    iperf_histogram_record(h, INT64_MAX);
+    if (h->count != 2 || h->min != -5 || h->max != INT64_MAX ||
+	iperf_histogram_percentile(h, 100) != INT64_MAX) {
+	printf("out of range values mishandled\n");
+	exit(-1);
+    }
+
+    /* Merging two halves gives the same answers as recording it all */
+    iperf_histogram_reset(h);
+    iperf_histogram_reset(h2);
+    for (v = 1; v <= 1000; ++v)
+	iperf_histogram_record(v % 2 ? h : h2, v * 10);
+    iperf_histogram_merge(h, h2);
+    if (h->count != 1000 || h->min != 10 || h->max != 10000 ||
+	!close_to(iperf_histogram_percentile(h, 90), 9000)) {
+	printf("merge failed\n");
+	exit(-1);
+    }
+
+    iperf_histogram_free(h);
+    iperf_histogram_free(h2);
+    return 0;
+}
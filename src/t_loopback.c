@@ -0,0 +1,256 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "cjson.h"
+
+
+#define SKIP 77			/* automake's exit status for a skipped test */
+#define MAX_ARGS 32
+
+
+static int port;
+
+
+/* A loopback port nothing is listening on */
+static int
+free_port(void)
+{
+    struct sockaddr_in sa;
+    socklen_t len = sizeof(sa);
+    int fd, p;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+	return -1;
+    if (bind(fd, (struct sockaddr *) &sa, sizeof(sa)) < 0 ||
+	getsockname(fd, (struct sockaddr *) &sa, &len) < 0) {
+	close(fd);
+	return -1;
+    }
+    p = ntohs(sa.sin_port);
+    close(fd);
+    return p;
+}
+
+
+static int
+split(char *line, char **argv)
+{
+    int argc = 0;
+    char *tok;
+
+    argv[argc++] = "iperf3";
+    for (tok = strtok(line, " "); tok != NULL && argc < MAX_ARGS - 1; tok = strtok(NULL, " "))
+	argv[argc++] = tok;
+    argv[argc] = NULL;
+    return argc;
+}
+
+
+/*
+ * Run a one-off server in a child and a client with these options
+ * against it; the client's JSON output, or NULL.
+ */
+static cJSON *
+run(const char *options)
+{
+    struct iperf_test *test;
+    char line[512], *argv[MAX_ARGS];
+    cJSON *root = NULL;
+    pid_t pid;
+    int argc, status;
+
+    /* or the server child would print our buffered output again */
+    fflush(stdout);
+    if ((pid = fork()) < 0)
+	return NULL;
+    if (pid == 0) {
+	snprintf(line, sizeof(line), "-s -1 -B 127.0.0.1 -p %d", port);
+	argc = split(line, argv);
+	if ((test = iperf_new_test()) == NULL || iperf_defaults(test) < 0 ||
+	    iperf_parse_arguments(test, argc, argv) < 0)
+	    _exit(1);
+	iperf_run_server(test);
+	iperf_free_test(test);
+	_exit(0);
+    }
+    /* Let the server get to listen() */
+    usleep(500000);
+
+    snprintf(line, sizeof(line), "-c 127.0.0.1 -p %d -J %s", port, options);
+    argc = split(line, argv);
+    if ((test = iperf_new_test()) != NULL && iperf_defaults(test) == 0 &&
+	iperf_parse_arguments(test, argc, argv) == 0 && iperf_run_client(test) == 0 &&
+	iperf_get_test_json_output_string(test) != NULL)
+	root = cJSON_Parse(iperf_get_test_json_output_string(test));
+    if (test != NULL)
+	iperf_free_test(test);
+    if (root == NULL)
+	kill(pid, SIGTERM);
+    waitpid(pid, &status, 0);
+    return root;
+}
+
+
+static double
+number(cJSON *j, const char *path)
+{
+    char buf[128], *name;
+
+    snprintf(buf, sizeof(buf), "%s", path);
+    for (name = strtok(buf, "."); name != NULL && j != NULL; name = strtok(NULL, "."))
+	j = cJSON_IsArray(j) ? cJSON_GetArrayItem(j, atoi(name)) : cJSON_GetObjectItem(j, name);
+    return j != NULL && cJSON_IsNumber(j) ? j->valuedouble : -1.0;
+}
+
+
+/* --bottleneck's rate, the basis of its -w advice, is what the test moved */
+static int
+test_bottleneck_rate(void)
+{
+    cJSON *root;
+    double sent, max;
+    int ret = 0;
+
+    if ((root = run("-t 2 -i 0.5 --bottleneck")) == NULL) {
+	printf("--bottleneck run failed\n");
+	return -1;
+    }
+    sent = number(root, "end.sum_sent.bits_per_second");
+    max = number(root, "end.bottleneck.streams.0.max_bits_per_second");
+    if (max < 0)
+	printf("--bottleneck: no kernel counters, not checked\n");
+    else if (sent <= 0 || max < 0.9 * sent || max > 3.0 * sent) {
+	printf("--bottleneck: rate %.0f bits/sec against %.0f measured\n", max, sent);
+	ret = -1;
+    }
+    cJSON_Delete(root);
+    return ret;
+}
+
+
+/* An open-loop --rr-rate keeps its rate, and what it sends is answered */
+static int
+test_rr_rate(const char *options, double rate)
+{
+    cJSON *root;
+    double offered, done, outstanding;
+    int ret = 0;
+
+    if ((root = run(options)) == NULL) {
+	printf("%s: run failed\n", options);
+	return -1;
+    }
+    offered = number(root, "end.request_response.sum.offered_per_second");
+    done = number(root, "end.request_response.sum.transactions_per_second");
+    outstanding = number(root, "end.request_response.sum.outstanding");
+    /*
+     * At most 10 ms worth still in flight at the end: enough slack for
+     * a loaded test host, and far below the backlog of a stalled sender
+     */
+    if (offered < 0.95 * rate || done < 0.95 * rate || outstanding < 0 || outstanding > rate / 100 + 1) {
+	printf("%s: offered %.1f/s, answered %.1f/s, %.0f outstanding\n", options, offered, done, outstanding);
+	ret = -1;
+    }
+    cJSON_Delete(root);
+    return ret;
+}
+
+
+/* --place= runs each stream in a thread on the CPU it was given, and -n still ends the test */
+static int
+test_place(void)
+{
+#if defined(HAVE_SCHED_SETAFFINITY) && defined(SO_INCOMING_CPU) && defined(HAVE_PTHREAD_SETAFFINITY_NP)
+    cJSON *root;
+    double sent, received;
+    int ret = 0;
+
+    if ((root = run("-t 1 -P 2 --place=0")) == NULL) {
+	printf("--place=0 run failed\n");
+	return -1;
+    }
+    sent = number(root, "end.sum_sent.bytes");
+    if (sent <= 0 || number(root, "end.placement.streams.0.thread_cpu") != 0 ||
+	number(root, "end.placement.streams.1.thread_cpu") != 0) {
+	printf("--place=0: %.0f bytes, threads on CPU %.0f and %.0f\n", sent,
+	       number(root, "end.placement.streams.0.thread_cpu"),
+	       number(root, "end.placement.streams.1.thread_cpu"));
+	ret = -1;
+    }
+    cJSON_Delete(root);
+
+    if ((root = run("-R -n 20M --place=rx")) == NULL) {
+	printf("-n with --place=rx run failed\n");
+	return -1;
+    }
+    received = number(root, "end.sum_received.bytes");
+    if (received < 20 * 1024 * 1024) {
+	printf("-n 20M with --place=rx: %.0f bytes received\n", received);
+	ret = -1;
+    }
+    cJSON_Delete(root);
+    return ret;
+#else
+    return 0;
+#endif /* HAVE_SCHED_SETAFFINITY && SO_INCOMING_CPU && HAVE_PTHREAD_SETAFFINITY_NP */
+}
+
+
+int
+main(int argc, char **argv)
+{
+    int ret = 0;
+
+    if ((port = free_port()) < 0) {
+	printf("no loopback, skipping\n");
+	exit(SKIP);
+    }
+    ret |= test_bottleneck_rate();
+    ret |= test_rr_rate("-t 2 --rr 64 --rr-rate 2000 --rr-arrivals poisson", 2000);
+    ret |= test_rr_rate("-t 2 --rr 64 --rr-rate 5000 --rr-arrivals poisson", 5000);
+    ret |= test_rr_rate("-t 2 --rr 64 --rr-rate 20000", 20000);
+    ret |= test_place();
+
+    return ret ? -1 : 0;
+}
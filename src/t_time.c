@@ -0,0 +1,143 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "iperf_time.h"
+
+/*
+ * Benchmark the clock sources behind iperf_time_now(): the cost of a
+ * call, and how far the TSC clock wanders from CLOCK_MONOTONIC.
+ *
+ * By default the drift check runs for a couple of seconds so it can be
+ * part of "make check".  Give a duration in seconds to run it longer,
+ * e.g. "t_time 86400" for a day, reporting progress every ten minutes.
+ */
+
+#define BENCH_CALLS 1000000
+#define MAX_DRIFT_US 5000	/* 5 ms */
+
+
+static int64_t
+mono_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+static double
+bench(int source)
+{
+    struct iperf_time t;
+    int64_t start, elapsed;
+    int i;
+
+    iperf_time_set_clock(source);
+    start = mono_us();
+    for (i = 0; i < BENCH_CALLS; ++i)
+	iperf_time_now(&t);
+    elapsed = mono_us() - start;
+    iperf_time_set_clock(IPERF_CLOCK_MONOTONIC);
+    return elapsed * 1000.0 / BENCH_CALLS;
+}
+
+
+/* Offset of the TSC clock from CLOCK_MONOTONIC, in microseconds, taken
+ * against the midpoint of two monotonic reads.
+ */
+static int64_t
+tsc_offset(void)
+{
+    struct iperf_time t;
+    int64_t before, after;
+
+    before = mono_us();
+    iperf_time_now(&t);
+    after = mono_us();
+    return (int64_t) iperf_time_in_usecs(&t) - (before + after) / 2;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    int duration = 2;
+    int report = 600;
+    int64_t offset, max_offset = 0, start, elapsed, next_report;
+
+    if (argc > 1)
+	duration = atoi(argv[1]);
+    if (duration <= 0) {
+	printf("usage: t_time [seconds]\n");
+	exit(-1);
+    }
+
+    printf("%-12s %8.1f ns/call\n", iperf_time_clock_name(IPERF_CLOCK_MONOTONIC),
+	   bench(IPERF_CLOCK_MONOTONIC));
+
+    if (iperf_time_set_clock(IPERF_CLOCK_TSC) < 0) {
+	printf("TSC clock not available, skipping\n");
+	exit(0);
+    }
+    printf("%-12s %8.1f ns/call\n", iperf_time_clock_name(IPERF_CLOCK_TSC),
+	   bench(IPERF_CLOCK_TSC));
+
+    iperf_time_set_clock(IPERF_CLOCK_TSC);
+    start = mono_us();
+    next_report = report;
+    do {
+	usleep(10000);
+	offset = tsc_offset();
+	if (llabs(offset) > llabs(max_offset))
+	    max_offset = offset;
+	elapsed = (mono_us() - start) / 1000000;
+	if (elapsed >= next_report) {
+	    printf("%8lld s: offset %lld us, max %lld us\n", (long long) elapsed,
+		   (long long) offset, (long long) max_offset);
+	    fflush(stdout);
+	    next_report += report;
+	}
+    } while (elapsed < duration);
+
+    printf("drift over %d s: final offset %lld us, max %lld us\n", duration,
+	   (long long) offset, (long long) max_offset);
+    if (llabs(max_offset) > MAX_DRIFT_US) {
+	printf("TSC clock drifted too far from CLOCK_MONOTONIC\n");
+	exit(-2);
+    }
+    exit(0);
+}
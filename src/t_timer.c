@@ -38,7 +38,13 @@
 #include "iperf_time.h"
 
 
+#define BENCH_TIMERS 10000
+
+
 static int flag;
+static int64_t last_fired;
+static int fired;
+static int out_of_order;
 
 
 static void
@@ -48,13 +54,228 @@ timer_proc( TimerClientData client_data, struct iperf_time* nowP )
 }
 
 
+static void
+order_proc( TimerClientData client_data, struct iperf_time* nowP )
+{
+    if (client_data.l < last_fired)
+	out_of_order = 1;
+    last_fired = client_data.l;
+    ++fired;
+}
+
+
+static void
+tie_proc( TimerClientData client_data, struct iperf_time* nowP )
+{
+    /* periodic timers 0 and 1 share a period and must alternate */
+    if (client_data.l != fired % 2)
+	out_of_order = 1;
+    ++fired;
+}
+
+
+static void
+bench_proc( TimerClientData client_data, struct iperf_time* nowP )
+{
+    ++fired;
+}
+
+
+static double
+elapsed_ns( struct iperf_time *start, int ops )
+{
+    struct iperf_time now, diff;
+
+    iperf_time_now(&now);
+    iperf_time_diff(&now, start, &diff);
+    return iperf_time_in_usecs(&diff) * 1000.0 / ops;
+}
+
+
+/* Timers must fire in expiration order no matter what order they
+** were created in, and cancelled ones must never fire.
+*/
+static int
+test_ordering( void )
+{
+    TimerQueue *q;
+    Timer *tp[1000];
+    TimerClientData cd;
+    struct iperf_time now, later;
+    int i;
+
+    q = tmr_queue_new();
+    if (!q)
+	return -1;
+    srandom(1);
+    iperf_time_now(&now);
+    for (i = 0; i < 1000; ++i) {
+	cd.l = random() % 1000000;
+	tp[i] = tmr_create(q, &now, order_proc, cd, cd.l, 0);
+	if (!tp[i])
+	    return -1;
+    }
+    for (i = 0; i < 1000; i += 2)
+	tmr_cancel(tp[i]);
+
+    later = now;
+    iperf_time_add_usecs(&later, 2000000);
+    fired = 0;
+    last_fired = 0;
+    out_of_order = 0;
+    tmr_run(q, &later);
+
+    if (fired != 500 || out_of_order)
+	return -1;
+
+    /* Timers due at the same time fire in the order they were
+    ** scheduled, including after a periodic timer re-arms.  The
+    ** stats and reporter timers rely on this.
+    */
+    for (i = 0; i < 100; ++i) {
+	cd.l = i;
+	if (!tmr_create(q, &now, order_proc, cd, 1000, 0))
+	    return -1;
+    }
+    fired = 0;
+    last_fired = 0;
+    tmr_run(q, &later);
+    if (fired != 100 || out_of_order)
+	return -1;
+
+    for (i = 0; i < 2; ++i) {
+	cd.l = i;
+	if (!tmr_create(q, &now, tie_proc, cd, 1000, 1))
+	    return -1;
+    }
+    later = now;
+    fired = 0;
+    for (i = 0; i < 10; ++i) {
+	iperf_time_add_usecs(&later, 1000);
+	tmr_run(q, &later);
+    }
+    tmr_queue_free(q);
+
+    if (fired != 20 || out_of_order)
+	return -1;
+    return 0;
+}
+
+
+/* A periodic timer that has fallen behind fires once, not once for
+** every period it missed, and then stays on its original phase.
+*/
+static int
+test_catch_up( void )
+{
+    TimerQueue *q;
+    TimerClientData cd;
+    struct iperf_time now, later;
+
+    q = tmr_queue_new();
+    if (!q)
+	return -1;
+    iperf_time_now(&now);
+    cd.l = 0;
+    if (!tmr_create(q, &now, bench_proc, cd, 1000, 1))
+	return -1;
+
+    later = now;
+    iperf_time_add_usecs(&later, 10500);
+    fired = 0;
+    tmr_run(q, &later);
+    if (fired != 1)
+	return -1;
+    /* next due at now + 11 ms */
+    iperf_time_add_usecs(&later, 400);
+    tmr_run(q, &later);
+    if (fired != 1)
+	return -1;
+    iperf_time_add_usecs(&later, 100);
+    tmr_run(q, &later);
+    tmr_queue_free(q);
+
+    if (fired != 2)
+	return -1;
+    return 0;
+}
+
+
+/* Time the operations the iperf3 main loop performs on its timers, with
+** enough pending timers to make a linear list scan show up.
+*/
+static int
+bench( void )
+{
+    TimerQueue *q;
+    Timer **tp;
+    TimerClientData cd;
+    struct iperf_time start, now;
+    int i;
+
+    q = tmr_queue_new();
+    tp = (Timer **) malloc(BENCH_TIMERS * sizeof(Timer *));
+    if (!q || !tp)
+	return -1;
+    srandom(2);
+
+    iperf_time_now(&now);
+    iperf_time_now(&start);
+    for (i = 0; i < BENCH_TIMERS; ++i) {
+	cd.l = i;
+	tp[i] = tmr_create(q, &now, bench_proc, cd, 1000 + random() % 1000000, 1);
+	if (!tp[i])
+	    return -1;
+    }
+    printf("tmr_create:  %8.1f ns/op (%d timers)\n", elapsed_ns(&start, BENCH_TIMERS), BENCH_TIMERS);
+
+    iperf_time_now(&start);
+    for (i = 0; i < BENCH_TIMERS; ++i)
+	tmr_reset(&now, tp[random() % BENCH_TIMERS]);
+    printf("tmr_reset:   %8.1f ns/op\n", elapsed_ns(&start, BENCH_TIMERS));
+
+    iperf_time_now(&start);
+    for (i = 0; i < BENCH_TIMERS; ++i)
+	(void) tmr_timeout(q, &now);
+    printf("tmr_timeout: %8.1f ns/op\n", elapsed_ns(&start, BENCH_TIMERS));
+
+    /* Step through one second of simulated time, firing and re-arming
+    ** the periodic timers as they come due.
+    */
+    fired = 0;
+    iperf_time_now(&start);
+    for (i = 0; i < BENCH_TIMERS; ++i) {
+	iperf_time_add_usecs(&now, 100);
+	tmr_run(q, &now);
+    }
+    printf("tmr_run:     %8.1f ns/timer fired (%d fired)\n", elapsed_ns(&start, fired > 0 ? fired : 1), fired);
+
+    iperf_time_now(&start);
+    for (i = 0; i < BENCH_TIMERS; ++i)
+	tmr_cancel(tp[i]);
+    printf("tmr_cancel:  %8.1f ns/op\n", elapsed_ns(&start, BENCH_TIMERS));
+
+    free(tp);
+    tmr_queue_free(q);
+    return 0;
+}
+
+
 int
 main(int argc, char **argv)
 {
+    TimerQueue *q;
     Timer *tp;
 
+    q = tmr_queue_new();
+    if (!q)
+    {
+	printf("failed to create timer queue\n");
+	exit(-1);
+    }
+
     flag = 0;
-    tp = tmr_create(NULL, timer_proc, JunkClientData, 3000000, 0);
+    tp = tmr_create(q, NULL, timer_proc, JunkClientData, 3000000, 0);
     if (!tp)
     {
 	printf("failed to create timer\n");
@@ -63,7 +284,7 @@ main(int argc, char **argv)
 
     sleep(2);
 
-    tmr_run(NULL);
+    tmr_run(q, NULL);
     if (flag)
     {
 	printf("timer should not have expired\n");
@@ -71,13 +292,32 @@ main(int argc, char **argv)
     }
     sleep(1);
 
-    tmr_run(NULL);
+    tmr_run(q, NULL);
     if (!flag)
     {
 	printf("timer should have expired\n");
 	exit(-2);
     }
 
-    tmr_destroy();
+    tmr_queue_free(q);
+
+    if (test_ordering() < 0)
+    {
+	printf("timers fired out of order\n");
+	exit(-3);
+    }
+
+    if (test_catch_up() < 0)
+    {
+	printf("late periodic timer fired more than once\n");
+	exit(-5);
+    }
+
+    if (bench() < 0)
+    {
+	printf("failed to run timer benchmark\n");
+	exit(-4);
+    }
+
     exit(0);
 }
@@ -55,6 +55,7 @@
 #include "iperf.h"
 #include "iperf_api.h"
 #include "iperf_locale.h"
+#include "units.h"
 
 /*************************************************************/
 int
@@ -185,6 +186,176 @@ get_rtt(struct iperf_interval_results *irp)
 #endif
 }
 
+/*************************************************************/
+/*
+ * Return the current RTT in usec, read from the socket now rather
+ * than from an interval's saved tcp_info, or -1.
+ */
+long
+get_rtt_now(struct iperf_stream *sp)
+{
+#if (defined(linux) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)) && \
+	defined(TCP_INFO)
+    struct iperf_interval_results ir;
+    socklen_t tcp_info_length = sizeof(struct tcp_info);
+
+    if (getsockopt(sp->socket, IPPROTO_TCP, TCP_INFO, (void *)&ir.tcpInfo, &tcp_info_length) < 0)
+	return -1;
+    return get_rtt(&ir);
+#else
+    return -1;
+#endif
+}
+
+/*************************************************************/
+/*
+ * Fill in the sender's chrono counters: the time it had data to send,
+ * and of that the time the receive window and the send buffer held it
+ * back, in usec.  Returns -1 where the system does not keep them.
+ */
+int
+get_limited(struct iperf_interval_results *irp, struct iperf_limited *l)
+{
+#if defined(linux) && defined(HAVE_TCP_INFO_BUSY_TIME)
+    l->busy = irp->tcpInfo.tcpi_busy_time;
+    l->rwnd = irp->tcpInfo.tcpi_rwnd_limited;
+    l->sndbuf = irp->tcpInfo.tcpi_sndbuf_limited;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+/*************************************************************/
+/*
+ * Return the lowest RTT the connection has seen, in usec, or -1.
+ */
+long
+get_min_rtt(struct iperf_interval_results *irp)
+{
+#if defined(linux) && defined(HAVE_TCP_INFO_MIN_RTT)
+    return irp->tcpInfo.tcpi_min_rtt == ~0U ? -1 : irp->tcpInfo.tcpi_min_rtt;
+#else
+    return -1;
+#endif
+}
+
+/*************************************************************/
+/*
+ * Fill in the rest of TCP_INFO that the results carry.  Returns -1
+ * where the system has none of it.
+ */
+int
+get_tcp_extra(struct iperf_interval_results *irp, struct iperf_tcp_extra *x)
+{
+    memset(x, 0, sizeof(*x));
+#if defined(linux) && defined(TCP_MD5SIG)
+    x->rcv_rtt = irp->tcpInfo.tcpi_rcv_rtt;
+    x->rcv_space = irp->tcpInfo.tcpi_rcv_space;
+    x->reordering = irp->tcpInfo.tcpi_reordering;
+    x->lost = irp->tcpInfo.tcpi_lost;
+#if defined(HAVE_STRUCT_TCP_INFO_TCPI_RCV_OOOPACK)
+    x->rcv_ooopack = irp->tcpInfo.tcpi_rcv_ooopack;
+#endif
+#if defined(HAVE_STRUCT_TCP_INFO_TCPI_DSACK_DUPS)
+    x->dsack_dups = irp->tcpInfo.tcpi_dsack_dups;
+#endif
+#if defined(HAVE_TCP_INFO_DELIVERY_RATE)
+    x->delivery_rate = irp->tcpInfo.tcpi_delivery_rate;
+#endif
+#if defined(HAVE_STRUCT_TCP_INFO_TCPI_BYTES_RETRANS)
+    x->bytes_retrans = irp->tcpInfo.tcpi_bytes_retrans;
+#endif
+#if defined(HAVE_STRUCT_TCP_INFO_TCPI_SEGS_OUT)
+    x->segs_out = irp->tcpInfo.tcpi_segs_out;
+    x->segs_in = irp->tcpInfo.tcpi_segs_in;
+#endif
+    x->valid = 1;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+/*************************************************************/
+/*
+ * This end's figures for the results: the counts since omitting
+ * ended, the rest as last read.
+ */
+void
+tcp_extra_since(struct iperf_stream_result *rp, struct iperf_tcp_extra *x)
+{
+    const struct iperf_tcp_extra *base = &rp->tcp_extra_base;
+
+    *x = rp->tcp_extra;
+    if (!base->valid)
+	return;
+    x->rcv_ooopack -= base->rcv_ooopack;
+    x->dsack_dups -= base->dsack_dups;
+    x->bytes_retrans -= base->bytes_retrans;
+    x->segs_out -= base->segs_out;
+    x->segs_in -= base->segs_in;
+}
+
+/*************************************************************/
+/*
+ * Print the view of a stream's sending or receiving end (-V).
+ */
+void
+print_tcp_extra(struct iperf_test *test, int socket, const char *mbuf, const struct iperf_tcp_extra *x, int sender)
+{
+    char ubuf[UNIT_LEN], nbuf[UNIT_LEN];
+
+    if (sender) {
+	unit_snprintf(ubuf, UNIT_LEN, (double) x->bytes_retrans, 'A');
+	unit_snprintf(nbuf, UNIT_LEN, (double) x->delivery_rate, test->settings->unit_format);
+	iperf_printf(test, report_tcp_sender_extra, socket, mbuf, (long long) x->lost, (long long) x->dsack_dups, ubuf,
+		     (long long) x->segs_out, (long long) x->segs_in, nbuf);
+    } else {
+	unit_snprintf(ubuf, UNIT_LEN, (double) x->rcv_space, 'A');
+	iperf_printf(test, report_tcp_receiver_extra, socket, mbuf, x->rcv_rtt / 1000.0, ubuf,
+		     (long long) x->rcv_ooopack, (long long) x->reordering, (long long) x->segs_in, (long long) x->segs_out);
+    }
+}
+
+/*************************************************************/
+/*
+ * Read the socket's TCP_INFO now into a --tcp-sample sample (all but
+ * its time).  Returns 0, or -1 if there is none to read.
+ */
+int
+sample_tcpinfo(struct iperf_stream *sp, struct iperf_tcp_sample *s)
+{
+#if (defined(linux) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)) && \
+	defined(TCP_INFO)
+    struct iperf_interval_results ir;
+    socklen_t tcp_info_length = sizeof(struct tcp_info);
+    long retrans;
+
+    if (getsockopt(sp->socket, IPPROTO_TCP, TCP_INFO, (void *)&ir.tcpInfo, &tcp_info_length) < 0)
+	return -1;
+    s->snd_cwnd = get_snd_cwnd(&ir);
+    s->rtt = get_rtt(&ir);
+    s->rttvar = get_rttvar(&ir);
+    retrans = get_total_retransmits(&ir);
+    s->total_retrans = retrans < 0 ? 0 : retrans;
+#if defined(HAVE_TCP_INFO_DELIVERY_RATE)
+    s->delivery_rate = ir.tcpInfo.tcpi_delivery_rate;
+#else
+    s->delivery_rate = 0;
+#endif
+#if defined(HAVE_TCP_INFO_PACING_RATE)
+    /* All ones when the socket is not paced */
+    s->pacing_rate = ir.tcpInfo.tcpi_pacing_rate == ~0ULL ? 0 : ir.tcpInfo.tcpi_pacing_rate;
+#else
+    s->pacing_rate = 0;
+#endif
+    return 0;
+#else
+    return -1;
+#endif
+}
+
 /*************************************************************/
 /*
  * Return rttvar in usec.
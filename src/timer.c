@@ -33,11 +33,10 @@
 #include "timer.h"
 #include "iperf_time.h"
 
-static Timer* timers = NULL;
-static Timer* free_timers = NULL;
-
 TimerClientData JunkClientData;
 
+#define TMR_INITIAL_HEAP_SIZE 16
+
 
 
 /* This is an efficiency tweak.  All the routines that need to know the
@@ -57,80 +56,142 @@ getnow( struct iperf_time* nowP, struct iperf_time* nowP2 )
 }
 
 
+static inline int
+heap_before( Timer* a, Timer* b )
+{
+    if ( a->time.secs != b->time.secs )
+	return a->time.secs < b->time.secs;
+    if ( a->time.usecs != b->time.usecs )
+	return a->time.usecs < b->time.usecs;
+    return a->seq < b->seq;
+}
+
+
+static inline void
+heap_place( TimerQueue* q, Timer* t, int i )
+{
+    q->heap[i] = t;
+    t->index = i;
+}
+
+
 static void
-list_add( Timer* t )
+heap_sift_up( TimerQueue* q, int i )
 {
-    Timer* t2;
-    Timer* t2prev;
+    Timer* t = q->heap[i];
+    int parent;
 
-    if ( timers == NULL ) {
-	/* The list is empty. */
-	timers = t;
-	t->prev = t->next = NULL;
-    } else {
-	if (iperf_time_compare(&t->time, &timers->time) < 0) {
-	    /* The new timer goes at the head of the list. */
-	    t->prev = NULL;
-	    t->next = timers;
-	    timers->prev = t;
-	    timers = t;
-	} else {
-	    /* Walk the list to find the insertion point. */
-	    for ( t2prev = timers, t2 = timers->next; t2 != NULL;
-		  t2prev = t2, t2 = t2->next ) {
-		if (iperf_time_compare(&t->time, &t2->time) < 0) {
-		    /* Found it. */
-		    t2prev->next = t;
-		    t->prev = t2prev;
-		    t->next = t2;
-		    t2->prev = t;
-		    return;
-		}
-	    }
-	    /* Oops, got to the end of the list.  Add to tail. */
-	    t2prev->next = t;
-	    t->prev = t2prev;
-	    t->next = NULL;
-	}
+    while ( i > 0 ) {
+	parent = ( i - 1 ) / 2;
+	if ( ! heap_before( t, q->heap[parent] ) )
+	    break;
+	heap_place( q, q->heap[parent], i );
+	i = parent;
+    }
+    heap_place( q, t, i );
+}
+
+
+static void
+heap_sift_down( TimerQueue* q, int i )
+{
+    Timer* t = q->heap[i];
+    int child;
+
+    for (;;) {
+	child = 2 * i + 1;
+	if ( child >= q->count )
+	    break;
+	if ( child + 1 < q->count && heap_before( q->heap[child + 1], q->heap[child] ) )
+	    ++child;
+	if ( ! heap_before( q->heap[child], t ) )
+	    break;
+	heap_place( q, q->heap[child], i );
+	i = child;
     }
+    heap_place( q, t, i );
 }
 
 
+/* Restore the heap order around slot i after its timer changed time. */
 static void
-list_remove( Timer* t )
+heap_fix( TimerQueue* q, int i )
 {
-    if ( t->prev == NULL )
-	timers = t->next;
+    if ( i > 0 && heap_before( q->heap[i], q->heap[( i - 1 ) / 2] ) )
+	heap_sift_up( q, i );
     else
-	t->prev->next = t->next;
-    if ( t->next != NULL )
-	t->next->prev = t->prev;
+	heap_sift_down( q, i );
+}
+
+
+static int
+heap_add( TimerQueue* q, Timer* t )
+{
+    Timer** heap;
+    int size;
+
+    if ( q->count == q->size ) {
+	size = q->size ? q->size * 2 : TMR_INITIAL_HEAP_SIZE;
+	heap = (Timer**) realloc( q->heap, size * sizeof(Timer*) );
+	if ( heap == NULL )
+	    return -1;
+	q->heap = heap;
+	q->size = size;
+    }
+    t->seq = q->next_seq++;
+    heap_place( q, t, q->count++ );
+    heap_sift_up( q, t->index );
+    return 0;
 }
 
 
 static void
-list_resort( Timer* t )
+heap_remove( TimerQueue* q, Timer* t )
+{
+    int i = t->index;
+
+    t->index = -1;
+    if ( --q->count == i )
+	return;
+    heap_place( q, q->heap[q->count], i );
+    heap_fix( q, i );
+}
+
+
+TimerQueue*
+tmr_queue_new( void )
+{
+    TimerQueue* q;
+
+    q = (TimerQueue*) calloc( 1, sizeof(TimerQueue) );
+    return q;
+}
+
+
+void
+tmr_queue_free( TimerQueue* q )
 {
-    /* Remove the timer from the list. */
-    list_remove( t );
-    /* And add it back in, sorted correctly. */
-    list_add( t );
+    if ( q == NULL )
+	return;
+    tmr_destroy( q );
+    free( (void*) q->heap );
+    free( (void*) q );
 }
 
 
 Timer*
 tmr_create(
-    struct iperf_time* nowP, TimerProc* timer_proc, TimerClientData client_data,
-    int64_t usecs, int periodic )
+    TimerQueue* q, struct iperf_time* nowP, TimerProc* timer_proc,
+    TimerClientData client_data, int64_t usecs, int periodic )
 {
     struct iperf_time now;
     Timer* t;
 
     getnow( nowP, &now );
 
-    if ( free_timers != NULL ) {
-	t = free_timers;
-	free_timers = t->next;
+    if ( q->free_timers != NULL ) {
+	t = q->free_timers;
+	q->free_timers = t->next;
     } else {
 	t = (Timer*) malloc( sizeof(Timer) );
 	if ( t == NULL )
@@ -142,57 +203,72 @@ tmr_create(
     t->usecs = usecs;
     t->periodic = periodic;
     t->time = now;
+    t->queue = q;
+    t->next = NULL;
     iperf_time_add_usecs(&t->time, usecs);
-    /* Add the new timer to the active list. */
-    list_add( t );
+    /* Add the new timer to the active heap. */
+    if ( heap_add( q, t ) < 0 ) {
+	free( (void*) t );
+	return NULL;
+    }
 
     return t;
 }
 
 
 struct timeval*
-tmr_timeout( struct iperf_time* nowP )
+tmr_timeout( TimerQueue* q, struct iperf_time* nowP )
 {
     struct iperf_time now, diff;
     int64_t usecs;
     int past;
-    static struct timeval timeout;
 
     getnow( nowP, &now );
-    /* Since the list is sorted, we only need to look at the first timer. */
-    if ( timers == NULL )
+    /* The earliest timer is always at the top of the heap. */
+    if ( q->count == 0 )
 	return NULL;
-    past = iperf_time_diff(&timers->time, &now, &diff);
+    past = iperf_time_diff(&q->heap[0]->time, &now, &diff);
     if (past)
         usecs = 0;
     else
         usecs = iperf_time_in_usecs(&diff);
-    timeout.tv_sec = usecs / 1000000LL;
-    timeout.tv_usec = usecs % 1000000LL;
-    return &timeout;
+    q->timeout.tv_sec = usecs / 1000000LL;
+    q->timeout.tv_usec = usecs % 1000000LL;
+    return &q->timeout;
 }
 
 
 void
-tmr_run( struct iperf_time* nowP )
+tmr_run( TimerQueue* q, struct iperf_time* nowP )
 {
-    struct iperf_time now;
+    struct iperf_time now, behind;
     Timer* t;
-    Timer* next;
 
     getnow( nowP, &now );
-    for ( t = timers; t != NULL; t = next ) {
-	next = t->next;
-	/* Since the list is sorted, as soon as we find a timer
-	** that isn't ready yet, we are done.
-	*/
+    while ( q->count > 0 ) {
+	t = q->heap[0];
+	/* As soon as the earliest timer isn't ready yet, we are done. */
 	if (iperf_time_compare(&t->time, &now) > 0)
 	    break;
 	(t->timer_proc)( t->client_data, &now );
+	/* The callback may have cancelled its own timer. */
+	if ( t->index < 0 )
+	    continue;
 	if ( t->periodic ) {
-	    /* Reschedule. */
+	    /* Reschedule.  A timer that has fallen more than a period
+	    ** behind (the process was descheduled, or a callback ran
+	    ** long) skips the periods it missed rather than firing once
+	    ** for each of them back to back, so it runs at most once per
+	    ** call; it keeps its phase.  The stats and reporter callbacks
+	    ** work out their intervals from the clock, not from a count.
+	    */
 	    iperf_time_add_usecs(&t->time, t->usecs);
-	    list_resort( t );
+	    if ( t->usecs > 0 && iperf_time_compare(&t->time, &now) <= 0 ) {
+		iperf_time_diff(&now, &t->time, &behind);
+		iperf_time_add_usecs(&t->time, (iperf_time_in_usecs(&behind) / t->usecs + 1) * t->usecs);
+	    }
+	    t->seq = q->next_seq++;
+	    heap_fix( q, t->index );
 	} else
 	    tmr_cancel( t );
     }
@@ -207,39 +283,44 @@ tmr_reset( struct iperf_time* nowP, Timer* t )
     getnow( nowP, &now );
     t->time = now;
     iperf_time_add_usecs( &t->time, t->usecs );
-    list_resort( t );
+    t->seq = t->queue->next_seq++;
+    heap_fix( t->queue, t->index );
 }
 
 
 void
 tmr_cancel( Timer* t )
 {
-    /* Remove it from the active list. */
-    list_remove( t );
+    TimerQueue* q = t->queue;
+
+    /* Already descheduled, and already on the free list. */
+    if ( t->index < 0 )
+	return;
+    /* Remove it from the active heap. */
+    heap_remove( q, t );
     /* And put it on the free list. */
-    t->next = free_timers;
-    free_timers = t;
-    t->prev = NULL;
+    t->next = q->free_timers;
+    q->free_timers = t;
 }
 
 
 void
-tmr_cleanup( void )
+tmr_cleanup( TimerQueue* q )
 {
     Timer* t;
 
-    while ( free_timers != NULL ) {
-	t = free_timers;
-	free_timers = t->next;
+    while ( q->free_timers != NULL ) {
+	t = q->free_timers;
+	q->free_timers = t->next;
 	free( (void*) t );
     }
 }
 
 
 void
-tmr_destroy( void )
+tmr_destroy( TimerQueue* q )
 {
-    while ( timers != NULL )
-	tmr_cancel( timers );
-    tmr_cleanup();
+    while ( q->count > 0 )
+	tmr_cancel( q->heap[q->count - 1] );
+    tmr_cleanup( q );
 }
@@ -54,6 +54,8 @@ extern TimerClientData JunkClientData;	/* for use when you don't care */
 */
 typedef void TimerProc( TimerClientData client_data, struct iperf_time* nowP );
 
+struct TimerQueueStruct;
+
 /* The Timer struct. */
 typedef struct TimerStruct
 {
@@ -62,26 +64,51 @@ typedef struct TimerStruct
     int64_t usecs;
     int periodic;
     struct iperf_time time;
-    struct TimerStruct* prev;
-    struct TimerStruct* next;
-    int hash;
+    struct TimerQueueStruct* queue;	/* queue the timer belongs to */
+    int index;				/* heap slot, -1 when not scheduled */
+    uint64_t seq;			/* scheduling order, breaks ties */
+    struct TimerStruct* next;		/* free list link */
 } Timer;
 
+/* A TimerQueue holds a set of pending timers, kept in a binary min-heap
+** ordered by expiration time.  Creating, resetting and cancelling a timer
+** are O(log n) and finding the next one to expire is O(1), so the cost of
+** a tmr_run() no longer depends on how many per-stream timers exist.
+** Timers due at the same time fire in the order they were scheduled.
+** Each iperf_test owns its own queue.
+*/
+typedef struct TimerQueueStruct
+{
+    Timer** heap;
+    int count;
+    int size;
+    uint64_t next_seq;
+    Timer* free_timers;
+    struct timeval timeout;
+} TimerQueue;
+
+/* Allocate an empty timer queue.  Returns (TimerQueue*) 0 on errors. */
+extern TimerQueue* tmr_queue_new( void );
+
+/* Cancel all timers in a queue and free it. */
+extern void tmr_queue_free( TimerQueue* queue );
+
 /* Set up a timer, either periodic or one-shot. Returns (Timer*) 0 on errors. */
 extern Timer* tmr_create(
-    struct iperf_time* nowP, TimerProc* timer_proc, TimerClientData client_data,
-    int64_t usecs, int periodic );
+    TimerQueue* queue, struct iperf_time* nowP, TimerProc* timer_proc,
+    TimerClientData client_data, int64_t usecs, int periodic );
 
 /* Returns a timeout indicating how long until the next timer triggers.  You
 ** can just put the call to this routine right in your select().  Returns
 ** (struct timeval*) 0 if no timers are pending.
 */
-extern struct timeval* tmr_timeout( struct iperf_time* nowP ) /* __attribute__((hot)) */;
+extern struct timeval* tmr_timeout( TimerQueue* queue, struct iperf_time* nowP ) /* __attribute__((hot)) */;
 
-/* Run the list of timers. Your main program needs to call this every so often,
-** or as indicated by tmr_timeout().
+/* Run the expired timers. Your main program needs to call this every so often,
+** or as indicated by tmr_timeout().  Each timer fires at most once per call;
+** a periodic one that is several periods late skips the ones it missed.
 */
-extern void tmr_run( struct iperf_time* nowP ) /* __attribute__((hot)) */;
+extern void tmr_run( TimerQueue* queue, struct iperf_time* nowP ) /* __attribute__((hot)) */;
 
 /* Reset the clock on a timer, to current time plus the original timeout. */
 extern void tmr_reset( struct iperf_time* nowP, Timer* timer );
@@ -91,10 +118,12 @@ extern void tmr_reset( struct iperf_time* nowP, Timer* timer );
 */
 extern void tmr_cancel( Timer* timer );
 
-/* Clean up the timers package, freeing any unused storage. */
-extern void tmr_cleanup( void );
+/* Clean up a timer queue, freeing any unused storage. */
+extern void tmr_cleanup( TimerQueue* queue );
 
-/* Cancel all timers and free storage, usually in preparation for exiting. */
-extern void tmr_destroy( void );
+/* Cancel all timers in a queue and free storage, usually in preparation
+** for exiting.  The queue itself stays usable.
+*/
+extern void tmr_destroy( TimerQueue* queue );
 
 #endif /* __TIMER_H */